@@ -30,6 +30,7 @@ typedef uint16_t guint16;
 typedef uint32_t guint32;
 typedef uint64_t guint64;
 typedef int32_t gint32;
+typedef int64_t gint64;
 typedef char gchar;
 typedef int gboolean;
 typedef int gint;
@@ -57,6 +58,7 @@ typedef struct GString {
 typedef struct GPtrArray {
     void **pdata;
     guint len;
+    guint size; /* allocated length of pdata */
 } GPtrArray;
 
 typedef struct GList {
@@ -65,9 +67,17 @@ typedef struct GList {
   struct GList *prev;
 } GList;
 
+/* Entries are kept in insertion order, which is also the order they are
+ * visited in; the slots index into them by hash, with open addressing. */
 typedef struct GHashTable {
+    GHashFunc   hash;
     GEqualFunc  compare;
-    GPtrArray  *array;
+    struct GHashNode *nodes;
+    guint       num_nodes; /* including removed ones */
+    guint       nodes_size;
+    guint       num_live;
+    guint      *slots; /* node index + 1, 0 if empty */
+    guint       num_slots; /* a power of 2 */
 } GHashTable;
 
 typedef struct GError {
@@ -106,13 +116,15 @@ typedef struct GOptionContext {
     const GOptionEntry *entries;
 } GOptionContext;
 
-#define g_str_hash NULL
 
 #define G_GUINT32_FORMAT PRIu32
+#define G_MININT32 INT32_MIN
+#define G_MAXINT32 INT32_MAX
 
 #define g_return_val_if_fail(a, b) if (!a) { return b; }
 
 #define g_ascii_strcasecmp strcasecmp
+#define g_ascii_strncasecmp strncasecmp
 #define g_malloc0(len) calloc(1, len)
 #define g_malloc malloc
 #define g_free free
@@ -132,6 +144,8 @@ typedef struct GOptionContext {
 /* string functions */
 void *g_memdup(const void *src, size_t len);
 int g_str_equal(const void *str1, const void *str2);
+guint g_str_hash(const void *str);
+guint g_direct_hash(const void *ptr);
 char **g_strsplit(const char *haystack, const char *needle, int max_tokens);
 void g_strfreev(char **dir);
 char *g_strconcat(const char *first, ...);
@@ -162,7 +176,8 @@ void g_hash_table_insert(GHashTable *tree, void *key, void *value);
 gboolean g_hash_table_remove(GHashTable *hash_table, const void *key);
 GHashTable *g_hash_table_new(GHashFunc hashes, GEqualFunc equals);
 void g_hash_table_foreach(GHashTable *tree, GHFunc function, void *data);
-void g_hash_table_foreach_remove(GHashTable *tree, GHRFunc function, void *data);
+guint g_hash_table_foreach_remove(GHashTable *tree, GHRFunc function, void *data);
+guint g_hash_table_size(GHashTable *table);
 void g_hash_table_destroy(GHashTable *tree);
 
 /* GPtrArray */
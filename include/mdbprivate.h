@@ -30,6 +30,64 @@
   extern "C" {
 #endif
 
+typedef struct S_MdbHashIndex MdbHashIndex; /* see hashindex.c */
+
+/* row offset table entries carry flags in the top bits */
+#define OFFSET_MASK 0x1fff
+
+/* buffered writer, see output.c */
+struct S_MdbOutput {
+	FILE *file;
+	char *buf;
+	size_t len;
+	size_t size;
+	int error;
+	/* which bytes mdb_output_col() has to look at, see backend.c */
+	char esc_quote;
+	char esc_escape;
+	gboolean esc_ready;
+	unsigned char special[256];
+};
+
+/* rows of a temp table, see worktable.c */
+typedef struct {
+	int start;
+	int len;
+	unsigned char is_null;
+} MdbTempValue;
+
+struct S_MdbTempRows {
+	unsigned char *data; /* the rows, one after another */
+	size_t len;
+	size_t size;
+	size_t *rows; /* where each row starts in data */
+	unsigned int num_rows;
+	unsigned int rows_size;
+};
+
+MdbLvalCursor *mdbi_lval_open(MdbHandle *mdb, const void *value, size_t size);
+void *mdbi_lval_read_all(MdbLvalCursor *lval, size_t *size);
+guint32 *mdbi_table_pages(MdbTableDef *table, unsigned int *num_pages);
+void mdbi_output_init(MdbOutput *out, FILE *file, char *buf, size_t size);
+void mdbi_file_stat(MdbFile *f, MdbFileStamp *stamp);
+int mdbi_file_stamp_equal(const MdbFileStamp *a, const MdbFileStamp *b);
+unsigned long mdbi_file_num_pages(MdbHandle *mdb);
+void mdbi_file_lock(MdbFile *f);
+void mdbi_file_unlock(MdbFile *f);
+void mdbi_file_unref(MdbFile *f);
+void mdbi_free_file_catalog(MdbFile *f);
+void mdbi_catalog_entry_ref(MdbCatalogEntry *entry);
+void mdbi_catalog_entry_unref(MdbCatalogEntry *entry);
+void mdbi_free_file_tdefs(MdbFile *f);
+gboolean mdbi_tdef_read_indices(MdbTableDef *table);
+void mdbi_tdef_save_indices(MdbTableDef *table);
+MdbHashIndex **mdbi_tdef_hash_indexes(MdbTableDef *table);
+int mdbi_hash_scan_init(MdbTableDef *table);
+void mdbi_free_hash_indexes(MdbHashIndex *list);
+void mdbi_free_relationships(MdbHandle *mdb);
+void mdbi_free_sarg_prog(MdbSargProg *prog);
+void mdbi_free_temp_rows(MdbTempRows *rows);
+int mdbi_add_packed_temp_row(MdbTableDef *table, unsigned char *row_buffer, int row_size);
 void mdbi_rc4(unsigned char *key, guint32 key_len, unsigned char *buf, guint32 buf_len);
 MdbBackend *mdbi_register_backend2(MdbHandle *mdb, char *backend_name, guint32 capabilities,
         const MdbBackendType *backend_type,
@@ -39,6 +39,7 @@ typedef struct MdbSQL
 	MdbTableDef *cur_table;
 	MdbSargNode *sarg_tree;
 	GList *sarg_stack;
+	GPtrArray *in_values; /* IN list being parsed */
 	GPtrArray *bound_values;
 	unsigned char *kludge_ttable_pg;
 	long max_rows;
@@ -76,6 +77,9 @@ MdbSQLSarg *mdb_sql_alloc_sarg(void);
 MdbHandle *mdb_sql_open(MdbSQL *sql, char *db_name);
 void mdb_sql_free_tree(MdbSargNode *tree);
 int mdb_sql_add_sarg(MdbSQL *sql, char *col_name, int op, char *constant);
+int mdb_sql_add_between(MdbSQL *sql, char *col_name, char *low, char *high);
+int mdb_sql_add_in_value(MdbSQL *sql, char *constant);
+int mdb_sql_add_in(MdbSQL *sql, char *col_name);
 void mdb_sql_all_columns(MdbSQL *sql);
 void mdb_sql_sel_count(MdbSQL *sql);
 int mdb_sql_add_column(MdbSQL *sql, char *column_name);
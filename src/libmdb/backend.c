@@ -520,7 +520,7 @@ int mdb_set_default_backend(MdbHandle *mdb, const char *backend_name)
 		mdb->default_backend = backend;
 		g_free(mdb->backend_name); // NULL is ok
 		mdb->backend_name = (char *) g_strdup(backend_name);
-		mdb->relationships_table = NULL;
+		mdb->relationships_next = 0;
 		if (backend->date_fmt) {
 			mdb_set_date_fmt(mdb, backend->date_fmt);
 		} else {
@@ -732,12 +732,116 @@ mdb_print_indexes(FILE* outfile, MdbTableDef *table, char *dbnamespace)
 	g_free(quoted_table_name);
 }
 
+/* One row of MSysRelationships, see mdb_get_relationships() */
+typedef struct {
+	char *column;
+	char *object;
+	char *referenced_column;
+	char *referenced_object;
+	long grbit;
+} MdbRelationship;
+
+struct S_MdbRelationships {
+	MdbRelationship *rows; /* in MSysRelationships order */
+	unsigned int num_rows;
+	int *next_by_object; /* next row with the same szObject, or -1 */
+	GHashTable *by_object; /* szObject -> its first row */
+};
+
+void
+mdbi_free_relationships(MdbHandle *mdb)
+{
+	MdbRelationships *rels = mdb->relationships;
+	unsigned int i;
+
+	if (!rels)
+		return;
+	for (i=0; i<rels->num_rows; i++) {
+		g_free(rels->rows[i].column);
+		g_free(rels->rows[i].object);
+		g_free(rels->rows[i].referenced_column);
+		g_free(rels->rows[i].referenced_object);
+	}
+	if (rels->by_object)
+		g_hash_table_destroy(rels->by_object);
+	g_free(rels->next_by_object);
+	g_free(rels->rows);
+	g_free(rels);
+	mdb->relationships = NULL;
+}
+
+/*
+ * Reads all of MSysRelationships, so that the relationships of a table
+ * can be found without scanning it again.  Returns an empty set if there
+ * is no such table.
+ */
+static MdbRelationships *
+mdbi_read_relationships(MdbHandle *mdb)
+{
+	MdbRelationships *rels = g_malloc0(sizeof(MdbRelationships));
+	MdbTableDef *table;
+	MdbRelationship *rel, *first;
+	char *bound[5];
+	unsigned int i, n_alloc = 0;
+
+	table = mdb_read_table_by_name(mdb, "MSysRelationships", MDB_TABLE);
+	if (!table || !table->num_rows) {
+		if (table)
+			mdb_free_tabledef(table);
+		return rels;
+	}
+	if (!mdb_read_columns(table)) {
+		fprintf(stderr, "Unable to read columns of MSysRelationships\n");
+		mdb_free_tabledef(table);
+		return rels;
+	}
+	for (i=0;i<5;i++) {
+		bound[i] = g_malloc0(mdb->bind_size);
+	}
+	mdb_bind_column_by_name(table, "szColumn", bound[0], NULL);
+	mdb_bind_column_by_name(table, "szObject", bound[1], NULL);
+	mdb_bind_column_by_name(table, "szReferencedColumn", bound[2], NULL);
+	mdb_bind_column_by_name(table, "szReferencedObject", bound[3], NULL);
+	mdb_bind_column_by_name(table, "grbit", bound[4], NULL);
+	mdb_rewind_table(table);
+
+	while (mdb_fetch_row(table)) {
+		if (rels->num_rows == n_alloc) {
+			n_alloc = n_alloc ? 2 * n_alloc : 64;
+			rels->rows = g_realloc(rels->rows, n_alloc * sizeof(MdbRelationship));
+		}
+		rel = &rels->rows[rels->num_rows++];
+		rel->column = g_strdup(bound[0]);
+		rel->object = g_strdup(bound[1]);
+		rel->referenced_column = g_strdup(bound[2]);
+		rel->referenced_object = g_strdup(bound[3]);
+		rel->grbit = atoi(bound[4]);
+	}
+	for (i=0;i<5;i++)
+		g_free(bound[i]);
+	mdb_free_tabledef(table);
+
+	/* walk backwards so that each chain is in MSysRelationships order */
+	rels->next_by_object = g_malloc((rels->num_rows + 1) * sizeof(int));
+	rels->by_object = g_hash_table_new(g_str_hash, g_str_equal);
+	for (i=rels->num_rows; i>0; i--) {
+		rel = &rels->rows[i-1];
+		first = g_hash_table_lookup(rels->by_object, rel->object);
+		rels->next_by_object[i-1] = first ? (int)(first - rels->rows) : -1;
+		if (first)
+			g_hash_table_remove(rels->by_object, rel->object);
+		g_hash_table_insert(rels->by_object, rel->object, rel);
+	}
+	return rels;
+}
+
 /**
  * mdb_get_relationships
  * @mdb: Handle to open MDB database file
  * @tablename: Name of the table to process. Process all tables if NULL.
  *
- * Generates relationships by reading the MSysRelationships table.
+ * Generates relationships from the MSysRelationships table, which is
+ * read once per handle.
  *   'szColumn' contains the column name of the child table.
  *   'szObject' contains the table name of the child table.
  *   'szReferencedColumn' contains the column name of the parent table.
@@ -753,10 +857,11 @@ mdb_print_indexes(FILE* outfile, MdbTableDef *table, char *dbnamespace)
 static char *
 mdb_get_relationships(MdbHandle *mdb, const gchar *dbnamespace, const char* tablename)
 {
-	unsigned int i;
 	gchar *text = NULL;  /* String to be returned */
-	char **bound = mdb->relationships_values;  /* Bound values */
+	MdbRelationships *rels;
+	MdbRelationship *rel, *first;
 	int backend = 0;
+	int row, next;
 	char *quoted_table_1, *quoted_column_1,
 	     *quoted_table_2, *quoted_column_2,
 	     *constraint_name, *quoted_constraint_name;
@@ -768,52 +873,48 @@ mdb_get_relationships(MdbHandle *mdb, const gchar *dbnamespace, const char* tabl
 		backend = MDB_BACKEND_POSTGRES;
 	} else if (!strcmp(mdb->backend_name, "mysql")) {
 		backend = MDB_BACKEND_MYSQL;
-	} else if (!mdb->relationships_table) {
+	} else if (!mdb->relationships_next) {
 		return NULL;
 	}
 
-	if (!mdb->relationships_table) {
-		mdb->relationships_table = mdb_read_table_by_name(mdb, "MSysRelationships", MDB_TABLE);
-		if (!mdb->relationships_table || !mdb->relationships_table->num_rows) {
+	/*
+	 * relationships_next is 0 before the first call, -1 after the last
+	 * row, and 1 + the row to return next in between.
+	 */
+	if (mdb->relationships_next == -1) {
+		mdb->relationships_next = 0;
+		return NULL;
+	}
+	if (!mdb->relationships_next) {
+		if (!mdb->relationships)
+			mdb->relationships = mdbi_read_relationships(mdb);
+		rels = mdb->relationships;
+		if (!rels->num_rows) {
 			fprintf(stderr, "No MSysRelationships\n");
 			return NULL;
 		}
-		if (!mdb_read_columns(mdb->relationships_table)) {
-			fprintf(stderr, "Unable to read columns of MSysRelationships\n");
-			return NULL;
-		}
-		for (i=0;i<5;i++) {
-			bound[i] = g_malloc0(mdb->bind_size);
-		}
-		mdb_bind_column_by_name(mdb->relationships_table, "szColumn", bound[0], NULL);
-		mdb_bind_column_by_name(mdb->relationships_table, "szObject", bound[1], NULL);
-		mdb_bind_column_by_name(mdb->relationships_table, "szReferencedColumn", bound[2], NULL);
-		mdb_bind_column_by_name(mdb->relationships_table, "szReferencedObject", bound[3], NULL);
-		mdb_bind_column_by_name(mdb->relationships_table, "grbit", bound[4], NULL);
-		mdb_rewind_table(mdb->relationships_table);
-	}
-    if (mdb->relationships_table->cur_row >= mdb->relationships_table->num_rows) {  /* past the last row */
-        for (i=0;i<5;i++)
-            g_free(bound[i]);
-        mdb->relationships_table = NULL;
-        return NULL;
-    }
-
-	while (1) {
-		if (!mdb_fetch_row(mdb->relationships_table)) {
-			for (i=0;i<5;i++)
-				g_free(bound[i]);
-			mdb->relationships_table = NULL;
+		if (!tablename) {
+			row = 0;
+		} else if ((first = g_hash_table_lookup(rels->by_object, tablename))) {
+			row = first - rels->rows;
+		} else {
 			return NULL;
 		}
-		if (!tablename || !strcmp(bound[1], tablename))
-			break;
+	} else {
+		rels = mdb->relationships;
+		row = mdb->relationships_next - 1;
 	}
+	if (tablename)
+		next = rels->next_by_object[row];
+	else
+		next = (unsigned int)row + 1 < rels->num_rows ? row + 1 : -1;
+	mdb->relationships_next = next < 0 ? -1 : next + 1;
+	rel = &rels->rows[row];
 
-	quoted_table_1 = mdb->default_backend->quote_schema_name(dbnamespace, bound[1]);
-	quoted_table_2 = mdb->default_backend->quote_schema_name(dbnamespace, bound[3]);
-	grbit = atoi(bound[4]);
-	constraint_name = g_strconcat(bound[1], "_", bound[0], "_fk", NULL);
+	quoted_table_1 = mdb->default_backend->quote_schema_name(dbnamespace, rel->object);
+	quoted_table_2 = mdb->default_backend->quote_schema_name(dbnamespace, rel->referenced_object);
+	grbit = rel->grbit;
+	constraint_name = g_strconcat(rel->object, "_", rel->column, "_fk", NULL);
 
 	switch (backend) {
 		case MDB_BACKEND_POSTGRES:
@@ -825,9 +926,9 @@ mdb_get_relationships(MdbHandle *mdb, const gchar *dbnamespace, const char* tabl
 			 */
 			quoted_constraint_name = mdb->default_backend->quote_schema_name(NULL, constraint_name);
 			quoted_constraint_name = mdb_normalise_and_replace(mdb, &quoted_constraint_name);
-			quoted_column_1 = mdb->default_backend->quote_schema_name(NULL, bound[0]);
+			quoted_column_1 = mdb->default_backend->quote_schema_name(NULL, rel->column);
 			quoted_column_1 = mdb_normalise_and_replace(mdb, &quoted_column_1);
-			quoted_column_2 = mdb->default_backend->quote_schema_name(NULL, bound[2]);
+			quoted_column_2 = mdb->default_backend->quote_schema_name(NULL, rel->referenced_column);
 			quoted_column_2 = mdb_normalise_and_replace(mdb, &quoted_column_2);
 			break;
 
@@ -836,8 +937,8 @@ mdb_get_relationships(MdbHandle *mdb, const gchar *dbnamespace, const char* tabl
 			 * column names.
 			 */
 			quoted_constraint_name = mdb->default_backend->quote_schema_name(dbnamespace, constraint_name);
-			quoted_column_1 = mdb->default_backend->quote_schema_name(dbnamespace, bound[0]);
-			quoted_column_2 = mdb->default_backend->quote_schema_name(dbnamespace, bound[2]);
+			quoted_column_1 = mdb->default_backend->quote_schema_name(dbnamespace, rel->column);
+			quoted_column_2 = mdb->default_backend->quote_schema_name(dbnamespace, rel->referenced_column);
 			break;
 	}
 	g_free(constraint_name);
@@ -977,7 +1078,7 @@ generate_table_schema(FILE *outfile, MdbCatalogEntry *entry, char *dbnamespace,
 
 		if (export_options & MDB_SHEXP_DEFVALUES) {
 			int done = 0;
-			if (col->props) {
+			if (mdb_col_get_props(col)) {
 				gchar *defval = g_hash_table_lookup(col->props->hash, "DefaultValue");
 				if (defval) {
 					size_t def_len = strlen(defval);
@@ -1038,7 +1139,7 @@ generate_table_schema(FILE *outfile, MdbCatalogEntry *entry, char *dbnamespace,
 	/* Add the constraints on columns */
 	for (i = 0; i < table->num_cols; i++) {
 		col = g_ptr_array_index (table->columns, i);
-		props = col->props;
+		props = mdb_col_get_props(col);
 		if (!props)
 			continue;
 
@@ -1153,67 +1254,132 @@ mdb_print_schema(MdbHandle *mdb, FILE *outfile, char *tabname, char *dbnamespace
 #define is_binary_type(x) (x==MDB_OLE || x==MDB_BINARY || x==MDB_REPID)
 #define is_quote_type(x) (is_binary_type(x) || x==MDB_TEXT || x==MDB_MEMO || x==MDB_DATETIME)
 //#define DONT_ESCAPE_ESCAPE
+
+/* bits of MdbOutput.special */
+#define MDB_ESC_QUOTE 1 /* may start the quote string */
+#define MDB_ESC_ESCAPE 2 /* may start the escape string */
+#define MDB_ESC_CONTROL 4 /* escaped by MDB_EXPORT_ESCAPE_CONTROL_CHARS */
+
+static void
+mdbi_output_escapes(MdbOutput *out, char *quote_char, char *escape_char)
+{
+	if (out->esc_ready && out->esc_quote == quote_char[0]
+			&& out->esc_escape == (escape_char ? escape_char[0] : '\0'))
+		return;
+	out->esc_quote = quote_char[0];
+	out->esc_escape = escape_char ? escape_char[0] : '\0';
+	memset(out->special, 0, sizeof(out->special));
+	out->special['\r'] = out->special['\n'] = MDB_ESC_CONTROL;
+	out->special['\t'] = out->special['\\'] = MDB_ESC_CONTROL;
+	if (out->esc_quote)
+		out->special[(unsigned char)out->esc_quote] |= MDB_ESC_QUOTE;
+#ifndef DONT_ESCAPE_ESCAPE
+	if (out->esc_escape)
+		out->special[(unsigned char)out->esc_escape] |= MDB_ESC_ESCAPE;
+#endif
+	out->esc_ready = TRUE;
+}
+
+/**
+ * mdb_output_col:
+ * @out: writer from mdb_output_new()
+ *
+ * Same as mdb_print_col(), through a buffered writer.  Runs of bytes that
+ * need no escaping, as told by a table of the bytes that might, are
+ * copied to the buffer in one go.
+ */
 void
-mdb_print_col(FILE *outfile, gchar *col_val, int quote_text, int col_type, int bin_len,
+mdb_output_col(MdbOutput *out, gchar *col_val, int quote_text, int col_type, int bin_len,
 		char *quote_char, char *escape_char, int flags)
 /* quote_text: Don't quote if 0.
  */
 {
 	size_t quote_len = strlen(quote_char); /* multibyte */
-
 	size_t orig_escape_len = escape_char ? strlen(escape_char) : 0;
 	int quoting = quote_text && is_quote_type(col_type);
-    int bin_mode = (flags & MDB_BINEXPORT_MASK);
-    int escape_cr_lf = !!(flags & MDB_EXPORT_ESCAPE_CONTROL_CHARS);
+	int bin_mode = (flags & MDB_BINEXPORT_MASK);
+	int escape_cr_lf = !!(flags & MDB_EXPORT_ESCAPE_CONTROL_CHARS);
+	unsigned char mask = 0;
+	const char *p, *end, *run;
+
+	mdbi_output_escapes(out, quote_char, escape_char);
 
 	/* double the quote char if no escape char passed */
 	if (!escape_char)
 		escape_char = quote_char;
 
 	if (quoting)
-		fputs(quote_char, outfile);
-
-	while (1) {
-		if (is_binary_type(col_type)) {
-			if (bin_mode == MDB_BINEXPORT_STRIP)
-				break;
-			if (!bin_len--)
-				break;
-		} else /* use \0 sentry */
-			if (!*col_val)
-				break;
+		mdb_output_write(out, quote_char, quote_len);
+
+	if (is_binary_type(col_type)) {
+		if (bin_mode == MDB_BINEXPORT_OCTAL) {
+			mdb_output_octal(out, col_val, bin_len);
+			bin_len = 0;
+		} else if (bin_mode == MDB_BINEXPORT_HEXADECIMAL) {
+			mdb_output_hex(out, col_val, bin_len);
+			bin_len = 0;
+		} else if (bin_mode == MDB_BINEXPORT_STRIP) {
+			bin_len = 0;
+		}
+		end = col_val + bin_len;
+	} else /* use \0 sentry */
+		end = col_val + strlen(col_val);
+
+	if (quoting && quote_len)
+		mask |= MDB_ESC_QUOTE;
+	if (quoting && orig_escape_len)
+		mask |= MDB_ESC_ESCAPE;
+	if (escape_cr_lf && is_quote_type(col_type))
+		mask |= MDB_ESC_CONTROL;
+
+	p = col_val;
+	while (p < end) {
+		run = p;
+		while (p < end && !(out->special[(unsigned char)*p] & mask))
+			p++;
+		if (p > run)
+			mdb_output_write(out, run, p - run);
+		if (p == end)
+			break;
 
-		if (is_binary_type(col_type) && bin_mode == MDB_BINEXPORT_OCTAL) {
-			fprintf(outfile, "\\%03o", *(unsigned char*)col_val++);
-		} else if (is_binary_type(col_type) && bin_mode == MDB_BINEXPORT_HEXADECIMAL) {
-			fprintf(outfile, "%02X", *(unsigned char*)col_val++);
-		} else if (quoting && quote_len && !strncmp(col_val, quote_char, quote_len)) {
-			fprintf(outfile, "%s%s", escape_char, quote_char);
-			col_val += quote_len;
+		if ((mask & MDB_ESC_QUOTE) && (size_t)(end - p) >= quote_len
+				&& !memcmp(p, quote_char, quote_len)) {
+			mdb_output_puts(out, escape_char);
+			mdb_output_write(out, quote_char, quote_len);
+			p += quote_len;
 #ifndef DONT_ESCAPE_ESCAPE
-		} else if (quoting && orig_escape_len && !strncmp(col_val, escape_char, orig_escape_len)) {
-			fprintf(outfile, "%s%s", escape_char, escape_char);
-			col_val += orig_escape_len;
+		} else if ((mask & MDB_ESC_ESCAPE) && (size_t)(end - p) >= orig_escape_len
+				&& !memcmp(p, escape_char, orig_escape_len)) {
+			mdb_output_write(out, escape_char, orig_escape_len);
+			mdb_output_write(out, escape_char, orig_escape_len);
+			p += orig_escape_len;
 #endif
-		} else if (escape_cr_lf && is_quote_type(col_type) && *col_val=='\r') {
-			col_val++;
-			putc('\\', outfile);
-			putc('r', outfile);
-		} else if (escape_cr_lf && is_quote_type(col_type) && *col_val=='\n') {
-			col_val++;
-			putc('\\', outfile);
-			putc('n', outfile);
-		} else if (escape_cr_lf && is_quote_type(col_type) && *col_val=='\t') {
-			col_val++;
-			putc('\\', outfile);
-			putc('t', outfile);
-		} else if (escape_cr_lf && is_quote_type(col_type) && *col_val=='\\') {
-			col_val++;
-			putc('\\', outfile);
-			putc('\\', outfile);
+		} else if ((mask & MDB_ESC_CONTROL) && (out->special[(unsigned char)*p] & MDB_ESC_CONTROL)) {
+			mdb_output_putc(out, '\\');
+			switch (*p++) {
+			case '\r': mdb_output_putc(out, 'r'); break;
+			case '\n': mdb_output_putc(out, 'n'); break;
+			case '\t': mdb_output_putc(out, 't'); break;
+			default: mdb_output_putc(out, '\\'); break;
+			}
 		} else
-			putc(*col_val++, outfile);
+			mdb_output_putc(out, *p++);
 	}
 	if (quoting)
-		fputs(quote_char, outfile);
+		mdb_output_write(out, quote_char, quote_len);
+}
+
+void
+mdb_print_col(FILE *outfile, gchar *col_val, int quote_text, int col_type, int bin_len,
+		char *quote_char, char *escape_char, int flags)
+/* quote_text: Don't quote if 0.
+ */
+{
+	char buf[4096];
+	MdbOutput out;
+
+	mdbi_output_init(&out, outfile, buf, sizeof(buf));
+	mdb_output_col(&out, col_val, quote_text, col_type, bin_len, quote_char, escape_char, flags);
+	if (out.len)
+		fwrite(out.buf, 1, out.len, outfile);
 }
@@ -17,6 +17,7 @@
  */
 
 #include "mdbtools.h"
+#include "mdbprivate.h"
 
 const char *
 mdb_get_objtype_string(int obj_type)
@@ -42,30 +43,89 @@ mdb_get_objtype_string(int obj_type)
 	}
 }
 
-void mdb_free_catalog(MdbHandle *mdb)
+/*
+ * The catalog is read from MSysObjects once per file and shared by every
+ * handle on it (see mdb_clone_handle).  Each handle keeps its own copy of
+ * the entries, since entry->mdb has to point back at the handle reading
+ * the table, and mdb->catalog is a view on those copies filtered by type.
+ */
+typedef struct {
+	int type; /* raw MSysObjects.Type */
+	GPtrArray *entries;
+} MdbCatalogType;
+
+struct S_MdbCatalogCache {
+	MdbCatalogEntry *entries; /* entry->mdb is unset */
+	int *raw_types; /* MSysObjects.Type of each entry */
+	unsigned int num_entries;
+	int *next_by_name; /* next entry with the same folded name, or -1 */
+	gchar **folded_names;
+	GHashTable *by_name; /* folded name -> first MdbCatalogEntry */
+	GPtrArray *by_type; /* MdbCatalogType */
+	MdbFileStamp stamp;
+};
+
+/*
+ * A handle's copy of the entries.  When the file changes the handle moves
+ * on to a new copy, and the old one is freed once the tables read from it
+ * and the mdb->catalog view on it are gone.
+ */
+struct S_MdbCatalogCopy {
+	MdbCatalogEntry *entries; /* ends with a zeroed entry */
+	int refs; /* the handle while current, mdb->catalog and tables */
+};
+
+static void mdbi_free_catalog_cache(MdbCatalogCache *cache)
 {
-	guint i, j;
-	MdbCatalogEntry *entry;
+	guint i;
 
-	if ((!mdb) || (!mdb->catalog)) return;
-	for (i=0; i<mdb->catalog->len; i++) {
-		entry = (MdbCatalogEntry *)g_ptr_array_index(mdb->catalog, i);
-		if (entry) {
-			if (entry->props) {
-				for (j=0; j<entry->props->len; j++)
-					mdb_free_props(g_ptr_array_index(entry->props, j));
-				g_ptr_array_free(entry->props, TRUE);
-			}
-			g_free(entry);
-		}
+	if (!cache) return;
+	for (i=0; i<cache->num_entries; i++)
+		g_free(cache->folded_names[i]);
+	for (i=0; i<cache->by_type->len; i++) {
+		MdbCatalogType *type = g_ptr_array_index(cache->by_type, i);
+		g_ptr_array_free(type->entries, TRUE);
+		g_free(type);
 	}
-	g_ptr_array_free(mdb->catalog, TRUE);
-	mdb->catalog = NULL;
+	g_ptr_array_free(cache->by_type, TRUE);
+	g_hash_table_destroy(cache->by_name);
+	g_free(cache->folded_names);
+	g_free(cache->next_by_name);
+	g_free(cache->raw_types);
+	g_free(cache->entries);
+	g_free(cache);
 }
 
-GPtrArray *mdb_read_catalog (MdbHandle *mdb, int objtype)
+/**
+ * mdbi_free_file_catalog:
+ * @f: file being closed
+ *
+ * Frees the catalog shared by the handles on @f.
+ */
+void mdbi_free_file_catalog(MdbFile *f)
+{
+	mdbi_free_catalog_cache(f->catalog);
+	f->catalog = NULL;
+}
+
+static MdbCatalogType *mdbi_catalog_type(MdbCatalogCache *cache, int type)
+{
+	MdbCatalogType *t;
+	guint i;
+
+	for (i=0; i<cache->by_type->len; i++) {
+		t = g_ptr_array_index(cache->by_type, i);
+		if (t->type == type)
+			return t;
+	}
+	return NULL;
+}
+
+static MdbCatalogCache *mdbi_load_catalog(MdbHandle *mdb)
 {
+	MdbCatalogCache *cache = NULL;
 	MdbCatalogEntry *entry, msysobj;
+	MdbCatalogType *t;
 	MdbTableDef *table;
 	char *obj_id = NULL;
 	char *obj_name = NULL;
@@ -74,14 +134,10 @@ GPtrArray *mdb_read_catalog (MdbHandle *mdb, int objtype)
 	char *obj_props = NULL;
 	int type;
 	int i;
+	unsigned int n, size = 0;
 	MdbColumn *col_props;
 	int kkd_size_ole;
 
-	if (!mdb) return NULL;
-	if (mdb->catalog) mdb_free_catalog(mdb);
-	mdb->catalog = g_ptr_array_new();
-	mdb->num_catalog = 0;
-
 	obj_id = malloc(mdb->bind_size);
 	obj_name = malloc(mdb->bind_size);
 	obj_type = malloc(mdb->bind_size);
@@ -100,13 +156,11 @@ GPtrArray *mdb_read_catalog (MdbHandle *mdb, int objtype)
 	table = mdb_read_table(&msysobj);
     if (!table) {
         fprintf(stderr, "Unable to read table %s\n", msysobj.object_name);
-        mdb_free_catalog(mdb);
         goto cleanup;
     }
 
 	if (!mdb_read_columns(table)) {
 		fprintf(stderr, "Unable to read columns of table %s\n", msysobj.object_name);
-		mdb_free_catalog(mdb);
 		goto cleanup;
 	}
 
@@ -116,42 +170,66 @@ GPtrArray *mdb_read_catalog (MdbHandle *mdb, int objtype)
         mdb_bind_column_by_name(table, "Flags", obj_flags, NULL) == -1) {
         fprintf(stderr, "Unable to bind columns from table %s (%d columns found)\n",
                 msysobj.object_name, table->num_cols);
-        mdb_free_catalog(mdb);
         goto cleanup;
     }
     if ((i = mdb_bind_column_by_name(table, "LvProp", obj_props, &kkd_size_ole)) == -1) {
         fprintf(stderr, "Unable to bind column %s from table %s\n", "LvProp", msysobj.object_name);
-        mdb_free_catalog(mdb);
         goto cleanup;
     }
 	col_props = g_ptr_array_index(table->columns, i-1);
 
+	cache = g_malloc0(sizeof(MdbCatalogCache));
+	mdbi_file_stat(mdb->f, &cache->stamp);
+
 	mdb_rewind_table(table);
 
 	while (mdb_fetch_row(table)) {
+		if (cache->num_entries == size) {
+			size = size ? size * 2 : 64;
+			cache->entries = g_realloc(cache->entries, size * sizeof(MdbCatalogEntry));
+			cache->raw_types = g_realloc(cache->raw_types, size * sizeof(int));
+		}
+		entry = &cache->entries[cache->num_entries];
+		memset(entry, 0, sizeof(MdbCatalogEntry));
 		type = atoi(obj_type);
-		if (objtype==MDB_ANY || type == objtype) {
-			//fprintf(stderr, "obj_id: %10ld objtype: %-3d (0x%04x) obj_name: %s\n",
-			//	(atol(obj_id) & 0x00FFFFFF), type, type, obj_name);
-			entry = g_malloc0(sizeof(MdbCatalogEntry));
-			entry->mdb = mdb;
-			snprintf(entry->object_name, sizeof(entry->object_name), "%s", obj_name);
-			entry->object_type = (type & 0x7F);
-			entry->table_pg = atol(obj_id) & 0x00FFFFFF;
-			entry->flags = atol(obj_flags);
-			mdb->num_catalog++;
-			g_ptr_array_add(mdb->catalog, entry);
-			if (kkd_size_ole) {
-				size_t kkd_len;
-				void *kkd = mdb_ole_read_full(mdb, col_props, &kkd_len);
-				//mdb_buffer_dump(kkd, 0, kkd_len);
-				if (kkd) {
-					entry->props = mdb_kkd_to_props(mdb, kkd, kkd_len);
-					free(kkd);
-				}
-			}
+		snprintf(entry->object_name, sizeof(entry->object_name), "%s", obj_name);
+		entry->object_type = (type & 0x7F);
+		entry->table_pg = atol(obj_id) & 0x00FFFFFF;
+		entry->flags = atol(obj_flags);
+		cache->raw_types[cache->num_entries++] = type;
+		/* properties are only decoded when asked for */
+		if (kkd_size_ole) {
+			entry->props_pg = mdb->cur_pg;
+			entry->props_offset = col_props->cur_value_start;
+			entry->props_len = col_props->cur_value_len;
 		}
 	}
+
+	cache->next_by_name = g_malloc0((cache->num_entries + 1) * sizeof(int));
+	cache->folded_names = g_malloc0((cache->num_entries + 1) * sizeof(gchar *));
+	cache->by_name = g_hash_table_new(g_str_hash, g_str_equal);
+	cache->by_type = g_ptr_array_new();
+	for (n=0; n<cache->num_entries; n++) {
+		if (!(t = mdbi_catalog_type(cache, cache->raw_types[n]))) {
+			t = g_malloc0(sizeof(MdbCatalogType));
+			t->type = cache->raw_types[n];
+			t->entries = g_ptr_array_new();
+			g_ptr_array_add(cache->by_type, t);
+		}
+		g_ptr_array_add(t->entries, &cache->entries[n]);
+	}
+	/* walk backwards so that each name chain is in MSysObjects order */
+	for (n=cache->num_entries; n>0; n--) {
+		MdbCatalogEntry *first;
+		gchar *folded;
+
+		folded = cache->folded_names[n-1] = g_utf8_casefold(cache->entries[n-1].object_name, -1);
+		first = g_hash_table_lookup(cache->by_name, folded);
+		cache->next_by_name[n-1] = first ? (int)(first - cache->entries) : -1;
+		if (first)
+			g_hash_table_remove(cache->by_name, folded);
+		g_hash_table_insert(cache->by_name, folded, &cache->entries[n-1]);
+	}
 	//mdb_dump_catalog(mdb, MDB_TABLE);
  
 cleanup:
@@ -164,24 +242,335 @@ cleanup:
 	free(obj_flags);
 	free(obj_props);
 
-    return mdb->catalog;
+	return cache;
 }
 
+static void mdbi_free_catalog_entries(MdbCatalogEntry *entries)
+{
+	guint i, j;
 
-MdbCatalogEntry *
-mdb_get_catalogentry_by_name(MdbHandle *mdb, const gchar* name)
+	/* the array ends with a zeroed entry */
+	for (i=0; entries[i].mdb; i++) {
+		MdbCatalogEntry *entry = &entries[i];
+		if (entry->props) {
+			for (j=0; j<entry->props->len; j++)
+				mdb_free_props(g_ptr_array_index(entry->props, j));
+			g_ptr_array_free(entry->props, TRUE);
+		}
+	}
+	g_free(entries);
+}
+
+static void mdbi_catalog_copy_unref(MdbCatalogCopy *copy)
+{
+	if (!copy || --copy->refs)
+		return;
+	mdbi_free_catalog_entries(copy->entries);
+	g_free(copy);
+}
+
+/**
+ * mdbi_catalog_entry_ref:
+ * @entry: catalog entry
+ *
+ * Keeps the handle's copy of the catalog holding @entry, if any, from
+ * being freed when the file changes.  Tables hold one while they're open.
+ */
+void mdbi_catalog_entry_ref(MdbCatalogEntry *entry)
 {
+	if (entry->copy)
+		entry->copy->refs++;
+}
+
+void mdbi_catalog_entry_unref(MdbCatalogEntry *entry)
+{
+	mdbi_catalog_copy_unref(entry->copy);
+}
+
+/*
+ * Make sure the shared catalog is loaded and current, and that this
+ * handle's entries were copied from it.  Returns the shared catalog,
+ * or NULL if MSysObjects could not be read.
+ */
+static MdbCatalogCache *mdbi_sync_catalog(MdbHandle *mdb)
+{
+	MdbFile *f = mdb->f;
+	MdbCatalogCache *cache;
 	unsigned int i;
+
+	/* other handles on the file may be loading or reading it too */
+	mdbi_file_lock(f);
+	cache = f->catalog;
+	if (cache) {
+		MdbFileStamp stamp;
+
+		mdbi_file_stat(mdb->f, &stamp);
+		if (!mdbi_file_stamp_equal(&stamp, &cache->stamp)) {
+			MdbCatalogCache *fresh = mdbi_load_catalog(mdb);
+			if (!fresh) {
+				mdbi_file_unlock(f);
+				return NULL;
+			}
+			mdbi_free_catalog_cache(cache);
+			f->catalog = cache = fresh;
+			f->catalog_gen++;
+		}
+	} else {
+		if (!(cache = mdbi_load_catalog(mdb))) {
+			mdbi_file_unlock(f);
+			return NULL;
+		}
+		f->catalog = cache;
+		f->catalog_gen++;
+	}
+
+	if (!mdb->catalog_all || mdb->catalog_gen != f->catalog_gen) {
+		MdbCatalogCopy *copy = g_malloc0(sizeof(MdbCatalogCopy));
+
+		copy->refs = 1;
+		copy->entries = g_malloc0((cache->num_entries + 1) * sizeof(MdbCatalogEntry));
+		for (i=0; i<cache->num_entries; i++) {
+			copy->entries[i] = cache->entries[i];
+			copy->entries[i].mdb = mdb;
+			copy->entries[i].copy = copy;
+		}
+		/* tables read from the old entries still point at them, and
+		 * mdb->catalog does until mdb_read_catalog is called again */
+		mdbi_catalog_copy_unref(mdb->catalog_copy);
+		mdb->catalog_copy = copy;
+		mdb->catalog_all = copy->entries;
+		mdb->catalog_gen = f->catalog_gen;
+	}
+	mdbi_file_unlock(f);
+	return cache;
+}
+
+/*
+ * Find the first entry named @name (case-insensitively) whose raw type
+ * is @objtype, or of any type for MDB_ANY.
+ */
+static MdbCatalogEntry *mdbi_find_catalog_entry(MdbHandle *mdb, const gchar *name, int objtype)
+{
+	MdbCatalogCache *cache;
 	MdbCatalogEntry *entry;
+	gchar *folded;
+	int i;
 
-	for (i=0; i<mdb->num_catalog; i++) {
-		entry = g_ptr_array_index(mdb->catalog, i);
-		if (!g_ascii_strcasecmp(entry->object_name, name))
-			return entry;
+	if (!(cache = mdbi_sync_catalog(mdb)))
+		return NULL;
+
+	folded = g_utf8_casefold(name, -1);
+	entry = g_hash_table_lookup(cache->by_name, folded);
+	g_free(folded);
+
+	for (i = entry ? (int)(entry - cache->entries) : -1; i >= 0; i = cache->next_by_name[i]) {
+		if (objtype == MDB_ANY || cache->raw_types[i] == objtype)
+			return &mdb->catalog_all[i];
 	}
 	return NULL;
 }
 
+/* Drops mdb->catalog, and with it its hold on the entries */
+static void mdbi_free_catalog_view(MdbHandle *mdb)
+{
+	if (mdb->catalog)
+		g_ptr_array_free(mdb->catalog, TRUE);
+	mdb->catalog = NULL;
+	mdb->num_catalog = 0;
+	mdbi_catalog_copy_unref(mdb->catalog_view);
+	mdb->catalog_view = NULL;
+}
+
+/**
+ * mdb_free_catalog:
+ * @mdb: Handle to open MDB database file
+ *
+ * Lets go of this handle's catalog entries.  Those that tables still
+ * point at are freed with the last of those tables.  The catalog shared
+ * with other handles on the same file stays loaded until the file is
+ * closed.
+ */
+void mdb_free_catalog(MdbHandle *mdb)
+{
+	if (!mdb) return;
+	mdbi_free_catalog_view(mdb);
+	mdbi_catalog_copy_unref(mdb->catalog_copy);
+	mdb->catalog_copy = NULL;
+	mdb->catalog_all = NULL;
+}
+
+/*
+ * The entry of the handle's current catalog for the same object as
+ * @entry, which may have been replaced since the file changed, or NULL
+ * if the object is gone.
+ */
+static MdbCatalogEntry *mdbi_current_catalog_entry(MdbCatalogEntry *entry)
+{
+	MdbHandle *mdb = entry->mdb;
+	MdbCatalogCache *cache;
+	MdbCatalogEntry *first;
+	gchar *folded;
+	int i;
+
+	if (!(cache = mdbi_sync_catalog(mdb)))
+		return NULL;
+	if (entry >= mdb->catalog_all && entry < mdb->catalog_all + cache->num_entries)
+		return entry;
+
+	folded = g_utf8_casefold(entry->object_name, -1);
+	first = g_hash_table_lookup(cache->by_name, folded);
+	g_free(folded);
+	for (i = first ? (int)(first - cache->entries) : -1; i >= 0; i = cache->next_by_name[i]) {
+		if (cache->entries[i].object_type == entry->object_type)
+			return &mdb->catalog_all[i];
+	}
+	return NULL;
+}
+
+/**
+ * mdb_catalogentry_get_props:
+ * @entry: catalog entry
+ *
+ * Decodes the object's LvProp blob the first time it is asked for.  The
+ * page buffer of the entry's handle is left alone.  If the file has
+ * changed since @entry was read, the blob may have moved, and it is read
+ * from where the object's current entry says it is.  The properties stay
+ * with @entry either way, as tables and columns keep pointers to them.
+ *
+ * Returns: GPtrArray of MdbProperties, or NULL if the object has none.
+ */
+GPtrArray *mdb_catalogentry_get_props(MdbCatalogEntry *entry)
+{
+	MdbHandle *mdb = entry->mdb;
+	unsigned char *pg_buf = mdb->alt_pg_buf;
+	MdbCatalogEntry *current;
+	MdbLvalCursor *lval;
+	GPtrArray *props;
+	size_t kkd_len = 0, blob_len;
+	void *kkd = NULL;
+
+	if (entry->props || entry->props_read)
+		return entry->props;
+	entry->props_read = 1;
+	/* noticing the change lets go of the handle's old copy of the
+	 * catalog, which may be the one holding @entry */
+	mdbi_catalog_entry_ref(entry);
+	if ((current = mdbi_current_catalog_entry(entry)) && current != entry) {
+		entry->props_pg = current->props_pg;
+		entry->props_offset = current->props_offset;
+		entry->props_len = current->props_len;
+	}
+	/* a blob that can't be read or parsed is reported, unlike a missing one */
+	if (current && entry->props_len) {
+		if (entry->props_len < MDB_MEMO_OVERHEAD
+		 || mdb_read_alt_pg(mdb, entry->props_pg) != mdb->fmt->pg_size
+		 || entry->props_offset + entry->props_len > mdb->fmt->pg_size) {
+			fprintf(stderr, "Unable to read the properties of %s\n", entry->object_name);
+		} else {
+			/* the inline data is copied before any LVAL page is read */
+			lval = mdbi_lval_open(mdb, pg_buf + entry->props_offset, entry->props_len);
+			blob_len = mdb_lval_length(lval);
+			kkd = mdbi_lval_read_all(lval, &kkd_len);
+			mdb_lval_close(lval);
+			if (kkd && kkd_len < blob_len) {
+				fprintf(stderr, "Unable to read the properties of %s (got %zu of %zu bytes)\n",
+					entry->object_name, kkd_len, blob_len);
+				free(kkd);
+				kkd = NULL;
+			}
+		}
+	}
+	if (kkd) {
+		//mdb_buffer_dump(kkd, 0, kkd_len);
+		if (kkd_len)
+			entry->props = mdb_kkd_to_props(mdb, kkd, kkd_len);
+		free(kkd);
+	}
+	props = entry->props;
+	mdbi_catalog_entry_unref(entry);
+	return props;
+}
+
+/**
+ * mdb_read_catalog:
+ * @mdb: Handle to open MDB database file
+ * @objtype: object type to list, or MDB_ANY
+ *
+ * Fills mdb->catalog with the objects of type @objtype.  MSysObjects is
+ * only scanned the first time the file's catalog is needed, and again
+ * after the file has been modified.
+ *
+ * Returns: mdb->catalog, or NULL if MSysObjects could not be read.
+ */
+GPtrArray *mdb_read_catalog (MdbHandle *mdb, int objtype)
+{
+	MdbCatalogCache *cache;
+	MdbCatalogType *t;
+	unsigned int i;
+
+	if (!mdb) return NULL;
+	cache = mdbi_sync_catalog(mdb);
+	/* only the view goes: open tables still point at the entries */
+	mdbi_free_catalog_view(mdb);
+	if (!cache)
+		return NULL;
+
+	mdb->catalog = g_ptr_array_new();
+	mdb->catalog_view = mdb->catalog_copy;
+	mdb->catalog_view->refs++;
+	mdb->catalog_type = objtype;
+	if (objtype == MDB_ANY) {
+		for (i=0; i<cache->num_entries; i++)
+			g_ptr_array_add(mdb->catalog, &mdb->catalog_all[i]);
+	} else if ((t = mdbi_catalog_type(cache, objtype))) {
+		for (i=0; i<t->entries->len; i++) {
+			MdbCatalogEntry *entry = g_ptr_array_index(t->entries, i);
+			g_ptr_array_add(mdb->catalog, &mdb->catalog_all[entry - cache->entries]);
+		}
+	}
+	mdb->num_catalog = mdb->catalog->len;
+
+	return mdb->catalog;
+}
+
+
+/**
+ * mdb_get_catalogentry_by_name:
+ * @mdb: Handle to open MDB database file
+ * @name: object name, compared case-insensitively
+ *
+ * Looks @name up among the object types last listed by mdb_read_catalog().
+ *
+ * Returns: the catalog entry, or NULL if there is no such object.
+ */
+MdbCatalogEntry *
+mdb_get_catalogentry_by_name(MdbHandle *mdb, const gchar* name)
+{
+	if (!mdb->catalog)
+		return NULL;
+	return mdbi_find_catalog_entry(mdb, name, mdb->catalog_type);
+}
+
+/**
+ * mdb_get_catalogentry_by_name_and_type:
+ * @mdb: Handle to open MDB database file
+ * @name: object name, compared case-insensitively
+ * @objtype: object type, or MDB_ANY
+ *
+ * Looks @name up in the file's catalog, loading it if needed.  Unlike
+ * mdb_read_catalog() this leaves mdb->catalog alone, so the entry is only
+ * good until a catalog lookup notices that the file has changed, unless a
+ * table is read from it.
+ *
+ * Returns: the catalog entry, or NULL if there is no such object.
+ */
+MdbCatalogEntry *
+mdb_get_catalogentry_by_name_and_type(MdbHandle *mdb, const gchar *name, int objtype)
+{
+	if (!mdb) return NULL;
+	return mdbi_find_catalog_entry(mdb, name, objtype);
+}
+
 void 
 mdb_dump_catalog(MdbHandle *mdb, int obj_type)
 {
@@ -0,0 +1,1035 @@
+/* MDB Tools - A library for reading MS Access database files
+ * Copyright (C) 2000 Brian Bruns
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "mdbtools.h"
+#include "mdbprivate.h"
+
+/*
+ * Compaction of a table in place, in a file opened for writing.  The live
+ * rows are read into memory, put in primary key order, and packed into as
+ * few of the table's data pages as they fit in; the rest of its pages are
+ * emptied and dropped from its usage map.  Each index is then built again
+ * from its entries, sorted, a level at a time from the leaves up, into the
+ * pages it already has.  Everything is worked out before the first page
+ * is written, so a table that can't be compacted is left as it was.
+ *
+ * Pages are only ever reused, so the file doesn't get any smaller.  Data
+ * pages a table gives up are marked free in the global usage map, where
+ * the next page allocation can find them; index pages stay with their
+ * index, as empty leaves.
+ */
+
+#define MDB_COMPACT_MAX_ROWS 255 /* rows on a data page, the row byte of a pg_row */
+
+typedef struct {
+	guint32 pg_row;     /* where the row is */
+	guint32 new_pg_row; /* where it goes */
+	size_t start;       /* into MdbCompact.data */
+	size_t len;
+	gboolean placed;
+} MdbCompactRow;
+
+typedef struct {
+	MdbTableDef *table;
+	guint32 *pages;      /* data pages, in page order */
+	unsigned int num_pages;
+	guint32 *other_pages; /* pages in the usage map that aren't */
+	unsigned int num_other_pages;
+	MdbCompactRow *rows; /* in pg_row order */
+	unsigned long num_rows;
+	unsigned char *data;
+	size_t data_len;
+	unsigned int *order; /* rows in the order they are written */
+	unsigned char **images; /* the data pages, as they are written */
+	unsigned int num_used; /* of pages */
+	gboolean release;    /* the pages after num_used go in the global map */
+} MdbCompact;
+
+typedef struct {
+	const unsigned char *key; /* into MdbCompactIndex.keys, once read */
+	size_t key_off;
+	size_t key_len;
+	guint32 pg_row;
+	guint32 child;            /* pages above the leaves */
+} MdbCompactEntry;
+
+typedef struct {
+	MdbIndex *idx;
+	MdbCompactEntry *entries;
+	unsigned int num_entries;
+	unsigned char *keys;
+	size_t keys_len;
+	guint32 *pool;            /* the pages the index has, in page order */
+	unsigned int num_pool;
+	unsigned char **images;   /* new contents of the pages of pool */
+	unsigned int num_used;
+} MdbCompactIndex;
+
+/* where the fields of an index page are */
+typedef struct {
+	int prev;
+	int next;
+	int tail;
+	int pref_len;
+	int mask;
+	int entries;
+} MdbIndexLayout;
+
+static void mdbi_index_layout(MdbHandle *mdb, MdbIndexLayout *l)
+{
+	if (IS_JET3(mdb)) {
+		l->prev = 0x08;
+		l->next = 0x0c;
+		l->tail = 0x10;
+		l->pref_len = 0x14;
+		l->mask = 0x16;
+		l->entries = 0xf8;
+	} else {
+		l->prev = 0x0c;
+		l->next = 0x10;
+		l->tail = 0x14;
+		l->pref_len = 0x18;
+		l->mask = 0x1b;
+		l->entries = 0x1e0;
+	}
+}
+
+static void mdbi_compact_free(MdbCompact *c)
+{
+	unsigned int i;
+
+	if (c->images)
+		for (i = 0; i < c->num_pages; i++)
+			g_free(c->images[i]);
+	g_free(c->images);
+	g_free(c->pages);
+	g_free(c->other_pages);
+	g_free(c->rows);
+	g_free(c->data);
+	g_free(c->order);
+}
+
+static void mdbi_compact_free_index(MdbCompactIndex *ci)
+{
+	unsigned int i;
+
+	if (ci->images)
+		for (i = 0; i < ci->num_pool; i++)
+			g_free(ci->images[i]);
+	g_free(ci->images);
+	g_free(ci->entries);
+	g_free(ci->keys);
+	g_free(ci->pool);
+}
+
+static guint32 *mdbi_add_page(guint32 *pages, unsigned int *num_pages, guint32 pg)
+{
+	if ((*num_pages & (*num_pages - 1)) == 0)
+		pages = g_realloc(pages, (*num_pages ? 2 * *num_pages : 1) * sizeof(guint32));
+	pages[(*num_pages)++] = pg;
+	return pages;
+}
+
+/* Index of @pg in @pages, in page order, or -1 */
+static long mdbi_find_page(const guint32 *pages, unsigned int num_pages, guint32 pg)
+{
+	unsigned int lo = 0, hi = num_pages;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (pages[mid] == pg)
+			return mid;
+		if (pages[mid] < pg)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return -1;
+}
+
+static int mdbi_page_cmp(const void *a, const void *b)
+{
+	guint32 x = *(const guint32 *)a, y = *(const guint32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Index into c->rows of the row at @pg_row, or -1 */
+static long mdbi_compact_find_row(MdbCompact *c, guint32 pg_row)
+{
+	unsigned long lo = 0, hi = c->num_rows;
+
+	while (lo < hi) {
+		unsigned long mid = lo + (hi - lo) / 2;
+
+		if (c->rows[mid].pg_row == pg_row)
+			return mid;
+		if (c->rows[mid].pg_row < pg_row)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return -1;
+}
+
+/*
+ * Checks that the MEMO and OLE values of a row, cracked into @fields,
+ * don't keep their LVAL rows on data pages of the table, where they would
+ * be taken for rows and moved.
+ */
+static int mdbi_compact_check_lvals(MdbCompact *c, MdbField *fields, int num_fields)
+{
+	MdbTableDef *table = c->table;
+	MdbHandle *mdb = table->entry->mdb;
+	MdbColumn *col;
+	guint32 header, pg_row;
+	void *buf;
+	int i, off, links;
+	size_t len;
+
+	for (i = 0; i < num_fields; i++) {
+		col = g_ptr_array_index(table->columns, fields[i].colnum);
+		if (col->col_type != MDB_MEMO && col->col_type != MDB_OLE)
+			continue;
+		if (fields[i].is_null || fields[i].siz < MDB_MEMO_OVERHEAD)
+			continue;
+		header = mdb_get_int32(fields[i].value, 0);
+		if (header & 0x80000000)
+			continue; /* inline */
+		pg_row = mdb_get_int32(fields[i].value, 4);
+		for (links = 0; pg_row && links < 10000; links++) {
+			if (mdbi_find_page(c->pages, c->num_pages, pg_row >> 8) != -1) {
+				fprintf(stderr, "%s: column %s has LVAL data on page %u, one of the table's data pages\n",
+					table->name, col->name, pg_row >> 8);
+				return -1;
+			}
+			if (header & 0x40000000)
+				break; /* a single LVAL row */
+			if (mdb_find_pg_row(mdb, pg_row, &buf, &off, &len) || len < 4)
+				break;
+			pg_row = mdb_get_int32(buf, off);
+		}
+	}
+	return 0;
+}
+
+/* Reads the live rows of the table into c->rows and c->data */
+static int mdbi_compact_read_rows(MdbCompact *c)
+{
+	MdbTableDef *table = c->table;
+	MdbHandle *mdb = table->entry->mdb;
+	MdbField *fields;
+	unsigned int i, j, num_rows;
+	unsigned long rows_size = 0;
+	size_t data_size = 0;
+	guint32 cur = 0;
+	gint32 pg;
+	int row_start, num_fields;
+	size_t row_size;
+
+	if (!table->usage_map || table->map_sz < 1
+	 || (table->usage_map[0] != 0 && table->usage_map[0] != 1)) {
+		fprintf(stderr, "%s: unknown usage map type\n", table->name);
+		return -1;
+	}
+	while ((pg = mdb_map_find_next(mdb, table->usage_map, table->map_sz, cur)) > 0) {
+		if ((guint32)pg <= cur)
+			break;
+		cur = pg;
+		if (!mdb_read_pg(mdb, pg)) {
+			fprintf(stderr, "%s: reading page %u failed\n", table->name, cur);
+			return -1;
+		}
+		if (mdb->pg_buf[0] == MDB_PAGE_DATA && mdb_get_int32(mdb->pg_buf, 4) == (long)table->entry->table_pg)
+			c->pages = mdbi_add_page(c->pages, &c->num_pages, cur);
+		else
+			c->other_pages = mdbi_add_page(c->other_pages, &c->num_other_pages, cur);
+	}
+	if (pg < 0) {
+		fprintf(stderr, "%s: can't read the usage map\n", table->name);
+		return -1;
+	}
+
+	fields = g_malloc(table->num_cols * sizeof(MdbField));
+	for (i = 0; i < c->num_pages; i++) {
+		if (!mdb_read_pg(mdb, c->pages[i])) {
+			fprintf(stderr, "%s: reading page %u failed\n", table->name, c->pages[i]);
+			g_free(fields);
+			return -1;
+		}
+		num_rows = mdb_get_int16(mdb->pg_buf, mdb->fmt->row_count_offset);
+		for (j = 0; j < num_rows; j++) {
+			if (mdb_find_row(mdb, j, &row_start, &row_size) == -1) {
+				fprintf(stderr, "%s: bad row %u on page %u\n", table->name, j, c->pages[i]);
+				g_free(fields);
+				return -1;
+			}
+			if (row_size == 0 || (row_start & 0x4000))
+				continue; /* deleted */
+			if (row_start & 0x8000) {
+				fprintf(stderr, "%s: row %u on page %u has been moved to another page\n",
+					table->name, j, c->pages[i]);
+				g_free(fields);
+				return -1;
+			}
+			row_start &= OFFSET_MASK;
+			num_fields = mdb_crack_row(table, row_start, row_size, fields);
+			if (num_fields > 0 && mdbi_compact_check_lvals(c, fields, num_fields) == -1) {
+				g_free(fields);
+				return -1;
+			}
+			if (c->num_rows == rows_size) {
+				rows_size = rows_size ? 2 * rows_size : 256;
+				c->rows = g_realloc(c->rows, rows_size * sizeof(MdbCompactRow));
+			}
+			while (c->data_len + row_size > data_size) {
+				data_size = data_size ? 2 * data_size : 65536;
+				c->data = g_realloc(c->data, data_size);
+			}
+			memcpy(c->data + c->data_len, mdb->pg_buf + row_start, row_size);
+			c->rows[c->num_rows].pg_row = (c->pages[i] << 8) | j;
+			c->rows[c->num_rows].new_pg_row = 0;
+			c->rows[c->num_rows].start = c->data_len;
+			c->rows[c->num_rows].len = row_size;
+			c->rows[c->num_rows].placed = FALSE;
+			c->num_rows++;
+			c->data_len += row_size;
+		}
+	}
+	g_free(fields);
+	return 0;
+}
+
+/* Appends an entry of @len bytes, key and pg_row, to ci->entries */
+static void mdbi_compact_add_entry(MdbCompactIndex *ci, const unsigned char *entry, size_t len)
+{
+	if ((ci->num_entries & (ci->num_entries - 1)) == 0)
+		ci->entries = g_realloc(ci->entries,
+			(ci->num_entries ? 2 * ci->num_entries : 1) * sizeof(MdbCompactEntry));
+	if ((ci->keys_len + len) / 65536 != ci->keys_len / 65536 || !ci->keys)
+		ci->keys = g_realloc(ci->keys, ((ci->keys_len + len) / 65536 + 1) * 65536);
+	memcpy(ci->keys + ci->keys_len, entry, len - 4);
+	ci->entries[ci->num_entries].key = NULL;
+	ci->entries[ci->num_entries].key_off = ci->keys_len;
+	ci->entries[ci->num_entries].key_len = len - 4;
+	ci->entries[ci->num_entries].pg_row = mdb_get_int32_msb((void *)entry, len - 4);
+	ci->entries[ci->num_entries].child = 0;
+	ci->num_entries++;
+	ci->keys_len += len - 4;
+}
+
+/*
+ * Reads the index page @pg and the pages below it, adding the pages to
+ * ci->pool and the entries of the leaves to ci->entries.
+ */
+static int mdbi_compact_read_index_pg(MdbCompactIndex *ci, guint32 pg, int depth)
+{
+	MdbTableDef *table = ci->idx->table;
+	MdbHandle *mdb = table->entry->mdb;
+	MdbIndexLayout l;
+	unsigned char *buf, *entry;
+	size_t first_len = 0, len, pref_len;
+	guint32 tail;
+	int leaf, tail_len, start, end, ret = 0;
+	unsigned int i;
+
+	if (depth >= MDB_MAX_INDEX_DEPTH) {
+		fprintf(stderr, "%s: index %s is more than %d levels deep\n",
+			table->name, ci->idx->name, MDB_MAX_INDEX_DEPTH);
+		return -1;
+	}
+	for (i = 0; i < ci->num_pool; i++) {
+		if (ci->pool[i] == pg) {
+			fprintf(stderr, "%s: index %s has a loop at page %u\n",
+				table->name, ci->idx->name, pg);
+			return -1;
+		}
+	}
+	if (!mdb_read_pg(mdb, pg)) {
+		fprintf(stderr, "%s: reading page %u failed\n", table->name, pg);
+		return -1;
+	}
+	if ((mdb->pg_buf[0] != MDB_PAGE_INDEX && mdb->pg_buf[0] != MDB_PAGE_LEAF)
+	 || mdb_get_int32(mdb->pg_buf, 4) != (long)table->entry->table_pg) {
+		fprintf(stderr, "%s: page %u of index %s isn't an index page of the table\n",
+			table->name, pg, ci->idx->name);
+		return -1;
+	}
+	ci->pool = mdbi_add_page(ci->pool, &ci->num_pool, pg);
+
+	/* the page buffer is needed again for the pages below this one */
+	buf = g_memdup2(mdb->pg_buf, mdb->fmt->pg_size);
+	entry = g_malloc(mdb->fmt->pg_size);
+	mdbi_index_layout(mdb, &l);
+	leaf = buf[0] == MDB_PAGE_LEAF;
+	tail_len = leaf ? 4 : 8;
+	pref_len = mdb_get_int16(buf, l.pref_len);
+	tail = leaf ? 0 : mdb_get_int32(buf, l.tail);
+
+	/* a bit is set in the mask at the end of each entry */
+	for (start = end = l.entries; ret == 0 && end < mdb->fmt->pg_size; ) {
+		end++;
+		if (!(buf[l.mask + (end - l.entries) / 8] & (1 << ((end - l.entries) % 8))))
+			continue;
+		if (start == l.entries) {
+			first_len = len = end - start;
+			memcpy(entry, buf + start, len);
+		} else if (pref_len > first_len) {
+			len = 0;
+		} else {
+			/* the first pref_len bytes are those of the first entry */
+			len = pref_len + end - start;
+			memcpy(entry + pref_len, buf + start, end - start);
+		}
+		start = end;
+		if (len <= (size_t)tail_len) {
+			fprintf(stderr, "%s: bad entry on page %u of index %s\n",
+				table->name, pg, ci->idx->name);
+			ret = -1;
+		} else if (leaf) {
+			mdbi_compact_add_entry(ci, entry, len);
+		} else {
+			ret = mdbi_compact_read_index_pg(ci,
+				mdb_get_int32_msb(entry, len - 4), depth + 1);
+		}
+	}
+	if (ret == 0 && tail)
+		ret = mdbi_compact_read_index_pg(ci, tail, depth + 1);
+	g_free(entry);
+	g_free(buf);
+	return ret;
+}
+
+static int mdbi_entry_cmp(const void *a, const void *b)
+{
+	const MdbCompactEntry *x = a, *y = b;
+	int cmp = memcmp(x->key, y->key, x->key_len < y->key_len ? x->key_len : y->key_len);
+
+	if (cmp)
+		return cmp;
+	if (x->key_len != y->key_len)
+		return x->key_len < y->key_len ? -1 : 1;
+	return x->pg_row < y->pg_row ? -1 : x->pg_row > y->pg_row;
+}
+
+/* Reads the entries of an index, sorted */
+static int mdbi_compact_read_index(MdbCompactIndex *ci, MdbIndex *idx)
+{
+	unsigned int i;
+
+	ci->idx = idx;
+	if (mdbi_compact_read_index_pg(ci, idx->first_pg, 0) == -1)
+		return -1;
+	for (i = 0; i < ci->num_entries; i++)
+		ci->entries[i].key = ci->keys + ci->entries[i].key_off;
+	qsort(ci->entries, ci->num_entries, sizeof(MdbCompactEntry), mdbi_entry_cmp);
+	qsort(ci->pool, ci->num_pool, sizeof(guint32), mdbi_page_cmp);
+	return 0;
+}
+
+/*
+ * Puts the rows in the order of the primary key, if the table has one.
+ * Rows the index doesn't have, which it should, go last.
+ */
+static int mdbi_compact_order_rows(MdbCompact *c)
+{
+	MdbTableDef *table = c->table;
+	MdbCompactIndex ci;
+	MdbIndex *idx, *pk = NULL;
+	unsigned long n = 0, i;
+	long row;
+
+	c->order = g_malloc((c->num_rows ? c->num_rows : 1) * sizeof(unsigned int));
+	for (i = 0; table->indices && i < table->num_idxs; i++) {
+		idx = g_ptr_array_index(table->indices, i);
+		if (idx->index_type == 1 && idx->first_pg) {
+			pk = idx;
+			break;
+		}
+	}
+	if (pk) {
+		memset(&ci, 0, sizeof(ci));
+		if (mdbi_compact_read_index(&ci, pk) == -1) {
+			mdbi_compact_free_index(&ci);
+			return -1;
+		}
+		for (i = 0; i < ci.num_entries; i++) {
+			row = mdbi_compact_find_row(c, ci.entries[i].pg_row);
+			if (row == -1 || c->rows[row].placed)
+				continue;
+			c->rows[row].placed = TRUE;
+			c->order[n++] = row;
+		}
+		mdbi_compact_free_index(&ci);
+	}
+	for (i = 0; i < c->num_rows; i++)
+		if (!c->rows[i].placed)
+			c->order[n++] = i;
+	return 0;
+}
+
+/* Lays the rows out on as few pages as they fit on, in order */
+static int mdbi_compact_pack_rows(MdbCompact *c)
+{
+	MdbTableDef *table = c->table;
+	MdbHandle *mdb = table->entry->mdb;
+	MdbFormatConstants *fmt = mdb->fmt;
+	unsigned char *pg = NULL;
+	MdbCompactRow *row;
+	unsigned int num_rows = 0;
+	size_t pos = 0;
+	unsigned long i;
+
+	c->images = g_malloc0((c->num_pages ? c->num_pages : 1) * sizeof(unsigned char *));
+	for (i = 0; i < c->num_rows; i++) {
+		row = &c->rows[c->order[i]];
+		if (pg && (num_rows == MDB_COMPACT_MAX_ROWS
+		 || pos < fmt->row_count_offset + 2 + 2 * (num_rows + 1) + row->len))
+			pg = NULL;
+		if (!pg) {
+			if (c->num_used == c->num_pages) {
+				fprintf(stderr, "%s: the rows don't fit in the pages the table has\n", table->name);
+				return -1;
+			}
+			pg = c->images[c->num_used++] = mdb_new_data_pg(table->entry);
+			num_rows = 0;
+			pos = fmt->pg_size;
+		}
+		pos -= row->len;
+		memcpy(pg + pos, c->data + row->start, row->len);
+		mdb_put_int16(pg, fmt->row_count_offset + 2 + 2 * num_rows, pos);
+		row->new_pg_row = (c->pages[c->num_used - 1] << 8) | num_rows;
+		num_rows++;
+		mdb_put_int16(pg, fmt->row_count_offset, num_rows);
+		mdb_put_int16(pg, 2, pos - fmt->row_count_offset - 2 - 2 * num_rows);
+	}
+	/* the pages left over are emptied */
+	for (i = c->num_used; i < c->num_pages; i++)
+		c->images[i] = mdb_new_data_pg(table->entry);
+	return 0;
+}
+
+/*
+ * Splits @num_entries entries into pages, as many to a page as fit.
+ * @tail_len is the size of an entry after its key.  The page each entry
+ * goes on is put in @page.  Returns the number of pages.
+ */
+static unsigned int mdbi_compact_split(MdbHandle *mdb, MdbCompactEntry *entries,
+	unsigned int num_entries, int tail_len, unsigned int *page)
+{
+	MdbIndexLayout l;
+	unsigned int i, first = 0, num_pages = 0;
+	size_t room, total = 0, pref_len = 0, len, p;
+
+	mdbi_index_layout(mdb, &l);
+	room = mdb->fmt->pg_size - l.entries;
+	for (i = 0; i < num_entries; i++) {
+		len = entries[i].key_len + tail_len;
+		if (num_pages) {
+			for (p = 0; p < pref_len && p < entries[i].key_len
+					&& entries[first].key[p] == entries[i].key[p]; p++)
+				;
+			if (total + len - (i - first) * p <= room) {
+				total += len;
+				pref_len = p;
+				page[i] = num_pages - 1;
+				continue;
+			}
+		}
+		/* a new page, whose first entry is written in full */
+		first = i;
+		total = len;
+		pref_len = entries[i].key_len;
+		page[i] = num_pages++;
+	}
+	return num_pages;
+}
+
+/*
+ * Writes the entries of one index page into @pg.  The first pref_len
+ * bytes of each entry after the first are left out, being the same as
+ * those of the first.
+ */
+static void mdbi_compact_fill_index_pg(MdbTableDef *table, unsigned char *pg, int leaf,
+	MdbCompactEntry *entries, unsigned int num_entries, guint32 prev, guint32 next)
+{
+	MdbHandle *mdb = table->entry->mdb;
+	MdbIndexLayout l;
+	size_t pref_len = num_entries ? entries[0].key_len : 0, p;
+	unsigned int i;
+	int pos;
+
+	mdbi_index_layout(mdb, &l);
+	for (i = 1; i < num_entries; i++) {
+		for (p = 0; p < pref_len && p < entries[i].key_len
+				&& entries[0].key[p] == entries[i].key[p]; p++)
+			;
+		pref_len = p;
+	}
+	memset(pg, 0, mdb->fmt->pg_size);
+	pg[0] = leaf ? MDB_PAGE_LEAF : MDB_PAGE_INDEX;
+	pg[1] = 0x01;
+	mdb_put_int32(pg, 4, table->entry->table_pg);
+	mdb_put_int32(pg, l.prev, prev);
+	mdb_put_int32(pg, l.next, next);
+	mdb_put_int16(pg, l.pref_len, num_entries > 1 ? pref_len : 0);
+	pos = l.entries;
+	for (i = 0; i < num_entries; i++) {
+		p = i ? pref_len : 0;
+		memcpy(pg + pos, entries[i].key + p, entries[i].key_len - p);
+		pos += entries[i].key_len - p;
+		mdb_put_int32_msb(pg, pos, entries[i].pg_row);
+		pos += 4;
+		if (!leaf) {
+			mdb_put_int32_msb(pg, pos, entries[i].child);
+			pos += 4;
+		}
+		pg[l.mask + (pos - l.entries) / 8] |= 1 << ((pos - l.entries) % 8);
+	}
+	mdb_put_int16(pg, 2, mdb->fmt->pg_size - pos);
+}
+
+/*
+ * Builds an index again from its entries, into ci->images: the leaves
+ * first, then each level above from the last entries of the pages below,
+ * until one page holds them all.  That one goes on the first page of the
+ * index, where the search starts, and the others on the rest of its pages
+ * in order.
+ */
+static int mdbi_compact_build_index(MdbCompactIndex *ci)
+{
+	MdbTableDef *table = ci->idx->table;
+	MdbHandle *mdb = table->entry->mdb;
+	MdbCompactEntry *levels[MDB_MAX_INDEX_DEPTH];
+	unsigned int *pages[MDB_MAX_INDEX_DEPTH];
+	unsigned int num_entries[MDB_MAX_INDEX_DEPTH];
+	unsigned int num_pages[MDB_MAX_INDEX_DEPTH];
+	unsigned int first_pg[MDB_MAX_INDEX_DEPTH];
+	unsigned int depth = 0, d, i, j, n, total = 0, root = 0;
+	int ret = 0;
+
+	levels[0] = ci->entries;
+	num_entries[0] = ci->num_entries;
+	for (;;) {
+		pages[depth] = g_malloc((num_entries[depth] ? num_entries[depth] : 1) * sizeof(unsigned int));
+		num_pages[depth] = num_entries[depth] ?
+			mdbi_compact_split(mdb, levels[depth], num_entries[depth], depth ? 8 : 4, pages[depth]) : 1;
+		first_pg[depth] = total;
+		total += num_pages[depth];
+		if (num_pages[depth] == 1)
+			break;
+		if (depth + 1 == MDB_MAX_INDEX_DEPTH) {
+			fprintf(stderr, "%s: index %s would be more than %d levels deep\n",
+				table->name, ci->idx->name, MDB_MAX_INDEX_DEPTH);
+			ret = -1;
+			depth++;
+			break;
+		}
+		/* the last entry of each page, pointing to it */
+		levels[depth + 1] = g_malloc(num_pages[depth] * sizeof(MdbCompactEntry));
+		for (i = 0; i < num_entries[depth]; i++)
+			if (i + 1 == num_entries[depth] || pages[depth][i + 1] != pages[depth][i])
+				levels[depth + 1][pages[depth][i]] = levels[depth][i];
+		num_entries[depth + 1] = num_pages[depth];
+		depth++;
+	}
+	if (ret == 0 && total > ci->num_pool) {
+		fprintf(stderr, "%s: index %s needs %u pages, and has %u\n",
+			table->name, ci->idx->name, total, ci->num_pool);
+		ret = -1;
+	}
+	if (ret == 0) {
+		/* the top page goes on the first page of the index, the
+		 * others on the rest, lowest first */
+		guint32 *pool = g_malloc(ci->num_pool * sizeof(guint32));
+
+		for (i = 0, n = 0; i < ci->num_pool; i++)
+			if (ci->pool[i] != ci->idx->first_pg)
+				pool[n++] = ci->pool[i];
+		root = total - 1;
+		for (d = 0; d < depth; d++)
+			for (i = 0; i < num_entries[d + 1]; i++)
+				levels[d + 1][i].child = pool[first_pg[d] + i];
+		ci->images = g_malloc0(ci->num_pool * sizeof(unsigned char *));
+		for (d = 0; d <= depth; d++) {
+			for (j = 0, i = 0; j < num_pages[d]; j++) {
+				unsigned int k = first_pg[d] + j, start = i;
+				guint32 prev = 0, next = 0;
+
+				while (i < num_entries[d] && pages[d][i] == j)
+					i++;
+				if (k != root) {
+					prev = j ? pool[k - 1] : 0;
+					next = j + 1 < num_pages[d] ? pool[k + 1] : 0;
+				}
+				/* images are in the order of ci->pool */
+				n = mdbi_find_page(ci->pool, ci->num_pool,
+					k == root ? ci->idx->first_pg : pool[k]);
+				ci->images[n] = g_malloc(mdb->fmt->pg_size);
+				mdbi_compact_fill_index_pg(table, ci->images[n], d == 0,
+					levels[d] + start, i - start, prev, next);
+			}
+		}
+		/* pages the index no longer needs are left as empty leaves */
+		for (n = 0; n < ci->num_pool; n++) {
+			if (ci->images[n])
+				continue;
+			ci->images[n] = g_malloc(mdb->fmt->pg_size);
+			mdbi_compact_fill_index_pg(table, ci->images[n], 1, NULL, 0, 0, 0);
+		}
+		ci->num_used = total;
+		g_free(pool);
+	}
+	for (d = 0; d <= depth && d < MDB_MAX_INDEX_DEPTH; d++) {
+		if (d)
+			g_free(levels[d]);
+		g_free(pages[d]);
+	}
+	return ret;
+}
+
+/* Reads an index and builds it again with the rows where they now are */
+static int mdbi_compact_index(MdbCompact *c, MdbCompactIndex *ci, MdbIndex *idx)
+{
+	unsigned int i, n = 0;
+	long row;
+
+	if (mdbi_compact_read_index(ci, idx) == -1)
+		return -1;
+	for (i = 0; i < ci->num_entries; i++) {
+		if ((row = mdbi_compact_find_row(c, ci->entries[i].pg_row)) == -1)
+			continue; /* a row that is gone */
+		ci->entries[n] = ci->entries[i];
+		ci->entries[n++].pg_row = c->rows[row].new_pg_row;
+	}
+	ci->num_entries = n;
+	qsort(ci->entries, ci->num_entries, sizeof(MdbCompactEntry), mdbi_entry_cmp);
+	return mdbi_compact_build_index(ci);
+}
+
+/* Writes @image as page @pg */
+static int mdbi_compact_write_pg(MdbHandle *mdb, guint32 pg, const unsigned char *image)
+{
+	memcpy(mdb->pg_buf, image, mdb->fmt->pg_size);
+	/* the page buffer now holds @pg, as mdb_read_pg() would leave it */
+	mdb->cur_pg = pg;
+	if (!mdb_write_pg(mdb, pg)) {
+		fprintf(stderr, "writing page %u failed\n", pg);
+		mdb->cur_pg = 0;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Goes through the bits of the global usage map, row 0 of page 1, for the
+ * data pages the table gives up: those after c->num_used.  A bit is set
+ * there for each free page of the file.  Without @release, checks that the
+ * map covers every one of these pages and has it in use; with it, marks
+ * them all free.
+ */
+static int mdbi_compact_global_map(MdbCompact *c, gboolean release)
+{
+	MdbHandle *mdb = c->table->entry->mdb;
+	unsigned char *map, *row, *bits;
+	guint32 start_pg, bitlen, map_pg, off;
+	int row_start, ret = 0;
+	size_t map_sz;
+	unsigned int i, j, k;
+
+	if (c->num_used == c->num_pages)
+		return 0;
+	if (!mdb_read_pg(mdb, 1) || mdb->pg_buf[0] != MDB_PAGE_DATA
+	 || mdb_find_row(mdb, 0, &row_start, &map_sz) == -1 || map_sz < 5)
+		return -1;
+	map = mdb->pg_buf + (row_start & OFFSET_MASK);
+	if (map[0] == 0) {
+		start_pg = mdb_get_int32(map, 1);
+		bitlen = (map_sz - 5) * 8;
+		for (i = c->num_used; i < c->num_pages; i++) {
+			if (c->pages[i] < start_pg || c->pages[i] - start_pg >= bitlen)
+				return -1;
+			off = c->pages[i] - start_pg;
+			bits = map + 5 + off / 8;
+			if (release)
+				*bits |= 1 << (off % 8);
+			else if (*bits & (1 << (off % 8)))
+				return -1;
+		}
+		return release && !mdb_write_pg(mdb, 1) ? -1 : 0;
+	} else if (map[0] != 1) {
+		return -1;
+	}
+
+	/* the map pages it points to have to be read into the page buffer */
+	row = g_memdup2(map, map_sz);
+	bitlen = (mdb->fmt->pg_size - 4) * 8;
+	for (i = c->num_used; ret == 0 && i < c->num_pages; i = j) {
+		k = c->pages[i] / bitlen;
+		if (1 + 4 * (k + 1) > map_sz || !(map_pg = mdb_get_int32(row, 1 + 4 * k))
+		 || !mdb_read_pg(mdb, map_pg) || mdb->pg_buf[0] != MDB_PAGE_MAP) {
+			ret = -1;
+			break;
+		}
+		/* the pages are in page order, so those of one map page are together */
+		for (j = i; ret == 0 && j < c->num_pages && c->pages[j] / bitlen == k; j++) {
+			off = c->pages[j] % bitlen;
+			bits = mdb->pg_buf + 4 + off / 8;
+			if (release)
+				*bits |= 1 << (off % 8);
+			else if (*bits & (1 << (off % 8)))
+				ret = -1;
+		}
+		if (ret == 0 && release && !mdb_write_pg(mdb, map_pg))
+			ret = -1;
+	}
+	g_free(row);
+	return ret;
+}
+
+/*
+ * Rewrites the usage map at @pg_row to hold @pages, and those of
+ * @other_pages, both in page order.  The map is replaced row for row,
+ * with the same size and type, so pages it can't hold are left out.
+ */
+static int mdbi_compact_write_map(MdbHandle *mdb, guint32 pg_row,
+	const guint32 *pages, unsigned int num_pages,
+	const guint32 *other_pages, unsigned int num_other_pages)
+{
+	unsigned char *map;
+	guint32 start_pg, bitlen, map_pg, pg;
+	int row_start;
+	size_t map_sz;
+	unsigned int i, j, k;
+
+	if (!mdb_read_pg(mdb, pg_row >> 8) || mdb_find_row(mdb, pg_row & 0xff, &row_start, &map_sz) == -1
+	 || map_sz < 1) {
+		fprintf(stderr, "can't find the usage map at page %u row %u\n", pg_row >> 8, pg_row & 0xff);
+		return -1;
+	}
+	map = mdb->pg_buf + (row_start & OFFSET_MASK);
+	if (map[0] == 0) {
+		if (map_sz < 5)
+			return -1;
+		start_pg = mdb_get_int32(map, 1);
+		bitlen = (map_sz - 5) * 8;
+		memset(map + 5, 0, map_sz - 5);
+		for (k = 0; k < 2; k++) {
+			const guint32 *list = k ? other_pages : pages;
+
+			for (i = 0; i < (k ? num_other_pages : num_pages); i++)
+				if (list[i] >= start_pg && list[i] - start_pg < bitlen)
+					map[5 + (list[i] - start_pg) / 8] |= 1 << ((list[i] - start_pg) % 8);
+		}
+		return mdb_write_pg(mdb, mdb->cur_pg) ? 0 : -1;
+	} else if (map[0] == 1) {
+		/* the map pages it points to have to be read into the page buffer */
+		unsigned char *row = g_memdup2(map, map_sz);
+
+		bitlen = (mdb->fmt->pg_size - 4) * 8;
+		for (j = 0; 1 + 4 * (j + 1) <= map_sz; j++) {
+			map_pg = mdb_get_int32(row, 1 + 4 * j);
+			if (!map_pg)
+				continue;
+			if (!mdb_read_pg(mdb, map_pg) || mdb->pg_buf[0] != MDB_PAGE_MAP) {
+				fprintf(stderr, "page %u isn't a usage map page\n", map_pg);
+				g_free(row);
+				return -1;
+			}
+			memset(mdb->pg_buf + 4, 0, mdb->fmt->pg_size - 4);
+			for (k = 0; k < 2; k++) {
+				const guint32 *list = k ? other_pages : pages;
+
+				for (i = 0; i < (k ? num_other_pages : num_pages); i++) {
+					pg = list[i];
+					if (pg / bitlen == j)
+						mdb->pg_buf[4 + (pg % bitlen) / 8] |= 1 << (pg % 8);
+				}
+			}
+			if (!mdb_write_pg(mdb, map_pg)) {
+				g_free(row);
+				return -1;
+			}
+		}
+		g_free(row);
+		return 0;
+	}
+	fprintf(stderr, "unknown usage map type %d\n", map[0]);
+	return -1;
+}
+
+/*
+ * Writes the compacted table: its data pages, usage maps, indexes, and
+ * row counts, and gives the pages it no longer needs back to the file.
+ */
+static int mdbi_compact_write(MdbCompact *c, MdbCompactIndex *indexes, unsigned int num_indexes)
+{
+	MdbTableDef *table = c->table;
+	MdbHandle *mdb = table->entry->mdb;
+	MdbFormatConstants *fmt = mdb->fmt;
+	guint32 usage_pg_row, free_pg_row, last;
+	unsigned int i, j, off;
+
+	for (i = 0; i < c->num_pages; i++) {
+		/* a free page is all zeros */
+		if (i >= c->num_used && c->release)
+			memset(c->images[i], 0, fmt->pg_size);
+		if (mdbi_compact_write_pg(mdb, c->pages[i], c->images[i]) == -1)
+			return -1;
+	}
+	for (i = 0; i < num_indexes; i++)
+		for (j = 0; j < indexes[i].num_pool; j++)
+			if (mdbi_compact_write_pg(mdb, indexes[i].pool[j], indexes[i].images[j]) == -1)
+				return -1;
+
+	if (!mdb_read_pg(mdb, table->entry->table_pg))
+		return -1;
+	usage_pg_row = mdb_get_int32(mdb->pg_buf, fmt->tab_usage_map_offset);
+	free_pg_row = mdb_get_int32(mdb->pg_buf, fmt->tab_free_map_offset);
+	mdb_put_int32(mdb->pg_buf, fmt->tab_num_rows_offset, c->num_rows);
+	/* the row count of an index follows 4 unknown bytes of its entry */
+	for (i = 0; i < num_indexes; i++) {
+		off = fmt->tab_cols_start_offset + indexes[i].idx->index_num * fmt->tab_ridx_entry_size + 4;
+		if ((unsigned int)indexes[i].idx->index_num < table->num_real_idxs && off + 4 <= fmt->pg_size)
+			mdb_put_int32(mdb->pg_buf, off, indexes[i].num_entries);
+	}
+	if (!mdb_write_pg(mdb, table->entry->table_pg))
+		return -1;
+	table->num_rows = c->num_rows;
+	for (i = 0; i < table->num_idxs; i++) {
+		MdbIndex *idx = g_ptr_array_index(table->indices, i);
+
+		for (j = 0; j < num_indexes; j++)
+			if (idx->index_type != 2 && idx->index_num == indexes[j].idx->index_num)
+				idx->num_rows = indexes[j].num_entries;
+	}
+
+	if (mdbi_compact_write_map(mdb, usage_pg_row, c->pages, c->num_used,
+			c->other_pages, c->num_other_pages) == -1)
+		return -1;
+	/* only the last page has room to spare */
+	last = c->num_used ? c->pages[c->num_used - 1] : 0;
+	if (table->free_usage_map && mdbi_compact_write_map(mdb, free_pg_row, &last,
+			last && mdb_get_int16(c->images[c->num_used - 1], 2) > 0, NULL, 0) == -1)
+		return -1;
+	if (c->release && mdbi_compact_global_map(c, TRUE) == -1)
+		return -1;
+
+	/* read the maps again, for scans of the table from here on */
+	g_free(table->usage_map);
+	g_free(table->free_usage_map);
+	table->usage_map = table->free_usage_map = NULL;
+	table->map_sz = table->freemap_sz = 0;
+	{
+		void *buf;
+		int row_start;
+
+		if (mdb_find_pg_row(mdb, usage_pg_row, &buf, &row_start, &table->map_sz) == 0)
+			table->usage_map = g_memdup2((char *)buf + row_start, table->map_sz);
+		if (mdb_find_pg_row(mdb, free_pg_row, &buf, &row_start, &table->freemap_sz) == 0)
+			table->free_usage_map = g_memdup2((char *)buf + row_start, table->freemap_sz);
+	}
+	return 0;
+}
+
+/**
+ * mdb_compact_table:
+ * @table: table of a file opened with MDB_WRITABLE, with its columns and
+ * indices read
+ * @stats: filled in with what was done, or NULL
+ *
+ * Packs the live rows of @table onto as few of its data pages as they fit
+ * on, in the order of its primary key, and builds its indexes again from
+ * the bottom up, updating their row counts.  The data pages the table no
+ * longer needs are dropped from its usage map and, if the global usage map
+ * covers them, marked free there; they stay in the file.  The rows and
+ * index entries of the table are held in memory while this is done.
+ *
+ * Tables whose rows aren't all where their pg_row says, or that have
+ * LVAL data on their own data pages, are left alone, as are the tables of
+ * Jet3 files.
+ *
+ * Returns: 0 if the table was compacted, 1 if it was left as it was (the
+ * reason is printed on stderr), -1 if writing it failed part way.
+ */
+int mdb_compact_table(MdbTableDef *table, MdbCompactStats *stats)
+{
+	MdbHandle *mdb = table->entry->mdb;
+	MdbCompact c;
+	MdbCompactIndex *indexes;
+	MdbIndex *idx;
+	unsigned int num_indexes = 0, i, j;
+	int ret = 1;
+
+	if (!mdb->f->writable) {
+		fprintf(stderr, "%s: file not opened for writing\n", table->name);
+		return 1;
+	}
+	if (table->is_temp_table) {
+		fprintf(stderr, "%s: temporary table\n", table->name);
+		return 1;
+	}
+	/* the Jet3 page layouts are here, but haven't been tried on real files */
+	if (IS_JET3(mdb)) {
+		fprintf(stderr, "%s: Jet3 files aren't supported\n", table->name);
+		return 1;
+	}
+	memset(&c, 0, sizeof(c));
+	c.table = table;
+	indexes = g_malloc0((table->num_idxs ? table->num_idxs : 1) * sizeof(MdbCompactIndex));
+
+	if (mdbi_compact_read_rows(&c) == -1 || mdbi_compact_order_rows(&c) == -1
+	 || mdbi_compact_pack_rows(&c) == -1)
+		goto done;
+	for (i = 0; table->indices && i < table->num_idxs; i++) {
+		idx = g_ptr_array_index(table->indices, i);
+		/* foreign key references have no pages of their own */
+		if (idx->index_type == 2 || !idx->first_pg)
+			continue;
+		/* logical indexes may share a physical one */
+		for (j = 0; j < num_indexes; j++)
+			if (indexes[j].idx->first_pg == idx->first_pg)
+				break;
+		if (j < num_indexes)
+			continue;
+		if (mdbi_compact_index(&c, &indexes[num_indexes++], idx) == -1)
+			goto done;
+	}
+	/* if the global map isn't as expected, the pages are only left empty */
+	c.release = mdbi_compact_global_map(&c, FALSE) == 0;
+
+	ret = mdbi_compact_write(&c, indexes, num_indexes) == -1 ? -1 : 0;
+	if (ret == 0 && stats) {
+		memset(stats, 0, sizeof(MdbCompactStats));
+		stats->rows = c.num_rows;
+		stats->data_pages_before = c.num_pages;
+		stats->data_pages_after = c.num_used;
+		stats->pages_freed = c.release ? c.num_pages - c.num_used : 0;
+		for (i = 0; i < num_indexes; i++) {
+			stats->index_pages_before += indexes[i].num_pool;
+			stats->index_pages_after += indexes[i].num_used;
+		}
+	}
+done:
+	for (i = 0; i < num_indexes; i++)
+		mdbi_compact_free_index(&indexes[i]);
+	g_free(indexes);
+	mdbi_compact_free(&c);
+	return ret;
+}
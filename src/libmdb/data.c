@@ -17,15 +17,20 @@
  */
 
 #include "mdbtools.h"
+#include "mdbprivate.h"
 
 #include <time.h>
+#include <sys/stat.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
-#define OFFSET_MASK 0x1fff
 #define OLE_BUFFER_SIZE (MDB_BIND_SIZE*64)
 
 static int _mdb_attempt_bind(MdbHandle *mdb, 
 	MdbColumn *col, unsigned char isnull, int offset, int len);
 static char *mdb_date_to_string(MdbHandle *mdb, const char *fmt, void *buf, int start);
+static char *mdb_memo_to_string(MdbHandle *mdb, int start, int size, int *truncated);
 #ifdef MDB_COPY_OLE
 static size_t mdb_copy_ole(MdbHandle *mdb, void *dest, int start, int size);
 #endif
@@ -147,6 +152,8 @@ mdb_bind_column_by_name(MdbTableDef *table, gchar *col_name, void *bind_ptr, int
  * 
  * Returns: 0 on success. -1 on failure.
  */
+static int mdbi_find_row_in(MdbHandle *mdb, void *pg_buf, int row, int *start, size_t *len);
+
 int mdb_find_pg_row(MdbHandle *mdb, int pg_row, void **buf, int *off, size_t *len)
 {
 	unsigned int pg = pg_row >> 8;
@@ -155,24 +162,27 @@ int mdb_find_pg_row(MdbHandle *mdb, int pg_row, void **buf, int *off, size_t *le
 
 	if (mdb_read_alt_pg(mdb, pg) != mdb->fmt->pg_size)
 		return -1;
-	mdb_swap_pgbuf(mdb);
-	result = mdb_find_row(mdb, row, off, len);
-	mdb_swap_pgbuf(mdb);
+	result = mdbi_find_row_in(mdb, mdb->alt_pg_buf, row, off, len);
     *off &= OFFSET_MASK;
 	*buf = mdb->alt_pg_buf;
 	return result;
 }
 
 int mdb_find_row(MdbHandle *mdb, int row, int *start, size_t *len)
+{
+	return mdbi_find_row_in(mdb, mdb->pg_buf, row, start, len);
+}
+
+static int mdbi_find_row_in(MdbHandle *mdb, void *pg_buf, int row, int *start, size_t *len)
 {
 	int rco = mdb->fmt->row_count_offset;
 	int next_start;
 
 	if (row > 1000) return -1;
 
-	*start = mdb_get_int16(mdb->pg_buf, rco + 2 + row*2);
+	*start = mdb_get_int16(pg_buf, rco + 2 + row*2);
 	next_start = (row == 0) ? mdb->fmt->pg_size :
-		mdb_get_int16(mdb->pg_buf, rco + row*2) & OFFSET_MASK;
+		mdb_get_int16(pg_buf, rco + row*2) & OFFSET_MASK;
 	*len = next_start - (*start & OFFSET_MASK);
 
 	if ((*start & OFFSET_MASK) >= mdb->fmt->pg_size ||
@@ -282,13 +292,16 @@ int ret;
 		col->cur_value_start = 0;
 		col->cur_value_len = 0;
 	}
+	col->bind_truncated = 0;
 	if (col->bind_ptr) {
 		if (!len) {
 			strcpy(col->bind_ptr, "");
 		} else {
 			//fprintf(stdout,"len %d size %d\n",len, col->col_size);
 			char *str;
-			if (col->col_type == MDB_NUMERIC) {
+			if (col->col_type == MDB_MEMO) {
+				str = mdb_memo_to_string(mdb, start, len, &col->bind_truncated);
+			} else if (col->col_type == MDB_NUMERIC) {
 				str = mdb_numeric_to_string(mdb, start, col->col_scale, col->col_prec);
 			} else if (col->col_type == MDB_DATETIME) {
 				if (mdb_col_is_shortdate(col)) {
@@ -299,6 +312,8 @@ int ret;
 			} else {
 				str = mdb_col_to_string(mdb, mdb->pg_buf, start, col->col_type, len);
 			}
+			if (strlen(str) >= mdb->bind_size)
+				col->bind_truncated = 1;
 			snprintf(col->bind_ptr, mdb->bind_size, "%s", str);
 			g_free(str);
 		}
@@ -376,6 +391,51 @@ int mdb_read_row(MdbTableDef *table, unsigned int row)
 
 	return 1;
 }
+/*
+ * Binds row @row of a temp table.  Only the row's values are copied to the
+ * page buffer, see worktable.c.
+ */
+static int mdbi_read_temp_row(MdbTableDef *table, unsigned int row)
+{
+	MdbHandle *mdb = table->entry->mdb;
+	MdbTempRows *rows = table->temp_rows;
+	MdbTempValue *values = (MdbTempValue *)(rows->data + rows->rows[row]);
+	MdbColumn *col;
+	unsigned int i;
+	size_t len = 0;
+
+	if (table->num_cols == 0)
+		return 0;
+	for (i = 0; i < table->num_cols; i++)
+		len += values[i].len;
+	memcpy(mdb->pg_buf, &values[table->num_cols], len);
+
+	if (table->sarg_tree) {
+		MdbField *fields = g_malloc0(sizeof(MdbField) * table->num_cols);
+		int ok;
+
+		for (i = 0; i < table->num_cols; i++) {
+			col = g_ptr_array_index(table->columns, i);
+			fields[i].value = mdb->pg_buf + values[i].start;
+			fields[i].siz = values[i].len;
+			fields[i].start = values[i].start;
+			fields[i].is_null = values[i].is_null;
+			fields[i].is_fixed = col->is_fixed;
+			fields[i].colnum = i;
+		}
+		ok = mdb_test_sargs(table, fields, table->num_cols);
+		g_free(fields);
+		if (!ok)
+			return 0;
+	}
+
+	for (i = 0; i < table->num_cols; i++) {
+		col = g_ptr_array_index(table->columns, i);
+		_mdb_attempt_bind(mdb, col, values[i].is_null,
+			values[i].start, values[i].len);
+	}
+	return 1;
+}
 static int _mdb_attempt_bind(MdbHandle *mdb, 
 	MdbColumn *col, 
 	unsigned char isnull, 
@@ -445,6 +505,7 @@ int mdb_rewind_table(MdbTableDef *table)
 	table->cur_pg_num=0;
 	table->cur_phys_pg=0;
 	table->cur_row=0;
+	table->hash_pos=0;
 
 	return 0;
 }
@@ -461,26 +522,17 @@ mdb_fetch_row(MdbTableDef *table)
 	if (!table->cur_pg_num) {
 		table->cur_pg_num=1;
 		table->cur_row=0;
-		if ((!table->is_temp_table)&&(table->strategy!=MDB_INDEX_SCAN))
+		if ((!table->is_temp_table)&&(table->strategy==MDB_TABLE_SCAN))
 			if (!mdb_read_next_dpg(table)) return 0;
 	}
 
 	do {
 		if (table->is_temp_table) {
-			GPtrArray *pages = table->temp_table_pages;
-			if (pages->len == 0)
+			if (table->cur_row >= table->temp_rows->num_rows)
 				return 0;
-			rows = mdb_get_int16(
-				g_ptr_array_index(pages, table->cur_pg_num-1),
-				fmt->row_count_offset);
-			if (table->cur_row >= rows) {
-				table->cur_row = 0;
-				if (++table->cur_pg_num > (unsigned int)pages->len)
-					return 0;
-			}
-			memcpy(mdb->pg_buf,
-				g_ptr_array_index(pages, table->cur_pg_num-1),
-				fmt->pg_size);
+			rc = mdbi_read_temp_row(table, table->cur_row);
+			table->cur_row++;
+			continue;
 		} else if (table->strategy==MDB_INDEX_SCAN) {
 		
 			if (!mdb_index_find_next(table->mdbidx, table->scan_idx, table->chain, &pg, (guint16 *) &(table->cur_row))) {
@@ -488,6 +540,15 @@ mdb_fetch_row(MdbTableDef *table)
 				return 0;
 			}
 			mdb_read_pg(mdb, pg);
+		} else if (table->strategy==MDB_HASH_SCAN) {
+			if (table->hash_pos >= table->hash_num_rows)
+				return 0;
+			pg = table->hash_rows[table->hash_pos++];
+			if (!mdb_read_pg(mdb, pg >> 8)) {
+				rc = 0;
+				continue;
+			}
+			table->cur_row = pg & 0xff;
 		} else {
 			rows = mdb_get_int16(mdb->pg_buf,fmt->row_count_offset);
 
@@ -498,6 +559,17 @@ mdb_fetch_row(MdbTableDef *table)
 				if (!mdb_read_next_dpg(table)) {
 					return 0;
 				}
+				rows = mdb_get_int16(mdb->pg_buf,fmt->row_count_offset);
+			}
+
+			/* weed out rows using the fixed columns of the sargs */
+			if (table->cur_row == 0 && !mdb_get_option(MDB_NO_PAGE_FILTER))
+				mdb_filter_page(table, rows);
+			if (table->page_sel && table->cur_row < rows &&
+			 !table->page_sel[table->cur_row]) {
+				table->cur_row++;
+				rc = 0;
+				continue;
 			}
 		}
 
@@ -508,6 +580,244 @@ mdb_fetch_row(MdbTableDef *table)
 
 	return 1;
 }
+
+/**
+ * mdb_fetch_row_in_pages:
+ * @table: table to read, rewound with mdb_rewind_table()
+ * @pages: pages of @table to read the rows of
+ * @num_pages: number of entries in @pages
+ *
+ * Like mdb_fetch_row() on a table scan, but only goes through the rows of
+ * @pages, in the order given.  Pages that are no longer data pages of
+ * @table are passed over.  The row just read is row @table->cur_row - 1
+ * of page @table->cur_phys_pg.
+ *
+ * Returns: 1 if a row was read, 0 once all of @pages have been read.
+ */
+int mdb_fetch_row_in_pages(MdbTableDef *table, const guint32 *pages, unsigned int num_pages)
+{
+	MdbHandle *mdb = table->entry->mdb;
+	unsigned int rows;
+
+	while (1) {
+		if (table->cur_pg_num) {
+			rows = mdb_get_int16(mdb->pg_buf, mdb->fmt->row_count_offset);
+			while (table->cur_row < rows)
+				if (mdb_read_row(table, table->cur_row++))
+					return 1;
+		}
+		do {
+			if (table->cur_pg_num >= num_pages)
+				return 0;
+			table->cur_phys_pg = pages[table->cur_pg_num++];
+		} while (!mdb_read_pg(mdb, table->cur_phys_pg)
+			|| mdb->pg_buf[0] != MDB_PAGE_DATA
+			|| mdb_get_int32(mdb->pg_buf, 4) != (long)table->entry->table_pg);
+		table->cur_row = 0;
+	}
+}
+
+/* Data pages handed out to the row counting threads, a batch at a time */
+#define MDB_COUNT_BATCH 64
+
+typedef struct {
+	guint32 *pages;
+	unsigned int num_pages;
+	unsigned int next;
+	guint32 table_pg;
+	int noskip_del;
+	int failed;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t lock;
+#endif
+} MdbRowCount;
+
+typedef struct {
+	MdbRowCount *count;
+	MdbHandle *mdb;
+	long rows;
+} MdbRowCountJob;
+
+/* Candidate data pages of @table: those in its usage map, or every page
+ * of the file if the map can't be read. */
+guint32 *mdbi_table_pages(MdbTableDef *table, unsigned int *num_pages)
+{
+	MdbHandle *mdb = table->entry->mdb;
+	guint32 *pages = NULL;
+	unsigned int len = 0, size = 0;
+	gint32 pg = 0;
+	guint32 cur = 0;
+
+	while ((pg = mdb_map_find_next(mdb, table->usage_map, table->map_sz, cur)) > 0) {
+		if ((guint32)pg <= cur)
+			break; /* Infinite loop */
+		if (len == size) {
+			size = size ? 2 * size : 64;
+			pages = g_realloc(pages, size * sizeof(guint32));
+		}
+		pages[len++] = cur = pg;
+	}
+	if (pg < 0) {
+		unsigned long num = mdbi_file_num_pages(mdb);
+
+		fprintf(stderr, "Warning: defaulting to brute force read\n");
+		len = 0;
+		if (num > 1) {
+			size = num - 1;
+			pages = g_realloc(pages, size * sizeof(guint32));
+			for (cur = 1; len < size; cur++)
+				pages[len++] = cur;
+		}
+	}
+	*num_pages = len;
+	return pages;
+}
+
+/* Counts the live rows of one page, going by its row offset table alone */
+static long mdbi_count_page_rows(MdbHandle *mdb, MdbRowCount *count, guint32 pg)
+{
+	unsigned int rows, i;
+	int row_start;
+	size_t row_size;
+	long live = 0;
+
+	if (!mdb_read_pg(mdb, pg)) {
+		fprintf(stderr, "error: reading page %u failed.\n", pg);
+		return -1;
+	}
+	if (mdb->pg_buf[0] != MDB_PAGE_DATA || mdb_get_int32(mdb->pg_buf, 4) != (long)count->table_pg)
+		return 0;
+
+	rows = mdb_get_int16(mdb->pg_buf, mdb->fmt->row_count_offset);
+	for (i = 0; i < rows; i++) {
+		/* same rows mdb_read_row() would skip */
+		if (mdb_find_row(mdb, i, &row_start, &row_size) == -1 || row_size == 0)
+			continue;
+		if ((row_start & 0x4000) && !count->noskip_del)
+			continue;
+		live++;
+	}
+	return live;
+}
+
+static void *mdbi_count_worker(void *arg)
+{
+	MdbRowCountJob *job = arg;
+	MdbRowCount *count = job->count;
+	unsigned int first, last, i;
+	long rows;
+
+	while (1) {
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_lock(&count->lock);
+#endif
+		first = count->next;
+		if (first >= count->num_pages || count->failed) {
+#ifdef HAVE_PTHREAD_H
+			pthread_mutex_unlock(&count->lock);
+#endif
+			break;
+		}
+		last = first + MDB_COUNT_BATCH;
+		if (last > count->num_pages)
+			last = count->num_pages;
+		count->next = last;
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_unlock(&count->lock);
+#endif
+		for (i = first; i < last; i++) {
+			if ((rows = mdbi_count_page_rows(job->mdb, count, count->pages[i])) < 0) {
+				/* tells the other workers to stop taking batches */
+#ifdef HAVE_PTHREAD_H
+				pthread_mutex_lock(&count->lock);
+#endif
+				count->failed = 1;
+#ifdef HAVE_PTHREAD_H
+				pthread_mutex_unlock(&count->lock);
+#endif
+				return NULL;
+			}
+			job->rows += rows;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * mdb_count_rows:
+ * @table: table to count the rows of
+ * @jobs: number of threads to count with
+ *
+ * Counts the rows of @table by walking the row offset table of each of its
+ * data pages, skipping deleted rows unless @table->noskip_del is set.  The
+ * rows themselves are never read, so this is much cheaper than a full
+ * mdb_fetch_row() scan, and doesn't depend on the row count in the table
+ * definition, which isn't kept up to date by a database that was
+ * improperly closed.
+ *
+ * The pages are shared out between @jobs threads, each reading through its
+ * own clone of the table's handle.
+ *
+ * Returns: the number of rows, or -1 if a page couldn't be read.
+ */
+long mdb_count_rows(MdbTableDef *table, int jobs)
+{
+	MdbHandle *mdb = table->entry->mdb;
+	MdbRowCount count;
+	MdbRowCountJob *job;
+	long rows = 0;
+	int started, i;
+
+	memset(&count, 0, sizeof(count));
+	count.pages = mdbi_table_pages(table, &count.num_pages);
+	count.table_pg = table->entry->table_pg;
+	count.noskip_del = table->noskip_del;
+
+	if (jobs < 1 || count.num_pages <= MDB_COUNT_BATCH)
+		jobs = 1;
+	if ((unsigned int)jobs > count.num_pages / MDB_COUNT_BATCH + 1)
+		jobs = count.num_pages / MDB_COUNT_BATCH + 1;
+#ifndef HAVE_PTHREAD_H
+	jobs = 1;
+#endif
+	/* clones, so as to leave the page buffer of a scan in progress alone */
+	job = g_malloc0(jobs * sizeof(MdbRowCountJob));
+	for (i = 0; i < jobs; i++)
+		job[i].count = &count;
+	/* the first job runs on this thread */
+	job[0].mdb = mdb_clone_handle(mdb);
+	started = 1;
+#ifdef HAVE_PTHREAD_H
+	{
+		pthread_t *threads = g_malloc(jobs * sizeof(pthread_t));
+
+		pthread_mutex_init(&count.lock, NULL);
+		for (; started < jobs; started++) {
+			job[started].mdb = mdb_clone_handle(mdb);
+			if (pthread_create(&threads[started], NULL, mdbi_count_worker, &job[started])) {
+				mdb_close(job[started].mdb);
+				break;
+			}
+		}
+		mdbi_count_worker(&job[0]);
+		for (i = 1; i < started; i++)
+			pthread_join(threads[i], NULL);
+		pthread_mutex_destroy(&count.lock);
+		g_free(threads);
+	}
+#else
+	mdbi_count_worker(&job[0]);
+#endif
+	for (i = 0; i < started; i++) {
+		rows += job[i].rows;
+		mdb_close(job[i].mdb);
+	}
+	g_free(job);
+	g_free(count.pages);
+
+	return count.failed ? -1 : rows;
+}
+
 void mdb_data_dump(MdbTableDef *table)
 {
 	unsigned int i;
@@ -660,37 +970,264 @@ mdb_ole_read(MdbHandle *mdb, MdbColumn *col, void *ole_ptr, size_t chunk_size)
 	}
 }
 /*
- * mdb_ole_read_full calls mdb_ole_read then loop over mdb_ole_read_next as much as necessary.
- * returns the result in a big buffer.
- * The call must free it.
- * Note that this function is not idempotent: It may be called only once per column after each bind.
+ * mdb_ole_read_full returns the whole value of an OLE column in a buffer
+ * allocated with malloc.  The caller must free it.
  */
 void*
 mdb_ole_read_full(MdbHandle *mdb, MdbColumn *col, size_t *size)
 {
-	char ole_ptr[MDB_MEMO_OVERHEAD];
-	char *result = malloc(OLE_BUFFER_SIZE);
-	size_t result_buffer_size = OLE_BUFFER_SIZE;
-	size_t len, pos;
-
-	memcpy(ole_ptr, col->bind_ptr, MDB_MEMO_OVERHEAD);
-
-	len = mdb_ole_read(mdb, col, ole_ptr, OLE_BUFFER_SIZE);
-	memcpy(result, col->bind_ptr, len);
-	pos = len;
-	while ((len = mdb_ole_read_next(mdb, col, ole_ptr))) {
-		if (pos+len >= result_buffer_size) {
-			result_buffer_size += OLE_BUFFER_SIZE;
-			if ((result = reallocf(result, result_buffer_size)) == NULL) {
+	MdbLvalCursor *lval = mdb_lval_open(mdb, col);
+	char *result;
+	size_t len;
+
+	result = mdbi_lval_read_all(lval, &len);
+	mdb_lval_close(lval);
+	if (result && size)
+		*size = len;
+	return result;
+}
+
+/**
+ * mdb_memo_read_full:
+ * @mdb: Handle to open MDB database file
+ * @col: MEMO column of the current row
+ * @size: if not NULL, set to the length of the string
+ *
+ * Unlike the bound value, which is cut at the bind size, this converts
+ * the whole memo.
+ *
+ * Returns: a UTF-8 string the caller must free, or NULL on error.
+ */
+char *
+mdb_memo_read_full(MdbHandle *mdb, MdbColumn *col, size_t *size)
+{
+	MdbLvalCursor *lval = mdb_lval_open(mdb, col);
+	char *raw, *text;
+	size_t len, text_len;
+
+	raw = mdbi_lval_read_all(lval, &len);
+	mdb_lval_close(lval);
+	if (!raw)
+		return NULL;
+	/* every input byte, even compressed, gives at most 3 bytes of UTF-8 */
+	if ((text = malloc(3 * len + 1)) == NULL) {
+		fprintf(stderr, "Out of memory while reading memo\n");
+		free(raw);
+		return NULL;
+	}
+	text_len = len ? mdb_unicode2ascii(mdb, raw, len, text, 3 * len + 1) : 0;
+	text[text_len] = '\0';
+	free(raw);
+	if (size)
+		*size = text_len;
+	return text;
+}
+
+/*
+ * MEMO and OLE values start with a 12 byte header: the total length, with
+ * flags in the top two bits, and the pg_row of the data.  The data either
+ * follows the header inline (0x80000000), fills a single LVAL row
+ * (0x40000000), or is spread over a chain of LVAL rows, each starting
+ * with the pg_row of the next one.
+ */
+struct S_MdbLvalCursor {
+	MdbHandle *mdb;
+	size_t length;	/* as given by the header */
+	size_t pos;	/* bytes returned so far */
+	guint32 next_pg_row;	/* 0 once the last row has been read */
+	int chained;
+	/* what is left of the current row, when it didn't fit the caller's buffer */
+	size_t chunk_pos;
+	size_t chunk_len;
+	unsigned char chunk[MDB_PGSIZE];
+};
+
+/*
+ * Opens a reader on the value of @size bytes at @value, header included.
+ * Inline data is copied, so @value need not outlive the call.
+ */
+MdbLvalCursor *mdbi_lval_open(MdbHandle *mdb, const void *value, size_t size)
+{
+	MdbLvalCursor *lval = g_malloc0(sizeof(MdbLvalCursor));
+	guint32 header;
+
+	lval->mdb = mdb;
+	if (!value || size < MDB_MEMO_OVERHEAD)
+		return lval; /* NULL or empty */
+
+	header = mdb_get_int32((void *)value, 0);
+	mdb_debug(MDB_DEBUG_OLE, "lval len = %d flags = %02x",
+		header & 0x3fffffff, header >> 24);
+	if (header & 0x80000000) {
+		lval->length = size - MDB_MEMO_OVERHEAD;
+		if (lval->length > sizeof(lval->chunk))
+			lval->length = sizeof(lval->chunk);
+		memcpy(lval->chunk, (const char *)value + MDB_MEMO_OVERHEAD, lval->length);
+		lval->chunk_len = lval->length;
+	} else if (!(header & 0x40000000) && (header & 0xff000000)) {
+		/* assume all flags in MSB */
+		fprintf(stderr, "Unhandled memo field flags = %02x\n", header >> 24);
+	} else {
+		lval->length = header & 0x3fffffff;
+		lval->next_pg_row = mdb_get_int32((void *)value, 4);
+		lval->chained = !(header & 0x40000000);
+	}
+	return lval;
+}
+
+/**
+ * mdb_lval_open:
+ * @mdb: Handle to open MDB database file
+ * @col: MEMO or OLE column of the current row
+ *
+ * Opens a reader on the raw value of @col, bound or not, as it stands
+ * after the last mdb_fetch_row().  The value is taken from the page
+ * buffer now; the LVAL pages it points to are read through
+ * mdb->alt_pg_buf as mdb_lval_read() gets to them.
+ *
+ * Returns: a reader to pass to mdb_lval_read() and mdb_lval_close().
+ */
+MdbLvalCursor *mdb_lval_open(MdbHandle *mdb, MdbColumn *col)
+{
+	if (!col->cur_value_len)
+		return mdbi_lval_open(mdb, NULL, 0);
+	return mdbi_lval_open(mdb, mdb->pg_buf + col->cur_value_start, col->cur_value_len);
+}
+
+/**
+ * mdb_lval_length:
+ * @lval: reader from mdb_lval_open()
+ *
+ * Returns: the length of the value, as given by its header.
+ */
+size_t mdb_lval_length(MdbLvalCursor *lval)
+{
+	return lval->length;
+}
+
+/*
+ * Reads the next LVAL row, straight into @buf if the whole row fits in
+ * @len bytes, otherwise into lval->chunk.  Returns the number of bytes
+ * put in @buf, or -1 at the end of the chain.
+ */
+static ssize_t mdbi_lval_next_row(MdbLvalCursor *lval, char *buf, size_t len)
+{
+	MdbHandle *mdb = lval->mdb;
+	void *pg_buf;
+	int row_start;
+	size_t row_len;
+
+	if (!lval->next_pg_row)
+		return -1;
+	mdb_debug(MDB_DEBUG_OLE, "pg_row %d", lval->next_pg_row);
+	if (mdb_find_pg_row(mdb, lval->next_pg_row, &pg_buf, &row_start, &row_len))
+		return -1;
+	if (lval->chained) {
+		/* Stop processing on zero length multiple page fields */
+		if (row_len <= 4)
+			return -1;
+		lval->next_pg_row = mdb_get_int32(pg_buf, row_start);
+		row_start += 4;
+		row_len -= 4;
+	} else {
+		lval->next_pg_row = 0;
+	}
+	if (row_len > lval->length - lval->pos)
+		row_len = lval->length - lval->pos;
+	if (row_len <= len) {
+		memcpy(buf, (char *)pg_buf + row_start, row_len);
+		return row_len;
+	}
+	memcpy(lval->chunk, (char *)pg_buf + row_start, row_len);
+	lval->chunk_pos = 0;
+	lval->chunk_len = row_len;
+	return 0;
+}
+
+/**
+ * mdb_lval_read:
+ * @lval: reader from mdb_lval_open()
+ * @buf: where to put the data
+ * @len: size of @buf
+ *
+ * Reads up to @len bytes of the value, following the LVAL page chain as
+ * needed.  If the chain ends before the length given by the header, a
+ * warning is printed and mdb_lval_length() is cut down to what was read.
+ *
+ * Returns: the number of bytes read, 0 at the end of the value.
+ */
+size_t mdb_lval_read(MdbLvalCursor *lval, void *buf, size_t len)
+{
+	char *out = buf;
+	size_t done = 0, n;
+	ssize_t got;
+
+	while (done < len && lval->pos < lval->length) {
+		if (lval->chunk_pos < lval->chunk_len) {
+			n = lval->chunk_len - lval->chunk_pos;
+			if (n > len - done)
+				n = len - done;
+			memcpy(out + done, lval->chunk + lval->chunk_pos, n);
+			lval->chunk_pos += n;
+			lval->pos += n;
+			done += n;
+			continue;
+		}
+		if ((got = mdbi_lval_next_row(lval, out + done, len - done)) < 0) {
+			fprintf(stderr, "Warning: incorrect memo length\n");
+			lval->length = lval->pos;
+			break;
+		}
+		lval->pos += got;
+		done += got;
+	}
+	return done;
+}
+
+/**
+ * mdb_lval_close:
+ * @lval: reader from mdb_lval_open()
+ *
+ * Frees the reader.
+ */
+void mdb_lval_close(MdbLvalCursor *lval)
+{
+	g_free(lval);
+}
+
+/*
+ * Reads the rest of the value into a buffer allocated with malloc.  Values
+ * over OLE_BUFFER_SIZE are read into a buffer that doubles as it fills,
+ * so that a damaged header can't force a huge allocation up front.
+ */
+void *mdbi_lval_read_all(MdbLvalCursor *lval, size_t *size)
+{
+	size_t alloc = lval->length - lval->pos;
+	char *result;
+
+	if (alloc > OLE_BUFFER_SIZE)
+		alloc = OLE_BUFFER_SIZE;
+	if ((result = malloc(alloc ? alloc : 1)) == NULL) {
+		fprintf(stderr, "Out of memory while reading OLE object\n");
+		return NULL;
+	}
+	*size = 0;
+	while (lval->pos < lval->length) {
+		size_t len;
+
+		if (*size == alloc) {
+			alloc *= 2;
+			if (alloc > lval->length)
+				alloc = lval->length;
+			if ((result = reallocf(result, alloc)) == NULL) {
 				fprintf(stderr, "Out of memory while reading OLE object\n");
 				return NULL;
 			}
 		}
-		memcpy(result + pos, col->bind_ptr, len);
-		pos += len;
+		if (!(len = mdb_lval_read(lval, result + *size, alloc - *size)))
+			break;
+		*size += len;
 	}
-	if (size)
-		*size = pos;
 	return result;
 }
 
@@ -759,14 +1296,23 @@ static size_t mdb_copy_ole(MdbHandle *mdb, void *dest, int start, int size)
 	}
 }
 #endif
-static char *mdb_memo_to_string(MdbHandle *mdb, int start, int size)
+/*
+ * The text of a memo, cut to fit bind_size.  *@truncated, if given, is
+ * set when some of it may have been cut: that is, when not all of the
+ * value was read, or when the text came within a UTF-8 character of
+ * filling the buffer.
+ */
+static char *mdb_memo_to_string(MdbHandle *mdb, int start, int size, int *truncated)
 {
 	guint32 memo_len;
-	gint32 row_start, pg_row;
-	size_t len;
-	void *buf, *pg_buf = mdb->pg_buf;
+	void *pg_buf = mdb->pg_buf;
 	char *text = g_malloc(mdb->bind_size);
+	MdbLvalCursor *lval;
+	char *tmp;
+	size_t len, text_len = 0;
 
+	if (truncated)
+		*truncated = 0;
 	if (size<MDB_MEMO_OVERHEAD) {
 		strcpy(text, "");
 		return text;
@@ -784,67 +1330,34 @@ static char *mdb_memo_to_string(MdbHandle *mdb, int start, int size)
 
 	if (memo_len & 0x80000000) {
 		/* inline memo field */
-		mdb_unicode2ascii(mdb, (char*)pg_buf + start + MDB_MEMO_OVERHEAD,
+		text_len = mdb_unicode2ascii(mdb, (char*)pg_buf + start + MDB_MEMO_OVERHEAD,
 			size - MDB_MEMO_OVERHEAD, text, mdb->bind_size);
+		if (truncated && text_len + 4 >= mdb->bind_size)
+			*truncated = 1;
 		return text;
-	} else if (memo_len & 0x40000000) {
-		/* single-page memo field */
-		pg_row = mdb_get_int32(pg_buf, start+4);
-#if MDB_DEBUG
-		printf("Reading LVAL page %06x\n", pg_row >> 8);
-#endif
-		if (mdb_find_pg_row(mdb, pg_row, &buf, &row_start, &len)) {
-			strcpy(text, "");
-			return text;
-		}
-#if MDB_DEBUG
-		printf("row num %d start %d len %d\n",
-			pg_row & 0xff, row_start, len);
-		mdb_buffer_dump(buf, row_start, len);
-#endif
-		mdb_unicode2ascii(mdb, (char*)buf + row_start, len, text, mdb->bind_size);
-		return text;
-	} else if ((memo_len & 0xff000000) == 0) { // assume all flags in MSB
-		/* multi-page memo field */
-		guint32 tmpoff = 0;
-		char *tmp;
-
-		tmp = g_malloc(memo_len);
-		pg_row = mdb_get_int32(pg_buf, start+4);
-		do {
-#if MDB_DEBUG
-			printf("Reading LVAL page %06x\n", pg_row >> 8);
-#endif
-			if (mdb_find_pg_row(mdb,pg_row,&buf,&row_start,&len)) {
-				g_free(tmp);
-				strcpy(text, "");
-				return text;
-			}
-#if MDB_DEBUG
-			printf("row num %d start %d len %d\n",
-				pg_row & 0xff, row_start, len);
-#endif
-			if (tmpoff + len - 4 > memo_len)
-				break;
-
-			/* Stop processing on zero length multiple page memo fields */
-			if (len < 4)
-				break;
+	}
 
-			memcpy(tmp + tmpoff, (char*)buf + row_start + 4, len - 4);
-			tmpoff += len - 4;
-		} while (( pg_row = mdb_get_int32(buf, row_start) ));
-		if (tmpoff < memo_len) {
-			fprintf(stderr, "Warning: incorrect memo length\n");
-		}
-		mdb_unicode2ascii(mdb, tmp, tmpoff, text, mdb->bind_size);
-		g_free(tmp);
-		return text;
-	} else {
-		fprintf(stderr, "Unhandled memo field flags = %02x\n", memo_len >> 24);
+	/* single or multi-page memo field.  Each byte of text takes at most
+	 * two bytes of UCS-2, and compressed text one more now and then to
+	 * switch modes, so the LVAL chain is only followed as far as it takes
+	 * to fill bind_size. */
+	lval = mdbi_lval_open(mdb, (char*)pg_buf + start, size);
+	len = mdb_lval_length(lval);
+	if (len > 3 * mdb->bind_size)
+		len = 3 * mdb->bind_size;
+	tmp = g_malloc(len ? len : 1);
+	len = mdb_lval_read(lval, tmp, len);
+	if (truncated && len < mdb_lval_length(lval))
+		*truncated = 1;
+	mdb_lval_close(lval);
+	if (len)
+		text_len = mdb_unicode2ascii(mdb, tmp, len, text, mdb->bind_size);
+	else
 		strcpy(text, "");
-		return text;
-	}
+	if (truncated && text_len + 4 >= mdb->bind_size)
+		*truncated = 1;
+	g_free(tmp);
+	return text;
 }
 
 #if 0
@@ -1050,7 +1563,7 @@ char *mdb_col_to_string(MdbHandle *mdb, void *buf, int start, int datatype, int
 			text = mdb_date_to_string(mdb, mdb->date_fmt, buf, start);
 		break;
 		case MDB_MEMO:
-			text = mdb_memo_to_string(mdb, start, size);
+			text = mdb_memo_to_string(mdb, start, size, NULL);
 		break;
 		case MDB_MONEY:
 			text = mdb_money_to_string(mdb, start);
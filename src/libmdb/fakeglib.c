@@ -21,6 +21,7 @@
 #include "mdbfakeglib.h"
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -295,81 +296,167 @@ gchar *g_utf8_strdown(const gchar *str, gssize len) {
 
 /* GHashTable */
 
-typedef struct MyNode {
-    char *key;
+typedef struct GHashNode {
+    void *key;
     void *value;
-} MyNode;
+    guint hash;
+    gboolean removed;
+} GHashNode;
 
-void *g_hash_table_lookup(GHashTable *table, const void *key) {
-    guint i;
-    for (i=0; i<table->array->len; i++) {
-        MyNode *node = g_ptr_array_index(table->array, i);
-        if (table->compare(key, node->key))
-            return node->value;
+guint g_str_hash(const void *str) {
+    const unsigned char *p = str;
+    guint h = 5381;
+    while (*p)
+        h = h * 33 + *p++;
+    return h;
+}
+
+guint g_direct_hash(const void *ptr) {
+    return (guint)(uintptr_t)ptr;
+}
+
+static gboolean g_direct_equal(const void *a, const void *b) {
+    return a == b;
+}
+
+static guint hash_key(GHashTable *table, const void *key) {
+    guint h = table->hash(key);
+    /* the slot comes from the low bits, so mix the high ones in */
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h;
+}
+
+/* Returns the slot of @key, or the empty slot where it would go */
+static guint *hash_find_slot(GHashTable *table, const void *key, guint hash) {
+    guint mask = table->num_slots - 1;
+    guint i = hash & mask;
+    while (table->slots[i]) {
+        GHashNode *node = &table->nodes[table->slots[i] - 1];
+        if (!node->removed && node->hash == hash && table->compare(key, node->key))
+            break;
+        i = (i + 1) & mask;
+    }
+    return &table->slots[i];
+}
+
+/* Drops the removed nodes, and rebuilds the slots with room to grow */
+static void hash_resize(GHashTable *table) {
+    guint i, j, mask;
+    for (i=0, j=0; i<table->num_nodes; i++) {
+        if (!table->nodes[i].removed)
+            table->nodes[j++] = table->nodes[i];
+    }
+    table->num_nodes = j;
+    while (table->num_slots < (table->num_nodes + 1) * 2)
+        table->num_slots *= 2;
+    free(table->slots);
+    table->slots = calloc(table->num_slots, sizeof(guint));
+    mask = table->num_slots - 1;
+    for (i=0; i<table->num_nodes; i++) {
+        j = table->nodes[i].hash & mask;
+        while (table->slots[j])
+            j = (j + 1) & mask;
+        table->slots[j] = i + 1;
     }
+}
+
+void *g_hash_table_lookup(GHashTable *table, const void *key) {
+    guint *slot = hash_find_slot(table, key, hash_key(table, key));
+    if (*slot)
+        return table->nodes[*slot - 1].value;
     return NULL;
 }
 
 gboolean g_hash_table_lookup_extended (GHashTable *table, const void *lookup_key,
         void **orig_key, void **value) {
-    guint i;
-    for (i=0; i<table->array->len; i++) {
-        MyNode *node = g_ptr_array_index(table->array, i);
-        if (table->compare(lookup_key, node->key)) {
-            *orig_key = node->key;
-            *value = node->value;
-            return TRUE;
-        }
+    guint *slot = hash_find_slot(table, lookup_key, hash_key(table, lookup_key));
+    if (*slot) {
+        GHashNode *node = &table->nodes[*slot - 1];
+        *orig_key = node->key;
+        *value = node->value;
+        return TRUE;
     }
     return FALSE;
 }
 
 void g_hash_table_insert(GHashTable *table, void *key, void *value) {
-    MyNode *node = calloc(1, sizeof(MyNode));
-    node->value = value;
+    guint hash = hash_key(table, key);
+    guint *slot = hash_find_slot(table, key, hash);
+    GHashNode *node;
+    if (*slot) {
+        /* like GLib, the key already in the table is kept */
+        table->nodes[*slot - 1].value = value;
+        return;
+    }
+    if ((table->num_nodes + 1) * 4 > table->num_slots * 3) {
+        hash_resize(table);
+        slot = hash_find_slot(table, key, hash);
+    }
+    if (table->num_nodes == table->nodes_size) {
+        table->nodes_size *= 2;
+        table->nodes = realloc(table->nodes, table->nodes_size * sizeof(GHashNode));
+    }
+    node = &table->nodes[table->num_nodes++];
     node->key = key;
-    g_ptr_array_add(table->array, node);
+    node->value = value;
+    node->hash = hash;
+    node->removed = FALSE;
+    *slot = table->num_nodes;
+    table->num_live++;
 }
 
 gboolean g_hash_table_remove(GHashTable *table, gconstpointer key) {
-    int found = 0;
-    guint i;
-    for (i=0; i<table->array->len; i++) {
-        MyNode *node = g_ptr_array_index(table->array, i);
-        if (found) {
-            table->array->pdata[i-1] = table->array->pdata[i];
-        } else if (!found && table->compare(key, node->key)) {
-            found = 1;
-        }
-    }
-    if (found) {
-        table->array->len--;
-    }
-    return found;
+    guint *slot = hash_find_slot(table, key, hash_key(table, key));
+    if (!*slot)
+        return FALSE;
+    /* the slot stays taken, so that keys probed past it are still found */
+    table->nodes[*slot - 1].removed = TRUE;
+    table->num_live--;
+    return TRUE;
 }
 
 GHashTable *g_hash_table_new(GHashFunc hashes, GEqualFunc equals) {
     GHashTable *table = calloc(1, sizeof(GHashTable));
-    table->array = g_ptr_array_new();
-    table->compare = equals;
+    table->hash = hashes ? hashes : g_direct_hash;
+    table->compare = equals ? equals : g_direct_equal;
+    table->nodes_size = 8;
+    table->nodes = malloc(table->nodes_size * sizeof(GHashNode));
+    table->num_slots = 16;
+    table->slots = calloc(table->num_slots, sizeof(guint));
     return table;
 }
 
+guint g_hash_table_size(GHashTable *table) {
+    return table->num_live;
+}
+
 void g_hash_table_foreach(GHashTable *table, GHFunc function, void *data) {
     guint i;
-    for (i=0; i<table->array->len; i++) {
-        MyNode *node = g_ptr_array_index(table->array, i);
-        function(node->key, node->value, data);
+    for (i=0; i<table->num_nodes; i++) {
+        GHashNode *node = &table->nodes[i];
+        if (!node->removed)
+            function(node->key, node->value, data);
     }
 }
 
-void g_hash_table_destroy(GHashTable *table) {
-    guint i;
-    for (i=0; i<table->array->len; i++) {
-        MyNode *node = g_ptr_array_index(table->array, i);
-        free(node);
+guint g_hash_table_foreach_remove(GHashTable *table, GHRFunc function, void *data) {
+    guint i, removed = 0;
+    for (i=0; i<table->num_nodes; i++) {
+        GHashNode *node = &table->nodes[i];
+        if (!node->removed && function(node->key, node->value, data)) {
+            node->removed = TRUE;
+            table->num_live--;
+            removed++;
+        }
     }
-    g_ptr_array_free(table->array, TRUE);
+    return removed;
+}
+
+void g_hash_table_destroy(GHashTable *table) {
+    free(table->nodes);
+    free(table->slots);
     free(table);
 }
 
@@ -389,12 +476,17 @@ void g_ptr_array_foreach(GPtrArray *array, GFunc function, gpointer user_data) {
 GPtrArray *g_ptr_array_new() {
     GPtrArray *array = malloc(sizeof(GPtrArray));
     array->len = 0;
+    array->size = 0;
     array->pdata = NULL;
     return array;
 }
 
 void g_ptr_array_add(GPtrArray *array, void *entry) {
-    array->pdata = realloc(array->pdata, (array->len+1) * sizeof(void *));
+    if (array->len == array->size) {
+        /* doubling keeps appends amortized constant time */
+        array->size = array->size ? array->size * 2 : 16;
+        array->pdata = realloc(array->pdata, array->size * sizeof(void *));
+    }
     array->pdata[array->len++] = entry;
 }
 
@@ -421,15 +513,6 @@ void g_ptr_array_free(GPtrArray *array, gboolean something) {
 
 /* GList */
 
-GList *g_list_append(GList *list, void *data) {
-    GList *new_list = calloc(1, sizeof(GList));
-    new_list->data = data;
-    new_list->next = list;
-    if (list)
-        list->prev = new_list;
-    return new_list;
-}
-
 GList *g_list_last(GList *list) {
     while (list && list->next) {
         list = list->next;
@@ -437,6 +520,17 @@ GList *g_list_last(GList *list) {
     return list;
 }
 
+GList *g_list_append(GList *list, void *data) {
+    GList *new_list = calloc(1, sizeof(GList));
+    GList *last = g_list_last(list);
+    new_list->data = data;
+    if (!last)
+        return new_list;
+    last->next = new_list;
+    new_list->prev = last;
+    return list;
+}
+
 GList *g_list_remove(GList *list, void *data) {
     GList *link = list;
     while (link) {
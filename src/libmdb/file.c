@@ -20,6 +20,9 @@
 #include <stddef.h>
 #include "mdbtools.h"
 #include "mdbprivate.h"
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 MdbFormatConstants MdbJet4Constants = {
 	.pg_size = 4096,
@@ -68,6 +71,59 @@ MdbFormatConstants MdbJet3Constants = {
 
 static ssize_t _mdb_read_pg(MdbHandle *mdb, void *pg_buf, unsigned long pg);
 
+/*
+ * Cloned handles share their MdbFile, and may be used from different
+ * threads.  Page sources keep themselves safe for that (files are read
+ * with pread(), which leaves no file position to share); the reference
+ * count and the catalog and table definition caches are kept under this
+ * lock.  It is recursive, as filling the catalog
+ * reads table definitions.
+ */
+struct S_MdbFileLock {
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t mutex;
+#else
+	int unused;
+#endif
+};
+
+static MdbFileLock *mdbi_file_lock_new(void)
+{
+	MdbFileLock *lock = g_malloc0(sizeof(MdbFileLock));
+#ifdef HAVE_PTHREAD_H
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&lock->mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+#endif
+	return lock;
+}
+
+static void mdbi_file_lock_free(MdbFileLock *lock)
+{
+	if (!lock) return;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_destroy(&lock->mutex);
+#endif
+	g_free(lock);
+}
+
+void mdbi_file_lock(MdbFile *f)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&f->lock->mutex);
+#endif
+}
+
+void mdbi_file_unlock(MdbFile *f)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&f->lock->mutex);
+#endif
+}
+
 /**
  * mdb_find_file:
  * @filename: path to MDB (database) file
@@ -114,16 +170,29 @@ static char *mdb_find_file(const char *file_name)
 }
 
 /**
- * mdb_handle_from_stream:
- * @stream An open file stream
- * @flags MDB_NOFLAGS for read-only, MDB_WRITABLE for read/write
+ * mdb_open_source:
+ * @src: page source for an MDB file
+ * @flags: MDB_NOFLAGS for read-only, MDB_WRITABLE for read/write
  *
- * Allocates, initializes, and return an MDB handle from a file stream pointing
- * to an MDB file.
+ * Opens the MDB file that @src reads pages from, be it one of the sources
+ * made by mdb_page_source_stdio(), mdb_page_source_buffer() and
+ * mdb_page_source_inflate(), or one of the caller's.  The handle takes
+ * the source, and closes it with the last handle on the file, or at once
+ * if the file can't be opened.  MDB_WRITABLE needs a source with a
+ * write_page().
  *
  * Return value: The handle on success, NULL on failure
  */
-static MdbHandle *mdb_handle_from_stream(FILE *stream, MdbFileFlags flags) {
+MdbHandle *mdb_open_source(MdbPageSource *src, MdbFileFlags flags) {
+	if (!src)
+		return NULL;
+	if ((flags & MDB_WRITABLE) && !src->write_page) {
+		fprintf(stderr, "Page source is read-only\n");
+		if (src->close) src->close(src);
+		g_free(src);
+		return NULL;
+	}
+
 	MdbHandle *mdb = g_malloc0(sizeof(MdbHandle));
 	mdb_set_default_backend(mdb, "access");
     mdb_set_date_fmt(mdb, "%x %X");
@@ -139,7 +208,8 @@ static MdbHandle *mdb_handle_from_stream(FILE *stream, MdbFileFlags flags) {
 	mdb->fmt = &MdbJet3Constants;
 	mdb->f = g_malloc0(sizeof(MdbFile));
 	mdb->f->refs = 1;
-	mdb->f->stream = stream;
+	mdb->f->lock = mdbi_file_lock_new();
+	mdb->f->source = src;
 	if (flags & MDB_WRITABLE) {
 		mdb->f->writable = TRUE;
     }
@@ -201,22 +271,13 @@ static MdbHandle *mdb_handle_from_stream(FILE *stream, MdbFileFlags flags) {
  * @buffer A memory buffer containing an MDB file
  * @len Length of the buffer
  *
- * Opens an MDB file in memory and returns an MdbHandle to it.
+ * Opens an MDB file in memory and returns an MdbHandle to it.  Pages are
+ * read from and written to @buffer itself, which must outlive the handle.
  *
  * Return value: point to MdbHandle structure.
  */
 MdbHandle *mdb_open_buffer(void *buffer, size_t len, MdbFileFlags flags) {
-    FILE *file = NULL;
-#ifdef HAVE_FMEMOPEN
-    file = fmemopen(buffer, len, (flags & MDB_WRITABLE) ? "r+" : "r");
-#else
-    fprintf(stderr, "mdb_open_buffer requires a platform with support for fmemopen(3)\n");
-#endif
-    if (file == NULL) {
-        fprintf(stderr, "Couldn't open memory buffer\n");
-        return NULL;
-    }
-    return mdb_handle_from_stream(file, flags);
+    return mdb_open_source(mdb_page_source_buffer(buffer, len, flags & MDB_WRITABLE), flags);
 }
 
 /**
@@ -253,7 +314,58 @@ MdbHandle *mdb_open(const char *filename, MdbFileFlags flags)
 
     g_free(filepath);
 
-    return mdb_handle_from_stream(file, flags);
+    return mdb_open_source(mdb_page_source_stdio(file), flags);
+}
+
+/*
+ * Stamp of the file behind @f, used to notice that the shared catalog,
+ * table definitions and hash indexes have gone stale.
+ */
+void mdbi_file_stat(MdbFile *f, MdbFileStamp *stamp)
+{
+	memset(stamp, 0, sizeof(MdbFileStamp));
+	/* sources without stat() never change behind our back */
+	if (f->source->stat)
+		f->source->stat(f->source, stamp);
+}
+
+int mdbi_file_stamp_equal(const MdbFileStamp *a, const MdbFileStamp *b)
+{
+	return a->size == b->size
+		&& a->mtime == b->mtime && a->mtime_nsec == b->mtime_nsec
+		&& a->ctime == b->ctime && a->ctime_nsec == b->ctime_nsec
+		&& a->ino == b->ino;
+}
+
+/* Number of pages in the file, counting a partial page at the end */
+unsigned long mdbi_file_num_pages(MdbHandle *mdb)
+{
+	MdbPageSource *src = mdb->f->source;
+
+	return src->page_count(src, mdb->fmt->pg_size);
+}
+
+/*
+ * Drops a reference to @f, held by each handle on the file and by each
+ * table using one of its cached definitions, and closes the file with
+ * the last one.
+ */
+void mdbi_file_unref(MdbFile *f)
+{
+	int refs;
+
+	mdbi_file_lock(f);
+	refs = --f->refs;
+	mdbi_file_unlock(f);
+	if (refs)
+		return;
+	if (f->source->close)
+		f->source->close(f->source);
+	g_free(f->source);
+	mdbi_free_file_catalog(f);
+	mdbi_free_file_tdefs(f);
+	mdbi_file_lock_free(f->lock);
+	g_free(f);
 }
 
 /**
@@ -268,17 +380,12 @@ mdb_close(MdbHandle *mdb)
 {
 	if (!mdb) return;	
 	mdb_free_catalog(mdb);
+	mdbi_free_relationships(mdb);
 	g_free(mdb->stats);
 	g_free(mdb->backend_name);
 
-	if (mdb->f) {
-		if (mdb->f->refs > 1) {
-			mdb->f->refs--;
-		} else {
-			if (mdb->f->stream) fclose(mdb->f->stream);
-			g_free(mdb->f);
-		}
-	}
+	if (mdb->f)
+		mdbi_file_unref(mdb->f);
 
 	mdb_iconv_close(mdb);
     mdb_remove_backends(mdb);
@@ -289,29 +396,21 @@ mdb_close(MdbHandle *mdb)
  * mdb_clone_handle:
  * @mdb: Handle to open MDB database file
  *
- * Clones an existing database handle.  Cloned handle shares the file descriptor
+ * Clones an existing database handle.  Cloned handle shares the page source
  * but has its own page buffer, page position, and similar internal variables.
+ * A handle and its clones may be read from concurrently, one thread per
+ * handle; a handle opened with MDB_WRITABLE may not.
  *
  * Return value: new handle to the database.
  */
 MdbHandle *mdb_clone_handle(MdbHandle *mdb)
 {
 	MdbHandle *newmdb;
-	MdbCatalogEntry *entry, *data;
-	unsigned int i;
 
 	newmdb = (MdbHandle *) g_memdup2(mdb, sizeof(MdbHandle));
 
 	memset(&newmdb->catalog, 0, sizeof(MdbHandle) - offsetof(MdbHandle, catalog));
-
-	newmdb->catalog = g_ptr_array_new();
-	for (i=0;i<mdb->num_catalog;i++) {
-		entry = g_ptr_array_index(mdb->catalog,i);
-		data = g_memdup2(entry,sizeof(MdbCatalogEntry));
-		data->mdb = newmdb;
-		data->props = NULL;
-		g_ptr_array_add(newmdb->catalog, data);
-	}
+	newmdb->num_catalog = 0;
 
 	mdb_iconv_init(newmdb);
 	mdb_set_default_backend(newmdb, mdb->backend_name);
@@ -323,9 +422,15 @@ MdbHandle *mdb_clone_handle(MdbHandle *mdb)
 	mdb_set_repid_fmt(newmdb, mdb->repid_fmt);
 
 	if (mdb->f) {
+		mdbi_file_lock(mdb->f);
 		mdb->f->refs++;
+		mdbi_file_unlock(mdb->f);
 	}
 
+	/* the catalog itself lives on the shared MdbFile */
+	if (mdb->catalog)
+		mdb_read_catalog(newmdb, mdb->catalog_type);
+
 	return newmdb;
 }
 
@@ -351,29 +456,20 @@ ssize_t mdb_read_alt_pg(MdbHandle *mdb, unsigned long pg)
 }
 static ssize_t _mdb_read_pg(MdbHandle *mdb, void *pg_buf, unsigned long pg)
 {
+	MdbPageSource *src = mdb->f->source;
 	ssize_t len;
-	off_t offset = pg * mdb->fmt->pg_size;
 
-    if (fseeko(mdb->f->stream, 0, SEEK_END) == -1) {
-        fprintf(stderr, "Unable to seek to end of file\n");
-        return 0;
-    }
-    if (ftello(mdb->f->stream) < offset) { 
-        fprintf(stderr,"offset %" PRIu64 " is beyond EOF\n",(uint64_t)offset);
+	len = src->read_page(src, pg_buf, mdb->fmt->pg_size, pg);
+	if (len == -1)
+		return 0;
+	/* the page just past the end reads as zeros */
+	if (len == 0 && pg > src->page_count(src, mdb->fmt->pg_size)) {
+        fprintf(stderr,"offset %" PRIu64 " is beyond EOF\n",(uint64_t)pg * mdb->fmt->pg_size);
         return 0;
     }
 	if (mdb->stats && mdb->stats->collect) 
 		mdb->stats->pg_reads++;
 
-	if (fseeko(mdb->f->stream, offset, SEEK_SET) == -1) {
-        fprintf(stderr, "Unable to seek to page %lu\n", pg);
-        return 0;
-    }
-	len = fread(pg_buf, 1, mdb->fmt->pg_size, mdb->f->stream);
-	if (ferror(mdb->f->stream)) {
-		perror("read");
-		return 0;
-	}
     memset(pg_buf + len, 0, mdb->fmt->pg_size - len);
 	/*
 	 * unencrypt the page if necessary.
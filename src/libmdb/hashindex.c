@@ -0,0 +1,498 @@
+/* MDB Tools - A library for reading MS Access database files
+ * Copyright (C) 2000 Brian Bruns
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "mdbtools.h"
+#include "mdbprivate.h"
+
+/*
+ * Ad-hoc hash indexes, turned on with MDBOPTS=hash_index.  When a column
+ * without a usable index is looked up with '=' for the second time, every
+ * row of the table is read once and the rows are grouped by the column's
+ * value.  Later lookups on that column go straight to the data pages of
+ * the matching rows instead of scanning the table.
+ *
+ * The indexes hang off the shared table definition (see table.c), so all
+ * handles on the file use them, and they go away with it when the file's
+ * stamp changes.  Each one also remembers the stamp it was built from, and
+ * is not used once the file no longer matches it.
+ *
+ * Keys are built so that two values get the same key exactly when the
+ * sarg test finds them equal: the integer the test compares for BYTE,
+ * INTEGER and LONG INTEGER columns, and the strxfrm() of the text for
+ * TEXT columns, which are compared with strcoll().  Rows found through an
+ * index are still run through the whole sarg tree by mdb_read_row().
+ */
+
+/* equality lookups on a column before it gets an index */
+#define MDB_HASH_INDEX_LOOKUPS 2
+
+typedef struct {
+	guint32 hash;
+	guint32 start; /* in key_data */
+	guint32 len;
+	guint32 first; /* in rows */
+	guint32 count;
+} MdbHashKey;
+
+struct S_MdbHashIndex {
+	struct S_MdbHashIndex *next; /* other columns of the table */
+	int col_num;
+	unsigned int lookups;
+	int building;
+	int ready;
+	/* the file as it was when the index was built */
+	MdbFileStamp stamp;
+	/* set once ready, and not changed afterwards */
+	guint32 *slots; /* key number + 1, 0 for an empty slot */
+	unsigned int num_slots;
+	MdbHashKey *keys;
+	unsigned int num_keys;
+	unsigned int keys_size;
+	char *key_data;
+	size_t key_len;
+	size_t key_size;
+	guint32 *rows; /* page << 8 | row, grouped by key, in page order */
+};
+
+static guint32 mdbi_hash_bytes(const char *key, size_t len)
+{
+	guint32 hash = 2166136261U;
+	size_t i;
+
+	for (i=0; i<len; i++)
+		hash = (hash ^ (unsigned char)key[i]) * 16777619U;
+	return hash;
+}
+
+static int mdbi_hash_col_supported(MdbColumn *col)
+{
+	switch (col->col_type) {
+		case MDB_BYTE:
+		case MDB_INT:
+		case MDB_LONGINT:
+		case MDB_TEXT:
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Whether the constant of @node can be made a key: a number has to be in
+ * the range of a gint32 to be converted to one.  Others are left to the
+ * row test.
+ */
+static int mdbi_hash_const_supported(MdbSargNode *node)
+{
+	if (node->col->col_type == MDB_TEXT || node->val_type == MDB_INT)
+		return 1;
+	/* false for a NaN too */
+	return node->value.d >= -2147483648.0 && node->value.d <= 2147483647.0;
+}
+
+static int mdbi_hash_node_supported(MdbSargNode *node)
+{
+	unsigned int i;
+
+	if (!node->col || !mdbi_hash_col_supported(node->col))
+		return 0;
+	if (node->op == MDB_EQUAL)
+		return mdbi_hash_const_supported(node);
+	for (i=0; i<node->values->len; i++) {
+		MdbSargNode *value = g_ptr_array_index(node->values, i);
+
+		if (!mdbi_hash_const_supported(value))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Finds an '=' or an IN list on a column with a hashable type among the
+ * leaves of the top level AND of the sarg tree, the only ones every
+ * matching row must pass.
+ */
+static MdbSargNode *mdbi_hash_find_leaf(MdbSargNode *node)
+{
+	MdbSargNode *leaf;
+
+	if (!node)
+		return NULL;
+	if (node->op == MDB_AND) {
+		if ((leaf = mdbi_hash_find_leaf(node->left)))
+			return leaf;
+		return mdbi_hash_find_leaf(node->right);
+	}
+	if ((node->op == MDB_EQUAL || (node->op == MDB_IN && node->values)) &&
+			mdbi_hash_node_supported(node))
+		return node;
+	return NULL;
+}
+
+/* Puts the strxfrm() of @s in *@key, growing it as needed */
+static size_t mdbi_hash_text_key(const char *s, char **key, size_t *key_sz)
+{
+	size_t len = strxfrm(*key, s, *key_sz);
+
+	if (len >= *key_sz) {
+		*key_sz = len + 1;
+		*key = g_realloc(*key, *key_sz);
+		strxfrm(*key, s, *key_sz);
+	}
+	return len;
+}
+
+/* Key of the constant @node compares against, as the sarg test sees it */
+static size_t mdbi_hash_const_key(MdbSargNode *node, char **key, size_t *key_sz)
+{
+	gint32 v;
+
+	if (node->col->col_type == MDB_TEXT)
+		return mdbi_hash_text_key(node->value.s, key, key_sz);
+	v = node->val_type == MDB_INT ? node->value.i : node->value.d;
+	memcpy(*key, &v, sizeof(v));
+	return sizeof(v);
+}
+
+/* Key of a non-null field of @col; @text holds the converted text */
+static size_t mdbi_hash_field_key(MdbHandle *mdb, MdbColumn *col, MdbField *field,
+	char *text, size_t text_sz, char **key, size_t *key_sz)
+{
+	size_t len;
+	gint32 v;
+
+	switch (col->col_type) {
+		case MDB_BYTE:
+			v = ((char *)field->value)[0];
+			break;
+		case MDB_INT:
+			v = (short)mdb_get_int16(field->value, 0);
+			break;
+		case MDB_LONGINT:
+			v = mdb_get_int32(field->value, 0);
+			break;
+		default:
+			len = mdb_unicode2ascii(mdb, field->value, field->siz, text, text_sz);
+			text[len < text_sz ? len : text_sz - 1] = '\0';
+			return mdbi_hash_text_key(text, key, key_sz);
+	}
+	memcpy(*key, &v, sizeof(v));
+	return sizeof(v);
+}
+
+static MdbHashKey *mdbi_hash_find_key(MdbHashIndex *idx, const char *key, size_t len, guint32 hash, guint32 *slot)
+{
+	guint32 mask = idx->num_slots - 1;
+	guint32 i = hash & mask;
+	MdbHashKey *k;
+
+	while (idx->slots[i]) {
+		k = &idx->keys[idx->slots[i] - 1];
+		if (k->hash == hash && k->len == len &&
+				!memcmp(idx->key_data + k->start, key, len))
+			return k;
+		i = (i + 1) & mask;
+	}
+	*slot = i;
+	return NULL;
+}
+
+static void mdbi_hash_grow_slots(MdbHashIndex *idx)
+{
+	guint32 i, j, mask;
+
+	g_free(idx->slots);
+	idx->num_slots = idx->num_slots ? idx->num_slots * 2 : 1024;
+	idx->slots = g_malloc0(idx->num_slots * sizeof(guint32));
+	mask = idx->num_slots - 1;
+	for (i=0; i<idx->num_keys; i++) {
+		for (j = idx->keys[i].hash & mask; idx->slots[j]; j = (j + 1) & mask)
+			;
+		idx->slots[j] = i + 1;
+	}
+}
+
+/* Returns the number of the key, adding it if it's new */
+static guint32 mdbi_hash_add_key(MdbHashIndex *idx, const char *key, size_t len)
+{
+	guint32 hash = mdbi_hash_bytes(key, len);
+	MdbHashKey *k;
+	guint32 slot;
+
+	if ((k = mdbi_hash_find_key(idx, key, len, hash, &slot))) {
+		k->count++;
+		return k - idx->keys;
+	}
+	if (idx->num_keys == idx->keys_size) {
+		idx->keys_size = idx->keys_size ? idx->keys_size * 2 : 256;
+		idx->keys = g_realloc(idx->keys, idx->keys_size * sizeof(MdbHashKey));
+	}
+	while (idx->key_len + len > idx->key_size) {
+		idx->key_size = idx->key_size ? idx->key_size * 2 : 4096;
+		idx->key_data = g_realloc(idx->key_data, idx->key_size);
+	}
+	k = &idx->keys[idx->num_keys];
+	k->hash = hash;
+	k->start = idx->key_len;
+	k->len = len;
+	k->first = 0;
+	k->count = 1;
+	memcpy(idx->key_data + idx->key_len, key, len);
+	idx->key_len += len;
+	idx->slots[slot] = ++idx->num_keys;
+	/* keep the table at most half full */
+	if (idx->num_keys * 2 > idx->num_slots)
+		mdbi_hash_grow_slots(idx);
+	return idx->num_keys - 1;
+}
+
+static void mdbi_hash_free_data(MdbHashIndex *idx)
+{
+	g_free(idx->slots);
+	g_free(idx->keys);
+	g_free(idx->key_data);
+	g_free(idx->rows);
+	idx->slots = NULL;
+	idx->keys = NULL;
+	idx->key_data = NULL;
+	idx->rows = NULL;
+	idx->num_slots = idx->num_keys = idx->keys_size = 0;
+	idx->key_len = idx->key_size = 0;
+}
+
+/*
+ * Reads every live row of @table through its handle, and fills in @idx
+ * for the column at @field in table->columns.  The table must not be in
+ * the middle of a scan, since this moves its handle's page buffer.
+ *
+ * Returns: 0 on success, -1 if the table's pages can't be walked.
+ */
+static int mdbi_hash_index_build(MdbTableDef *table, MdbColumn *col, int field, MdbHashIndex *idx)
+{
+	MdbHandle *mdb = table->entry->mdb;
+	MdbFormatConstants *fmt = mdb->fmt;
+	MdbField *fields = g_malloc(sizeof(MdbField) * table->num_cols);
+	size_t text_sz = col->col_size * 3 + 1, key_sz = 256, row_size, len;
+	char *text = g_malloc(text_sz);
+	char *key = g_malloc(key_sz);
+	guint32 *row_keys = NULL, *row_ids = NULL, *pos;
+	unsigned int num_rows = 0, rows_size = 0, rows, row, i;
+	int row_start, ret = 0;
+	gint32 pg = 0;
+
+	mdbi_file_stat(mdb->f, &idx->stamp);
+	mdbi_hash_grow_slots(idx);
+
+	while ((pg = mdb_map_find_next(mdb, table->usage_map, table->map_sz, pg)) > 0) {
+		if (!mdb_read_pg(mdb, pg) || mdb->pg_buf[0] != MDB_PAGE_DATA ||
+				mdb_get_int32(mdb->pg_buf, 4) != (long)table->entry->table_pg)
+			continue;
+		rows = mdb_get_int16(mdb->pg_buf, fmt->row_count_offset);
+		for (row=0; row<rows; row++) {
+			if (mdb_find_row(mdb, row, &row_start, &row_size) || row_size == 0 ||
+					(row_start & 0x4000))
+				continue;
+			if (mdb_crack_row(table, row_start & OFFSET_MASK, row_size, fields) < 0 ||
+					fields[field].is_null)
+				continue;
+			if (num_rows == rows_size) {
+				rows_size = rows_size ? rows_size * 2 : 1024;
+				row_keys = g_realloc(row_keys, rows_size * sizeof(guint32));
+				row_ids = g_realloc(row_ids, rows_size * sizeof(guint32));
+			}
+			len = mdbi_hash_field_key(mdb, col, &fields[field], text, text_sz, &key, &key_sz);
+			row_keys[num_rows] = mdbi_hash_add_key(idx, key, len);
+			row_ids[num_rows] = ((guint32)pg << 8) | row;
+			num_rows++;
+		}
+	}
+	if (pg < 0) {
+		/* unknown usage map type */
+		mdbi_hash_free_data(idx);
+		ret = -1;
+	} else {
+		/* group the rows by key, keeping them in page order */
+		pos = g_malloc((idx->num_keys + 1) * sizeof(guint32));
+		for (i=0, pos[0]=0; i<idx->num_keys; i++) {
+			idx->keys[i].first = pos[i];
+			pos[i+1] = pos[i] + idx->keys[i].count;
+		}
+		idx->rows = g_malloc((num_rows + 1) * sizeof(guint32));
+		for (i=0; i<num_rows; i++)
+			idx->rows[pos[row_keys[i]]++] = row_ids[i];
+		g_free(pos);
+	}
+	g_free(row_keys);
+	g_free(row_ids);
+	g_free(fields);
+	g_free(text);
+	g_free(key);
+	return ret;
+}
+
+static int mdbi_hash_cmp_rows(const void *a, const void *b)
+{
+	guint32 x = *(const guint32 *)a, y = *(const guint32 *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Puts the rows of every value of the IN list @node in table->hash_merged,
+ * in page order, a row whose value is listed twice only once.
+ */
+static void mdbi_hash_merge_in(MdbTableDef *table, MdbHashIndex *idx, MdbSargNode *node)
+{
+	MdbHashKey *k;
+	size_t key_sz = 256, len;
+	char *key = g_malloc(key_sz);
+	guint32 slot, *rows = NULL;
+	unsigned int i, num_rows = 0, n;
+
+	for (i=0; i<node->values->len; i++) {
+		len = mdbi_hash_const_key(g_ptr_array_index(node->values, i), &key, &key_sz);
+		if (!(k = mdbi_hash_find_key(idx, key, len, mdbi_hash_bytes(key, len), &slot)))
+			continue;
+		rows = g_realloc(rows, (num_rows + k->count) * sizeof(guint32));
+		memcpy(rows + num_rows, idx->rows + k->first, k->count * sizeof(guint32));
+		num_rows += k->count;
+	}
+	g_free(key);
+	if (num_rows) {
+		qsort(rows, num_rows, sizeof(guint32), mdbi_hash_cmp_rows);
+		for (i=1, n=1; i<num_rows; i++) {
+			if (rows[i] != rows[n-1])
+				rows[n++] = rows[i];
+		}
+		num_rows = n;
+	}
+	table->hash_merged = rows;
+	table->hash_rows = rows;
+	table->hash_num_rows = num_rows;
+}
+
+/**
+ * mdbi_hash_scan_init:
+ * @table: table about to be scanned, with its sarg tree compiled
+ *
+ * Counts an equality lookup on a hashable column of @table, building the
+ * column's hash index once it has been looked up often enough, and sets
+ * @table up to read only the rows the index gives for the value looked
+ * up, or for each value of an IN list.
+ *
+ * Returns: 1 if @table will be scanned through a hash index.
+ */
+int mdbi_hash_scan_init(MdbTableDef *table)
+{
+	MdbFile *f = table->entry->mdb->f;
+	MdbHashIndex **list, *idx, *built = NULL;
+	MdbSargNode *node;
+	MdbHashKey *k;
+	MdbFileStamp stamp;
+	size_t key_sz = 256, len;
+	char *key;
+	guint32 slot;
+	int field;
+
+	if (!mdb_get_option(MDB_HASH_INDEX) || table->noskip_del || table->is_temp_table)
+		return 0;
+	if (!(node = mdbi_hash_find_leaf(table->sarg_tree)))
+		return 0;
+	for (field=0; field<(int)table->num_cols; field++) {
+		if (g_ptr_array_index(table->columns, field) == node->col)
+			break;
+	}
+	if (field == (int)table->num_cols)
+		return 0;
+
+	mdbi_file_lock(f);
+	if (!(list = mdbi_tdef_hash_indexes(table))) {
+		/* only tables in the definition cache get indexes */
+		mdbi_file_unlock(f);
+		return 0;
+	}
+	for (idx = *list; idx; idx = idx->next) {
+		if (idx->col_num == node->col->col_num)
+			break;
+	}
+	if (!idx) {
+		idx = g_malloc0(sizeof(MdbHashIndex));
+		idx->col_num = node->col->col_num;
+		idx->next = *list;
+		*list = idx;
+	}
+	idx->lookups++;
+	if (!idx->ready && !idx->building && idx->lookups >= MDB_HASH_INDEX_LOOKUPS) {
+		idx->building = 1;
+		built = idx;
+	}
+	mdbi_file_unlock(f);
+
+	if (built) {
+		/* other handles may go on with table scans meanwhile */
+		int rc = mdbi_hash_index_build(table, node->col, field, built);
+
+		mdbi_file_lock(f);
+		built->building = 0;
+		/* a failed build is not tried again */
+		built->ready = 1;
+		mdbi_file_unlock(f);
+		if (rc == -1)
+			fprintf(stderr, "Can't build a hash index for table %s\n", table->name);
+	}
+
+	mdbi_file_lock(f);
+	if (!idx->ready || !idx->num_slots)
+		idx = NULL;
+	mdbi_file_unlock(f);
+	if (!idx)
+		return 0;
+	mdbi_file_stat(f, &stamp);
+	if (!mdbi_file_stamp_equal(&stamp, &idx->stamp))
+		return 0;
+
+	g_free(table->hash_merged);
+	table->hash_merged = NULL;
+	if (node->op == MDB_IN) {
+		mdbi_hash_merge_in(table, idx, node);
+	} else {
+		key = g_malloc(key_sz);
+		len = mdbi_hash_const_key(node, &key, &key_sz);
+		k = mdbi_hash_find_key(idx, key, len, mdbi_hash_bytes(key, len), &slot);
+		g_free(key);
+		table->hash_rows = k ? idx->rows + k->first : NULL;
+		table->hash_num_rows = k ? k->count : 0;
+	}
+	table->strategy = MDB_HASH_SCAN;
+	table->hash_pos = 0;
+	return 1;
+}
+
+/**
+ * mdbi_free_hash_indexes:
+ * @list: hash indexes of a table definition that is being freed
+ */
+void mdbi_free_hash_indexes(MdbHashIndex *list)
+{
+	MdbHashIndex *next;
+
+	for (; list; list = next) {
+		next = list->next;
+		mdbi_hash_free_data(list);
+		g_free(list);
+	}
+}
@@ -60,47 +60,101 @@ char idx_to_text[] = {
 0x81, 0x00, 0x00, 0x00, 'x',  0x00, 0x00, 0x00, /* 0xf8-0xff */
 };
 
-/* This table doesn't really work accurately, as it is missing
- * a lot of special processing, therefore do not use!
- * This is just some kind of fallback if MSWSTR cannot be used
- * for whatever reason and may not work for most indexes, i.e. 
- * those containing hyphens etc.
+/*
+ * Jet4 text index keys, General sort order.
+ *
+ * A key is the primary weight of each character, then END_TEXT (0x01),
+ * then the accent and case weights and the positions of the characters
+ * that have no primary weight (hyphens, apostrophes), ended by 0x00.
+ * Upper and lower case, and a letter with or without an accent, have the
+ * same primary weight.
+ *
+ * Only the primary section is generated here.  That is all an equality or
+ * LIKE prefix lookup needs to find the index entries, the rows being
+ * tested against the actual values afterwards.  Weights that aren't known
+ * are left at 0, and a string containing such a character is never looked
+ * up through an index.
  */
-char idx_to_text_ling[] = {
-0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,  /* 0-7      0x00-0x07 */
-0x01, 0x08, 0x08, 0x08, 0x08, 0x08, 0x01, 0x01,  /* 8-15     0x08-0x0F */
-0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,  /* 16-23    0x10-0x17 */
-0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,  /* 24-31    0x18-0x1F */
-0x07, 0x09, 0x0A, 0x0C, 0x0E, 0x10, 0x12, 0x01,  /* 32-39    0x20-0x27 */
-0x14, 0x16, 0x18,  ',', 0x1A, 0x01, 0x1C, 0x1E,  /* 40-47    0x28-0x2F */
- '6',  '8',  ':',  '<',  '>',  '@',  'B',  'D',  /* 48-55    0x30-0x37 */
- 'F',  'H',  ' ',  '"',  '.',  '0',  '2',  '$',  /* 56-63    0x38-0x3F */
- '&',  'J',  'L',  'M',  'O',  'Q',  'S',  'U',  /* 64-71    0x40-0x47 */
- 'W',  'Y',  '[',  '\\', '^',  '`',  'b',  'd',  /* 72-79    0x48-0x4F */
- 'f',  'h',  'i',  'k',  'm',  'o',  'q',  's',  /* 80-87    0x50-0x57 */
- 'u',  'v',  'x',  '\'', ')',  '*',  '+',  '+',  /* 88-95    0x58-0x5F */
- '+',  'J',  'L',  'M',  'O',  'Q',  'S',  'U',  /* 96-103   0x60-0x67 */
- 'W',  'Y',  '[',  '\\', '^',  '`',  'b',  'd',  /* 104-111  0x68-0x6F */
- 'f',  'h',  'i',  'k',  'm',  'o',  'q',  's',  /* 112-119  0x70-0x77 */
- 'u',  'v',  'x',  '+',  '+',  '+',  '+', 0x01,  /* 120-127  0x78-0x7F */
-0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,  /* 128-135  0x80-0x87 */
-0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,  /* 136-143  0x88-0x8F */
-0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,  /* 144-151  0x90-0x97 */
-0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,  /* 152-159  0x98-0x9F */
-0x08,  '+',  '4',  '4',  '4',  '4',  '+',  '4',  /* 160-167  0xA0-0xA7 */
- '+',  '4',  'J',  '3',  '4', 0x01,  '4',  '+',  /* 168-175  0xA8-0xAF */
- '4',  '3',  ':',  '<',  '+',  '4',  '4',  '4',  /* 176-183  0xB0-0xB7 */
- '+',  '8',  'd',  '3',  '7',  '7',  '7',  '+',  /* 184-191  0xB8-0xBF */
- 'J',  'J',  'J',  'J',  'J',  'J',  'J',  'M',  /* 192-199  0xC0-0xC7 */
- 'Q',  'Q',  'Q',  'Q',  'Y',  'Y',  'Y',  'Y',  /* 200-207  0xC8-0xCF */
- 'O',  'b',  'd',  'd',  'd',  'd',  'd',  '3',  /* 208-215  0xD0-0xD7 */
- 'd',  'o',  'o',  'o',  'o',  'v',  'm',  'k',  /* 216-223  0xD8-0xDF */
- 'J',  'J',  'J',  'J',  'J',  'J',  'J',  'M',  /* 224-231  0xE0-0xE7 */
- 'Q',  'Q',  'Q',  'Q',  'Y',  'Y',  'Y',  'Y',  /* 232-239  0xE8-0xEF */
- 'O',  'b',  'd',  'd',  'd',  'd',  'd',  '3',  /* 240-247  0xF0-0xF7 */
- 'd',  'o',  'o',  'o',  'o',  'v',  'm',  'v',  /* 248-255  0xF8-0xFF */
+#define MDB_SORT_GENERAL 1033
+#define MDB_IDX_END_TEXT 0x01
+
+/* number of keys mdbi_index_check_keys() compares, at most */
+#define MDB_INDEX_CHECK_ENTRIES 32
+
+static const unsigned char general_weights[128] = {
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x00-0x07 */
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x08-0x0f */
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x10-0x17 */
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x18-0x1f */
+0x07, 0x09, 0x0a, 0x0c, 0x0e, 0x10, 0x12, 0x00, /* 0x20-0x27  !"#$%&' */
+0x14, 0x16, 0x18, 0x2c, 0x1a, 0x00, 0x1c, 0x1e, /* 0x28-0x2f ()*+,-./ */
+0x36, 0x38, 0x3a, 0x3c, 0x3e, 0x40, 0x42, 0x44, /* 0x30-0x37 01234567 */
+0x46, 0x48, 0x20, 0x22, 0x2e, 0x30, 0x32, 0x24, /* 0x38-0x3f 89:;<=>? */
+0x26, 0x4a, 0x4c, 0x4d, 0x4f, 0x51, 0x53, 0x55, /* 0x40-0x47 @ABCDEFG */
+0x57, 0x59, 0x5b, 0x5c, 0x5e, 0x60, 0x62, 0x64, /* 0x48-0x4f HIJKLMNO */
+0x66, 0x68, 0x69, 0x6b, 0x6d, 0x6f, 0x71, 0x73, /* 0x50-0x57 PQRSTUVW */
+0x75, 0x76, 0x78, 0x27, 0x29, 0x2a, 0x00, 0x00, /* 0x58-0x5f XYZ[\]^_ */
+0x00, 0x4a, 0x4c, 0x4d, 0x4f, 0x51, 0x53, 0x55, /* 0x60-0x67 `abcdefg */
+0x57, 0x59, 0x5b, 0x5c, 0x5e, 0x60, 0x62, 0x64, /* 0x68-0x6f hijklmno */
+0x66, 0x68, 0x69, 0x6b, 0x6d, 0x6f, 0x71, 0x73, /* 0x70-0x77 pqrstuvw */
+0x75, 0x76, 0x78, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x78-0x7f xyz{|}~  */
 };
 
+/*
+ * Base letter of U+00C0 to U+017F, the Latin-1 and Latin Extended-A
+ * letters, which is where their primary weight comes from.  '.' for the
+ * ligatures, the letters with a stroke and the like, which sort on their
+ * own or as two letters.
+ */
+static const char general_latin_base[] =
+	"AAAAAA.CEEEEIIII" /* U+00C0 */
+	"DNOOOOO.OUUUUY.." /* U+00D0 */
+	"AAAAAA.CEEEEIIII" /* U+00E0 */
+	"DNOOOOO.OUUUUY.Y" /* U+00F0 */
+	"AAAAAACCCCCCCCDD" /* U+0100 */
+	"..EEEEEEEEEEGGGG" /* U+0110 */
+	"GGGGHH..IIIIIIII" /* U+0120 */
+	"I...JJKK.LLLLLL." /* U+0130 */
+	"...NNNNNN...OOOO" /* U+0140 */
+	"OO..RRRRRRSSSSSS" /* U+0150 */
+	"SSTTTT..UUUUUUUU" /* U+0160 */
+	"UUUUWWYYYZZZZZZ." /* U+0170 */;
+
+/*
+ * Writes the primary section of the General sort key of the UTF-8 string
+ * @text, END_TEXT included, to @key.  Returns its length, or -1 if @text
+ * has a character whose weight isn't known.
+ */
+static int
+mdbi_general_key(const char *text, unsigned char *key, size_t key_size)
+{
+	const unsigned char *s = (const unsigned char *)text;
+	size_t len = 0;
+	unsigned int c;
+
+	while (*s) {
+		if (*s < 0x80) {
+			c = *s++;
+		} else if ((s[0] & 0xe0) == 0xc0 && (s[1] & 0xc0) == 0x80) {
+			c = ((s[0] & 0x1f) << 6) | (s[1] & 0x3f);
+			s += 2;
+		} else {
+			return -1;
+		}
+		if (c >= 0xc0 && c < 0xc0 + sizeof(general_latin_base) - 1) {
+			if (general_latin_base[c - 0xc0] == '.')
+				return -1;
+			c = general_latin_base[c - 0xc0];
+		}
+		if (c >= 0x80 || !general_weights[c] || len + 2 > key_size)
+			return -1;
+		key[len++] = general_weights[c];
+	}
+	key[len++] = MDB_IDX_END_TEXT;
+	key[len] = '\0';
+	return len;
+}
+
 /* JET Red (v4) Index definition byte layouts
  *
  * Based on:
@@ -204,8 +258,8 @@ static void hexdump(unsigned char *tmpbuf, int size) {
 */
 
 
-GPtrArray *
-mdb_read_indices(MdbTableDef *table)
+static GPtrArray *
+mdbi_read_indices(MdbTableDef *table)
 {
 	MdbCatalogEntry *entry = table->entry;
 	MdbHandle *mdb = entry->mdb;
@@ -214,9 +268,13 @@ mdb_read_indices(MdbTableDef *table)
 	unsigned int i, j, k;
 	int key_num, col_num, cleaned_col_num;
 	int cur_pos, name_sz, idx2_sz, type_offset;
-	int index_start_pg = mdb->cur_pg;
+	int index_start_pg;
 	gchar *tmpbuf;
 
+	if (mdbi_tdef_read_indices(table))
+		return NULL;
+
+	index_start_pg = mdb->cur_pg;
 	table->indices = g_ptr_array_new();
 
 	if (IS_JET3(mdb)) {
@@ -319,9 +377,10 @@ mdb_read_indices(MdbTableDef *table)
 		}
 		//fprintf(stderr, "index %d #%d (%s) index_type:%d\n", i, pidx->index_num, pidx->name, pidx->index_type);
 
+		/* after 4 unknown bytes, as HACKING.md has it */
 		pidx->num_rows = mdb_get_int32(mdb->alt_pg_buf, 
 				fmt->tab_cols_start_offset +
-				(pidx->index_num*fmt->tab_ridx_entry_size));
+				(pidx->index_num*fmt->tab_ridx_entry_size) + 4);
 		/*
 		fprintf(stderr, "ridx block1 i:%d data1:0x%08x data2:0x%08x\n",
 			i,
@@ -379,13 +438,39 @@ mdb_read_indices(MdbTableDef *table)
 		//fprintf(stderr, "pidx->first_pg:%d pidx->flags:0x%02x\n",	pidx->first_pg, pidx->flags);
 		if (!IS_JET3(mdb)) cur_pos += 5;
 	}
+	mdbi_tdef_save_indices(table);
 	return NULL;
 }
-void
+
+GPtrArray *
+mdb_read_indices(MdbTableDef *table)
+{
+	MdbFile *f = table->entry->mdb->f;
+	GPtrArray *indices;
+
+	/* the cached definition's indices are shared with other handles */
+	mdbi_file_lock(f);
+	indices = mdbi_read_indices(table);
+	mdbi_file_unlock(f);
+	return indices;
+}
+/**
+ * mdb_index_hash_text:
+ * @mdb: Handle to the database
+ * @text: string to look up, UTF-8 for Jet4
+ * @hash: receives the key, at least 256 bytes
+ *
+ * Converts @text to the form its entries take in a text index.  For Jet4
+ * only the part of the key up to and including END_TEXT (0x01) is
+ * reliable: the accent and case weights after it are only there when the
+ * key comes from libmswstr.
+ *
+ * Returns: 1, or 0 if @text can't be converted and @hash was left empty.
+ */
+int
 mdb_index_hash_text(MdbHandle *mdb, char *text, char *hash)
 {
 	unsigned int k, len=strlen(text);
-	char *transtbl=NULL;
 
 	if (!IS_JET3(mdb))
 	{
@@ -397,32 +482,26 @@ mdb_index_hash_text(MdbHandle *mdb, char *text, char *hash)
 			out_ptr[i*2] = text[i];
 			out_ptr[i*2+1] = 0;
 		}
-        if (!(k=DBLCMapStringW(MAKELCID(mdb->f->lang_id, 0),
+        if ((k=DBLCMapStringW(MAKELCID(mdb->f->lang_id, 0),
                 LCMAP_LINGUISTIC_CASING | LCMAP_SORTKEY | NORM_IGNORECASE | NORM_IGNOREKANATYPE | NORM_IGNOREWIDTH,
                 (WCHAR*)out_ptr, len, (LPBYTE)hash, len*2)))
-		{
-			len++;
+			return 1;
 #endif
-		transtbl = idx_to_text_ling;
-#ifdef __MSWSTR_H__
-		}
-#endif
-	}
-	else
-	{
-		transtbl = idx_to_text;
+		if (mdb->f->lang_id == MDB_SORT_GENERAL &&
+				mdbi_general_key(text, (unsigned char *)hash, 256) >= 0)
+			return 1;
+		hash[0] = '\0';
+		return 0;
 	}
-	if (transtbl)
-	{
-		for (k=0;k<len;k++) {
-			unsigned char c = ((unsigned char *)(text))[k];
-			hash[k] = transtbl[c];
-			if (!(hash[k])) fprintf(stderr, 
-					"No translation available for %02x %d\n", c, c);
-		}
-		hash[len]='\0';
+	for (k=0;k<len;k++) {
+		unsigned char c = ((unsigned char *)(text))[k];
+		hash[k] = idx_to_text[c];
+		if (!(hash[k])) fprintf(stderr, 
+				"No translation available for %02x %d\n", c, c);
 	}
+	hash[len]='\0';
 	//printf ("mdb_index_hash_text %s -> %s (%d -> %d)\n", text, hash, len, k);
+	return 1;
 }
 /*
  * reverse the order of the column for hashing
@@ -436,6 +515,33 @@ mdb_index_swap_n(unsigned char *src, int sz, unsigned char *dest)
 		dest[j++] = src[i];
 	}
 }
+/*
+ * Builds the primary section of the index key @sarg looks up, into @key.
+ * A LIKE only looks up the literal prefix of its pattern, and that without
+ * END_TEXT, since longer strings start with it too.
+ *
+ * Returns 0 if the key can't be built.
+ */
+static int
+mdbi_index_sarg_key(MdbHandle *mdb, MdbSarg *sarg, char *key)
+{
+	char text[sizeof(sarg->value.s)];
+	char *p;
+
+	if (sarg->op == MDB_LIKE || sarg->op == MDB_ILIKE) {
+		size_t len = mdb_like_literal_prefix(sarg->value.s);
+
+		memcpy(text, sarg->value.s, len);
+		text[len] = '\0';
+	} else {
+		strcpy(text, sarg->value.s);
+	}
+	if (!mdb_index_hash_text(mdb, text, key))
+		return 0;
+	if ((p = strchr(key, MDB_IDX_END_TEXT)))
+		p[sarg->op == MDB_EQUAL ? 1 : 0] = '\0';
+	return 1;
+}
 void 
 mdb_index_cache_sarg(MdbColumn *col, MdbSarg *sarg, MdbSarg *idx_sarg)
 {
@@ -444,18 +550,22 @@ mdb_index_cache_sarg(MdbColumn *col, MdbSarg *sarg, MdbSarg *idx_sarg)
 
 	switch (col->col_type) {
 		case MDB_TEXT:
-		mdb_index_hash_text(col->table->mdbidx, sarg->value.s, idx_sarg->value.s);
+		mdbi_index_sarg_key(col->table->mdbidx, sarg, idx_sarg->value.s);
 		break;
 
+		/* big endian, with the sign bit flipped so that they sort */
 		case MDB_LONGINT:
-		idx_sarg->value.i = GUINT32_SWAP_LE_BE(sarg->value.i);
-		//cache_int = sarg->value.i * -1;
-		c = (unsigned char *) &(idx_sarg->value.i);
-		c[0] |= 0x80;
-		//printf("int %08x %02x %02x %02x %02x\n", sarg->value.i, c[0], c[1], c[2], c[3]);
+		c = (unsigned char *)idx_sarg->value.s;
+		c[0] = ((guint32)sarg->value.i >> 24) ^ 0x80;
+		c[1] = (guint32)sarg->value.i >> 16;
+		c[2] = (guint32)sarg->value.i >> 8;
+		c[3] = (guint32)sarg->value.i;
 		break;	
 
 		case MDB_INT:
+		c = (unsigned char *)idx_sarg->value.s;
+		c[0] = ((guint16)sarg->value.i >> 8) ^ 0x80;
+		c[1] = (guint16)sarg->value.i;
 		break;	
 
 		default:
@@ -491,6 +601,30 @@ int lastchar;
 	return 1;
 }
 #endif
+/*
+ * Tests an integer key against the key mdb_index_cache_sarg() made of the
+ * constant of @sarg.  Keys of a descending column have their bits
+ * flipped.  Only the operators whose matches are next to each other in
+ * the index can reject a key; the others are left to the row test.
+ */
+static int
+mdbi_index_test_int_key(MdbSarg *sarg, char *buf, int size, int order)
+{
+	unsigned char key[4];
+	int i, cmp;
+
+	for (i=0; i<size; i++)
+		key[i] = order == MDB_DESC ? ~buf[i] : buf[i];
+	cmp = memcmp(key, sarg->value.s, size);
+	switch (sarg->op) {
+		case MDB_EQUAL: return cmp == 0;
+		case MDB_GT: return cmp > 0;
+		case MDB_LT: return cmp < 0;
+		case MDB_GTEQ: return cmp >= 0;
+		case MDB_LTEQ: return cmp <= 0;
+	}
+	return 1;
+}
 int
 mdb_index_test_sargs(MdbHandle *mdb, MdbIndex *idx, char *buf, int len)
 {
@@ -544,10 +678,33 @@ mdb_index_test_sargs(MdbHandle *mdb, MdbIndex *idx, char *buf, int len)
 			field.value = buf;
 		       	field.siz = c_len;
 		       	field.is_null = FALSE;
-			/* In Jet 4 Index text hashes don't need to be converted from Unicode */
-			if (!IS_JET3(mdb) && col->col_type == MDB_TEXT)
+			/*
+			 * LIKE is tested on its literal prefix only, which bounds
+			 * the scan to the keys starting with it.  The whole pattern
+			 * is tested later against the row.
+			 */
+			if (col->col_type == MDB_TEXT &&
+			 (sarg->op == MDB_LIKE || sarg->op == MDB_ILIKE)) {
+				if (strncmp(buf, sarg->value.s, strlen(sarg->value.s)))
+					return 0;
+			}
+			/*
+			 * Jet4 keys are only compared up to the end of their
+			 * primary weights.  Other operators are left to the row
+			 * test, the index order not being the one they compare in.
+			 */
+			else if (!IS_JET3(mdb) && col->col_type == MDB_TEXT)
 			{
-				if (!mdb_test_string(&node, buf)) return 0;
+				if (sarg->op == MDB_EQUAL &&
+				 strncmp(buf, sarg->value.s, strlen(sarg->value.s)))
+					return 0;
+			}
+			else if (col->col_type == MDB_INT || col->col_type == MDB_LONGINT) {
+				/* a null, which no comparison matches */
+				if (len < col->col_size)
+					return 0;
+				if (!mdbi_index_test_int_key(sarg, buf, col->col_size, idx->key_col_order[i]))
+					return 0;
 			}
 			else if (!mdb_test_sarg(mdb, col, &node, &field)) {
 				/* sarg didn't match, no sense going on */
@@ -799,6 +956,53 @@ mdb_index_unwind(MdbHandle *mdb, MdbIndex *idx, MdbIndexChain *chain)
 	}
 	return ipg;
 }
+/*
+ * Copies the key of the entry mdb_index_find_next_on_page() found to
+ * ipg->cache_value, filling in what the page's prefix compression left
+ * out, and returns the page and row it points to.  @tail is the number of
+ * bytes after the key: 4 on leaf pages, 8 on the pages above them, whose
+ * entries also point to a child page.
+ */
+static guint32
+mdbi_index_entry_key(MdbHandle *mdb, MdbIndex *idx, MdbIndexPage *ipg, int tail, int *key_len)
+{
+	MdbColumn *col;
+	int idx_sz;
+	int idx_start = 0;
+	unsigned short compress_bytes;
+	int compressed;
+
+	col=g_ptr_array_index(idx->table->columns,idx->key_col_num[0]-1);
+	idx_sz = mdb_col_fixed_size(col);
+	compress_bytes = mdb_get_int16(mdb->pg_buf, IS_JET3(mdb)?0x14:0x18);
+	compressed = idx->num_keys==1 && compress_bytes > 1 && ipg->start_pos>1;
+	/*
+	 * A null in a fixed size column is the flag byte alone: its key is
+	 * given as empty.  Entries after the first leave out the prefix they
+	 * share with it, flag included.
+	 */
+	if (idx_sz>0 && idx->num_keys==1 &&
+			(ipg->start_pos>1 ? compress_bytes : 0) + ipg->len - tail < idx_sz + 1) {
+		*key_len = 0;
+		return mdb_get_int32_msb(mdb->pg_buf, ipg->offset + ipg->len - tail);
+	}
+	/* handle compressed indexes, single key indexes only? */
+	/* Length from Index - the trailing bytes (data page/row), and the
+	 * flags, which only the first entry has unless nothing is shared */
+	if (idx_sz<0) idx_sz = ipg->len - tail - (ipg->start_pos==1 || !compress_bytes ? 1 : 0);
+	if (idx_sz>0 && compressed /*ipg->len - 4 < idx_sz*/) {
+		//printf("short index found\n");
+		//mdb_buffer_dump(ipg->cache_value, 0, idx_sz);
+		memcpy(&ipg->cache_value[compress_bytes-1], &mdb->pg_buf[ipg->offset], ipg->len);
+		//mdb_buffer_dump(ipg->cache_value, 0, idx_sz);
+	} else {
+		idx_start = ipg->offset + (ipg->len - tail - idx_sz);
+		memcpy(ipg->cache_value, &mdb->pg_buf[idx_start], idx_sz);
+	}
+	*key_len = idx_sz;
+
+	return mdb_get_int32_msb(mdb->pg_buf, ipg->offset + ipg->len - tail);
+}
 /*
  * the main index function.
  * caller provides an index chain which is the current traversal of index
@@ -817,9 +1021,6 @@ mdb_index_find_next(MdbHandle *mdb, MdbIndex *idx, MdbIndexChain *chain, guint32
 	MdbIndexPage *ipg;
 	int passed = 0;
 	int idx_sz;
-	int idx_start = 0;
-	unsigned short compress_bytes;
-	MdbColumn *col;
 	guint32 pg_row;
 
 	ipg = mdb_index_read_bottom_pg(mdb, idx, chain);
@@ -842,8 +1043,9 @@ mdb_index_find_next(MdbHandle *mdb, MdbIndex *idx, MdbIndexChain *chain, guint32
 
 				if (!chain->last_leaf_found) return 0;
 				mdb_read_pg(mdb, chain->last_leaf_found);
+				/* next leaf; 0x0c is the previous one in Jet4 */
 				chain->last_leaf_found = mdb_get_int32(
-					mdb->pg_buf, 0x0c);
+					mdb->pg_buf, IS_JET3(mdb) ? 0x0c : 0x10);
 				//printf("next leaf %lu\n", chain->last_leaf_found);
 				mdb_read_pg(mdb, chain->last_leaf_found);
 				/* reuse the chain for cleanup mode */
@@ -856,26 +1058,11 @@ mdb_index_find_next(MdbHandle *mdb, MdbIndex *idx, MdbIndexChain *chain, guint32
 					return 0;
 			}
 		}
-		pg_row = mdb_get_int32_msb(mdb->pg_buf, ipg->offset + ipg->len - 4);
+		pg_row = mdbi_index_entry_key(mdb, idx, ipg, 4, &idx_sz);
 		*row = pg_row & 0xff;
 		*pg = pg_row >> 8;
 		//printf("row = %d pg = %lu ipg->pg = %lu offset = %lu len = %d\n", *row, *pg, ipg->pg, ipg->offset, ipg->len);
-		col=g_ptr_array_index(idx->table->columns,idx->key_col_num[0]-1);
-		idx_sz = mdb_col_fixed_size(col);
-		/* handle compressed indexes, single key indexes only? */
-		if (idx_sz<0) idx_sz = ipg->len - (ipg->start_pos==1?5:4); // Length from Index - the 4 trailing bytes (data page/row), Skip flags on first page
-		compress_bytes = mdb_get_int16(mdb->pg_buf, IS_JET3(mdb)?0x14:0x18);
-		if (idx->num_keys==1 && idx_sz>0 && compress_bytes > 1 && ipg->start_pos>1 /*ipg->len - 4 < idx_sz*/) {
-			//printf("short index found\n");
-			//mdb_buffer_dump(ipg->cache_value, 0, idx_sz);
-			memcpy(&ipg->cache_value[compress_bytes-1], &mdb->pg_buf[ipg->offset], ipg->len);
-			//mdb_buffer_dump(ipg->cache_value, 0, idx_sz);
-		} else {
-			idx_start = ipg->offset + (ipg->len - 4 - idx_sz);
-			memcpy(ipg->cache_value, &mdb->pg_buf[idx_start], idx_sz);
-		}
 
-		//idx_start = ipg->offset + (ipg->len - 4 - idx_sz);
 		passed = mdb_index_test_sargs(mdb, idx, (char *)(ipg->cache_value), idx_sz);
 		if (passed) ipg->rc=1; else if (ipg->rc) return 0;
 
@@ -982,6 +1169,34 @@ mdb_index_dump(MdbTableDef *table, MdbIndex *idx)
 	}
 	mdb_index_walk(table, idx);
 }
+/*
+ * Whether the sargs on the columns of @idx can be turned into index keys.
+ * A Jet4 text value with a character mdb_index_hash_text() has no weight
+ * for has no key, and its table is scanned instead.
+ */
+static int
+mdbi_index_usable(MdbTableDef *table, MdbIndex *idx)
+{
+	MdbHandle *mdb = table->entry->mdb;
+	MdbColumn *col;
+	MdbSarg *sarg;
+	char key[sizeof(MdbAny)];
+	unsigned int i, j;
+
+	if (IS_JET3(mdb))
+		return 1;
+	for (i = 0; i < idx->num_keys; i++) {
+		col = g_ptr_array_index(table->columns, idx->key_col_num[i]-1);
+		if (col->col_type != MDB_TEXT)
+			continue;
+		for (j = 0; j < col->num_sargs; j++) {
+			sarg = g_ptr_array_index(col->sargs, j);
+			if (!mdbi_index_sarg_key(mdb, sarg, key))
+				return 0;
+		}
+	}
+	return 1;
+}
 /*
  * compute_cost tries to assign a cost to a given index using the sargs 
  * available in this query.
@@ -998,6 +1213,7 @@ int mdb_index_compute_cost(MdbTableDef *table, MdbIndex *idx)
 	int not_all_equal = 0;
 
 	if (!idx->num_keys) return 0;
+	if (!mdbi_index_usable(table, idx)) return 0;
 	if (idx->num_keys > 1) {
 		for (i=0;i<idx->num_keys;i++) {
 			col=g_ptr_array_index(table->columns,idx->key_col_num[i]-1);
@@ -1017,7 +1233,8 @@ int mdb_index_compute_cost(MdbTableDef *table, MdbIndex *idx)
 
 	/*
 	 * a like with a wild card first is useless as a sarg */
-	if ((sarg->op == MDB_LIKE || sarg->op == MDB_ILIKE) && sarg->value.s[0]=='%')
+	if ((sarg->op == MDB_LIKE || sarg->op == MDB_ILIKE) &&
+			!mdb_like_literal_prefix(sarg->value.s))
 		return 0;
 
 	/*
@@ -1111,18 +1328,115 @@ mdb_choose_index(MdbTableDef *table, int *choice)
 	if (least==99) return MDB_TABLE_SCAN;
 	return MDB_INDEX_SCAN;
 }
+/*
+ * Checks keys of @idx against the keys built from the values of the rows
+ * they point to, so that a file whose keys weren't built the way
+ * mdb_index_hash_text() builds them is table scanned instead.  The keys
+ * are taken across the root page, which spans the whole index whether it
+ * is a leaf or the page above them.  Entries whose value has no key are
+ * passed over.
+ *
+ * At most MDB_INDEX_CHECK_ENTRIES keys are compared, so a weight that is
+ * wrong for a character none of them has goes unnoticed.  Only single
+ * column Jet4 text indexes are checked: the keys of the others don't
+ * depend on the sort order.  Without libmswstr, a Jet4 index on more than
+ * one column with a text column among them isn't used at all, as its keys
+ * can't be checked here.
+ *
+ * Returns 1 if the keys agree.
+ */
+static int
+mdbi_index_check_keys(MdbTableDef *table, MdbIndex *idx)
+{
+	MdbHandle *mdb = table->entry->mdb;
+	MdbHandle *mdbidx;
+	MdbField *fields;
+	MdbIndexPage ipg;
+	MdbField *field;
+	char value[MDB_BIND_SIZE], key[sizeof(MdbAny)];
+	char *p;
+	guint32 pg_row;
+	int row_start, key_len, tail, entries, stride, i;
+	size_t row_size;
+	unsigned int k;
+	int checked = 0, ok = 1;
+
+	if (IS_JET3(mdb))
+		return 1;
+	for (k = 0; k < idx->num_keys; k++) {
+		if (((MdbColumn *)g_ptr_array_index(table->columns, idx->key_col_num[k]-1))->col_type == MDB_TEXT)
+			break;
+	}
+	if (k == idx->num_keys)
+		return 1;
+	if (idx->num_keys != 1) {
+#ifdef HAVE_LIBMSWSTR
+		return 1;
+#else
+		return 0;
+#endif
+	}
+	mdbidx = mdb_clone_handle(mdb);
+	fields = g_malloc(sizeof(MdbField) * table->num_cols);
+	mdb_index_page_init(mdbidx, &ipg);
+	ipg.pg = idx->first_pg;
+	if (!mdb_read_pg(mdbidx, ipg.pg) || (mdbidx->pg_buf[0] != MDB_PAGE_LEAF &&
+			mdbidx->pg_buf[0] != MDB_PAGE_INDEX)) {
+		ok = 0;
+		goto out;
+	}
+	tail = mdbidx->pg_buf[0] == MDB_PAGE_LEAF ? 4 : 8;
+	entries = mdb_index_unpack_bitmap(mdbidx, &ipg) - 1;
+	stride = entries / MDB_INDEX_CHECK_ENTRIES + 1;
+
+	for (i = 0; ok && mdb_index_find_next_on_page(mdbidx, &ipg); i++) {
+		/* every entry is read, for the prefix of the next one */
+		pg_row = mdbi_index_entry_key(mdbidx, idx, &ipg, tail, &key_len);
+		ipg.offset += ipg.len;
+		if (i % stride || key_len <= 0 || key_len >= (int)sizeof(ipg.cache_value))
+			continue;
+		ipg.cache_value[key_len] = '\0';
+
+		if (!mdb_read_pg(mdb, pg_row >> 8) ||
+				mdb_find_row(mdb, pg_row & 0xff, &row_start, &row_size) ||
+				row_size == 0)
+			continue;
+		if (mdb_crack_row(table, row_start & OFFSET_MASK, row_size, fields) < 0)
+			continue;
+		field = &fields[idx->key_col_num[0]-1];
+		if (field->is_null)
+			continue;
+		mdb_unicode2ascii(mdb, field->value, field->siz, value, sizeof(value));
+		if (!mdb_index_hash_text(mdb, value, key) ||
+				!(p = strchr(key, MDB_IDX_END_TEXT)))
+			continue;
+		p[1] = '\0';
+		if (strncmp((char *)ipg.cache_value, key, strlen(key)))
+			ok = 0;
+		checked++;
+	}
+	if (!checked && entries > 0)
+		ok = 0;
+out:
+	g_free(fields);
+	mdb_close(mdbidx);
+	return ok;
+}
 void
 mdb_index_scan_init(MdbHandle *mdb, MdbTableDef *table)
 {
 	int i;
 
-	if (mdb_get_option(MDB_USE_INDEX) && mdb_choose_index(table, &i) == MDB_INDEX_SCAN) {
+	if (mdb_get_option(MDB_USE_INDEX) && mdb_choose_index(table, &i) == MDB_INDEX_SCAN &&
+			mdbi_index_check_keys(table, g_ptr_array_index(table->indices, i))) {
 		table->strategy = MDB_INDEX_SCAN;
 		table->scan_idx = g_ptr_array_index (table->indices, i);
 		table->chain = g_malloc0(sizeof(MdbIndexChain));
 		table->mdbidx = mdb_clone_handle(mdb);
 		mdb_read_pg(table->mdbidx, table->scan_idx->first_pg);
 		//printf("best index is %s\n",table->scan_idx->name);
+	} else {
+		mdbi_hash_scan_init(table);
 	}
 	//printf("TABLE SCAN? %d\n", table->strategy);
 }
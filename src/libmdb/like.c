@@ -20,6 +20,82 @@
 #include <string.h>
 #include "mdbtools.h"
 
+/* Does the @n byte segment @r, '_' matching any byte, match the start of @s? */
+static int
+mdbi_like_seg_eq(const char *s, const char *r, size_t n)
+{
+	size_t i;
+
+	for (i=0; i<n; i++) {
+		if (r[i] != '_' && r[i] != s[i])
+			return 0;
+	}
+	return 1;
+}
+
+/* leftmost place in the @len bytes at @s where the segment @r matches */
+static const char *
+mdbi_like_seg_find(const char *s, size_t len, const char *r, size_t n)
+{
+	const char *end;
+
+	if (n > len)
+		return NULL;
+#ifdef HAVE_MEMMEM
+	if (!memchr(r, '_', n))
+		return memmem(s, len, r, n);
+#endif
+	for (end = s + len - n; s <= end; s++) {
+		if (mdbi_like_seg_eq(s, r, n))
+			return s;
+	}
+	return NULL;
+}
+
+/*
+ * Matcher for the general case.  The pattern is split on '%': the segment
+ * before the first one must match at the start, the one after the last at
+ * the end, and the ones in between in order, each at the leftmost place
+ * after the one before.  Taking the leftmost match never loses a match
+ * that a later one would find, so nothing is backtracked and a pattern
+ * like "%a%a%a%b" stays linear in the length of the subject.  Segments
+ * without '_' are searched with memmem() where there is one; the plain
+ * search taken otherwise is linear only for short segments.
+ */
+static int
+mdbi_like_match(const char *s, const char *r)
+{
+	const char *pct = strchr(r, '%'), *last, *found;
+	size_t len = strlen(s), n;
+
+	if (!pct)
+		return len == strlen(r) && mdbi_like_seg_eq(s, r, len);
+
+	n = pct - r;
+	if (n > len || !mdbi_like_seg_eq(s, r, n))
+		return 0;
+	s += n;
+	len -= n;
+
+	last = strrchr(r, '%') + 1;
+	n = strlen(last);
+	if (n > len || !mdbi_like_seg_eq(s + len - n, last, n))
+		return 0;
+	len -= n;
+
+	for (r = pct + 1; r < last; r = pct + 1) {
+		pct = strchr(r, '%');
+		n = pct - r;
+		if (!n)
+			continue;
+		if (!(found = mdbi_like_seg_find(s, len, r, n)))
+			return 0;
+		len -= found + n - s;
+		s = found + n;
+	}
+	return 1;
+}
+
 /**
  *
  * @param s: String to search within.
@@ -33,39 +109,8 @@
  */
 int mdb_like_cmp(char *s, char *r)
 {
-	unsigned int i;
-	int ret;
-
 	mdb_debug(MDB_DEBUG_LIKE, "comparing %s and %s", s, r);
-	switch (r[0]) {
-		case '\0':
-			return (s[0]=='\0');
-		case '_':
-			/* skip one character */
-			return mdb_like_cmp(&s[1],&r[1]);
-		case '%':
-			/* skip any number of characters */
-			/* the strlen(s)+1 is important so the next call can */
-			/* if there are trailing characters */
-			for(i=0;i<strlen(s)+1;i++) {
-				if (mdb_like_cmp(&s[i],&r[1])) {
-					return 1;
-				}
-			}
-			return 0;
-		default:
-			for(i=0;i<strlen(r);i++) {
-				if (r[i]=='_' || r[i]=='%') break;
-			}
-			if (strncmp(s,r,i)) {
-				return 0;
-			} else {
-				mdb_debug(MDB_DEBUG_LIKE, "at pos %d comparing %s and %s", i, &s[i], &r[i]);
-				ret = mdb_like_cmp(&s[i],&r[i]);
-				mdb_debug(MDB_DEBUG_LIKE, "returning %d (%s and %s)", ret, &s[i], &r[i]);
-				return ret;
-			}
-	}
+	return mdbi_like_match(s, r);
 }
 
 /**
@@ -89,3 +134,157 @@ int mdb_ilike_cmp(char *s, char *r) {
 	return result;
 }
 
+/*
+ * Precompiled patterns.  Most patterns used in practice are a literal with
+ * a '%' at one or both ends, those are matched with a single compare or
+ * strstr() instead of the general matcher.
+ */
+enum {
+	MDB_LIKE_GENERAL,
+	MDB_LIKE_EXACT,		/* abc */
+	MDB_LIKE_PREFIX,	/* abc% */
+	MDB_LIKE_SUFFIX,	/* %abc */
+	MDB_LIKE_CONTAINS	/* %abc% */
+};
+
+struct S_MdbLikePattern {
+	int	kind;
+	int	icase;
+	char	*pattern;	/* case folded for ILIKE */
+	char	*literal;	/* the part between the wildcards for fast paths */
+	size_t	literal_len;
+	char	*fold_buf;	/* reused to case fold ASCII subjects */
+	size_t	fold_sz;
+};
+
+/**
+ * mdb_like_compile:
+ * @pattern: LIKE pattern using '%' and '_' wildcards
+ * @icase: non-zero to build an ILIKE (case-insensitive) matcher
+ *
+ * Analyzes @pattern once so it can be matched against many strings with
+ * mdb_like_match().  For ILIKE the pattern is case folded here rather than
+ * on every comparison.
+ *
+ * Returns: a newly allocated pattern, to be freed with mdb_like_free().
+ */
+MdbLikePattern *
+mdb_like_compile(const char *pattern, int icase)
+{
+	MdbLikePattern *like = g_malloc0(sizeof(MdbLikePattern));
+	size_t len, start = 0, end;
+
+	like->icase = icase;
+	like->pattern = icase ? g_utf8_casefold(pattern, -1) : g_strdup(pattern);
+
+	len = strlen(like->pattern);
+	end = len;
+	if (end > 0 && like->pattern[0] == '%')
+		start = 1;
+	if (end > start && like->pattern[end-1] == '%')
+		end--;
+	if (strcspn(like->pattern + start, "%_") < end - start) {
+		like->kind = MDB_LIKE_GENERAL;
+		return like;
+	}
+	like->literal_len = end - start;
+	like->literal = g_malloc(like->literal_len + 1);
+	memcpy(like->literal, like->pattern + start, like->literal_len);
+	like->literal[like->literal_len] = '\0';
+	if (start && end < len)
+		like->kind = MDB_LIKE_CONTAINS;
+	else if (start)
+		like->kind = MDB_LIKE_SUFFIX;
+	else if (end < len)
+		like->kind = MDB_LIKE_PREFIX;
+	else
+		like->kind = MDB_LIKE_EXACT;
+	return like;
+}
+
+void
+mdb_like_free(MdbLikePattern *like)
+{
+	if (!like) return;
+	g_free(like->pattern);
+	g_free(like->literal);
+	g_free(like->fold_buf);
+	g_free(like);
+}
+
+/* case fold @s, without allocating when it is plain ASCII */
+static const char *
+mdbi_like_fold(MdbLikePattern *like, const char *s, char **folded)
+{
+	size_t i, len = strlen(s);
+
+	for (i=0; i<len; i++) {
+		if ((unsigned char)s[i] >= 0x80)
+			return *folded = g_utf8_casefold(s, len);
+	}
+	if (len >= like->fold_sz) {
+		g_free(like->fold_buf);
+		like->fold_sz = len + 64;
+		like->fold_buf = g_malloc(like->fold_sz);
+	}
+	for (i=0; i<len; i++) {
+		char c = s[i];
+		like->fold_buf[i] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+	}
+	like->fold_buf[len] = '\0';
+	return like->fold_buf;
+}
+
+/**
+ * mdb_like_match:
+ * @like: Pattern returned by mdb_like_compile()
+ * @s: String to test
+ *
+ * Returns: 1 if @s matches the pattern, 0 if it does not.
+ */
+int
+mdb_like_match(MdbLikePattern *like, const char *s)
+{
+	char *folded = NULL;
+	size_t len;
+	int ret;
+
+	if (like->icase)
+		s = mdbi_like_fold(like, s, &folded);
+
+	switch (like->kind) {
+		case MDB_LIKE_EXACT:
+			ret = !strcmp(s, like->literal);
+			break;
+		case MDB_LIKE_PREFIX:
+			ret = !strncmp(s, like->literal, like->literal_len);
+			break;
+		case MDB_LIKE_SUFFIX:
+			len = strlen(s);
+			ret = len >= like->literal_len &&
+				!memcmp(s + len - like->literal_len, like->literal, like->literal_len);
+			break;
+		case MDB_LIKE_CONTAINS:
+			ret = strstr(s, like->literal) != NULL;
+			break;
+		default:
+			ret = mdbi_like_match(s, like->pattern);
+			break;
+	}
+	g_free(folded);
+	return ret;
+}
+
+/**
+ * mdb_like_literal_prefix:
+ * @pattern: LIKE pattern
+ *
+ * Returns: the number of leading bytes of @pattern before the first
+ * wildcard.  Every string matching the pattern starts with them, which
+ * lets an index scan be bounded to that range.
+ */
+size_t
+mdb_like_literal_prefix(const char *pattern)
+{
+	return strcspn(pattern, "%_");
+}
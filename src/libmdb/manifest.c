@@ -0,0 +1,391 @@
+/* MDB Tools - A library for reading MS Access database files
+ * Copyright (C) 2000 Brian Bruns
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "mdbtools.h"
+#include "mdbprivate.h"
+#include <errno.h>
+
+/*
+ * Page manifests, for exporting only what changed since the last export.
+ * A manifest holds, for each table, a checksum of each of its data pages.
+ * The checksum covers the whole page, and the LVAL rows of the MEMO and
+ * OLE values on it that aren't stored inline, since those can be
+ * rewritten without touching the data page.  Comparing the manifest of
+ * the file as it is now with the one saved by the last export tells which
+ * tables are unchanged, and which pages of the others have to be read
+ * again.
+ *
+ * On disk a manifest is a text file:
+ *
+ *	mdbtools manifest 1
+ *	table <number of pages> <table name>
+ *	<page> <checksum, 16 hex digits>
+ *	...
+ *
+ * with the tables sorted by name, and the pages of each in page order.
+ */
+
+#define MDB_MANIFEST_HEADER "mdbtools manifest 1"
+
+/* 64-bit FNV-1a */
+#define MDB_FNV64_INIT 14695981039346656037ULL
+#define MDB_FNV64_PRIME 1099511628211ULL
+
+typedef struct {
+	guint32 pg;
+	guint64 sum;
+} MdbPageSum;
+
+struct S_MdbManifestTable {
+	char *name;
+	unsigned int num_pages;
+	MdbPageSum *pages; /* in page order */
+};
+
+struct S_MdbManifest {
+	GPtrArray *tables;
+	GHashTable *by_name;
+};
+
+static guint64 mdbi_fnv64(guint64 sum, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		sum = (sum ^ p[i]) * MDB_FNV64_PRIME;
+	return sum;
+}
+
+/* Folds the LVAL data of the MEMO and OLE values of a row into @sum */
+static guint64 mdbi_manifest_lvals(MdbTableDef *table, MdbField *fields, int num_fields, guint64 sum)
+{
+	MdbHandle *mdb = table->entry->mdb;
+	MdbColumn *col;
+	MdbLvalCursor *lval;
+	char buf[MDB_PGSIZE];
+	size_t len;
+	int i;
+
+	for (i = 0; i < num_fields; i++) {
+		col = g_ptr_array_index(table->columns, fields[i].colnum);
+		if (col->col_type != MDB_MEMO && col->col_type != MDB_OLE)
+			continue;
+		if (fields[i].is_null || fields[i].siz < MDB_MEMO_OVERHEAD)
+			continue;
+		/* inline values are part of the data page */
+		if (mdb_get_int32(fields[i].value, 0) & 0x80000000)
+			continue;
+		lval = mdbi_lval_open(mdb, fields[i].value, fields[i].siz);
+		while ((len = mdb_lval_read(lval, buf, sizeof(buf))))
+			sum = mdbi_fnv64(sum, buf, len);
+		mdb_lval_close(lval);
+	}
+	return sum;
+}
+
+/* Checksum of the data page in mdb->pg_buf */
+static guint64 mdbi_manifest_page_sum(MdbTableDef *table, MdbField *fields)
+{
+	MdbHandle *mdb = table->entry->mdb;
+	guint64 sum = mdbi_fnv64(MDB_FNV64_INIT, mdb->pg_buf, mdb->fmt->pg_size);
+	unsigned int rows, i;
+	int row_start, num_fields;
+	size_t row_size;
+
+	if (!fields)
+		return sum;
+	rows = mdb_get_int16(mdb->pg_buf, mdb->fmt->row_count_offset);
+	for (i = 0; i < rows; i++) {
+		if (mdb_find_row(mdb, i, &row_start, &row_size) == -1 || row_size == 0)
+			continue;
+		if (row_start & 0x4000)
+			continue; /* deleted */
+		num_fields = mdb_crack_row(table, row_start & OFFSET_MASK, row_size, fields);
+		if (num_fields > 0)
+			sum = mdbi_manifest_lvals(table, fields, num_fields, sum);
+	}
+	return sum;
+}
+
+/**
+ * mdb_manifest_scan_table:
+ * @table: table to checksum
+ *
+ * Reads every data page of @table, as listed in its usage map, and
+ * checksums it.  If the columns of @table have been read, the LVAL rows
+ * the page points to are checksummed with it.  This goes through the page
+ * buffer of the handle, so it can't be done in the middle of a scan.
+ *
+ * Returns: the checksums, to add to a manifest with mdb_manifest_add_table()
+ * or free with mdb_manifest_free_table().
+ */
+MdbManifestTable *mdb_manifest_scan_table(MdbTableDef *table)
+{
+	MdbHandle *mdb = table->entry->mdb;
+	MdbManifestTable *mt = g_malloc0(sizeof(MdbManifestTable));
+	MdbField *fields = NULL;
+	guint32 *pages;
+	unsigned int num_pages, i;
+
+	mt->name = g_strdup(table->name);
+	pages = mdbi_table_pages(table, &num_pages);
+	mt->pages = g_malloc0((num_pages ? num_pages : 1) * sizeof(MdbPageSum));
+	if (table->columns && table->num_cols)
+		fields = g_malloc(table->num_cols * sizeof(MdbField));
+	for (i = 0; i < num_pages; i++) {
+		if (!mdb_read_pg(mdb, pages[i])) {
+			fprintf(stderr, "error: reading page %u failed.\n", pages[i]);
+			continue;
+		}
+		if (mdb->pg_buf[0] != MDB_PAGE_DATA || mdb_get_int32(mdb->pg_buf, 4) != (long)table->entry->table_pg)
+			continue;
+		mt->pages[mt->num_pages].pg = pages[i];
+		mt->pages[mt->num_pages].sum = mdbi_manifest_page_sum(table, fields);
+		mt->num_pages++;
+	}
+	g_free(fields);
+	g_free(pages);
+	return mt;
+}
+
+/**
+ * mdb_manifest_table_equal:
+ * @old: checksums from an earlier manifest, or NULL
+ * @cur: checksums of the table as it is now
+ *
+ * Returns: TRUE if the table has the same data pages in @old and @cur,
+ * with the same checksums.
+ */
+gboolean mdb_manifest_table_equal(MdbManifestTable *old, MdbManifestTable *cur)
+{
+	unsigned int i;
+
+	if (!old || old->num_pages != cur->num_pages)
+		return FALSE;
+	for (i = 0; i < cur->num_pages; i++)
+		if (old->pages[i].pg != cur->pages[i].pg || old->pages[i].sum != cur->pages[i].sum)
+			return FALSE;
+	return TRUE;
+}
+
+/**
+ * mdb_manifest_changed_pages:
+ * @old: checksums from an earlier manifest, or NULL
+ * @cur: checksums of the table as it is now
+ * @num_pages: set to the number of pages returned
+ *
+ * Lists the data pages of @cur that are not in @old, or whose checksum
+ * differs, in page order: the pages whose rows have to be exported again.
+ * Pages of @old that are not in @cur no longer hold any rows of the table.
+ *
+ * Returns: the page numbers, to be freed with g_free().
+ */
+guint32 *mdb_manifest_changed_pages(MdbManifestTable *old, MdbManifestTable *cur, unsigned int *num_pages)
+{
+	guint32 *pages = g_malloc((cur->num_pages ? cur->num_pages : 1) * sizeof(guint32));
+	unsigned int i, j = 0, len = 0;
+
+	for (i = 0; i < cur->num_pages; i++) {
+		if (old) {
+			while (j < old->num_pages && old->pages[j].pg < cur->pages[i].pg)
+				j++;
+			if (j < old->num_pages && old->pages[j].pg == cur->pages[i].pg
+			 && old->pages[j].sum == cur->pages[i].sum)
+				continue;
+		}
+		pages[len++] = cur->pages[i].pg;
+	}
+	*num_pages = len;
+	return pages;
+}
+
+void mdb_manifest_free_table(MdbManifestTable *mt)
+{
+	if (!mt)
+		return;
+	g_free(mt->name);
+	g_free(mt->pages);
+	g_free(mt);
+}
+
+MdbManifest *mdb_manifest_new(void)
+{
+	MdbManifest *manifest = g_malloc0(sizeof(MdbManifest));
+
+	manifest->tables = g_ptr_array_new();
+	manifest->by_name = g_hash_table_new(g_str_hash, g_str_equal);
+	return manifest;
+}
+
+void mdb_manifest_free(MdbManifest *manifest)
+{
+	unsigned int i;
+
+	if (!manifest)
+		return;
+	for (i = 0; i < manifest->tables->len; i++)
+		mdb_manifest_free_table(g_ptr_array_index(manifest->tables, i));
+	g_ptr_array_free(manifest->tables, TRUE);
+	g_hash_table_destroy(manifest->by_name);
+	g_free(manifest);
+}
+
+/**
+ * mdb_manifest_add_table:
+ * @manifest: manifest to add to
+ * @mt: checksums from mdb_manifest_scan_table()
+ *
+ * Adds @mt to @manifest, which takes it over.  Checksums already in
+ * @manifest for a table of the same name are dropped.
+ */
+void mdb_manifest_add_table(MdbManifest *manifest, MdbManifestTable *mt)
+{
+	MdbManifestTable *prev = g_hash_table_lookup(manifest->by_name, mt->name);
+
+	if (prev) {
+		g_ptr_array_remove(manifest->tables, prev);
+		g_hash_table_remove(manifest->by_name, prev->name);
+		mdb_manifest_free_table(prev);
+	}
+	g_ptr_array_add(manifest->tables, mt);
+	g_hash_table_insert(manifest->by_name, mt->name, mt);
+}
+
+/**
+ * mdb_manifest_find_table:
+ * @manifest: manifest to look in
+ * @name: name of the table
+ *
+ * Returns: the checksums of table @name in @manifest, or NULL if it has
+ * none.
+ */
+MdbManifestTable *mdb_manifest_find_table(MdbManifest *manifest, const char *name)
+{
+	return g_hash_table_lookup(manifest->by_name, name);
+}
+
+static int mdbi_manifest_table_cmp(const void *a, const void *b)
+{
+	const MdbManifestTable *ta = *(MdbManifestTable * const *)a;
+	const MdbManifestTable *tb = *(MdbManifestTable * const *)b;
+
+	return strcmp(ta->name, tb->name);
+}
+
+/**
+ * mdb_manifest_write:
+ * @manifest: manifest to save
+ * @path: file to write it to
+ *
+ * Returns: 0 on success, -1 on error, after printing a message.
+ */
+int mdb_manifest_write(MdbManifest *manifest, const char *path)
+{
+	MdbManifestTable *mt;
+	FILE *file;
+	unsigned int i, j;
+	int ret = 0;
+
+	if (!(file = fopen(path, "w"))) {
+		fprintf(stderr, "Can't create manifest %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	qsort(manifest->tables->pdata, manifest->tables->len, sizeof(gpointer), mdbi_manifest_table_cmp);
+	fprintf(file, "%s\n", MDB_MANIFEST_HEADER);
+	for (i = 0; i < manifest->tables->len; i++) {
+		mt = g_ptr_array_index(manifest->tables, i);
+		fprintf(file, "table %u %s\n", mt->num_pages, mt->name);
+		for (j = 0; j < mt->num_pages; j++)
+			fprintf(file, "%u %016llx\n", mt->pages[j].pg, (unsigned long long)mt->pages[j].sum);
+	}
+	if (ferror(file))
+		ret = -1;
+	if (fclose(file))
+		ret = -1;
+	if (ret)
+		fprintf(stderr, "Error writing manifest %s: %s\n", path, strerror(errno));
+	return ret;
+}
+
+/**
+ * mdb_manifest_read:
+ * @path: file written by mdb_manifest_write()
+ *
+ * Returns: the manifest saved in @path, or NULL if it can't be read,
+ * after printing a message.
+ */
+MdbManifest *mdb_manifest_read(const char *path)
+{
+	MdbManifest *manifest;
+	MdbManifestTable *mt = NULL;
+	FILE *file;
+	char line[4 * MDB_MAX_OBJ_NAME];
+	char *name, *end;
+	unsigned long num_pages = 0, pg;
+	guint64 sum;
+	unsigned int lineno = 1;
+	int bad = 0;
+
+	if (!(file = fopen(path, "r"))) {
+		fprintf(stderr, "Can't open manifest %s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+	if (!fgets(line, sizeof(line), file) || strcmp(line, MDB_MANIFEST_HEADER "\n")) {
+		fprintf(stderr, "%s is not an mdbtools manifest\n", path);
+		fclose(file);
+		return NULL;
+	}
+	manifest = mdb_manifest_new();
+	while (!bad && fgets(line, sizeof(line), file)) {
+		lineno++;
+		line[strcspn(line, "\n")] = '\0';
+		if (!strncmp(line, "table ", 6)) {
+			if (mt && mt->num_pages != num_pages)
+				break;
+			num_pages = strtoul(line + 6, &name, 10);
+			if (*name++ != ' ' || !*name) {
+				bad = 1;
+				break;
+			}
+			mt = g_malloc0(sizeof(MdbManifestTable));
+			mt->name = g_strdup(name);
+			mt->pages = g_malloc0((num_pages ? num_pages : 1) * sizeof(MdbPageSum));
+			mdb_manifest_add_table(manifest, mt);
+			continue;
+		}
+		pg = strtoul(line, &end, 10);
+		bad = !mt || mt->num_pages >= num_pages || *end++ != ' ';
+		if (!bad) {
+			sum = strtoull(end, &end, 16);
+			bad = *end || (mt->num_pages && pg <= mt->pages[mt->num_pages - 1].pg);
+		}
+		if (!bad) {
+			mt->pages[mt->num_pages].pg = pg;
+			mt->pages[mt->num_pages].sum = sum;
+			mt->num_pages++;
+		}
+	}
+	if (bad || ferror(file) || (mt && mt->num_pages != num_pages)) {
+		fprintf(stderr, "%s: bad manifest line %u\n", path, lineno);
+		mdb_manifest_free(manifest);
+		manifest = NULL;
+	}
+	fclose(file);
+	return manifest;
+}
@@ -21,114 +21,143 @@
 
 #define MAX_MONEY_PRECISION   20
 #define MAX_NUMERIC_PRECISION 40
-/* 
-** these routines are copied from the freetds project which does something
-** very similiar
-*/
 
-static int multiply_byte(unsigned char *product, int num, unsigned char *multiplier, size_t len);
-static int do_carry(unsigned char *product, size_t len);
 static char *array_to_string(unsigned char *array, size_t len, int unsigned scale, int neg);
 
-/**
- * mdb_money_to_string
- * @mdb: Handle to open MDB database file
- * @start: Offset of the field within the current page
- *
- * Returns: the allocated string that has received the value.
+static guint32 get_uint32(const unsigned char *buf)
+{
+	return (guint32)buf[0] | (guint32)buf[1] << 8 |
+		(guint32)buf[2] << 16 | (guint32)buf[3] << 24;
+}
+
+/*
+ * Reads the 16 byte magnitude of a NUMERIC field: four little-endian
+ * 32 bit words, the most significant first.
  */
-char *mdb_money_to_string(MdbHandle *mdb, int start)
+static void numeric_magnitude(MdbHandle *mdb, int start, guint64 *hi, guint64 *lo)
+{
+	const unsigned char *bytes = mdb->pg_buf + start + 1;
+
+	*hi = (guint64)get_uint32(bytes) << 32 | get_uint32(bytes + 4);
+	*lo = (guint64)get_uint32(bytes + 8) << 32 | get_uint32(bytes + 12);
+}
+
+/*
+ * Stores the decimal digits of hi:lo in digits[], least significant
+ * first, padding with zeroes up to len digits.
+ */
+static void uint128_to_digits(guint64 hi, guint64 lo, unsigned char *digits, size_t len)
 {
-	const int num_bytes=8, scale=4;
+	guint32 w[4] = { hi >> 32, hi & 0xffffffff, lo >> 32, lo & 0xffffffff };
+	size_t n = 0;
 	int i;
-	int neg=0;
-	unsigned char multiplier[MAX_MONEY_PRECISION] = { 1 };
-	unsigned char temp[MAX_MONEY_PRECISION];
-	unsigned char product[MAX_MONEY_PRECISION] = { 0 };
-	unsigned char bytes[num_bytes];
-
-	memcpy(bytes, mdb->pg_buf + start, num_bytes);
-
-	/* Perform two's complement for negative numbers */
-	if (bytes[num_bytes-1] & 0x80) {
-		neg = 1;
-		for (i=0;i<num_bytes;i++) {
-                       bytes[i] = ~bytes[i];
+
+	memset(digits, 0, len);
+	/* peel off 9 digits at a time by long division of the 32 bit words */
+	while ((w[0] || w[1]) && n < len) {
+		guint64 rem = 0;
+		for (i=0; i<4; i++) {
+			guint64 cur = rem << 32 | w[i];
+			w[i] = cur / 1000000000;
+			rem = cur % 1000000000;
 		}
-		for (i=0; i<num_bytes; i++) {
-                       bytes[i] ++;
-                       if (bytes[i]!=0) break;
+		for (i=0; i<9 && n < len; i++) {
+			digits[n++] = rem % 10;
+			rem /= 10;
 		}
 	}
-
-	for (i=0;i<num_bytes;i++) {
-		/* product += multiplier * current byte */
-               multiply_byte(product, bytes[i], multiplier, sizeof(multiplier));
-
-		/* multiplier = multiplier * 256 */
-               memcpy(temp, multiplier, sizeof(multiplier));
-               memset(multiplier, 0, sizeof(multiplier));
-		multiply_byte(multiplier, 256, temp, sizeof(multiplier));
+	/* the rest fits in 64 bits */
+	lo = (guint64)w[2] << 32 | w[3];
+	while (lo && n < len) {
+		digits[n++] = lo % 10;
+		lo /= 10;
 	}
-       return array_to_string(product, sizeof(product), scale, neg);
+}
+
+/**
+ * mdb_money_to_int64
+ * @mdb: Handle to open MDB database file
+ * @start: Offset of the field within the current page
+ * @scale: if not NULL, receives the number of decimals, always 4 for MONEY
+ *
+ * Returns: the amount in units of 1/10000.
+ */
+gint64 mdb_money_to_int64(MdbHandle *mdb, int start, int *scale)
+{
+	const unsigned char *bytes = mdb->pg_buf + start;
 
+	if (scale)
+		*scale = 4;
+	return (gint64)((guint64)get_uint32(bytes + 4) << 32 | get_uint32(bytes));
 }
 
-char *mdb_numeric_to_string(MdbHandle *mdb, int start, int scale, int prec) {
-       const int num_bytes = 16;
-       int i;
-       int neg=0;
-       unsigned char multiplier[MAX_NUMERIC_PRECISION] = { 1 };
-       unsigned char temp[MAX_NUMERIC_PRECISION];
-       unsigned char product[MAX_NUMERIC_PRECISION] = { 0 };
-       unsigned char bytes[num_bytes];
-
-       memcpy(bytes, mdb->pg_buf + start + 1, num_bytes);
-
-       /* Negative bit is stored in first byte */
-       if (mdb->pg_buf[start] & 0x80) neg = 1;
-       for (i=0;i<num_bytes;i++) {
-               /* product += multiplier * current byte */
-               multiply_byte(product, bytes[12-4*(i/4)+i%4], multiplier, sizeof(multiplier));
-
-               /* multiplier = multiplier * 256 */
-               memcpy(temp, multiplier, sizeof(multiplier));
-               memset(multiplier, 0, sizeof(multiplier));
-               multiply_byte(multiplier, 256, temp, sizeof(multiplier));
-       }
-       return array_to_string(product, sizeof(product), prec, neg);
+/**
+ * mdb_money_to_string
+ * @mdb: Handle to open MDB database file
+ * @start: Offset of the field within the current page
+ *
+ * Returns: the allocated string that has received the value.
+ */
+char *mdb_money_to_string(MdbHandle *mdb, int start)
+{
+	const int scale=4;
+	unsigned char product[MAX_MONEY_PRECISION];
+	gint64 value = mdb_money_to_int64(mdb, start, NULL);
+	/* negate as unsigned, so that the most negative value works too */
+	guint64 magnitude = value < 0 ? ~(guint64)value + 1 : (guint64)value;
+
+	uint128_to_digits(0, magnitude, product, sizeof(product));
+	return array_to_string(product, sizeof(product), scale, value < 0);
 }
 
-static int multiply_byte(unsigned char *product, int num, unsigned char *multiplier, size_t len)
+/**
+ * mdb_numeric_to_int128
+ * @mdb: Handle to open MDB database file
+ * @start: Offset of the field within the current page
+ * @prec: the column's col_prec, as for mdb_numeric_to_string()
+ * @hi: receives the upper 64 bits of the value
+ * @lo: receives the lower 64 bits of the value
+ * @value_scale: if not NULL, receives the number of decimals
+ *
+ * Reads a NUMERIC field as a two's complement 128 bit integer, to be
+ * divided by ten to the power of *@value_scale.  That is the number of
+ * decimals mdb_numeric_to_string() prints for the same arguments.
+ *
+ * Returns: 0, or -1 if the value does not fit in 128 signed bits.
+ */
+int mdb_numeric_to_int128(MdbHandle *mdb, int start, int prec,
+	gint64 *hi, guint64 *lo, int *value_scale)
 {
-	unsigned char number[3] = { num % 10, (num/10) % 10, (num/100) % 10 };
-	unsigned int i, j;
-
-	for (i=0;i<len;i++) {
-		if (multiplier[i] == 0) continue;
-		for (j=0;j<3 && i+j<len;j++) {
-			if (number[j] == 0) continue;
-			product[i+j] += multiplier[i]*number[j];
-		}
-		do_carry(product, len);
+	guint64 mag_hi, mag_lo;
+
+	/* mdb_numeric_to_string puts the decimal point prec digits in */
+	if (value_scale)
+		*value_scale = prec;
+	numeric_magnitude(mdb, start, &mag_hi, &mag_lo);
+	if (mag_hi >> 63)
+		return -1;
+	if (mdb->pg_buf[start] & 0x80) {
+		/* negate the 128 bit magnitude */
+		mag_hi = ~mag_hi;
+		mag_lo = ~mag_lo + 1;
+		if (!mag_lo)
+			mag_hi++;
 	}
+	*hi = (gint64)mag_hi;
+	*lo = mag_lo;
 	return 0;
 }
-static int do_carry(unsigned char *product, size_t len)
-{
-	unsigned int j;
 
-       for (j=0;j<len-1;j++) {
-		if (product[j]>9) {
-			product[j+1]+=product[j]/10;
-			product[j]%=10;
-		}
-	}
-	if (product[j]>9) {
-		product[j]%=10;
-	}
-	return 0;
+char *mdb_numeric_to_string(MdbHandle *mdb, int start, int scale, int prec) {
+	unsigned char product[MAX_NUMERIC_PRECISION];
+	guint64 hi, lo;
+
+	numeric_magnitude(mdb, start, &hi, &lo);
+	uint128_to_digits(hi, lo, product, sizeof(product));
+	/* Negative bit is stored in first byte */
+	return array_to_string(product, sizeof(product), prec, mdb->pg_buf[start] & 0x80);
 }
+
 static char *array_to_string(unsigned char *array, size_t len, unsigned int scale, int neg)
 {
 	char *s;
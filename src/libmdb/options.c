@@ -55,11 +55,16 @@ load_options()
     if (!optset && (s=getenv("MDBOPTS"))) {
 		opt = strtok_r(s, ":", &ctx);
 		while (opt) {
+			if (!strcmp(opt, "hash_index")) {
+				opts |= MDB_HASH_INDEX;
+			}
+			if (!strcmp(opt, "no_page_filter")) {
+				opts |= MDB_NO_PAGE_FILTER;
+			}
 			if (!strcmp(opt, "use_index")) {
-#ifdef HAVE_LIBMSWSTR
 				opts |= MDB_USE_INDEX;
-#else
-				fprintf(stderr, "The 'use_index' argument was supplied to MDBOPTS environment variable. However, this feature requires the libmswstr library, which was not found when libmdb was compiled. As a result, the 'use_index' argument will be ignored.\n\nTo enable indexes, you will need to download libmswstr from https://github.com/leecher1337/libmswstr and then recompile libmdb. Note that the 'use_index' feature is largely untested, and may have unexpected results.\n\nTo suppress this warning, run the program again after removing the 'use_index' argument from the MDBOPTS environment variable.\n");
+#ifndef HAVE_LIBMSWSTR
+				fprintf(stderr, "The 'use_index' argument was supplied to MDBOPTS environment variable. The libmswstr library was not found when libmdb was compiled, so the keys of Jet4 text indexes are built by libmdb itself. It only builds them for the General sort order, and a text index is only used once its keys have been checked against the rows they point to. Other Jet4 text indexes are not used. Note that the 'use_index' feature is largely untested, and may have unexpected results.\n\nFor other sort orders, you will need to download libmswstr from https://github.com/leecher1337/libmswstr and then recompile libmdb.\n");
 #endif
 			}
 			if (!strcmp(opt, "no_memo")) {
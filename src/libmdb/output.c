@@ -0,0 +1,242 @@
+/* MDB Tools - A library for reading MS Access database files
+ * Copyright (C) 2000 Brian Bruns
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "mdbtools.h"
+#include "mdbprivate.h"
+
+/*
+ * Buffered writer for the export tools.  Values are copied into one large
+ * buffer and handed to stdio a buffer at a time, instead of going through
+ * putc() and fprintf() a character at a time.
+ */
+
+#define MDB_OUTPUT_BUFSIZE (256 * 1024)
+
+static const char hex_digits[] = "0123456789ABCDEF";
+static const char base64_chars[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void
+mdbi_output_init(MdbOutput *out, FILE *file, char *buf, size_t size)
+{
+	memset(out, 0, sizeof(MdbOutput));
+	out->file = file;
+	out->buf = buf;
+	out->size = size;
+}
+
+/**
+ * mdb_output_new:
+ * @file: stream to write to
+ *
+ * Creates a buffered writer on @file.  Nothing reaches @file until the
+ * buffer fills up or mdb_output_flush() is called, so don't mix it with
+ * writes of your own to @file.
+ *
+ * Returns: the writer, to be released with mdb_output_free().
+ */
+MdbOutput *mdb_output_new(FILE *file)
+{
+	MdbOutput *out = g_malloc(sizeof(MdbOutput) + MDB_OUTPUT_BUFSIZE);
+
+	mdbi_output_init(out, file, (char *)(out + 1), MDB_OUTPUT_BUFSIZE);
+	return out;
+}
+
+/**
+ * mdb_output_flush:
+ * @out: writer from mdb_output_new()
+ *
+ * Writes out whatever is buffered, and flushes @out's stream.
+ *
+ * Returns: 0 on success, -1 if any write to the stream has failed.
+ */
+int mdb_output_flush(MdbOutput *out)
+{
+	if (out->len && fwrite(out->buf, 1, out->len, out->file) != out->len)
+		out->error = 1;
+	out->len = 0;
+	if (fflush(out->file))
+		out->error = 1;
+	return out->error ? -1 : 0;
+}
+
+/**
+ * mdb_output_free:
+ * @out: writer from mdb_output_new()
+ *
+ * Flushes @out and frees it.  The stream itself is left open.
+ *
+ * Returns: 0 on success, -1 if any write to the stream has failed.
+ */
+int mdb_output_free(MdbOutput *out)
+{
+	int ret = mdb_output_flush(out);
+
+	g_free(out);
+	return ret;
+}
+
+/* Makes room for at least @n bytes, @n being no more than the buffer size */
+static char *output_reserve(MdbOutput *out, size_t n)
+{
+	if (out->size - out->len < n) {
+		if (fwrite(out->buf, 1, out->len, out->file) != out->len)
+			out->error = 1;
+		out->len = 0;
+	}
+	return out->buf + out->len;
+}
+
+/**
+ * mdb_output_write:
+ * @out: writer from mdb_output_new()
+ * @data: bytes to write
+ * @len: number of bytes in @data
+ */
+void mdb_output_write(MdbOutput *out, const void *data, size_t len)
+{
+	if (out->size - out->len < len) {
+		if (fwrite(out->buf, 1, out->len, out->file) != out->len)
+			out->error = 1;
+		out->len = 0;
+		/* no point in copying what won't fit anyway */
+		if (len >= out->size) {
+			if (fwrite(data, 1, len, out->file) != len)
+				out->error = 1;
+			return;
+		}
+	}
+	memcpy(out->buf + out->len, data, len);
+	out->len += len;
+}
+
+void mdb_output_puts(MdbOutput *out, const char *s)
+{
+	mdb_output_write(out, s, strlen(s));
+}
+
+void mdb_output_putc(MdbOutput *out, char c)
+{
+	if (out->len == out->size)
+		output_reserve(out, 1);
+	out->buf[out->len++] = c;
+}
+
+/**
+ * mdb_output_hex:
+ * @out: writer from mdb_output_new()
+ * @data: bytes to write
+ * @len: number of bytes in @data
+ *
+ * Writes @data as upper case hexadecimal, two digits per byte.
+ */
+void mdb_output_hex(MdbOutput *out, const void *data, size_t len)
+{
+	const unsigned char *s = data;
+
+	while (len) {
+		char *d = output_reserve(out, 2);
+		size_t n = (out->size - out->len) / 2;
+		size_t i;
+
+		if (n > len)
+			n = len;
+		for (i = 0; i < n; i++) {
+			*d++ = hex_digits[s[i] >> 4];
+			*d++ = hex_digits[s[i] & 0x0f];
+		}
+		out->len += 2 * n;
+		s += n;
+		len -= n;
+	}
+}
+
+/**
+ * mdb_output_octal:
+ * @out: writer from mdb_output_new()
+ * @data: bytes to write
+ * @len: number of bytes in @data
+ *
+ * Writes each byte of @data as a backslash and three octal digits.
+ */
+void mdb_output_octal(MdbOutput *out, const void *data, size_t len)
+{
+	const unsigned char *s = data;
+
+	while (len) {
+		char *d = output_reserve(out, 4);
+		size_t n = (out->size - out->len) / 4;
+		size_t i;
+
+		if (n > len)
+			n = len;
+		for (i = 0; i < n; i++) {
+			*d++ = '\\';
+			*d++ = '0' + (s[i] >> 6);
+			*d++ = '0' + ((s[i] >> 3) & 7);
+			*d++ = '0' + (s[i] & 7);
+		}
+		out->len += 4 * n;
+		s += n;
+		len -= n;
+	}
+}
+
+/**
+ * mdb_output_base64:
+ * @out: writer from mdb_output_new()
+ * @data: bytes to write
+ * @len: number of bytes in @data
+ *
+ * Writes @data base64 encoded, padded with '=' as needed.  A long value
+ * may be written in several calls, as long as each but the last is given
+ * a multiple of 3 bytes.
+ */
+void mdb_output_base64(MdbOutput *out, const void *data, size_t len)
+{
+	const unsigned char *s = data;
+
+	while (len >= 3) {
+		char *d = output_reserve(out, 4);
+		size_t n = (out->size - out->len) / 4;
+		size_t i;
+
+		if (n > len / 3)
+			n = len / 3;
+		for (i = 0; i < n; i++, s += 3) {
+			guint32 v = (s[0] << 16) | (s[1] << 8) | s[2];
+			*d++ = base64_chars[v >> 18];
+			*d++ = base64_chars[(v >> 12) & 63];
+			*d++ = base64_chars[(v >> 6) & 63];
+			*d++ = base64_chars[v & 63];
+		}
+		out->len += 4 * n;
+		len -= 3 * n;
+	}
+	if (len) {
+		char *d = output_reserve(out, 4);
+		guint32 v = (s[0] << 16) | (len > 1 ? s[1] << 8 : 0);
+
+		d[0] = base64_chars[v >> 18];
+		d[1] = base64_chars[(v >> 12) & 63];
+		d[2] = len > 1 ? base64_chars[(v >> 6) & 63] : '=';
+		d[3] = '=';
+		out->len += 4;
+	}
+}
@@ -192,6 +192,38 @@ mdb_test_date(MdbSargNode *node, double td)
 #endif
 
 
+/*
+ * Index keys of integer columns are made from value.i, so a constant the
+ * row test converts from a double is converted here the same way.  One
+ * that doesn't fit the column is left to the row test.
+ */
+static int
+mdbi_sarg_int_value(MdbSargNode *node, MdbSarg *sarg)
+{
+	gint32 min, max;
+
+	switch (node->col->col_type) {
+		case MDB_INT:
+			min = -32768;
+			max = 32767;
+			break;
+		case MDB_LONGINT:
+			min = G_MININT32;
+			max = G_MAXINT32;
+			break;
+		default:
+			return 1;
+	}
+	if (node->val_type == MDB_DOUBLE) {
+		/* false for a NaN too */
+		if (!(node->value.d >= min && node->value.d <= max))
+			return 0;
+		sarg->value.i = node->value.d;
+	} else if (node->val_type != MDB_INT) {
+		return 0;
+	}
+	return sarg->value.i >= min && sarg->value.i <= max;
+}
 int
 mdb_find_indexable_sargs(MdbSargNode *node, gpointer data)
 {
@@ -212,11 +244,12 @@ mdb_find_indexable_sargs(MdbSargNode *node, gpointer data)
 	 * a pretty worthless test for indexes, ie NOT col1 = 3, we are 
 	 * probably better off table scanning.
 	 */
-	if (mdb_is_relational_op(node->op) && node->col) {
+	if (mdb_is_relational_op(node->op) && node->op != MDB_IN && node->col) {
 		//printf("op = %d value = %s\n", node->op, node->value.s);
 		sarg.op = node->op;
 		sarg.value = node->value;
-		mdb_add_sarg(node->col, &sarg);
+		if (mdbi_sarg_int_value(node, &sarg))
+			mdb_add_sarg(node->col, &sarg);
 	}
 	return 0;
 }
@@ -226,7 +259,15 @@ mdb_test_sarg(MdbHandle *mdb, MdbColumn *col, MdbSargNode *node, MdbField *field
 	char tmpbuf[256];
 	char* val;
 	int ret = 1;
+	unsigned int i;
 
+	if (node->op == MDB_IN) {
+		for (i=0; node->values && i<node->values->len; i++) {
+			if (mdb_test_sarg(mdb, col, g_ptr_array_index(node->values, i), field))
+				return 1;
+		}
+		return 0;
+	}
 	if (node->op == MDB_ISNULL)
 		ret = field->is_null;
 	else if (node->op == MDB_NOTNULL)
@@ -316,19 +357,947 @@ mdb_test_sarg_node(MdbHandle *mdb, MdbSargNode *node, MdbField *fields, int num_
 	}
 	return 1;
 }
+/*
+ * Compiled sarg trees.
+ *
+ * Walking the sarg tree for every row means a linear mdb_find_field() per
+ * leaf, a type switch per leaf, and re-converting text columns every time
+ * they are referenced.  mdb_compile_sargs() flattens the tree once per
+ * query into an array of instructions evaluated against a single
+ * accumulator.  Leaves are specialized by column type and carry the index
+ * of their field and a constant already converted to the type being read
+ * off the page.  AND and OR compile to conditional jumps over their right
+ * hand side, NOT inverts the accumulator.  Short IN lists compile to an OR
+ * of '=' leaves, longer ones to a single leaf looking the value up in a
+ * hash set of the constants.
+ */
+
+/* IN lists longer than this are tested through a hash set */
+#define MDB_SARG_IN_LINEAR 8
+
+enum {
+	MDB_SARG_OP_CONST,
+	MDB_SARG_OP_ISNULL,
+	MDB_SARG_OP_NOTNULL,
+	MDB_SARG_OP_BOOL,
+	MDB_SARG_OP_BYTE,
+	MDB_SARG_OP_INT16,
+	MDB_SARG_OP_INT32,
+	MDB_SARG_OP_SINGLE,
+	MDB_SARG_OP_DOUBLE,
+	MDB_SARG_OP_DATETIME,
+	MDB_SARG_OP_MONEY,
+	MDB_SARG_OP_TEXT,
+	MDB_SARG_OP_MEMO,
+	MDB_SARG_OP_IN,
+	MDB_SARG_OP_JUMP_FALSE,
+	MDB_SARG_OP_JUMP_TRUE,
+	MDB_SARG_OP_NOT
+};
+
+/*
+ * Constants of an IN list, keyed the way the leaf for the column's type
+ * compares them: numbers by the double it compares, -0 folded into 0, and
+ * text by its strxfrm(), which is equal exactly when strcoll() is 0.
+ */
+typedef struct {
+	int	code;		/* leaf code of the column's type */
+	double	*nums;		/* open addressing */
+	unsigned char *used;
+	guint32	mask;
+	GHashTable *strs;
+	char	*key;		/* strxfrm() of the row's text */
+	size_t	key_sz;
+} MdbSargSet;
+
+typedef struct {
+	unsigned char code;
+	unsigned char op;	/* relational operator for leaves */
+	int	field;		/* index into fields[], or jump target */
+	int	slot;		/* text conversion slot */
+	union {
+		gint32	i;
+		double	d;
+		gint64	m;	/* money, in 1/10000 units */
+	} k;
+	MdbSargNode *node;	/* text leaves compare against node->value.s */
+	MdbLikePattern *like;	/* LIKE and ILIKE leaves */
+	MdbSargSet *set;	/* IN leaves */
+} MdbSargInsn;
+
+/* text is converted at most once per row no matter how often it's tested */
+typedef struct {
+	int	field;
+	int	col_type;
+	guint32	row_gen;
+	char	*buf;
+	size_t	buf_sz;
+	char	*str;
+} MdbSargText;
+
+/* a leaf of the top level conjunction that mdb_filter_page() can test */
+typedef struct {
+	MdbColumn *col;
+	int	pc;		/* instruction holding the op and constant */
+	unsigned int fixed_rank; /* position among the table's fixed columns */
+} MdbSargPageLeaf;
+
+/* what mdb_filter_page() needs to know about each row on the page */
+typedef struct {
+	unsigned int start;
+	unsigned int end;
+	unsigned int bitmask_sz;
+	unsigned int fixed_cols;
+} MdbSargRowInfo;
+
+struct S_MdbSargProg {
+	MdbSargNode *tree;
+	MdbSargInsn *code;
+	int	len;
+	int	size;
+	MdbSargText *text;
+	int	num_text;
+	guint32	row_gen;
+	MdbSargPageLeaf *page_leaves;
+	int	num_page_leaves;
+	MdbSargRowInfo *row_info;
+	double	*page_vals;
+};
+
+static int
+mdbi_sarg_emit(MdbSargProg *prog, int code)
+{
+	if (prog->len == prog->size) {
+		prog->size = prog->size ? prog->size * 2 : 16;
+		prog->code = g_realloc(prog->code, prog->size * sizeof(MdbSargInsn));
+	}
+	memset(&prog->code[prog->len], 0, sizeof(MdbSargInsn));
+	prog->code[prog->len].code = code;
+	return prog->len++;
+}
+
+static int
+mdbi_sarg_text_slot(MdbSargProg *prog, MdbColumn *col, int field)
+{
+	MdbSargText *text;
+	int i;
+
+	for (i=0; i<prog->num_text; i++) {
+		if (prog->text[i].field == field)
+			return i;
+	}
+	prog->text = g_realloc(prog->text, (prog->num_text + 1) * sizeof(MdbSargText));
+	text = &prog->text[prog->num_text];
+	memset(text, 0, sizeof(MdbSargText));
+	text->field = field;
+	text->col_type = col->col_type;
+	if (col->col_type == MDB_TEXT) {
+		/* worst case is 3 bytes out per byte in */
+		text->buf_sz = col->col_size * 3 + 1;
+		text->buf = g_malloc(text->buf_sz);
+	}
+	return prog->num_text++;
+}
+
+static int
+mdbi_sarg_find_field(MdbTableDef *table, MdbColumn *col)
+{
+	unsigned int i;
+
+	/* mdb_crack_row() fills fields[] in table->columns order */
+	for (i=0; i<table->num_cols; i++) {
+		if (g_ptr_array_index(table->columns, i) == col)
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Currency is stored as an integer count of 1/10000 units; the constant is
+ * rounded to one once, so that a value like -48.7655 compares equal to its
+ * column value instead of missing it by the error of the double.
+ */
+static gint64
+mdbi_sarg_money_const(MdbSargNode *node)
+{
+	double v = (node->val_type == MDB_INT ? node->value.i : node->value.d) * 10000.0;
+
+	if (v != v)
+		return 0;
+	if (v >= 9223372036854775807.0)
+		return (gint64)(~(guint64)0 >> 1);
+	if (v <= -9223372036854775808.0)
+		return -(gint64)(~(guint64)0 >> 1) - 1;
+	/* round half away from zero, like llround() */
+	return (gint64)(v < 0 ? v - 0.5 : v + 0.5);
+}
+
+static int
+mdbi_sarg_compile_leaf(MdbTableDef *table, MdbSargProg *prog, MdbSargNode *node)
+{
+	MdbColumn *col = node->col;
+	MdbSargInsn *insn;
+	int pc, field;
+
+	/* for const = const expressions */
+	if (!col) {
+		pc = mdbi_sarg_emit(prog, MDB_SARG_OP_CONST);
+		prog->code[pc].k.i = node->value.i ? 1 : 0;
+		return pc;
+	}
+	field = mdbi_sarg_find_field(table, col);
+	if (field < 0) {
+		fprintf(stderr, "Column %s used in sarg is not part of table %s\n",
+			col->name, table->name);
+		return mdbi_sarg_emit(prog, MDB_SARG_OP_CONST);
+	}
+	if (node->op == MDB_ISNULL || node->op == MDB_NOTNULL) {
+		pc = mdbi_sarg_emit(prog, node->op == MDB_ISNULL ?
+			MDB_SARG_OP_ISNULL : MDB_SARG_OP_NOTNULL);
+		prog->code[pc].field = field;
+		return pc;
+	}
+
+	switch (col->col_type) {
+		case MDB_BOOL:
+			pc = mdbi_sarg_emit(prog, MDB_SARG_OP_BOOL);
+			break;
+		case MDB_BYTE:
+			pc = mdbi_sarg_emit(prog, MDB_SARG_OP_BYTE);
+			break;
+		case MDB_INT:
+			pc = mdbi_sarg_emit(prog, MDB_SARG_OP_INT16);
+			break;
+		case MDB_LONGINT:
+			pc = mdbi_sarg_emit(prog, MDB_SARG_OP_INT32);
+			break;
+		case MDB_FLOAT:
+			pc = mdbi_sarg_emit(prog, MDB_SARG_OP_SINGLE);
+			break;
+		case MDB_DOUBLE:
+			pc = mdbi_sarg_emit(prog, MDB_SARG_OP_DOUBLE);
+			break;
+		case MDB_DATETIME:
+			pc = mdbi_sarg_emit(prog, MDB_SARG_OP_DATETIME);
+			break;
+		case MDB_MONEY:
+			pc = mdbi_sarg_emit(prog, MDB_SARG_OP_MONEY);
+			break;
+		case MDB_TEXT:
+			pc = mdbi_sarg_emit(prog, MDB_SARG_OP_TEXT);
+			break;
+		case MDB_MEMO:
+		case MDB_REPID:
+			pc = mdbi_sarg_emit(prog, MDB_SARG_OP_MEMO);
+			break;
+		default:
+			fprintf(stderr, "Calling mdb_test_sarg on unknown type.  Add code to mdb_test_sarg() for type %d\n",col->col_type);
+			pc = mdbi_sarg_emit(prog, MDB_SARG_OP_CONST);
+			prog->code[pc].k.i = 1;
+			return pc;
+	}
+	insn = &prog->code[pc];
+	insn->op = node->op;
+	insn->field = field;
+	insn->node = node;
+
+	switch (insn->code) {
+		case MDB_SARG_OP_TEXT:
+		case MDB_SARG_OP_MEMO:
+			insn->slot = mdbi_sarg_text_slot(prog, col, field);
+			if (node->op == MDB_LIKE || node->op == MDB_ILIKE)
+				insn->like = mdb_like_compile(node->value.s, node->op == MDB_ILIKE);
+			return pc;
+		case MDB_SARG_OP_SINGLE:
+		case MDB_SARG_OP_DOUBLE:
+			insn->k.d = node->val_type == MDB_INT ? node->value.i : node->value.d;
+			break;
+		case MDB_SARG_OP_DATETIME:
+			insn->k.d = poor_mans_trunc(node->value.d);
+			break;
+		case MDB_SARG_OP_MONEY:
+			insn->k.m = mdbi_sarg_money_const(node);
+			break;
+		default:
+			insn->k.i = node->val_type == MDB_INT ? node->value.i : node->value.d;
+			break;
+	}
+	if (node->op == MDB_LIKE || node->op == MDB_ILIKE) {
+		fprintf(stderr, "Calling mdb_test_sarg on unknown operator.  Add code to mdb_test_int() for operator %d\n",node->op);
+		insn->code = MDB_SARG_OP_CONST;
+		insn->k.i = 0;
+	}
+	return pc;
+}
+
+/* The number the leaf for @code compares against the constant of @node */
+static double
+mdbi_sarg_const_num(int code, MdbSargNode *node)
+{
+	double v = node->val_type == MDB_INT ? node->value.i : node->value.d;
+
+	switch (code) {
+		case MDB_SARG_OP_SINGLE:
+		case MDB_SARG_OP_DOUBLE:
+			return v;
+		case MDB_SARG_OP_DATETIME:
+			return poor_mans_trunc(node->value.d);
+		case MDB_SARG_OP_MONEY:
+			return (double)mdbi_sarg_money_const(node);
+	}
+	return (gint32)v;
+}
+
+static guint32
+mdbi_sarg_num_hash(double v)
+{
+	guint64 b;
+
+	memcpy(&b, &v, sizeof(b));
+	b ^= b >> 33;
+	b *= 0xff51afd7ed558ccdULL;
+	b ^= b >> 33;
+	return (guint32)b;
+}
+
+/* Returns 1 if @v is in @set, else puts the free slot for it in *@slot */
+static int
+mdbi_sarg_set_find(MdbSargSet *set, double v, guint32 *slot)
+{
+	guint32 i;
+
+	if (v == 0)
+		v = 0;
+	for (i = mdbi_sarg_num_hash(v) & set->mask; set->used[i]; i = (i + 1) & set->mask) {
+		if (set->nums[i] == v)
+			return 1;
+	}
+	if (slot)
+		*slot = i;
+	return 0;
+}
+
+static const char *
+mdbi_sarg_xfrm(MdbSargSet *set, const char *s)
+{
+	size_t len = strxfrm(set->key, s, set->key_sz);
+
+	if (len >= set->key_sz) {
+		set->key_sz = len + 1;
+		set->key = g_realloc(set->key, set->key_sz);
+		strxfrm(set->key, s, set->key_sz);
+	}
+	return set->key;
+}
+
+static void
+mdbi_sarg_free_key(gpointer key, gpointer value, gpointer data)
+{
+	g_free(key);
+}
+
+static void
+mdbi_sarg_free_set(MdbSargSet *set)
+{
+	if (!set) return;
+	if (set->strs) {
+		g_hash_table_foreach(set->strs, mdbi_sarg_free_key, NULL);
+		g_hash_table_destroy(set->strs);
+	}
+	g_free(set->nums);
+	g_free(set->used);
+	g_free(set->key);
+	g_free(set);
+}
+
+/* Returns NULL for types whose leaves aren't worth hashing */
+static MdbSargSet *
+mdbi_sarg_build_set(MdbSargNode *node, int code)
+{
+	MdbSargSet *set;
+	MdbSargNode *value;
+	unsigned int i, size = 16;
+	guint32 slot;
+	char *key;
+	double v;
+
+	switch (code) {
+		case MDB_SARG_OP_BYTE:
+		case MDB_SARG_OP_INT16:
+		case MDB_SARG_OP_INT32:
+		case MDB_SARG_OP_SINGLE:
+		case MDB_SARG_OP_DOUBLE:
+		case MDB_SARG_OP_DATETIME:
+		case MDB_SARG_OP_MONEY:
+		case MDB_SARG_OP_TEXT:
+		case MDB_SARG_OP_MEMO:
+			break;
+		default:
+			return NULL;
+	}
+	set = g_malloc0(sizeof(MdbSargSet));
+	set->code = code;
+	if (code == MDB_SARG_OP_TEXT || code == MDB_SARG_OP_MEMO) {
+		set->strs = g_hash_table_new(g_str_hash, g_str_equal);
+		for (i=0; i<node->values->len; i++) {
+			value = g_ptr_array_index(node->values, i);
+			mdbi_sarg_xfrm(set, value->value.s);
+			if (g_hash_table_lookup(set->strs, set->key))
+				continue;
+			key = g_strdup(set->key);
+			g_hash_table_insert(set->strs, key, key);
+		}
+		return set;
+	}
+	/* keep the table at most half full */
+	while (size < node->values->len * 2)
+		size *= 2;
+	set->nums = g_malloc(size * sizeof(double));
+	set->used = g_malloc0(size);
+	set->mask = size - 1;
+	for (i=0; i<node->values->len; i++) {
+		v = mdbi_sarg_const_num(code, g_ptr_array_index(node->values, i));
+		if (v == 0)
+			v = 0;
+		if (!mdbi_sarg_set_find(set, v, &slot)) {
+			set->nums[slot] = v;
+			set->used[slot] = 1;
+		}
+	}
+	return set;
+}
+
+/*
+ * Compiles an IN list, either to one leaf testing the value against a set
+ * of the constants, or to the '=' leaves of its values with a jump to the
+ * end after each one.
+ */
+static int
+mdbi_sarg_compile_in(MdbTableDef *table, MdbSargProg *prog, MdbSargNode *node)
+{
+	MdbSargInsn *insn;
+	MdbSargSet *set;
+	unsigned int i, n = node->values ? node->values->len : 0;
+	int pc, *jumps;
+
+	if (!node->col || !n)
+		return mdbi_sarg_emit(prog, MDB_SARG_OP_CONST);
+
+	/* the first value's leaf tells how the column is read */
+	pc = mdbi_sarg_compile_leaf(table, prog, g_ptr_array_index(node->values, 0));
+	insn = &prog->code[pc];
+	if (n > MDB_SARG_IN_LINEAR && insn->code != MDB_SARG_OP_CONST &&
+			(set = mdbi_sarg_build_set(node, insn->code))) {
+		insn->code = MDB_SARG_OP_IN;
+		insn->node = node;
+		insn->set = set;
+		return pc;
+	}
+	jumps = g_malloc(n * sizeof(int));
+	for (i=1; i<n; i++) {
+		jumps[i-1] = mdbi_sarg_emit(prog, MDB_SARG_OP_JUMP_TRUE);
+		mdbi_sarg_compile_leaf(table, prog, g_ptr_array_index(node->values, i));
+	}
+	for (i=1; i<n; i++)
+		prog->code[jumps[i-1]].field = prog->len;
+	g_free(jumps);
+	return pc;
+}
+
+static void
+mdbi_sarg_add_page_leaf(MdbTableDef *table, MdbSargProg *prog, MdbSargNode *node, int pc)
+{
+	MdbSargInsn *insn = &prog->code[pc];
+	MdbSargPageLeaf *leaf;
+	unsigned int i, rank = 0;
+
+	switch (insn->code) {
+		case MDB_SARG_OP_INT16:
+		case MDB_SARG_OP_INT32:
+		case MDB_SARG_OP_DOUBLE:
+		case MDB_SARG_OP_MONEY:
+			break;
+		case MDB_SARG_OP_DATETIME:
+			/* can't reject on inequality without the exact truncation */
+			if (insn->op == MDB_NEQ)
+				return;
+			break;
+		default:
+			return;
+	}
+	if (!node->col->is_fixed)
+		return;
+	for (i=0; i<(unsigned int)insn->field; i++) {
+		MdbColumn *col = g_ptr_array_index(table->columns, i);
+		if (col->is_fixed)
+			rank++;
+	}
+	prog->page_leaves = g_realloc(prog->page_leaves,
+		(prog->num_page_leaves + 1) * sizeof(MdbSargPageLeaf));
+	leaf = &prog->page_leaves[prog->num_page_leaves++];
+	leaf->col = node->col;
+	leaf->pc = pc;
+	leaf->fixed_rank = rank;
+}
+
+static void
+mdbi_sarg_compile_node(MdbTableDef *table, MdbSargProg *prog, MdbSargNode *node, int top_and)
+{
+	int pc;
+
+	if (node->op == MDB_IN) {
+		mdbi_sarg_compile_in(table, prog, node);
+		return;
+	}
+	if (mdb_is_relational_op(node->op)) {
+		pc = mdbi_sarg_compile_leaf(table, prog, node);
+		if (top_and && node->col)
+			mdbi_sarg_add_page_leaf(table, prog, node, pc);
+		return;
+	}
+	switch (node->op) {
+		case MDB_NOT:
+			mdbi_sarg_compile_node(table, prog, node->left, 0);
+			mdbi_sarg_emit(prog, MDB_SARG_OP_NOT);
+			break;
+		case MDB_AND:
+		case MDB_OR:
+			top_and = top_and && node->op == MDB_AND;
+			mdbi_sarg_compile_node(table, prog, node->left, top_and);
+			pc = mdbi_sarg_emit(prog, node->op == MDB_AND ?
+				MDB_SARG_OP_JUMP_FALSE : MDB_SARG_OP_JUMP_TRUE);
+			mdbi_sarg_compile_node(table, prog, node->right, top_and);
+			prog->code[pc].field = prog->len;
+			break;
+		default:
+			pc = mdbi_sarg_emit(prog, MDB_SARG_OP_CONST);
+			prog->code[pc].k.i = 1;
+			break;
+	}
+}
+
+void
+mdbi_free_sarg_prog(MdbSargProg *prog)
+{
+	int i;
+
+	if (!prog) return;
+	for (i=0; i<prog->len; i++) {
+		mdb_like_free(prog->code[i].like);
+		mdbi_sarg_free_set(prog->code[i].set);
+	}
+	for (i=0; i<prog->num_text; i++) {
+		g_free(prog->text[i].buf);
+		if (prog->text[i].col_type != MDB_TEXT)
+			g_free(prog->text[i].str);
+	}
+	g_free(prog->text);
+	g_free(prog->code);
+	g_free(prog->page_leaves);
+	g_free(prog->row_info);
+	g_free(prog->page_vals);
+	g_free(prog);
+}
+
+/**
+ * mdb_compile_sargs:
+ * @table: Table whose sarg_tree should be compiled
+ *
+ * Flattens @table->sarg_tree into the program mdb_test_sargs() runs for
+ * each row.  The columns referenced by the tree must already be resolved.
+ * Calling this is optional, mdb_test_sargs() compiles on first use, but
+ * doing it up front keeps the work out of the first fetch.
+ *
+ * Returns: 1 if the table has a compiled sarg program, 0 if there is no
+ * sarg tree.
+ */
+int
+mdb_compile_sargs(MdbTableDef *table)
+{
+	MdbSargProg *prog;
+
+	mdbi_free_sarg_prog(table->sarg_prog);
+	table->sarg_prog = NULL;
+	if (!table->sarg_tree)
+		return 0;
+
+	prog = g_malloc0(sizeof(MdbSargProg));
+	prog->tree = table->sarg_tree;
+	mdbi_sarg_compile_node(table, prog, table->sarg_tree, 1);
+	table->sarg_prog = prog;
+	return 1;
+}
+
+static int
+mdbi_sarg_rc(int op, int rc)
+{
+	switch (op) {
+		case MDB_EQUAL: return rc == 0;
+		case MDB_GT: return rc < 0;
+		case MDB_LT: return rc > 0;
+		case MDB_GTEQ: return rc <= 0;
+		case MDB_LTEQ: return rc >= 0;
+		case MDB_NEQ: return rc != 0;
+	}
+	return 0;
+}
+
+static const char *
+mdbi_sarg_text(MdbHandle *mdb, MdbSargProg *prog, MdbSargInsn *insn, MdbField *field)
+{
+	MdbSargText *text = &prog->text[insn->slot];
+	size_t len;
+
+	if (text->row_gen == prog->row_gen)
+		return text->str;
+	text->row_gen = prog->row_gen;
+	if (text->col_type == MDB_TEXT) {
+		len = mdb_unicode2ascii(mdb, field->value, field->siz, text->buf, text->buf_sz);
+		text->buf[len < text->buf_sz ? len : text->buf_sz - 1] = '\0';
+		text->str = text->buf;
+	} else {
+		g_free(text->str);
+		text->str = mdb_col_to_string(mdb, mdb->pg_buf, field->start,
+			text->col_type, field->siz);
+	}
+	return text->str;
+}
+
+static gint64
+mdbi_sarg_money(void *buf)
+{
+	guint64 v = (guint64)(guint32)mdb_get_int32(buf, 0) |
+		(guint64)(guint32)mdb_get_int32(buf, 4) << 32;
+
+	return (gint64)v;
+}
+
+static int
+mdbi_sarg_in(MdbHandle *mdb, MdbSargProg *prog, MdbSargInsn *insn, MdbField *field)
+{
+	MdbSargSet *set = insn->set;
+	double v;
+
+	switch (set->code) {
+		case MDB_SARG_OP_BYTE:
+			v = ((char *)field->value)[0];
+			break;
+		case MDB_SARG_OP_INT16:
+			v = (short)mdb_get_int16(field->value, 0);
+			break;
+		case MDB_SARG_OP_INT32:
+			v = (gint32)mdb_get_int32(field->value, 0);
+			break;
+		case MDB_SARG_OP_SINGLE:
+			v = mdb_get_single(field->value, 0);
+			break;
+		case MDB_SARG_OP_DOUBLE:
+			v = mdb_get_double(field->value, 0);
+			break;
+		case MDB_SARG_OP_DATETIME:
+			v = poor_mans_trunc(mdb_get_double(field->value, 0));
+			break;
+		case MDB_SARG_OP_MONEY:
+			v = (double)mdbi_sarg_money(field->value);
+			break;
+		default:
+			return g_hash_table_lookup(set->strs,
+				mdbi_sarg_xfrm(set, mdbi_sarg_text(mdb, prog, insn, field))) != NULL;
+	}
+	return mdbi_sarg_set_find(set, v, NULL);
+}
+
+static int
+mdbi_run_sarg_prog(MdbHandle *mdb, MdbSargProg *prog, MdbField *fields, int num_fields)
+{
+	MdbSargInsn *insn, *end = prog->code + prog->len;
+	MdbField *field;
+	int acc = 1;
+	gint32 v;
+	gint64 m;
+
+	/* invalidates the text conversions of the previous row */
+	if (!++prog->row_gen)
+		prog->row_gen = 1;
+
+	for (insn = prog->code; insn < end; insn++) {
+		switch (insn->code) {
+			case MDB_SARG_OP_JUMP_FALSE:
+				if (!acc) insn = prog->code + insn->field - 1;
+				continue;
+			case MDB_SARG_OP_JUMP_TRUE:
+				if (acc) insn = prog->code + insn->field - 1;
+				continue;
+			case MDB_SARG_OP_NOT:
+				acc = !acc;
+				continue;
+			case MDB_SARG_OP_CONST:
+				acc = insn->k.i;
+				continue;
+		}
+		if (insn->field >= num_fields) {
+			acc = 0;
+			continue;
+		}
+		field = &fields[insn->field];
+		if (insn->code == MDB_SARG_OP_ISNULL) {
+			acc = field->is_null;
+			continue;
+		}
+		if (insn->code == MDB_SARG_OP_NOTNULL) {
+			acc = !field->is_null;
+			continue;
+		}
+		/* booleans live in the null mask */
+		if (insn->code == MDB_SARG_OP_BOOL) {
+			v = !field->is_null;
+			acc = mdbi_sarg_rc(insn->op, (insn->k.i > v) - (insn->k.i < v));
+			continue;
+		}
+		if (field->is_null) {
+			acc = 0;
+			continue;
+		}
+		switch (insn->code) {
+			case MDB_SARG_OP_BYTE:
+				v = ((char *)field->value)[0];
+				acc = mdbi_sarg_rc(insn->op, (insn->k.i > v) - (insn->k.i < v));
+				break;
+			case MDB_SARG_OP_INT16:
+				v = (short)mdb_get_int16(field->value, 0);
+				acc = mdbi_sarg_rc(insn->op, (insn->k.i > v) - (insn->k.i < v));
+				break;
+			case MDB_SARG_OP_INT32:
+				v = mdb_get_int32(field->value, 0);
+				acc = mdbi_sarg_rc(insn->op, (insn->k.i > v) - (insn->k.i < v));
+				break;
+			case MDB_SARG_OP_SINGLE:
+				acc = mdb_test_double(insn->op, insn->k.d, mdb_get_single(field->value, 0));
+				break;
+			case MDB_SARG_OP_DOUBLE:
+				acc = mdb_test_double(insn->op, insn->k.d, mdb_get_double(field->value, 0));
+				break;
+			case MDB_SARG_OP_DATETIME:
+				acc = mdb_test_double(insn->op, insn->k.d, poor_mans_trunc(mdb_get_double(field->value, 0)));
+				break;
+			case MDB_SARG_OP_MONEY:
+				m = mdbi_sarg_money(field->value);
+				acc = mdbi_sarg_rc(insn->op, (insn->k.m > m) - (insn->k.m < m));
+				break;
+			case MDB_SARG_OP_TEXT:
+			case MDB_SARG_OP_MEMO:
+				if (insn->like)
+					acc = mdb_like_match(insn->like, mdbi_sarg_text(mdb, prog, insn, field));
+				else
+					acc = mdb_test_string(insn->node, (char *)mdbi_sarg_text(mdb, prog, insn, field));
+				break;
+			case MDB_SARG_OP_IN:
+				acc = mdbi_sarg_in(mdb, prog, insn, field);
+				break;
+		}
+	}
+	return acc;
+}
+
 int 
 mdb_test_sargs(MdbTableDef *table, MdbField *fields, int num_fields)
 {
-	MdbSargNode *node;
 	MdbCatalogEntry *entry = table->entry;
 	MdbHandle *mdb = entry->mdb;
 
-	node = table->sarg_tree;
-
 	/* there may not be a sarg tree */
-	if (!node) return 1;
+	if (!table->sarg_tree) return 1;
 
-	return mdb_test_sarg_node(mdb, node, fields, num_fields);
+	if (!table->sarg_prog || table->sarg_prog->tree != table->sarg_tree)
+		mdb_compile_sargs(table);
+
+	return mdbi_run_sarg_prog(mdb, table->sarg_prog, fields, num_fields);
+}
+
+/* Currency leaves of mdb_filter_page(), compared as integers */
+static void
+mdbi_filter_money(MdbSargInsn *insn, unsigned char *pg_buf, unsigned int *offs,
+	unsigned char *sel, unsigned int rows)
+{
+	gint64 k = insn->k.m, v;
+	unsigned int i;
+
+	for (i=0; i<rows; i++) {
+		if (!sel[i] || !offs[i])
+			continue;
+		v = mdbi_sarg_money(pg_buf + offs[i]);
+		sel[i] = mdbi_sarg_rc(insn->op, (k > v) - (k < v));
+	}
+}
+
+/**
+ * mdb_filter_page:
+ * @table: Table being scanned, with the data page to filter in mdb->pg_buf
+ * @rows: Number of entries in the page's row offset table
+ *
+ * Runs the fixed-width leaves (INTEGER, LONG INTEGER, DOUBLE, DATETIME and
+ * MONEY) of the top level AND of the sarg tree against every row of the
+ * current data page in one pass per leaf.  Each value is gathered straight
+ * from its fixed offset in the row, so rejected rows are never cracked or
+ * bound.  table->page_sel[row] is left at 1 for rows that may match and
+ * 0 for rows that can't, deleted rows included.  Surviving rows must
+ * still be checked with mdb_test_sargs().
+ *
+ * Returns: 1 if table->page_sel is valid for the current page, 0 if there
+ * is nothing to filter on.
+ */
+int
+mdb_filter_page(MdbTableDef *table, unsigned int rows)
+{
+	MdbHandle *mdb = table->entry->mdb;
+	unsigned char *pg_buf = mdb->pg_buf;
+	unsigned int max_rows = mdb->fmt->pg_size / 2;
+	unsigned int col_count_size = IS_JET3(mdb) ? 1 : 2;
+	unsigned int i, *offs;
+	unsigned char *sel;
+	MdbSargProg *prog;
+	double *vals;
+	int l;
+
+	if (table->sarg_tree &&
+	 (!table->sarg_prog || table->sarg_prog->tree != table->sarg_tree))
+		mdb_compile_sargs(table);
+	prog = table->sarg_prog;
+	if (!table->sarg_tree || !prog->num_page_leaves || rows > max_rows) {
+		g_free(table->page_sel);
+		table->page_sel = NULL;
+		return 0;
+	}
+	if (!table->page_sel)
+		table->page_sel = g_malloc(max_rows);
+	if (!prog->row_info) {
+		prog->row_info = g_malloc(max_rows * sizeof(MdbSargRowInfo));
+		prog->page_vals = g_malloc(max_rows * (sizeof(double) + sizeof(unsigned int)));
+	}
+	sel = table->page_sel;
+	vals = prog->page_vals;
+	offs = (unsigned int *)(vals + max_rows);
+
+	/* locate each row and its null mask once for all leaves */
+	for (i=0; i<rows; i++) {
+		MdbSargRowInfo *ri = &prog->row_info[i];
+		unsigned int row_cols, row_var_cols = 0;
+		int row_start;
+		size_t row_size;
+
+		sel[i] = 0;
+		ri->end = 0; /* left for mdb_read_row() to sort out */
+		if (mdb_find_row(mdb, i, &row_start, &row_size) == -1 || row_size == 0)
+			continue;
+		if (!table->noskip_del && (row_start & 0x4000))
+			continue;
+		sel[i] = 1;
+		row_start &= OFFSET_MASK;
+		ri->start = row_start;
+		row_cols = IS_JET3(mdb) ? pg_buf[row_start] : mdb_get_int16(pg_buf, row_start);
+		ri->bitmask_sz = (row_cols + 7) / 8;
+		if (ri->bitmask_sz + 2 + col_count_size >= row_start + row_size)
+			continue;
+		if (table->num_var_cols > 0) {
+			unsigned int pos = row_start + row_size - 1 - ri->bitmask_sz;
+			row_var_cols = IS_JET3(mdb) ? pg_buf[pos] : mdb_get_int16(pg_buf, pos - 1);
+		}
+		if (row_var_cols > row_cols)
+			continue;
+		ri->fixed_cols = row_cols - row_var_cols;
+		ri->end = row_start + row_size - 1;
+	}
+
+	for (l=0; l<prog->num_page_leaves; l++) {
+		MdbSargPageLeaf *leaf = &prog->page_leaves[l];
+		MdbSargInsn *insn = &prog->code[leaf->pc];
+		MdbColumn *col = leaf->col;
+		unsigned int byte_num = col->col_num / 8;
+		unsigned char bit = 1 << (col->col_num % 8);
+		double k, eps = 0;
+
+		/* find the value of every row still in the running */
+		for (i=0; i<rows; i++) {
+			MdbSargRowInfo *ri = &prog->row_info[i];
+
+			offs[i] = 0;
+			if (!sel[i] || !ri->end)
+				continue;
+			/* missing from this row or null: the leaf is false */
+			if (leaf->fixed_rank >= ri->fixed_cols) {
+				sel[i] = 0;
+				continue;
+			}
+			if (byte_num >= ri->bitmask_sz)
+				continue;
+			if (!(pg_buf[ri->end - ri->bitmask_sz + 1 + byte_num] & bit)) {
+				sel[i] = 0;
+				continue;
+			}
+			offs[i] = ri->start + col_count_size + col->fixed_offset;
+			if (offs[i] + col->col_size > ri->end + 1)
+				offs[i] = 0;
+		}
+
+		if (insn->code == MDB_SARG_OP_MONEY) {
+			mdbi_filter_money(insn, pg_buf, offs, sel, rows);
+			continue;
+		}
+
+		switch (insn->code) {
+			case MDB_SARG_OP_INT16:
+				for (i=0; i<rows; i++)
+					vals[i] = (short)mdb_get_int16(pg_buf, offs[i]);
+				k = insn->k.i;
+				break;
+			case MDB_SARG_OP_INT32:
+				for (i=0; i<rows; i++)
+					vals[i] = (gint32)mdb_get_int32(pg_buf, offs[i]);
+				k = insn->k.i;
+				break;
+			case MDB_SARG_OP_DATETIME:
+				/*
+				 * mdb_test_sargs() compares values rounded to 6 decimals,
+				 * only reject rows that are outside that by a margin.
+				 */
+				eps = 1e-6;
+				/* fall through */
+			default:
+				for (i=0; i<rows; i++)
+					vals[i] = mdb_get_double(pg_buf, offs[i]);
+				k = insn->k.d;
+				break;
+		}
+
+		/* written to leave the loops to the compiler's vectorizer */
+		switch (insn->op) {
+			case MDB_EQUAL:
+				for (i=0; i<rows; i++)
+					sel[i] &= (offs[i] == 0) | ((vals[i] >= k - eps) & (vals[i] <= k + eps));
+				break;
+			case MDB_GT:
+				for (i=0; i<rows; i++)
+					sel[i] &= (offs[i] == 0) | (vals[i] > k);
+				break;
+			case MDB_LT:
+				for (i=0; i<rows; i++)
+					sel[i] &= (offs[i] == 0) | (vals[i] < k);
+				break;
+			case MDB_GTEQ:
+				for (i=0; i<rows; i++)
+					sel[i] &= (offs[i] == 0) | (vals[i] >= k - eps);
+				break;
+			case MDB_LTEQ:
+				for (i=0; i<rows; i++)
+					sel[i] &= (offs[i] == 0) | (vals[i] <= k + eps);
+				break;
+			case MDB_NEQ:
+				for (i=0; i<rows; i++)
+					sel[i] &= (offs[i] == 0) | (vals[i] != k);
+				break;
+		}
+	}
+	return 1;
 }
 #if 0
 int mdb_test_sargs(MdbHandle *mdb, MdbColumn *col, int offset, int len)
@@ -0,0 +1,723 @@
+/* MDB Tools - A library for reading MS Access database files
+ * Copyright (C) 2000 Brian Bruns
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include "mdbtools.h"
+#include "mdbprivate.h"
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/*
+ * The page sources mdbtools comes with: a stdio stream, a buffer in
+ * memory, and a compressed stream, inflated as pages are asked for.
+ */
+
+/* stdio streams */
+
+typedef struct {
+	FILE *stream;
+	int fd; /* descriptor of stream, -1 for streams without one */
+} MdbStdioSource;
+
+static ssize_t mdbi_stdio_read_page(MdbPageSource *src, void *buf, size_t pg_size, unsigned long pg)
+{
+	MdbStdioSource *s = src->data;
+	off_t offset = (off_t)pg * pg_size;
+	off_t end = 0;
+	ssize_t len = 0;
+	int err = 0;
+
+#ifdef HAVE_PREAD
+	if (s->fd >= 0) {
+		/* no file position, so nothing shared with the clones */
+		len = pread(s->fd, buf, pg_size, offset);
+		if (len == -1)
+			perror("read");
+		return len;
+	}
+#endif
+	/* the stream position is shared with the clones */
+#ifdef HAVE_FLOCKFILE
+	flockfile(s->stream);
+#endif
+	if (fseeko(s->stream, 0, SEEK_END) == -1)
+		err = 1;
+	else if ((end = ftello(s->stream)) < offset)
+		len = 0;
+	else if (fseeko(s->stream, offset, SEEK_SET) == -1)
+		err = 2;
+	else {
+		len = fread(buf, 1, pg_size, s->stream);
+		if (ferror(s->stream))
+			err = 3;
+	}
+#ifdef HAVE_FLOCKFILE
+	funlockfile(s->stream);
+#endif
+
+	if (err == 1)
+		fprintf(stderr, "Unable to seek to end of file\n");
+	else if (err == 2)
+		fprintf(stderr, "Unable to seek to page %lu\n", pg);
+	else if (err == 3)
+		perror("read");
+	return err ? -1 : len;
+}
+
+static unsigned long mdbi_stdio_page_count(MdbPageSource *src, size_t pg_size)
+{
+	MdbStdioSource *s = src->data;
+	off_t size = 0;
+
+	if (s->fd >= 0) {
+		struct stat st;
+
+		if (fstat(s->fd, &st) == 0)
+			size = st.st_size;
+	} else {
+#ifdef HAVE_FLOCKFILE
+		flockfile(s->stream);
+#endif
+		if (fseeko(s->stream, 0, SEEK_END) == 0)
+			size = ftello(s->stream);
+#ifdef HAVE_FLOCKFILE
+		funlockfile(s->stream);
+#endif
+	}
+	return size > 0 ? (size + pg_size - 1) / pg_size : 0;
+}
+
+static ssize_t mdbi_stdio_write_page(MdbPageSource *src, const void *buf, size_t pg_size, unsigned long pg)
+{
+	MdbStdioSource *s = src->data;
+	ssize_t len;
+
+	if (fseeko(s->stream, (off_t)pg * pg_size, SEEK_SET) == -1) {
+		fprintf(stderr, "Unable to seek to page %lu\n", pg);
+		return -1;
+	}
+	len = fwrite(buf, 1, pg_size, s->stream);
+	/* pages are read back with pread(), past the stream's buffer */
+	fflush(s->stream);
+	if (ferror(s->stream)) {
+		perror("write");
+		return -1;
+	}
+	return len;
+}
+
+static void mdbi_stdio_stat(MdbPageSource *src, MdbFileStamp *stamp)
+{
+	MdbStdioSource *s = src->data;
+	struct stat st;
+
+	/* memory streams have no descriptor and never change behind our back */
+	if (s->fd >= 0 && fstat(s->fd, &st) == 0) {
+		stamp->size = st.st_size;
+		stamp->mtime = st.st_mtime;
+		stamp->ctime = st.st_ctime;
+		stamp->ino = st.st_ino;
+#if defined(HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC)
+		stamp->mtime_nsec = st.st_mtim.tv_nsec;
+		stamp->ctime_nsec = st.st_ctim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC_TV_NSEC)
+		stamp->mtime_nsec = st.st_mtimespec.tv_nsec;
+		stamp->ctime_nsec = st.st_ctimespec.tv_nsec;
+#endif
+	}
+}
+
+static void mdbi_stdio_close(MdbPageSource *src)
+{
+	MdbStdioSource *s = src->data;
+
+	fclose(s->stream);
+	g_free(s);
+}
+
+/**
+ * mdb_page_source_stdio:
+ * @stream: stream open on an MDB file, for reading, or for reading and
+ * writing
+ *
+ * Makes a page source of @stream.  Pages are read with pread(), if the
+ * stream has a file descriptor, so that handles on the file don't share
+ * a file position.  The stream is closed with the source.
+ *
+ * Returns: the source, to pass to mdb_open_source().
+ */
+MdbPageSource *mdb_page_source_stdio(FILE *stream)
+{
+	MdbPageSource *src = g_malloc0(sizeof(MdbPageSource));
+	MdbStdioSource *s = g_malloc0(sizeof(MdbStdioSource));
+
+	s->stream = stream;
+	s->fd = fileno(stream);
+	src->read_page = mdbi_stdio_read_page;
+	src->page_count = mdbi_stdio_page_count;
+	src->write_page = mdbi_stdio_write_page;
+	src->stat = mdbi_stdio_stat;
+	src->close = mdbi_stdio_close;
+	src->data = s;
+	return src;
+}
+
+/* memory buffers */
+
+typedef struct {
+	unsigned char *buffer;
+	size_t len;
+} MdbBufferSource;
+
+static ssize_t mdbi_buffer_read_page(MdbPageSource *src, void *buf, size_t pg_size, unsigned long pg)
+{
+	MdbBufferSource *s = src->data;
+	size_t offset = pg * pg_size;
+
+	if (pg > s->len / pg_size || offset >= s->len)
+		return 0;
+	if (pg_size > s->len - offset)
+		pg_size = s->len - offset;
+	memcpy(buf, s->buffer + offset, pg_size);
+	return pg_size;
+}
+
+static unsigned long mdbi_buffer_page_count(MdbPageSource *src, size_t pg_size)
+{
+	MdbBufferSource *s = src->data;
+
+	return (s->len + pg_size - 1) / pg_size;
+}
+
+static ssize_t mdbi_buffer_write_page(MdbPageSource *src, const void *buf, size_t pg_size, unsigned long pg)
+{
+	MdbBufferSource *s = src->data;
+	size_t offset = pg * pg_size;
+
+	if (pg > s->len / pg_size || offset >= s->len)
+		return 0;
+	if (pg_size > s->len - offset)
+		pg_size = s->len - offset;
+	memcpy(s->buffer + offset, buf, pg_size);
+	return pg_size;
+}
+
+static void mdbi_buffer_close(MdbPageSource *src)
+{
+	g_free(src->data);
+}
+
+/**
+ * mdb_page_source_buffer:
+ * @buffer: an MDB file in memory
+ * @len: length of @buffer
+ * @writable: whether pages may be written back to @buffer
+ *
+ * Makes a page source that reads pages straight from @buffer.  The buffer
+ * isn't copied, and must outlive the handles on it; it is never grown.
+ *
+ * Returns: the source, to pass to mdb_open_source().
+ */
+MdbPageSource *mdb_page_source_buffer(void *buffer, size_t len, gboolean writable)
+{
+	MdbPageSource *src = g_malloc0(sizeof(MdbPageSource));
+	MdbBufferSource *s = g_malloc0(sizeof(MdbBufferSource));
+
+	s->buffer = buffer;
+	s->len = len;
+	src->read_page = mdbi_buffer_read_page;
+	src->page_count = mdbi_buffer_page_count;
+	if (writable)
+		src->write_page = mdbi_buffer_write_page;
+	src->close = mdbi_buffer_close;
+	src->data = s;
+	return src;
+}
+
+/*
+ * Compressed streams.  A deflate stream can only be read from the start,
+ * so it is inflated a block at a time as far as the pages asked for, and
+ * the blocks are kept, up to a limit, the least recently used going first.
+ * On the way, about every MDB_INFLATE_SPAN bytes, a seek point is kept, as
+ * zlib's zran example does: where a deflate block starts in the compressed
+ * data, and the 32 KB of inflated data before it, which the block may
+ * refer back to.  A block that has gone is inflated again from the last
+ * seek point before it, at most MDB_INFLATE_SPAN bytes back.  A stream
+ * that can't be rewound keeps all its blocks, and no seek points.
+ */
+#ifdef HAVE_ZLIB
+
+/* a multiple of both page sizes */
+#define MDB_INFLATE_BLOCK (256 * 1024)
+#define MDB_INFLATE_CACHE (64 * 1024 * 1024)
+/* each seek point takes a window, 32 KB per MB of inflated data */
+#define MDB_INFLATE_SPAN (1024 * 1024)
+#define MDB_INFLATE_WINDOW 32768
+
+typedef struct {
+	unsigned char *data;
+	size_t len;
+	unsigned long used; /* when last read, as MdbInflateSource.clock */
+} MdbInflateBlock;
+
+typedef struct {
+	guint64 out;         /* inflated bytes before the point */
+	off_t in;            /* where the point is in the stream */
+	int bits;            /* bits of the byte before @in that are part of it */
+	unsigned char window[MDB_INFLATE_WINDOW];
+	size_t window_len;
+} MdbInflatePoint;
+
+typedef struct {
+	FILE *stream;
+	off_t start;         /* where the compressed data starts */
+	gboolean seekable;
+	int flags;
+	z_stream z;
+	unsigned char in[65536];
+	off_t in_pos;        /* where the stream is, after the data in @in */
+	unsigned char skip[65536]; /* inflated data that isn't kept */
+	gboolean at_end;     /* of the compressed data */
+	guint64 out;         /* inflated bytes so far */
+	guint64 size;        /* inflated bytes in all, once at_end is reached */
+	gboolean size_known;
+	unsigned char window[MDB_INFLATE_WINDOW]; /* the last bytes inflated */
+	size_t window_len;
+	MdbInflatePoint *points;
+	unsigned long num_points;
+	unsigned long next;  /* number of the block to be inflated next */
+	MdbInflateBlock *blocks;
+	unsigned long num_blocks;
+	size_t cached, max_cached;
+	unsigned long clock;
+	gboolean failed;     /* inflating failed, start again from a seek point */
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t mutex;
+#endif
+} MdbInflateSource;
+
+static void mdbi_inflate_lock(MdbInflateSource *s)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&s->mutex);
+#endif
+}
+
+static void mdbi_inflate_unlock(MdbInflateSource *s)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&s->mutex);
+#endif
+}
+
+/* 32 + 15 takes gzip or zlib headers, whichever it finds */
+#define MDB_INFLATE_WBITS(s) (((s)->flags & MDB_INFLATE_RAW) ? -15 : 32 + 15)
+
+static int mdbi_inflate_init(MdbInflateSource *s)
+{
+	int ret;
+
+	memset(&s->z, 0, sizeof(s->z));
+	ret = inflateInit2(&s->z, MDB_INFLATE_WBITS(s));
+	if (ret != Z_OK) {
+		fprintf(stderr, "inflateInit2: %s\n", zError(ret));
+		return -1;
+	}
+	return 0;
+}
+
+/* Keeps the last MDB_INFLATE_WINDOW bytes inflated, for the next seek point */
+static void mdbi_inflate_window(MdbInflateSource *s, const unsigned char *buf, size_t len)
+{
+	size_t keep;
+
+	if (len >= MDB_INFLATE_WINDOW) {
+		memcpy(s->window, buf + len - MDB_INFLATE_WINDOW, MDB_INFLATE_WINDOW);
+		s->window_len = MDB_INFLATE_WINDOW;
+		return;
+	}
+	keep = s->window_len < MDB_INFLATE_WINDOW - len ? s->window_len : MDB_INFLATE_WINDOW - len;
+	memmove(s->window, s->window + s->window_len - keep, keep);
+	memcpy(s->window + keep, buf, len);
+	s->window_len = keep + len;
+}
+
+/* Keeps a seek point where inflate() has stopped, between deflate blocks */
+static void mdbi_inflate_add_point(MdbInflateSource *s)
+{
+	MdbInflatePoint *point;
+
+	if (!s->seekable || s->out < (s->num_points ? s->points[s->num_points - 1].out : 0) + MDB_INFLATE_SPAN)
+		return;
+	if ((s->num_points & (s->num_points - 1)) == 0)
+		s->points = g_realloc(s->points, (s->num_points ? 2 * s->num_points : 1) * sizeof(MdbInflatePoint));
+	point = &s->points[s->num_points++];
+	point->out = s->out;
+	point->in = s->in_pos - s->z.avail_in;
+	point->bits = s->z.data_type & 7;
+	memcpy(point->window, s->window, s->window_len);
+	point->window_len = s->window_len;
+}
+
+/*
+ * Inflates up to @len bytes into @buf, keeping seek points on the way.
+ * Returns the number of bytes inflated, which is less than @len only at
+ * the end of the data, or -1.
+ */
+static ssize_t mdbi_inflate_out(MdbInflateSource *s, unsigned char *buf, size_t len)
+{
+	size_t n, have;
+	int ret;
+
+	s->z.next_out = buf;
+	s->z.avail_out = len;
+	while (s->z.avail_out && !s->at_end) {
+		/* at the end of the stream inflate() is called with no input,
+		 * to get past the end of the last deflate block */
+		if (!s->z.avail_in) {
+			n = fread(s->in, 1, sizeof(s->in), s->stream);
+			if (ferror(s->stream)) {
+				perror("read");
+				return -1;
+			}
+			s->in_pos += n;
+			s->z.next_in = s->in;
+			s->z.avail_in = n;
+		}
+		/* Z_BLOCK stops at the end of each deflate block, where a seek
+		 * point can go */
+		have = s->z.avail_out;
+		ret = inflate(&s->z, Z_BLOCK);
+		have -= s->z.avail_out;
+		mdbi_inflate_window(s, s->z.next_out - have, have);
+		s->out += have;
+		if (ret == Z_STREAM_END) {
+			s->at_end = TRUE;
+			s->size = s->out;
+			s->size_known = TRUE;
+		} else if (ret == Z_BUF_ERROR) {
+			/* no input left, and more wanted */
+			fprintf(stderr, "Compressed data ends early\n");
+			return -1;
+		} else if (ret != Z_OK) {
+			fprintf(stderr, "inflate: %s\n", s->z.msg ? s->z.msg : zError(ret));
+			return -1;
+		} else if ((s->z.data_type & 128) && !(s->z.data_type & 64)) {
+			/* between two blocks, and not after the last one */
+			mdbi_inflate_add_point(s);
+		}
+	}
+	return len - s->z.avail_out;
+}
+
+/*
+ * Goes back to @point, or to the start of the compressed data if it is
+ * NULL, and inflates from there to the start of the next block.
+ */
+static int mdbi_inflate_seek(MdbInflateSource *s, MdbInflatePoint *point)
+{
+	off_t in = point ? point->in - (point->bits ? 1 : 0) : s->start;
+	guint64 skip;
+	ssize_t n;
+	int c, ret;
+
+	if (fseeko(s->stream, in, SEEK_SET) == -1) {
+		perror("fseeko");
+		return -1;
+	}
+	s->in_pos = in;
+	s->z.avail_in = 0;
+	s->at_end = FALSE;
+	s->failed = TRUE; /* until it is done */
+	if (!point) {
+		ret = inflateReset2(&s->z, MDB_INFLATE_WBITS(s));
+		s->out = 0;
+		s->window_len = 0;
+	} else {
+		/* the deflate data goes on from the point with no header */
+		ret = inflateReset2(&s->z, -15);
+		if (ret == Z_OK && point->bits) {
+			if ((c = getc(s->stream)) == EOF) {
+				fprintf(stderr, "Compressed data ends early\n");
+				return -1;
+			}
+			s->in_pos++;
+			ret = inflatePrime(&s->z, point->bits, c >> (8 - point->bits));
+		}
+		if (ret == Z_OK)
+			ret = inflateSetDictionary(&s->z, point->window, point->window_len);
+		s->out = point->out;
+		memcpy(s->window, point->window, point->window_len);
+		s->window_len = point->window_len;
+	}
+	if (ret != Z_OK) {
+		fprintf(stderr, "inflate: %s\n", zError(ret));
+		return -1;
+	}
+	s->next = (s->out + MDB_INFLATE_BLOCK - 1) / MDB_INFLATE_BLOCK;
+	for (skip = (guint64)s->next * MDB_INFLATE_BLOCK - s->out; skip; skip -= n) {
+		n = mdbi_inflate_out(s, s->skip, skip < sizeof(s->skip) ? skip : sizeof(s->skip));
+		if (n == -1)
+			return -1;
+		if (n == 0)
+			break;
+	}
+	s->failed = FALSE;
+	return 0;
+}
+
+/* The last seek point at or before @out, or NULL if there is none */
+static MdbInflatePoint *mdbi_inflate_find_point(MdbInflateSource *s, guint64 out)
+{
+	unsigned long lo = 0, hi = s->num_points;
+
+	while (lo < hi) {
+		unsigned long mid = lo + (hi - lo) / 2;
+
+		if (s->points[mid].out <= out)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo ? &s->points[lo - 1] : NULL;
+}
+
+/* Frees the least recently used blocks, leaving room for one more */
+static void mdbi_inflate_evict(MdbInflateSource *s)
+{
+	unsigned long i, lru;
+
+	while (s->seekable && s->cached + MDB_INFLATE_BLOCK > s->max_cached) {
+		lru = s->num_blocks;
+		for (i = 0; i < s->num_blocks; i++)
+			if (s->blocks[i].data && (lru == s->num_blocks || s->blocks[i].used < s->blocks[lru].used))
+				lru = i;
+		if (lru == s->num_blocks)
+			break;
+		g_free(s->blocks[lru].data);
+		s->blocks[lru].data = NULL;
+		s->cached -= MDB_INFLATE_BLOCK;
+	}
+}
+
+/* Inflates the next block, and keeps it */
+static int mdbi_inflate_next(MdbInflateSource *s)
+{
+	MdbInflateBlock *block;
+	unsigned char *out;
+	ssize_t len;
+	size_t n;
+
+	if (s->next >= s->num_blocks) {
+		unsigned long num_blocks = s->num_blocks ? 2 * s->num_blocks : 64;
+
+		while (num_blocks <= s->next)
+			num_blocks *= 2;
+		s->blocks = g_realloc(s->blocks, num_blocks * sizeof(MdbInflateBlock));
+		memset(s->blocks + s->num_blocks, 0, (num_blocks - s->num_blocks) * sizeof(MdbInflateBlock));
+		s->num_blocks = num_blocks;
+	}
+	block = &s->blocks[s->next];
+	if (block->data) {
+		/* inflated again after a seek, on the way to a later block */
+		for (n = 0; n < MDB_INFLATE_BLOCK && !s->at_end; n += sizeof(s->skip))
+			if (mdbi_inflate_out(s, s->skip, sizeof(s->skip)) == -1)
+				goto fail;
+	} else {
+		mdbi_inflate_evict(s);
+		out = g_malloc(MDB_INFLATE_BLOCK);
+		if ((len = mdbi_inflate_out(s, out, MDB_INFLATE_BLOCK)) == -1) {
+			g_free(out);
+			goto fail;
+		}
+		block->data = out;
+		block->len = len;
+		s->cached += MDB_INFLATE_BLOCK;
+	}
+	block->used = ++s->clock;
+	s->next++;
+	return 0;
+
+fail:
+	s->failed = TRUE;
+	return -1;
+}
+/*
+ * Block @num, inflated, or NULL if the data ends before it.  A block that
+ * isn't kept is inflated from the last seek point before it, unless the
+ * stream is already on its way there from nearer.
+ */
+static MdbInflateBlock *mdbi_inflate_block(MdbInflateSource *s, unsigned long num, int *err)
+{
+	MdbInflatePoint *point;
+
+	*err = 0;
+	if (s->size_known && (guint64)num * MDB_INFLATE_BLOCK >= s->size)
+		return NULL;
+	if (num < s->next && num < s->num_blocks && s->blocks[num].data) {
+		s->blocks[num].used = ++s->clock;
+		return &s->blocks[num];
+	}
+	point = mdbi_inflate_find_point(s, (guint64)num * MDB_INFLATE_BLOCK);
+	if (num < s->next || s->failed || (point && point->out > s->out)) {
+		if (!s->seekable) {
+			fprintf(stderr, "Block %lu is gone, and the stream can't be rewound\n", num);
+			*err = 1;
+			return NULL;
+		}
+		if (mdbi_inflate_seek(s, point) == -1) {
+			*err = 1;
+			return NULL;
+		}
+	}
+	while (s->next <= num) {
+		if (s->at_end)
+			return NULL;
+		if (mdbi_inflate_next(s) == -1) {
+			*err = 1;
+			return NULL;
+		}
+	}
+	return &s->blocks[num];
+}
+
+static ssize_t mdbi_inflate_read_page(MdbPageSource *src, void *buf, size_t pg_size, unsigned long pg)
+{
+	MdbInflateSource *s = src->data;
+	MdbInflateBlock *block;
+	guint64 offset = (guint64)pg * pg_size;
+	size_t start = offset % MDB_INFLATE_BLOCK, len = 0;
+	int err;
+
+	mdbi_inflate_lock(s);
+	block = mdbi_inflate_block(s, offset / MDB_INFLATE_BLOCK, &err);
+	if (block && start < block->len) {
+		len = block->len - start < pg_size ? block->len - start : pg_size;
+		memcpy(buf, block->data + start, len);
+	}
+	mdbi_inflate_unlock(s);
+	return err ? -1 : (ssize_t)len;
+}
+
+static unsigned long mdbi_inflate_page_count(MdbPageSource *src, size_t pg_size)
+{
+	MdbInflateSource *s = src->data;
+	MdbInflatePoint *point;
+	guint64 size = 0;
+	int err = 0;
+
+	mdbi_inflate_lock(s);
+	/*
+	 * The size is only known once it has all been inflated.  That is done
+	 * from the furthest the stream has got, without keeping the blocks.
+	 */
+	if (!s->size_known && !s->seekable) {
+		/* the blocks can't be inflated again, so they are all kept */
+		while (!s->at_end && !err)
+			mdbi_inflate_block(s, s->next, &err);
+	} else if (!s->size_known) {
+		point = s->num_points ? &s->points[s->num_points - 1] : NULL;
+		if ((s->failed || (point && point->out > s->out)) && mdbi_inflate_seek(s, point) == -1)
+			err = 1;
+		while (!err && !s->at_end) {
+			if (mdbi_inflate_out(s, s->skip, sizeof(s->skip)) == -1) {
+				s->failed = TRUE;
+				err = 1;
+			}
+		}
+		/* the blocks after s->next are past, and not kept */
+		if (!err)
+			s->next = (s->out + MDB_INFLATE_BLOCK - 1) / MDB_INFLATE_BLOCK;
+	}
+	if (!err)
+		size = s->size;
+	mdbi_inflate_unlock(s);
+	return (size + pg_size - 1) / pg_size;
+}
+
+static void mdbi_inflate_close(MdbPageSource *src)
+{
+	MdbInflateSource *s = src->data;
+	unsigned long i;
+
+	for (i = 0; i < s->num_blocks; i++)
+		g_free(s->blocks[i].data);
+	g_free(s->blocks);
+	g_free(s->points);
+	inflateEnd(&s->z);
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_destroy(&s->mutex);
+#endif
+	fclose(s->stream);
+	g_free(s);
+}
+#endif /* HAVE_ZLIB */
+
+/**
+ * mdb_page_source_inflate:
+ * @stream: stream at the start of an MDB file compressed with gzip or
+ * zlib, or with raw deflate, as the members of a zip file are
+ * @flags: MDB_INFLATE_RAW for raw deflate data, otherwise 0
+ * @cache_size: bytes of inflated data to keep, 0 for the default of 64 MB
+ *
+ * Makes a read-only page source that inflates @stream as pages are asked
+ * for, and keeps up to @cache_size bytes of it.  Pages that are no longer
+ * kept are found again by inflating from the last seek point before them;
+ * one is kept about every megabyte, and takes 32 KB.  For that the stream
+ * has to be seekable; if it isn't, all of it is kept.  The stream is
+ * closed with the source.
+ *
+ * Returns: the source, to pass to mdb_open_source(), or NULL if mdbtools
+ * was built without zlib.  The stream is left open on failure.
+ */
+MdbPageSource *mdb_page_source_inflate(FILE *stream, int flags, size_t cache_size)
+{
+#ifdef HAVE_ZLIB
+	MdbPageSource *src;
+	MdbInflateSource *s = g_malloc0(sizeof(MdbInflateSource));
+
+	s->stream = stream;
+	s->flags = flags;
+	s->start = s->in_pos = ftello(stream);
+	s->seekable = s->start != -1 && fseeko(stream, s->start, SEEK_SET) == 0;
+	s->max_cached = cache_size ? cache_size : MDB_INFLATE_CACHE;
+	if (s->max_cached < MDB_INFLATE_BLOCK)
+		s->max_cached = MDB_INFLATE_BLOCK;
+	if (mdbi_inflate_init(s) == -1) {
+		g_free(s);
+		return NULL;
+	}
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_init(&s->mutex, NULL);
+#endif
+	src = g_malloc0(sizeof(MdbPageSource));
+	src->read_page = mdbi_inflate_read_page;
+	src->page_count = mdbi_inflate_page_count;
+	src->close = mdbi_inflate_close;
+	src->data = s;
+	return src;
+#else
+	fprintf(stderr, "mdb_page_source_inflate: mdbtools was built without zlib\n");
+	return NULL;
+#endif
+}
@@ -29,10 +29,159 @@ static gint mdb_col_comparer(MdbColumn **a, MdbColumn **b)
 		return 0;
 }
 
+/*
+ * Parsed table definitions are kept per file, keyed by TDEF page, so that
+ * opening a table again does not re-read and re-parse its definition
+ * pages.  A definition is filled in stage by stage (table, columns,
+ * indices) by the first handle to read it and is not changed afterwards.
+ * Every MdbTableDef holds a reference, and one on the file so that it can
+ * be freed after its handle is closed, and shares the usage maps; it gets
+ * its own deep copies of the columns and indices, which carry the bindings
+ * and sargs of the cursor.
+ *
+ * Only read-only files are cached, and the whole cache is dropped when
+ * the file's stamp (see mdbi_file_stat) changes.
+ */
+#define MDB_TDEF_BUCKETS 64
+
+typedef struct S_MdbTdef {
+	struct S_MdbTdef *next; /* same bucket */
+	int refs;
+	MdbFile *f; /* referenced by each table, not by the cache */
+	guint32 table_pg;
+	unsigned int num_rows;
+	unsigned int num_var_cols;
+	unsigned int num_cols;
+	unsigned int num_idxs;
+	unsigned int num_real_idxs;
+	guint32 first_data_pg;
+	size_t map_sz;
+	unsigned char *usage_map;
+	size_t freemap_sz;
+	unsigned char *free_usage_map;
+	/* set by the first mdb_read_columns */
+	GPtrArray *columns;
+	int index_start;
+	guint32 index_start_pg;
+	/* set by the first mdb_read_indices */
+	GPtrArray *indices;
+	unsigned int idx_num_real_idxs;
+	/* built on demand, see hashindex.c */
+	MdbHashIndex *hash_indexes;
+} MdbTdef;
+
+struct S_MdbTdefCache {
+	MdbTdef *buckets[MDB_TDEF_BUCKETS];
+	MdbFileStamp stamp;
+};
+
+static void mdbi_tdef_unref(MdbTdef *tdef)
+{
+	if (!tdef || --tdef->refs > 0)
+		return;
+	mdb_free_columns(tdef->columns);
+	mdb_free_indices(tdef->indices);
+	g_free(tdef->usage_map);
+	g_free(tdef->free_usage_map);
+	mdbi_free_hash_indexes(tdef->hash_indexes);
+	g_free(tdef);
+}
+
+static void mdbi_tdef_cache_clear(MdbTdefCache *cache)
+{
+	MdbTdef *tdef, *next;
+	int i;
+
+	for (i=0; i<MDB_TDEF_BUCKETS; i++) {
+		for (tdef = cache->buckets[i]; tdef; tdef = next) {
+			next = tdef->next;
+			tdef->next = NULL;
+			mdbi_tdef_unref(tdef);
+		}
+		cache->buckets[i] = NULL;
+	}
+}
+
+/**
+ * mdbi_free_file_tdefs:
+ * @f: file being closed
+ *
+ * Drops the table definitions cached for @f.  Tables still open keep
+ * their own definition alive until they are freed.
+ */
+void mdbi_free_file_tdefs(MdbFile *f)
+{
+	if (!f->tdefs) return;
+	mdbi_tdef_cache_clear(f->tdefs);
+	g_free(f->tdefs);
+	f->tdefs = NULL;
+}
+
+/*
+ * Returns the cache for @mdb's file, emptied if the file has changed
+ * since it was filled, or NULL if the file is not cached at all.
+ */
+static MdbTdefCache *mdbi_tdef_cache(MdbHandle *mdb)
+{
+	MdbFile *f = mdb->f;
+	MdbFileStamp stamp;
+
+	if (f->writable)
+		return NULL;
+	mdbi_file_stat(f, &stamp);
+	if (!f->tdefs) {
+		f->tdefs = g_malloc0(sizeof(MdbTdefCache));
+	} else if (!mdbi_file_stamp_equal(&stamp, &f->tdefs->stamp)) {
+		mdbi_tdef_cache_clear(f->tdefs);
+	}
+	f->tdefs->stamp = stamp;
+	return f->tdefs;
+}
+
+/*
+ * Copies a column between a table and the cached definition.  The copy
+ * is unbound and has its own sargs; its props are looked up again, from
+ * the catalog entry of the table it now belongs to.
+ */
+static MdbColumn *mdbi_copy_column(const MdbColumn *col, MdbTableDef *table)
+{
+	MdbColumn *copy = g_memdup2(col, sizeof(MdbColumn));
+	guint i;
+
+	copy->table = table;
+	copy->bind_ptr = NULL;
+	copy->len_ptr = NULL;
+	copy->bind_truncated = 0;
+	copy->properties = NULL;
+	copy->props = NULL;
+	copy->idx_sarg_cache = NULL;
+	copy->cur_value_start = 0;
+	copy->cur_value_len = 0;
+	copy->cur_blob_pg_row = 0;
+	copy->chunk_size = 0;
+	if (col->sargs) {
+		copy->sargs = g_ptr_array_new();
+		for (i=0; i<col->sargs->len; i++)
+			g_ptr_array_add(copy->sargs,
+				g_memdup2(g_ptr_array_index(col->sargs, i), sizeof(MdbSarg)));
+	}
+	return copy;
+}
+
+static MdbIndex *mdbi_copy_index(const MdbIndex *idx, MdbTableDef *table)
+{
+	MdbIndex *copy = g_memdup2(idx, sizeof(MdbIndex));
+
+	copy->table = table;
+	return copy;
+}
+
 MdbTableDef *mdb_alloc_tabledef(MdbCatalogEntry *entry)
 {
 	MdbTableDef *table = g_malloc0(sizeof(MdbTableDef));
 	table->entry=entry;
+	/* the entry stays put when the handle's catalog is reread */
+	mdbi_catalog_entry_ref(entry);
 	snprintf(table->name, sizeof(table->name), "%s", entry->object_name);
 
 	return table;	
@@ -40,29 +189,67 @@ MdbTableDef *mdb_alloc_tabledef(MdbCatalogEntry *entry)
 void mdb_free_tabledef(MdbTableDef *table)
 {
 	if (!table) return;
+	mdbi_catalog_entry_unref(table->entry);
 	if (table->is_temp_table) {
-		guint i;
-		/* Temp table pages are being stored in memory */
-		for (i=0; i<table->temp_table_pages->len; i++)
-			g_free(g_ptr_array_index(table->temp_table_pages,i));
-		g_ptr_array_free(table->temp_table_pages, TRUE);
+		/* Temp table rows are being stored in memory */
+		mdbi_free_temp_rows(table->temp_rows);
 		/* Temp tables use dummy entries */
 		g_free(table->entry);
 	}
 	mdb_free_columns(table->columns);
 	mdb_free_indices(table->indices);
-	g_free(table->usage_map);
-	g_free(table->free_usage_map);
+	mdbi_free_sarg_prog(table->sarg_prog);
+	g_free(table->page_sel);
+	g_free(table->hash_merged);
+	if (table->tdef) {
+		/* the usage maps belong to the shared definition.  The table
+		 * may outlive its handle, and closes the file if it is last */
+		MdbFile *f = table->tdef->f;
+
+		mdbi_file_lock(f);
+		mdbi_tdef_unref(table->tdef);
+		mdbi_file_unlock(f);
+		mdbi_file_unref(f);
+	} else {
+		g_free(table->usage_map);
+		g_free(table->free_usage_map);
+	}
 	g_free(table);
 }
-MdbTableDef *mdb_read_table(MdbCatalogEntry *entry)
+static MdbTableDef *mdbi_read_table(MdbCatalogEntry *entry)
 {
 	MdbTableDef *table;
 	MdbHandle *mdb = entry->mdb;
 	MdbFormatConstants *fmt = mdb->fmt;
+	MdbTdefCache *cache = mdbi_tdef_cache(mdb);
+	MdbTdef *tdef = NULL;
 	int row_start, pg_row;
 	void *buf, *pg_buf = mdb->pg_buf;
-	guint i;
+
+	if (cache) {
+		for (tdef = cache->buckets[entry->table_pg % MDB_TDEF_BUCKETS];
+				tdef; tdef = tdef->next) {
+			if (tdef->table_pg == entry->table_pg)
+				break;
+		}
+	}
+	if (tdef) {
+		table = mdb_alloc_tabledef(entry);
+		table->tdef = tdef;
+		tdef->refs++;
+		mdb->f->refs++;
+		table->num_rows = tdef->num_rows;
+		table->num_var_cols = tdef->num_var_cols;
+		table->num_cols = tdef->num_cols;
+		table->num_idxs = tdef->num_idxs;
+		table->num_real_idxs = tdef->num_real_idxs;
+		table->map_sz = tdef->map_sz;
+		table->usage_map = tdef->usage_map;
+		table->freemap_sz = tdef->freemap_sz;
+		table->free_usage_map = tdef->free_usage_map;
+		table->first_data_pg = tdef->first_data_pg;
+		return table;
+	}
 
 	if (!mdb_read_pg(mdb, entry->table_pg)) {
         fprintf(stderr, "mdb_read_table: Unable to read page %lu\n", entry->table_pg);
@@ -117,29 +304,50 @@ MdbTableDef *mdb_read_table(MdbCatalogEntry *entry)
 
 	table->first_data_pg = mdb_get_int16(pg_buf, fmt->tab_first_dpg_offset);
 
-	if (entry->props)
-		for (i=0; i<entry->props->len; ++i) {
-			MdbProperties *props = g_ptr_array_index(entry->props, i);
-			if (!props->name)
-				table->props = props;
-		}
+	if (cache) {
+		tdef = g_malloc0(sizeof(MdbTdef));
+		tdef->refs = 2; /* the cache and this table */
+		tdef->f = mdb->f;
+		mdb->f->refs++;
+		tdef->table_pg = entry->table_pg;
+		tdef->num_rows = table->num_rows;
+		tdef->num_var_cols = table->num_var_cols;
+		tdef->num_cols = table->num_cols;
+		tdef->num_idxs = table->num_idxs;
+		tdef->num_real_idxs = table->num_real_idxs;
+		tdef->map_sz = table->map_sz;
+		tdef->usage_map = table->usage_map;
+		tdef->freemap_sz = table->freemap_sz;
+		tdef->free_usage_map = table->free_usage_map;
+		tdef->first_data_pg = table->first_data_pg;
+		tdef->next = cache->buckets[entry->table_pg % MDB_TDEF_BUCKETS];
+		cache->buckets[entry->table_pg % MDB_TDEF_BUCKETS] = tdef;
+		table->tdef = tdef;
+	}
+
+	/* table->props and col->props are filled in on demand, see mdb_table_get_props */
+
+	return table;
+}
+MdbTableDef *mdb_read_table(MdbCatalogEntry *entry)
+{
+	MdbFile *f = entry->mdb->f;
+	MdbTableDef *table;
 
+	/* the definition cache is shared with other handles on the file */
+	mdbi_file_lock(f);
+	table = mdbi_read_table(entry);
+	mdbi_file_unlock(f);
 	return table;
 }
 MdbTableDef *mdb_read_table_by_name(MdbHandle *mdb, gchar *table_name, int obj_type)
 {
-	unsigned int i;
 	MdbCatalogEntry *entry;
 
-	mdb_read_catalog(mdb, obj_type);
-
-	for (i=0; i<mdb->num_catalog; i++) {
-		entry = g_ptr_array_index(mdb->catalog, i);
-		if (!g_ascii_strcasecmp(entry->object_name, table_name))
-			return mdb_read_table(entry);
-	}
+	if (!(entry = mdb_get_catalogentry_by_name_and_type(mdb, table_name, obj_type)))
+		return NULL;
 
-	return NULL;
+	return mdb_read_table(entry);
 }
 
 
@@ -234,20 +442,32 @@ void mdb_free_columns(GPtrArray *columns)
 	}
 	g_ptr_array_free(columns, TRUE);
 }
-GPtrArray *mdb_read_columns(MdbTableDef *table)
+static GPtrArray *mdbi_read_columns(MdbTableDef *table)
 {
 	MdbHandle *mdb = table->entry->mdb;
 	MdbFormatConstants *fmt = mdb->fmt;
 	MdbColumn *pcol;
 	unsigned char *col;
 	unsigned int i;
-	guint j;
 	int cur_pos;
 	size_t name_sz;
-	GPtrArray *allprops;
-	
+	MdbTdef *tdef = table->tdef;
+
 	table->columns = g_ptr_array_new();
 
+	if (tdef && tdef->columns) {
+		for (i=0; i<tdef->columns->len; i++)
+			g_ptr_array_add(table->columns,
+				mdbi_copy_column(g_ptr_array_index(tdef->columns, i), table));
+		table->index_start = tdef->index_start;
+		return table->columns;
+	}
+	/* the definition was cached before anyone asked for its columns */
+	if (tdef && !mdb_read_pg(mdb, table->entry->table_pg)) {
+		mdb_free_columns(table->columns);
+		return table->columns = NULL;
+	}
+
 	col = g_malloc(fmt->tab_col_entry_size);
 
 	cur_pos = fmt->tab_cols_start_offset + 
@@ -334,22 +554,79 @@ GPtrArray *mdb_read_columns(MdbTableDef *table)
 	/* Sort the columns by col_num */
 	g_ptr_array_sort(table->columns, (GCompareFunc)mdb_col_comparer);
 
-	allprops = table->entry->props;
-	if (allprops)
-		for (i=0;i<table->num_cols;i++) {
-			pcol = g_ptr_array_index(table->columns, i);
-			for (j=0; j<allprops->len; ++j) {
-				MdbProperties *props = g_ptr_array_index(allprops, j);
-				if (props->name && !strcmp(props->name, pcol->name)) {
-					pcol->props = props;
-					break;
-				}
-
-			}
-		}
 	table->index_start = cur_pos;
+
+	if (tdef) {
+		tdef->columns = g_ptr_array_new();
+		for (i=0; i<table->columns->len; i++)
+			g_ptr_array_add(tdef->columns,
+				mdbi_copy_column(g_ptr_array_index(table->columns, i), NULL));
+		tdef->index_start = table->index_start;
+		tdef->index_start_pg = mdb->cur_pg;
+	}
 	return table->columns;
 }
+GPtrArray *mdb_read_columns(MdbTableDef *table)
+{
+	MdbFile *f = table->entry->mdb->f;
+	GPtrArray *columns;
+
+	mdbi_file_lock(f);
+	columns = mdbi_read_columns(table);
+	mdbi_file_unlock(f);
+	return columns;
+}
+
+/*
+ * Fills in table->indices from the cached definition.  Returns FALSE if
+ * mdb_read_indices has to parse them, with the page buffer back where
+ * mdb_read_columns left it.
+ */
+gboolean mdbi_tdef_read_indices(MdbTableDef *table)
+{
+	MdbTdef *tdef = table->tdef;
+	guint i;
+
+	if (!tdef || !tdef->columns)
+		return FALSE;
+	if (!tdef->indices) {
+		mdb_read_pg(table->entry->mdb, tdef->index_start_pg);
+		return FALSE;
+	}
+	table->indices = g_ptr_array_new();
+	for (i=0; i<tdef->indices->len; i++)
+		g_ptr_array_add(table->indices,
+			mdbi_copy_index(g_ptr_array_index(tdef->indices, i), table));
+	table->num_real_idxs = tdef->idx_num_real_idxs;
+	return TRUE;
+}
+
+/*
+ * Keeps a copy of the indices mdb_read_indices just parsed in the
+ * cached definition.
+ */
+void mdbi_tdef_save_indices(MdbTableDef *table)
+{
+	MdbTdef *tdef = table->tdef;
+	guint i;
+
+	if (!tdef || !tdef->columns || tdef->indices)
+		return;
+	tdef->indices = g_ptr_array_new();
+	for (i=0; i<table->indices->len; i++)
+		g_ptr_array_add(tdef->indices,
+			mdbi_copy_index(g_ptr_array_index(table->indices, i), NULL));
+	tdef->idx_num_real_idxs = table->num_real_idxs;
+}
+
+/*
+ * Where the hash indexes of @table's cached definition are kept, or NULL
+ * if the definition is not cached.  Called with the file locked.
+ */
+MdbHashIndex **mdbi_tdef_hash_indexes(MdbTableDef *table)
+{
+	return table->tdef ? &table->tdef->hash_indexes : NULL;
+}
 
 void mdb_table_dump(MdbCatalogEntry *entry)
 {
@@ -369,7 +646,7 @@ guint32 pgnum;
 	fprintf(stdout,"number of columns   = %d\n",table->num_cols);
 	fprintf(stdout,"number of indices   = %d\n",table->num_real_idxs);
 
-	if (table->props)
+	if (mdb_table_get_props(table))
 		mdb_dump_props(table->props, stdout, 0);
 	mdb_read_columns(table);
 	mdb_read_indices(table);
@@ -381,7 +658,7 @@ guint32 pgnum;
 			i, col->name,
 			mdb_get_colbacktype_string(col),
 			col->col_size);
-		if (col->props)
+		if (mdb_col_get_props(col))
 			mdb_dump_props(col->props, stdout, 0);
 	}
 
@@ -428,18 +705,70 @@ int mdb_is_system_table(MdbCatalogEntry *entry)
 	 && (entry->flags & 0x80000002)) ? 1 : 0;
 }
 
+/**
+ * mdb_table_get_props:
+ * @table: table definition
+ *
+ * Returns: the table's own properties, decoding the object's property
+ * blob on first use, or NULL.
+ */
+MdbProperties *
+mdb_table_get_props(MdbTableDef *table)
+{
+	GPtrArray *allprops;
+	unsigned int j;
+
+	if (table->props)
+		return table->props;
+	if (!(allprops = mdb_catalogentry_get_props(table->entry)))
+		return NULL;
+	for (j=0; j<allprops->len; ++j) {
+		MdbProperties *props = g_ptr_array_index(allprops, j);
+		if (!props->name)
+			return table->props = props;
+	}
+	return NULL;
+}
+
+/**
+ * mdb_col_get_props:
+ * @col: column
+ *
+ * Returns: the column's properties, decoding the table's property blob
+ * on first use, or NULL.
+ */
+MdbProperties *
+mdb_col_get_props(MdbColumn *col)
+{
+	GPtrArray *allprops;
+	unsigned int j;
+
+	if (col->props || !col->table)
+		return col->props;
+	if (!(allprops = mdb_catalogentry_get_props(col->table->entry)))
+		return NULL;
+	for (j=0; j<allprops->len; ++j) {
+		MdbProperties *props = g_ptr_array_index(allprops, j);
+		if (props->name && !strcmp(props->name, col->name))
+			return col->props = props;
+	}
+	return NULL;
+}
+
 const char *
 mdb_table_get_prop(const MdbTableDef *table, const gchar *key) {
-	if (!table->props)
+	MdbProperties *props = mdb_table_get_props((MdbTableDef *)table);
+	if (!props)
 		return NULL;
-	return g_hash_table_lookup(table->props->hash, key);
+	return g_hash_table_lookup(props->hash, key);
 }
 
 const char *
 mdb_col_get_prop(const MdbColumn *col, const gchar *key) {
-	if (!col->props)
+	MdbProperties *props = mdb_col_get_props((MdbColumn *)col);
+	if (!props)
 		return NULL;
-	return g_hash_table_lookup(col->props->hash, key);
+	return g_hash_table_lookup(props->hash, key);
 }
 
 int mdb_col_is_shortdate(const MdbColumn *col) {
@@ -22,8 +22,16 @@
 /*
  * Temp table routines.  These are currently used to generate mock results for
  * commands like "list tables" and "describe table"
+ *
+ * The rows are kept in memory one after another, each as an MdbTempValue
+ * per column followed by the column values.  mdb_fetch_row() copies the
+ * values of the row it returns to the start of the page buffer, where the
+ * bound columns and cur_value_start expect them.
  */
 
+/* rows start on a boundary MdbTempValue can be read from */
+#define MDB_TEMP_ROW_ALIGN 8
+
 void
 mdb_fill_temp_col(MdbColumn *tcol, char *col_name, int col_size, int col_type, int is_fixed)
 {
@@ -63,7 +71,7 @@ mdb_create_temp_table(MdbHandle *mdb, char *name)
 	table = mdb_alloc_tabledef(entry);
 	table->columns = g_ptr_array_new();
 	table->is_temp_table = 1;
-	table->temp_table_pages = g_ptr_array_new();
+	table->temp_rows = g_malloc0(sizeof(MdbTempRows));
 
 	return table;
 }
@@ -94,3 +102,119 @@ void mdb_temp_columns_end(MdbTableDef *table)
 		}
 	}
 }
+
+/* the size of value @i of a row, which for fixed size columns is theirs */
+static size_t
+mdbi_temp_value_size(MdbTableDef *table, MdbField *fields, unsigned int i)
+{
+	MdbColumn *col = g_ptr_array_index(table->columns, i);
+
+	if (col->col_type != MDB_TEXT && col->col_type != MDB_MEMO)
+		return col->col_size;
+	return fields[i].siz;
+}
+
+/**
+ * mdb_temp_table_add_row:
+ * @table: temp table from mdb_create_temp_table()
+ * @fields: one value per column, as filled in by mdb_fill_temp_field()
+ * @num_fields: number of columns
+ *
+ * Appends a row to @table, and counts it in table->num_rows.  A field with
+ * a NULL value is a null; fixed size values are read at the column's
+ * size.  The values are copied.
+ *
+ * Returns: 0 on success, -1 if the values don't fit in a page.
+ */
+int
+mdb_temp_table_add_row(MdbTableDef *table, MdbField *fields, unsigned int num_fields)
+{
+	MdbTempRows *rows = table->temp_rows;
+	MdbTempValue *values;
+	unsigned char *data;
+	size_t header = table->num_cols * sizeof(MdbTempValue);
+	size_t len = 0, row_len;
+	unsigned int i;
+
+	for (i=0; i<num_fields && i<table->num_cols; i++) {
+		if (fields[i].value)
+			len += mdbi_temp_value_size(table, fields, i);
+	}
+	if (len > (size_t)table->entry->mdb->fmt->pg_size) {
+		fprintf(stderr, "Row of %zu bytes doesn't fit in a page\n", len);
+		return -1;
+	}
+	row_len = (header + len + MDB_TEMP_ROW_ALIGN - 1) & ~(size_t)(MDB_TEMP_ROW_ALIGN - 1);
+
+	if (rows->len + row_len > rows->size) {
+		while (rows->len + row_len > rows->size)
+			rows->size = rows->size ? rows->size * 2 : 4096;
+		rows->data = g_realloc(rows->data, rows->size);
+	}
+	if (rows->num_rows == rows->rows_size) {
+		rows->rows_size = rows->rows_size ? rows->rows_size * 2 : 64;
+		rows->rows = g_realloc(rows->rows, rows->rows_size * sizeof(size_t));
+	}
+	rows->rows[rows->num_rows++] = rows->len;
+	values = (MdbTempValue *)(rows->data + rows->len);
+	data = rows->data + rows->len + header;
+	rows->len += row_len;
+
+	len = 0;
+	for (i=0; i<table->num_cols; i++) {
+		values[i].start = len;
+		if (i >= num_fields || !fields[i].value) {
+			values[i].len = 0;
+			values[i].is_null = 1;
+			continue;
+		}
+		values[i].len = mdbi_temp_value_size(table, fields, i);
+		values[i].is_null = 0;
+		memcpy(data + len, fields[i].value, values[i].len);
+		len += values[i].len;
+	}
+	table->num_rows++;
+	return 0;
+}
+
+/*
+ * mdb_add_row_to_pg() on a temp table: @row_buffer is a row from
+ * mdb_pack_row(), cracked in the page buffer to get at its values.  The
+ * caller counts the row itself, as it always has.  Returns the row's
+ * number, which mdb_insert_row() passes on to mdb_update_indexes(), or -1
+ * if the row couldn't be cracked or stored.
+ */
+int
+mdbi_add_packed_temp_row(MdbTableDef *table, unsigned char *row_buffer, int row_size)
+{
+	MdbHandle *mdb = table->entry->mdb;
+	MdbField *fields = g_malloc(sizeof(MdbField) * (table->num_cols ? table->num_cols : 1));
+	void *save = g_memdup2(mdb->pg_buf, mdb->fmt->pg_size);
+	int num_fields, i, ret = -1;
+
+	memcpy(mdb->pg_buf, row_buffer, row_size);
+	num_fields = mdb_crack_row(table, 0, row_size, fields);
+	if (num_fields >= 0) {
+		for (i=0; i<num_fields; i++) {
+			if (fields[i].is_null)
+				fields[i].value = NULL;
+		}
+		if (mdb_temp_table_add_row(table, fields, num_fields) == 0) {
+			table->num_rows--;
+			ret = table->temp_rows->num_rows - 1;
+		}
+	}
+	memcpy(mdb->pg_buf, save, mdb->fmt->pg_size);
+	g_free(save);
+	g_free(fields);
+	return ret;
+}
+
+void
+mdbi_free_temp_rows(MdbTempRows *rows)
+{
+	if (!rows) return;
+	g_free(rows->data);
+	g_free(rows->rows);
+	g_free(rows);
+}
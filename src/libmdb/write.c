@@ -75,17 +75,19 @@ __attribute__((alias("mdb_put_int32_msb")));
 ssize_t
 mdb_write_pg(MdbHandle *mdb, unsigned long pg)
 {
+	MdbPageSource *src = mdb->f->source;
 	ssize_t len;
-	off_t offset = pg * mdb->fmt->pg_size;
 	unsigned char *buf = mdb->pg_buf;
 
-    fseeko(mdb->f->stream, 0, SEEK_END);
+	if (!src->write_page) {
+		fprintf(stderr, "Page source is read-only\n");
+		return 0;
+	}
 	/* is page beyond current size + 1 ? */
-	if (ftello(mdb->f->stream) < offset + mdb->fmt->pg_size) {
-		fprintf(stderr,"offset %" PRIu64 " is beyond EOF\n",(uint64_t)offset);
+	if (pg >= src->page_count(src, mdb->fmt->pg_size)) {
+		fprintf(stderr,"offset %" PRIu64 " is beyond EOF\n",(uint64_t)pg * mdb->fmt->pg_size);
 		return 0;
 	}
-	fseeko(mdb->f->stream, offset, SEEK_SET);
 
 	if (pg != 0 && mdb->f->db_key != 0)
 	{
@@ -94,14 +96,13 @@ mdb_write_pg(MdbHandle *mdb, unsigned long pg)
 		mdbi_rc4((unsigned char*)&tmp_key, 4, buf, mdb->fmt->pg_size);
 	}
 
-	len = fwrite(buf, 1, mdb->fmt->pg_size, mdb->f->stream);
+	len = src->write_page(src, buf, mdb->fmt->pg_size, pg);
 
 	if (buf != mdb->pg_buf) {
 		g_free(buf);
 	}
 
-	if (ferror(mdb->f->stream)) {
-		perror("write");
+	if (len == -1) {
 		return 0;
 	} else if (len<mdb->fmt->pg_size) {
 	/* fprintf(stderr,"EOF reached %d bytes returned.\n",len, mdb->pg_size); */
@@ -600,7 +601,7 @@ mdb_insert_row(MdbTableDef *table, int num_fields, MdbField *fields)
 	MdbHandle *mdb = entry->mdb;
 	MdbFormatConstants *fmt = mdb->fmt;
 	gint32 pgnum;
-	guint16 rownum;
+	int rownum;
 
 	if (!mdb->f->writable) {
 		fprintf(stderr, "File is not open for writing\n");
@@ -617,6 +618,8 @@ mdb_insert_row(MdbTableDef *table, int num_fields, MdbField *fields)
 	}
 
 	rownum = mdb_add_row_to_pg(table, row_buffer, new_row_size);
+	if (rownum == -1)
+		return 0;
 
 	if (mdb_get_option(MDB_DEBUG_WRITE)) {
 		mdb_buffer_dump(mdb->pg_buf, 0, 40);
@@ -634,9 +637,10 @@ mdb_insert_row(MdbTableDef *table, int num_fields, MdbField *fields)
 }
 /*
  * Assumes caller has verfied space is available on page and adds the new 
- * row to the current pg_buf.
+ * row to the current pg_buf.  Returns the new row's number, or -1 if a
+ * temp table couldn't store it.
  */
-guint16
+int
 mdb_add_row_to_pg(MdbTableDef *table, unsigned char *row_buffer, int new_row_size)
 {
 	void *new_pg;
@@ -646,35 +650,20 @@ mdb_add_row_to_pg(MdbTableDef *table, unsigned char *row_buffer, int new_row_siz
 	MdbHandle *mdb = entry->mdb;
 	MdbFormatConstants *fmt = mdb->fmt;
 
-	if (table->is_temp_table) {
-		GPtrArray *pages = table->temp_table_pages;
-		if (pages->len == 0) {
-			new_pg = mdb_new_data_pg(entry);
-			g_ptr_array_add(pages, new_pg);
-		} else {
-			new_pg = g_ptr_array_index(pages, pages->len - 1);
-			if (mdb_get_int16(new_pg, 2) < new_row_size + 2) {
-				new_pg = mdb_new_data_pg(entry);
-				g_ptr_array_add(pages, new_pg);
-			}
-		}
+	if (table->is_temp_table)
+		return mdbi_add_packed_temp_row(table, row_buffer, new_row_size);
 
-		num_rows = mdb_get_int16(new_pg, fmt->row_count_offset);
-		pos = (num_rows == 0) ? fmt->pg_size :
-			mdb_get_int16(new_pg, fmt->row_count_offset + (num_rows*2));
-	} else {  /* is not a temp table */
-		new_pg = mdb_new_data_pg(entry);
-
-		num_rows = mdb_get_int16(mdb->pg_buf, fmt->row_count_offset);
-		pos = fmt->pg_size;
-
-		/* copy existing rows */
-		for (i=0;i<num_rows;i++) {
-			mdb_find_row(mdb, i, &row_start, &row_size);
-			pos -= row_size;
-			memcpy((char*)new_pg + pos, mdb->pg_buf + row_start, row_size);
-			mdb_put_int16(new_pg, (fmt->row_count_offset + 2) + (i*2), pos);
-		}
+	new_pg = mdb_new_data_pg(entry);
+
+	num_rows = mdb_get_int16(mdb->pg_buf, fmt->row_count_offset);
+	pos = fmt->pg_size;
+
+	/* copy existing rows */
+	for (i=0;i<num_rows;i++) {
+		mdb_find_row(mdb, i, &row_start, &row_size);
+		pos -= row_size;
+		memcpy((char*)new_pg + pos, mdb->pg_buf + row_start, row_size);
+		mdb_put_int16(new_pg, (fmt->row_count_offset + 2) + (i*2), pos);
 	}
 
 	/* add our new row */
@@ -691,10 +680,8 @@ mdb_add_row_to_pg(MdbTableDef *table, unsigned char *row_buffer, int new_row_siz
 	mdb_put_int16(new_pg,2,pos - fmt->row_count_offset - 2 - (num_rows*2));
 
 	/* copy new page over old */
-	if (!table->is_temp_table) {
-		memcpy(mdb->pg_buf, new_pg, fmt->pg_size);
-		g_free(new_pg);
-	}
+	memcpy(mdb->pg_buf, new_pg, fmt->pg_size);
+	g_free(new_pg);
 
 	return num_rows;
 }
@@ -67,14 +67,24 @@ struct _hstmt {
 	int rows_affected;
 	int icol; /* SQLGetData: last column */
 	int pos; /* SQLGetData: last position (truncated result) */
+	SQLULEN row_array_size; /* SQL_ATTR_ROW_ARRAY_SIZE: rows per SQLFetch */
+	SQLULEN rowset_size; /* SQL_ROWSET_SIZE: rows per SQLExtendedFetch */
+	SQLULEN bind_type; /* SQL_BIND_BY_COLUMN or size of a row-wise struct */
+	SQLULEN *bind_offset_ptr; /* SQL_ATTR_ROW_BIND_OFFSET_PTR */
+	SQLUSMALLINT *row_status_ptr; /* SQL_ATTR_ROW_STATUS_PTR */
+	SQLULEN *rows_fetched_ptr; /* SQL_ATTR_ROWS_FETCHED_PTR */
+	MdbColumn **col_map; /* SQL column -> table column, NULL until resolved */
+	int at_end; /* the scan has ended: fetch no more until the next SQLExecute */
 };
 
 struct _sql_bind_info {
 	int column_number;
 	int column_bindtype; /* type/conversion required */
+	int c_type; /* column_bindtype with SQL_C_DEFAULT resolved, set with fast_type */
 	SQLLEN column_bindlen; /* size of varaddr buffer */
 	SQLLEN *column_lenbind; /* where to store length of varaddr used */
 	char *varaddr;
+	int fast_type; /* direct page-to-buffer copy, resolved with col_map */
 	struct _sql_bind_info *next;
 };
 
@@ -37,6 +37,10 @@ static int _odbc_fix_literals(struct _hstmt *stmt);
 static int _odbc_get_string_size(int size, SQLCHAR *str);
 
 static void unbind_columns (struct _hstmt*);
+static int _odbc_map_columns(struct _hstmt *stmt);
+static void _odbc_unmap_columns(struct _hstmt *stmt);
+static SQLRETURN _odbc_fetch_rowset(struct _hstmt *stmt, SQLULEN rowset_size,
+	SQLULEN *rows_fetched, SQLUSMALLINT *row_status);
 
 #define FILL_FIELD(f,v,s) mdb_fill_temp_field(f,v,s,0,0,0,0)
 
@@ -220,36 +224,14 @@ SQLRETURN SQL_API SQLExtendedFetch(
     SQLUSMALLINT      *rgfRowStatus)
 {
 	struct _hstmt *stmt = (struct _hstmt *) hstmt;
-	struct _sql_bind_info *cur = stmt->bind_head;
 
 	TRACE("SQLExtendedFetch");
 	if (fFetchType!=SQL_FETCH_NEXT) {
 		LogStatementError(stmt, "Fetch type not supported in SQLExtendedFetch");
+		strcpy(stmt->sqlState, "HY106");
 		return SQL_ERROR;
 	}
-	if (pcrow)
-		*pcrow=1;
-	if (rgfRowStatus)
-		*rgfRowStatus = SQL_SUCCESS; /* what is the row status value? */
-	
-	if (mdb_fetch_row(stmt->sql->cur_table)) {
-		SQLRETURN final_retval = SQL_SUCCESS;
-		while (cur && (final_retval == SQL_SUCCESS || final_retval == SQL_SUCCESS_WITH_INFO)) {
-			/* log error ? */
-			SQLLEN lenbind = 0;
-			SQLRETURN this_retval = SQLGetData(hstmt, cur->column_number, cur->column_bindtype,
-					cur->varaddr, cur->column_bindlen, &lenbind);
-			if (cur->column_lenbind)
-				*(cur->column_lenbind) = lenbind;
-			if (this_retval != SQL_SUCCESS)
-				final_retval = this_retval;
-			cur = cur->next;
-		}
-		stmt->rows_affected++;
-		return final_retval;
-	} else {
-		return SQL_NO_DATA_FOUND;
-	}
+	return _odbc_fetch_rowset(stmt, stmt->rowset_size, pcrow, rgfRowStatus);
 }
 
 SQLRETURN SQL_API SQLForeignKeys(
@@ -465,6 +447,9 @@ SQLRETURN SQL_API SQLAllocStmt(
 	g_ptr_array_add(dbc->statements, stmt);
 	stmt->sql = mdb_sql_init();
 	stmt->sql->mdb = mdb_clone_handle(dbc->sqlconn->mdb);
+	stmt->row_array_size = 1;
+	stmt->rowset_size = 1;
+	stmt->bind_type = SQL_BIND_BY_COLUMN;
 
 	*phstmt = stmt;
 	return SQL_SUCCESS;
@@ -503,6 +488,7 @@ SQLRETURN SQL_API SQLBindCol(
 	struct _sql_bind_info *cur, *newitem;
 
 	TRACE("SQLBindCol");
+	_odbc_unmap_columns(stmt);
 	/* find available item in list */
 	cur = stmt->bind_head;
 	while (cur) {
@@ -818,7 +804,9 @@ SQLRETURN SQL_API SQLExecute(SQLHSTMT hstmt)
 	/* fprintf(stderr,"query = %s\n",stmt->query); */
 	_odbc_fix_literals(stmt);
 
+	_odbc_unmap_columns(stmt);
 	mdb_sql_reset(stmt->sql);
+	stmt->at_end = 0;
 
 	mdb_sql_run_query(stmt->sql, stmt->query);
 	if (mdb_sql_has_error(stmt->sql)) {
@@ -846,6 +834,7 @@ unbind_columns(struct _hstmt *stmt)
 
 	TRACE("unbind_columns");
 
+	_odbc_unmap_columns(stmt);
 	//Free the memory allocated for bound columns
 	cur = stmt->bind_head;
 	while(cur) {
@@ -856,35 +845,284 @@ unbind_columns(struct _hstmt *stmt)
 	stmt->bind_head = NULL;
 }
 
-SQLRETURN SQLFetch(
-    SQLHSTMT           hstmt)
+/* Bound columns whose C type is the column's native type */
+enum {
+	_ODBC_FAST_NONE = 0,
+	_ODBC_FAST_BYTE,
+	_ODBC_FAST_INT16,
+	_ODBC_FAST_INT32,
+	_ODBC_FAST_SINGLE,
+	_ODBC_FAST_DOUBLE
+};
+
+static int _odbc_fast_type(MdbColumn *col, SQLSMALLINT fCType)
 {
-	struct _hstmt *stmt = (struct _hstmt *) hstmt;
-	struct _sql_bind_info *cur = stmt->bind_head;
-	TRACE("SQLFetch");
+	switch (col->col_type) {
+		case MDB_BYTE:
+			return fCType == SQL_C_UTINYINT ? _ODBC_FAST_BYTE : _ODBC_FAST_NONE;
+		case MDB_INT:
+			return (fCType == SQL_C_SHORT || fCType == SQL_C_SSHORT) ?
+				_ODBC_FAST_INT16 : _ODBC_FAST_NONE;
+		case MDB_LONGINT:
+			return (fCType == SQL_C_LONG || fCType == SQL_C_SLONG) ?
+				_ODBC_FAST_INT32 : _ODBC_FAST_NONE;
+		case MDB_FLOAT:
+			return fCType == SQL_C_FLOAT ? _ODBC_FAST_SINGLE : _ODBC_FAST_NONE;
+		case MDB_DOUBLE:
+			return fCType == SQL_C_DOUBLE ? _ODBC_FAST_DOUBLE : _ODBC_FAST_NONE;
+	}
+	return _ODBC_FAST_NONE;
+}
 
-	if ( stmt->sql->limit >= 0 && stmt->rows_affected == stmt->sql->limit ) {
-		return SQL_NO_DATA_FOUND;
+/*
+ * Resolve every result column to its MdbColumn once per result set, and
+ * pick the direct copy routine for each bound column, so that fetching
+ * does not have to search the table columns by name for every cell.
+ * Returns 0 on success.
+ */
+static int _odbc_map_columns(struct _hstmt *stmt)
+{
+	MdbSQL *sql = stmt->sql;
+	MdbTableDef *table = sql->cur_table;
+	struct _sql_bind_info *cur;
+	unsigned int i, j;
+
+	if (stmt->col_map)
+		return 0;
+	if (!table)
+		return 1;
+	stmt->col_map = g_malloc0((sql->num_columns + 1) * sizeof(MdbColumn *));
+	for (i=0; i<sql->num_columns; i++) {
+		MdbSQLColumn *sqlcol = g_ptr_array_index(sql->columns, i);
+		for (j=0; j<table->num_cols; j++) {
+			MdbColumn *col = g_ptr_array_index(table->columns, j);
+			if (!g_ascii_strcasecmp(sqlcol->name, col->name)) {
+				stmt->col_map[i] = col;
+				break;
+			}
+		}
+	}
+	for (cur = stmt->bind_head; cur; cur = cur->next) {
+		MdbColumn *col = NULL;
+
+		if (cur->column_number >= 1 && cur->column_number <= (int)sql->num_columns)
+			col = stmt->col_map[cur->column_number - 1];
+		/* as SQLGetData() does, so both agree on what goes in the buffer */
+		cur->c_type = cur->column_bindtype;
+		if (col && cur->c_type == SQL_C_DEFAULT)
+			cur->c_type = _odbc_get_client_type(col);
+		cur->fast_type = col ? _odbc_fast_type(col, cur->c_type) : _ODBC_FAST_NONE;
+	}
+	return 0;
+}
+
+static void _odbc_unmap_columns(struct _hstmt *stmt)
+{
+	g_free(stmt->col_map);
+	stmt->col_map = NULL;
+}
+
+/*
+ * Copy a bound column whose C type matches the column's type straight
+ * from the page buffer, without going through SQLGetData.
+ */
+static SQLRETURN _odbc_fast_get(struct _hstmt *stmt, struct _sql_bind_info *cur,
+	char *varaddr, SQLLEN *lenaddr)
+{
+	MdbColumn *col = stmt->col_map[cur->column_number - 1];
+	void *pg_buf = stmt->sql->mdb->pg_buf;
+	int start = col->cur_value_start;
+	SQLLEN len;
+
+	if (col->cur_value_len == 0) {
+		if (!lenaddr) {
+			strcpy(stmt->sqlState, "22002");
+			return SQL_ERROR;
+		}
+		*lenaddr = SQL_NULL_DATA;
+		return SQL_SUCCESS;
+	}
+	switch (cur->fast_type) {
+		case _ODBC_FAST_BYTE:
+			*(SQLCHAR *)varaddr = mdb_get_byte(pg_buf, start);
+			len = sizeof(SQLCHAR);
+			break;
+		case _ODBC_FAST_INT16:
+			*(SQLSMALLINT *)varaddr = mdb_get_int16(pg_buf, start);
+			len = sizeof(SQLSMALLINT);
+			break;
+		case _ODBC_FAST_INT32:
+			*(SQLINTEGER *)varaddr = mdb_get_int32(pg_buf, start);
+			len = sizeof(SQLINTEGER);
+			break;
+		case _ODBC_FAST_SINGLE:
+			*(float *)varaddr = mdb_get_single(pg_buf, start);
+			len = sizeof(float);
+			break;
+		default:
+			*(double *)varaddr = mdb_get_double(pg_buf, start);
+			len = sizeof(double);
+			break;
+	}
+	if (lenaddr)
+		*lenaddr = len;
+	return SQL_SUCCESS;
+}
+
+/*
+ * Size of one element of a column-wise bound array: the buffer length for
+ * variable-length C types, the size of the C type otherwise.  SQL_C_DEFAULT
+ * has been resolved to the column's own type by _odbc_map_columns().
+ */
+static SQLLEN _odbc_c_type_size(struct _sql_bind_info *cur)
+{
+	switch (cur->c_type) {
+		case SQL_C_BIT:
+		case SQL_C_TINYINT:
+		case SQL_C_STINYINT:
+		case SQL_C_UTINYINT:
+			return sizeof(SQLCHAR);
+		case SQL_C_SHORT:
+		case SQL_C_SSHORT:
+		case SQL_C_USHORT:
+			return sizeof(SQLSMALLINT);
+		case SQL_C_LONG:
+		case SQL_C_SLONG:
+		case SQL_C_ULONG:
+			return sizeof(SQLINTEGER);
+		case SQL_C_SBIGINT:
+		case SQL_C_UBIGINT:
+			return sizeof(SQLBIGINT);
+		case SQL_C_FLOAT:
+			return sizeof(SQLREAL);
+		case SQL_C_DOUBLE:
+			return sizeof(SQLDOUBLE);
+		case SQL_C_TYPE_DATE:
+		case SQL_C_DATE:
+			return sizeof(DATE_STRUCT);
+		case SQL_C_TYPE_TIME:
+		case SQL_C_TIME:
+			return sizeof(TIME_STRUCT);
+		case SQL_C_TYPE_TIMESTAMP:
+		case SQL_C_TIMESTAMP:
+			return sizeof(TIMESTAMP_STRUCT);
+		default:
+			return cur->column_bindlen;
 	}
-	if (mdb_fetch_row(stmt->sql->cur_table)) {
-		SQLRETURN final_retval = SQL_SUCCESS;
-		while (cur && (final_retval == SQL_SUCCESS || final_retval == SQL_SUCCESS_WITH_INFO)) {
+}
+
+/*
+ * Fill up to rowset_size rows of the bound buffers straight from the scan.
+ * Row n of a column lives at varaddr + n * element size when binding by
+ * column, or at varaddr + n * bind_type when binding by row; the
+ * length/indicator arrays follow the same layout.
+ */
+static SQLRETURN _odbc_fetch_rowset(struct _hstmt *stmt, SQLULEN rowset_size,
+	SQLULEN *rows_fetched, SQLUSMALLINT *row_status)
+{
+	struct _sql_bind_info *cur;
+	SQLULEN row, errors = 0, infos = 0;
+	SQLLEN offset = stmt->bind_offset_ptr ? *stmt->bind_offset_ptr : 0;
+	SQLRETURN row_retval = SQL_SUCCESS;
+
+	if (rowset_size < 1)
+		rowset_size = 1;
+	if (_odbc_map_columns(stmt))
+		return SQL_ERROR;
+	for (row=0; row<rowset_size && !stmt->at_end; row++) {
+		/* a scan that has ended would start over on the last page */
+		if ((stmt->sql->limit >= 0 && stmt->rows_affected == stmt->sql->limit)
+		 || !mdb_fetch_row(stmt->sql->cur_table)) {
+			stmt->at_end = 1;
+			break;
+		}
+		row_retval = SQL_SUCCESS;
+		for (cur = stmt->bind_head; cur && (row_retval == SQL_SUCCESS || row_retval == SQL_SUCCESS_WITH_INFO); cur = cur->next) {
 			/* log error ? */
 			SQLLEN lenbind = 0;
-			SQLRETURN this_retval = SQLGetData(hstmt, cur->column_number, cur->column_bindtype,
-					cur->varaddr, cur->column_bindlen, &lenbind);
-			if (cur->column_lenbind)
-				*(cur->column_lenbind) = lenbind;
+			SQLRETURN this_retval;
+			char *varaddr = cur->varaddr;
+			SQLLEN *lenaddr = cur->column_lenbind;
+
+			if (stmt->bind_type == SQL_BIND_BY_COLUMN) {
+				if (varaddr)
+					varaddr += offset + row * _odbc_c_type_size(cur);
+				if (lenaddr)
+					lenaddr = (SQLLEN *)((char *)lenaddr + offset) + row;
+			} else {
+				if (varaddr)
+					varaddr += offset + row * stmt->bind_type;
+				if (lenaddr)
+					lenaddr = (SQLLEN *)((char *)lenaddr + offset + row * stmt->bind_type);
+			}
+			if (cur->fast_type && varaddr) {
+				this_retval = _odbc_fast_get(stmt, cur, varaddr, lenaddr);
+			} else {
+				stmt->pos = 0;
+				this_retval = SQLGetData(stmt, cur->column_number, cur->column_bindtype,
+						varaddr, cur->column_bindlen, &lenbind);
+				if (lenaddr)
+					*lenaddr = lenbind;
+			}
 			if (this_retval != SQL_SUCCESS)
-				final_retval = this_retval;
-			cur = cur->next;
+				row_retval = this_retval;
 		}
+		if (row_retval == SQL_SUCCESS_WITH_INFO)
+			infos++;
+		else if (row_retval != SQL_SUCCESS)
+			errors++;
+		if (row_status)
+			row_status[row] = row_retval == SQL_SUCCESS ? SQL_ROW_SUCCESS :
+				row_retval == SQL_SUCCESS_WITH_INFO ? SQL_ROW_SUCCESS_WITH_INFO :
+				SQL_ROW_ERROR;
 		stmt->rows_affected++;
-		stmt->pos=0;
-		return final_retval;
-	} else {
+	}
+	stmt->pos = 0;
+	if (rows_fetched)
+		*rows_fetched = row;
+	if (row_status) {
+		SQLULEN i;
+		for (i=row; i<rowset_size; i++)
+			row_status[i] = SQL_ROW_NOROW;
+	}
+
+	if (row == 0)
 		return SQL_NO_DATA_FOUND;
+	/* a single-row fetch reports the row's own result, as before */
+	if (rowset_size == 1)
+		return row_retval;
+	if (errors == row)
+		return SQL_ERROR;
+	if (errors || infos)
+		return SQL_SUCCESS_WITH_INFO;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQLFetch(
+    SQLHSTMT           hstmt)
+{
+	struct _hstmt *stmt = (struct _hstmt *) hstmt;
+	TRACE("SQLFetch");
+
+	return _odbc_fetch_rowset(stmt, stmt->row_array_size,
+			stmt->rows_fetched_ptr, stmt->row_status_ptr);
+}
+
+SQLRETURN SQL_API SQLFetchScroll(
+    SQLHSTMT           hstmt,
+    SQLSMALLINT        FetchOrientation,
+    SQLLEN             FetchOffset)
+{
+	struct _hstmt *stmt = (struct _hstmt *) hstmt;
+	TRACE("SQLFetchScroll");
+
+	if (FetchOrientation!=SQL_FETCH_NEXT) {
+		LogStatementError(stmt, "Fetch type not supported in SQLFetchScroll");
+		strcpy(stmt->sqlState, "HY106");
+		return SQL_ERROR;
 	}
+	return _odbc_fetch_rowset(stmt, stmt->row_array_size,
+			stmt->rows_fetched_ptr, stmt->row_status_ptr);
 }
 
 SQLRETURN SQL_API SQLFreeConnect(
@@ -954,6 +1192,7 @@ SQLRETURN SQL_API SQLFreeStmt(
 		g_free(stmt);
 	} else if (fOption==SQL_CLOSE) {
 		stmt->rows_affected = 0;
+		stmt->at_end = 0;
 	} else if (fOption==SQL_UNBIND) {
 		unbind_columns(stmt);
 	} else if (fOption==SQL_RESET_PARAMS) {
@@ -990,10 +1229,144 @@ SQLRETURN SQL_API SQLGetStmtAttr (
     SQLINTEGER BufferLength,
     SQLINTEGER * StringLength)
 {
+	struct _hstmt *stmt = (struct _hstmt *) StatementHandle;
+
 	TRACE("SQLGetStmtAttr");
+	if (!Value)
+		return SQL_SUCCESS;
+	switch (Attribute) {
+		case SQL_ATTR_ROW_ARRAY_SIZE:
+			*(SQLULEN *)Value = stmt->row_array_size;
+			break;
+		case SQL_ROWSET_SIZE:
+			*(SQLULEN *)Value = stmt->rowset_size;
+			break;
+		case SQL_ATTR_ROW_BIND_TYPE:
+			*(SQLULEN *)Value = stmt->bind_type;
+			break;
+		case SQL_ATTR_ROW_BIND_OFFSET_PTR:
+			*(SQLULEN **)Value = stmt->bind_offset_ptr;
+			break;
+		case SQL_ATTR_ROW_STATUS_PTR:
+			*(SQLUSMALLINT **)Value = stmt->row_status_ptr;
+			break;
+		case SQL_ATTR_ROWS_FETCHED_PTR:
+			*(SQLULEN **)Value = stmt->rows_fetched_ptr;
+			break;
+	}
 	return SQL_SUCCESS;
 }
 
+SQLRETURN SQL_API SQLSetStmtAttr (
+    SQLHSTMT StatementHandle,
+    SQLINTEGER Attribute,
+    SQLPOINTER Value,
+    SQLINTEGER StringLength)
+{
+	struct _hstmt *stmt = (struct _hstmt *) StatementHandle;
+
+	TRACE("SQLSetStmtAttr");
+	switch (Attribute) {
+		case SQL_ATTR_ROW_ARRAY_SIZE:
+			if ((SQLULEN)Value < 1) {
+				strcpy(stmt->sqlState, "HY024");
+				return SQL_ERROR;
+			}
+			stmt->row_array_size = (SQLULEN)Value;
+			break;
+		case SQL_ROWSET_SIZE:
+			if ((SQLULEN)Value < 1) {
+				strcpy(stmt->sqlState, "HY024");
+				return SQL_ERROR;
+			}
+			stmt->rowset_size = (SQLULEN)Value;
+			break;
+		case SQL_ATTR_ROW_BIND_TYPE:
+			stmt->bind_type = (SQLULEN)Value;
+			break;
+		case SQL_ATTR_ROW_BIND_OFFSET_PTR:
+			stmt->bind_offset_ptr = (SQLULEN *)Value;
+			break;
+		case SQL_ATTR_ROW_STATUS_PTR:
+			stmt->row_status_ptr = (SQLUSMALLINT *)Value;
+			break;
+		case SQL_ATTR_ROWS_FETCHED_PTR:
+			stmt->rows_fetched_ptr = (SQLULEN *)Value;
+			break;
+		/* settings the driver has only one value for */
+		case SQL_ATTR_CURSOR_TYPE:
+			if ((SQLULEN)Value != SQL_CURSOR_FORWARD_ONLY)
+				goto not_capable;
+			break;
+		case SQL_ATTR_CONCURRENCY:
+			if ((SQLULEN)Value != SQL_CONCUR_READ_ONLY)
+				goto not_capable;
+			break;
+		case SQL_ATTR_CURSOR_SCROLLABLE:
+			if ((SQLULEN)Value != SQL_NONSCROLLABLE)
+				goto not_capable;
+			break;
+		case SQL_ATTR_USE_BOOKMARKS:
+			if ((SQLULEN)Value != SQL_UB_OFF)
+				goto not_capable;
+			break;
+		case SQL_ATTR_ASYNC_ENABLE:
+			if ((SQLULEN)Value != SQL_ASYNC_ENABLE_OFF)
+				goto not_capable;
+			break;
+		case SQL_ATTR_RETRIEVE_DATA:
+			if ((SQLULEN)Value != SQL_RD_ON)
+				goto not_capable;
+			break;
+		case SQL_ATTR_PARAMSET_SIZE:
+			if ((SQLULEN)Value != 1)
+				goto not_capable;
+			break;
+		case SQL_ATTR_NOSCAN:
+			break;
+		/* limits the driver doesn't have: keep 0, as the spec allows */
+		case SQL_ATTR_QUERY_TIMEOUT:
+		case SQL_ATTR_MAX_ROWS:
+		case SQL_ATTR_MAX_LENGTH:
+		case SQL_ATTR_KEYSET_SIZE:
+			if ((SQLULEN)Value != 0) {
+				LogStatementError(stmt, "Statement attribute %d has no limit, left at 0", (int)Attribute);
+				strcpy(stmt->sqlState, "01S02"); // Option value changed
+				return SQL_SUCCESS_WITH_INFO;
+			}
+			break;
+		case SQL_ATTR_APP_ROW_DESC:
+		case SQL_ATTR_APP_PARAM_DESC:
+		case SQL_ATTR_CURSOR_SENSITIVITY:
+		case SQL_ATTR_ENABLE_AUTO_IPD:
+		case SQL_ATTR_FETCH_BOOKMARK_PTR:
+		case SQL_ATTR_PARAM_BIND_OFFSET_PTR:
+		case SQL_ATTR_PARAM_BIND_TYPE:
+		case SQL_ATTR_PARAM_OPERATION_PTR:
+		case SQL_ATTR_PARAM_STATUS_PTR:
+		case SQL_ATTR_PARAMS_PROCESSED_PTR:
+		case SQL_ATTR_ROW_OPERATION_PTR:
+		case SQL_ATTR_SIMULATE_CURSOR:
+			goto not_capable;
+		case SQL_ATTR_IMP_ROW_DESC:
+		case SQL_ATTR_IMP_PARAM_DESC:
+		case SQL_ATTR_ROW_NUMBER:
+			LogStatementError(stmt, "Statement attribute %d is read-only", (int)Attribute);
+			strcpy(stmt->sqlState, "HY092"); // Invalid attribute identifier
+			return SQL_ERROR;
+		default:
+			LogStatementError(stmt, "Unknown statement attribute %d", (int)Attribute);
+			strcpy(stmt->sqlState, "HY092"); // Invalid attribute identifier
+			return SQL_ERROR;
+	}
+	return SQL_SUCCESS;
+
+not_capable:
+	LogStatementError(stmt, "Statement attribute %d not supported", (int)Attribute);
+	strcpy(stmt->sqlState, "HYC00"); // Optional feature not implemented
+	return SQL_ERROR;
+}
+
 SQLRETURN SQL_API SQLGetCursorName(
     SQLHSTMT           hstmt,
     SQLCHAR           *szCursor,
@@ -1090,8 +1463,6 @@ SQLRETURN SQL_API SQLColumns(
 	MdbHandle *mdb = sql->mdb;
 	MdbTableDef *ttable;
 	MdbField fields[18];
-	unsigned char row_buffer[MDB_PGSIZE];
-	int row_size;
 	unsigned int i, j, k;
 	MdbCatalogEntry *entry;
 	MdbTableDef *table;
@@ -1170,13 +1541,12 @@ SQLRETURN SQL_API SQLColumns(
 			FILL_FIELD(&fields[13], &sqldatatype, 0);
 			FILL_FIELD(&fields[16], &ordinal, 0);
 
-			row_size = mdb_pack_row(ttable, row_buffer, 18, fields);
-			mdb_add_row_to_pg(ttable, row_buffer, row_size);
-			ttable->num_rows++;
+			mdb_temp_table_add_row(ttable, fields, 18);
 		}
 		mdb_free_tabledef(table);
 	}
 	sql->cur_table = ttable;
+	_odbc_unmap_columns(stmt);
 
 	return SQL_SUCCESS;
 }
@@ -1201,10 +1571,8 @@ SQLRETURN SQL_API SQLGetData(
 	struct _hstmt *stmt;
 	MdbSQL *sql;
 	MdbHandle *mdb;
-	MdbSQLColumn *sqlcol;
 	MdbColumn *col;
-	MdbTableDef *table;
-	int i, intValue;
+	int intValue;
 
 	TRACE("SQLGetData");
 	stmt = (struct _hstmt *) hstmt;
@@ -1216,15 +1584,7 @@ SQLRETURN SQL_API SQLGetData(
 		return SQL_ERROR;
 	}
 
-	sqlcol = g_ptr_array_index(sql->columns,icol - 1);
-	table = sql->cur_table;
-	for (i=0;i<table->num_cols;i++) {
-		col=g_ptr_array_index(table->columns,i);
-		if (!g_ascii_strcasecmp(sqlcol->name, col->name)) {
-			break;
-		}
-	}
-	if (i==table->num_cols)
+	if (_odbc_map_columns(stmt) || !(col = stmt->col_map[icol - 1]))
 		return SQL_ERROR;
 
 	if (icol!=stmt->icol) {
@@ -1615,7 +1975,7 @@ SQLRETURN SQL_API SQLGetFunctions(
 			_set_func_exists(pfExists,SQL_API_SQLEXECDIRECT);
 			_set_func_exists(pfExists,SQL_API_SQLEXECUTE);
 			_set_func_exists(pfExists,SQL_API_SQLFETCH);
-			//_set_func_exists(pfExists,SQL_API_SQLFETCHSCROLL);
+			_set_func_exists(pfExists,SQL_API_SQLFETCHSCROLL);
 			_set_func_exists(pfExists,SQL_API_SQLFREECONNECT);
 			_set_func_exists(pfExists,SQL_API_SQLFREEENV);
 			_set_func_exists(pfExists,SQL_API_SQLFREEHANDLE);
@@ -1646,7 +2006,7 @@ SQLRETURN SQL_API SQLGetFunctions(
 			//_set_func_exists(pfExists,SQL_API_SQLSETDESCREC);
 			_set_func_exists(pfExists,SQL_API_SQLSETENVATTR);
 			_set_func_exists(pfExists,SQL_API_SQLSETPARAM);
-			//_set_func_exists(pfExists,SQL_API_SQLSETSTMTATTR);
+			_set_func_exists(pfExists,SQL_API_SQLSETSTMTATTR);
 			_set_func_exists(pfExists,SQL_API_SQLSETSTMTOPTION);
 			_set_func_exists(pfExists,SQL_API_SQLSPECIALCOLUMNS);
 			_set_func_exists(pfExists,SQL_API_SQLSTATISTICS);
@@ -1670,6 +2030,7 @@ SQLRETURN SQL_API SQLGetFunctions(
 			_set_func_exists(pfExists,SQL_API_SQLERROR);
 			_set_func_exists(pfExists,SQL_API_SQLEXECDIRECT);
 			_set_func_exists(pfExists,SQL_API_SQLEXECUTE);
+			_set_func_exists(pfExists,SQL_API_SQLEXTENDEDFETCH);
 			_set_func_exists(pfExists,SQL_API_SQLFETCH);
 			_set_func_exists(pfExists,SQL_API_SQLFREECONNECT);
 			_set_func_exists(pfExists,SQL_API_SQLFREEENV);
@@ -1713,7 +2074,12 @@ SQLRETURN SQL_API SQLGetFunctions(
 		case SQL_API_SQLERROR:
 		case SQL_API_SQLEXECDIRECT:
 		case SQL_API_SQLEXECUTE:
+		case SQL_API_SQLEXTENDEDFETCH:
 		case SQL_API_SQLFETCH:
+#if ODBCVER >= 0x0300
+		case SQL_API_SQLFETCHSCROLL:
+		case SQL_API_SQLSETSTMTATTR:
+#endif
 		case SQL_API_SQLFREECONNECT:
 		case SQL_API_SQLFREEENV:
 		case SQL_API_SQLFREEHANDLE:
@@ -1817,7 +2183,7 @@ SQLRETURN SQL_API SQLGetStmtOption(
     SQLPOINTER         pvParam)
 {
 	TRACE("SQLGetStmtOption");
-	return SQL_SUCCESS;
+	return SQLGetStmtAttr(hstmt, fOption, pvParam, 0, NULL);
 }
 
 SQLRETURN SQL_API SQLGetTypeInfo(
@@ -1828,8 +2194,6 @@ SQLRETURN SQL_API SQLGetTypeInfo(
 	MdbTableDef *ttable;
 	MdbSQL *sql = stmt->sql;
 	MdbHandle *mdb = sql->mdb;
-	int row_size;
-	unsigned char row_buffer[MDB_PGSIZE];
 	unsigned int ts0, ts3, ts4, ts5, ts12;
 	unsigned char t0[MDB_BIND_SIZE],
 	              t3[MDB_BIND_SIZE],
@@ -1893,11 +2257,10 @@ SQLRETURN SQL_API SQLGetTypeInfo(
 		FILL_FIELD(&fields[17],type_info[i].num_prec_radix, 0);
 		FILL_FIELD(&fields[18],type_info[i].interval_precision, 0);
 
-		row_size = mdb_pack_row(ttable, row_buffer, NUM_TYPE_INFO_COLS, fields);
-		mdb_add_row_to_pg(ttable,row_buffer, row_size);
-		ttable->num_rows++;
+		mdb_temp_table_add_row(ttable, fields, NUM_TYPE_INFO_COLS);
 	}
 	sql->cur_table = ttable;
+	_odbc_unmap_columns(stmt);
 	
 	/* return SQLExecute(hstmt); */
 	return SQL_SUCCESS;
@@ -1935,7 +2298,7 @@ SQLRETURN SQL_API SQLSetStmtOption(
     SQLULEN            vParam)
 {
 	TRACE("SQLSetStmtOption");
-	return SQL_SUCCESS;
+	return SQLSetStmtAttr(hstmt, fOption, (SQLPOINTER)vParam, 0);
 }
 
 SQLRETURN SQL_API SQLSpecialColumns(
@@ -1986,9 +2349,8 @@ SQLRETURN SQL_API SQLTables( //sz* not used, so Unicode API not required.
 	MdbTableDef *ttable;
 	MdbField fields[5];
 	MdbCatalogEntry *entry;
-	unsigned char row_buffer[MDB_PGSIZE];
 	char *table_types[] = {"TABLE", "SYSTEM TABLE", "VIEW"};
-	unsigned int i, j, row_size, ttype;
+	unsigned int i, j, ttype;
 	unsigned int ts2, ts3;
 	unsigned char t2[MDB_BIND_SIZE],
 	              t3[MDB_BIND_SIZE];
@@ -2029,11 +2391,10 @@ SQLRETURN SQL_API SQLTables( //sz* not used, so Unicode API not required.
 		FILL_FIELD(&fields[2], t2, ts2);
 		FILL_FIELD(&fields[3], t3, ts3);
 		
-		row_size = mdb_pack_row(ttable, row_buffer, 5, fields);
-		mdb_add_row_to_pg(ttable, row_buffer, row_size);
-		ttable->num_rows++;
+		mdb_temp_table_add_row(ttable, fields, 5);
 	}
 	sql->cur_table = ttable;
+	_odbc_unmap_columns(stmt);
 
 	return SQL_SUCCESS;
 }
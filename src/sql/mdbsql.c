@@ -46,6 +46,7 @@ int yyparse ();
 #endif /* ! YYPARSE_PARAM */
 
 static MdbSargNode * mdb_sql_alloc_node(void);
+static void mdb_sql_free_values(GPtrArray *values);
 
 void
 mdb_sql_error(MdbSQL* sql, const char* fmt, ...)
@@ -150,6 +151,9 @@ static void mdb_sql_free(MdbSQL *sql)
 	/* Free MdbTableDef structures	*/
 	if (sql->cur_table) {
 		mdb_index_scan_free(sql->cur_table);
+		/* the sarg tree was handed over by mdb_sql_select() */
+		if (sql->cur_table->sarg_tree)
+			mdb_sql_free_tree(sql->cur_table->sarg_tree);
 		mdb_free_tabledef(sql->cur_table);
 		sql->cur_table = NULL;
 	}
@@ -167,6 +171,12 @@ static void mdb_sql_free(MdbSQL *sql)
 	g_list_free(sql->sarg_stack);
 	sql->sarg_stack = NULL;
 
+	/* Free the values of an IN list that never got its column */
+	if (sql->in_values) {
+		mdb_sql_free_values(sql->in_values);
+		sql->in_values = NULL;
+	}
+
 	/* Free bindings  */
 	mdb_sql_unbind_all(sql);
 	g_ptr_array_free(sql->bound_values, TRUE);
@@ -202,12 +212,22 @@ mdb_sql_alloc_node()
 {
 	return (MdbSargNode *) g_malloc0(sizeof(MdbSargNode));
 }
+static void
+mdb_sql_free_values(GPtrArray *values)
+{
+	unsigned int i;
+
+	for (i=0; i<values->len; i++)
+		mdb_sql_free_tree(g_ptr_array_index(values, i));
+	g_ptr_array_free(values, TRUE);
+}
 void
 mdb_sql_free_tree(MdbSargNode *tree)
 {
 
 	if (tree->left) mdb_sql_free_tree(tree->left);
 	if (tree->right) mdb_sql_free_tree(tree->right);
+	if (tree->values) mdb_sql_free_values(tree->values);
 	if (tree->parent) g_free(tree->parent);
 	g_free(tree);
 }
@@ -327,6 +347,9 @@ mdb_sql_dump_node(MdbSargNode *node, int level)
 		case MDB_EQUAL: 
 			printf(" = %d\n", node->value.i); 
 			break;
+		case MDB_IN:
+			printf(" in (%d values)\n", node->values ? node->values->len : 0);
+			break;
 	}
 	if (node->left) {
 		printf("left  ");
@@ -433,22 +456,11 @@ mdb_sql_eval_expr(MdbSQL *sql, char *const1, int op, char *const2)
 	mdb_sql_push_node(sql, node);
 	return 0;
 }
-int 
-mdb_sql_add_sarg(MdbSQL *sql, char *col_name, int op, char *constant)
+static void
+mdb_sql_set_constant(MdbSargNode *node, char *constant)
 {
 	char *p;
-	MdbSargNode *node;
-
-	node = mdb_sql_alloc_node();
-	node->op = op;
-	/* stash the column name until we finish with the grammar */
-	node->parent = (void *) g_strdup(col_name);
 
-	if (!constant) {
-		/* XXX - do we need to check operator? */
-		mdb_sql_push_node(sql, node);
-		return 0;
-	}
 	/* FIX ME -- we should probably just be storing the ascii value until the 
 	** column definition can be checked for validity
 	*/
@@ -463,11 +475,60 @@ mdb_sql_add_sarg(MdbSQL *sql, char *col_name, int op, char *constant)
 		node->value.i = atoi(constant);
 		node->val_type = MDB_INT;
 	}
+}
+int 
+mdb_sql_add_sarg(MdbSQL *sql, char *col_name, int op, char *constant)
+{
+	MdbSargNode *node;
 
+	node = mdb_sql_alloc_node();
+	node->op = op;
+	/* stash the column name until we finish with the grammar */
+	node->parent = (void *) g_strdup(col_name);
+
+	if (constant)
+		mdb_sql_set_constant(node, constant);
+	/* XXX - do we need to check operator? */
 	mdb_sql_push_node(sql, node);
 
 	return 0;
 }
+/* BETWEEN is a range, col >= low AND col <= high, as far as indexes go */
+int
+mdb_sql_add_between(MdbSQL *sql, char *col_name, char *low, char *high)
+{
+	mdb_sql_add_sarg(sql, col_name, MDB_GTEQ, low);
+	mdb_sql_add_sarg(sql, col_name, MDB_LTEQ, high);
+	mdb_sql_add_and(sql);
+	return 0;
+}
+/* values of an IN list are gathered before the grammar gets to its column */
+int
+mdb_sql_add_in_value(MdbSQL *sql, char *constant)
+{
+	MdbSargNode *node;
+
+	node = mdb_sql_alloc_node();
+	node->op = MDB_EQUAL;
+	mdb_sql_set_constant(node, constant);
+	if (!sql->in_values)
+		sql->in_values = g_ptr_array_new();
+	g_ptr_array_add(sql->in_values, node);
+	return 0;
+}
+int
+mdb_sql_add_in(MdbSQL *sql, char *col_name)
+{
+	MdbSargNode *node;
+
+	node = mdb_sql_alloc_node();
+	node->op = MDB_IN;
+	node->parent = (void *) g_strdup(col_name);
+	node->values = sql->in_values ? sql->in_values : g_ptr_array_new();
+	sql->in_values = NULL;
+	mdb_sql_push_node(sql, node);
+	return 0;
+}
 void
 mdb_sql_all_columns(MdbSQL *sql)
 {
@@ -594,8 +655,6 @@ void mdb_sql_listtables(MdbSQL *sql)
 	MdbCatalogEntry *entry;
 	MdbHandle *mdb = sql->mdb;
 	MdbField fields[1];
-	unsigned char row_buffer[MDB_PGSIZE];
-	int row_size;
 	MdbTableDef *ttable;
 	gchar tmpstr[100];
 	int tmpsiz;
@@ -616,9 +675,7 @@ void mdb_sql_listtables(MdbSQL *sql)
 			//col = g_ptr_array_index(table->columns,0);
 			tmpsiz = mdb_ascii2unicode(mdb, entry->object_name, 0, tmpstr, sizeof(tmpstr));
 			mdb_fill_temp_field(&fields[0],tmpstr, tmpsiz, 0,0,0,0);
-			row_size = mdb_pack_row(ttable, row_buffer, 1, fields);
-			mdb_add_row_to_pg(ttable,row_buffer, row_size);
-			ttable->num_rows++;
+			mdb_temp_table_add_row(ttable, fields, 1);
 		}
 	}
 	sql->cur_table = ttable;
@@ -647,8 +704,6 @@ void mdb_sql_describe_table(MdbSQL *sql)
 	unsigned int i;
 	MdbField fields[3];
 	char tmpstr[256];
-	unsigned char row_buffer[MDB_PGSIZE];
-	int row_size;
 	gchar col_name[100], col_type[100], col_size[100];
 	int tmpsiz;
 
@@ -694,9 +749,7 @@ void mdb_sql_describe_table(MdbSQL *sql)
 		tmpsiz = mdb_ascii2unicode(mdb, tmpstr, 0, col_size, sizeof(col_size));
 		mdb_fill_temp_field(&fields[2],col_size, tmpsiz, 0,0,0,2);
 
-		row_size = mdb_pack_row(ttable, row_buffer, 3, fields);
-		mdb_add_row_to_pg(ttable,row_buffer, row_size);
-		ttable->num_rows++;
+		mdb_temp_table_add_row(ttable, fields, 3);
 	}
 
 	/* the column and table names are no good now */
@@ -716,29 +769,42 @@ MdbColumn *mdb_sql_find_colbyname(MdbTableDef *table, char *name)
 	return NULL;
 }
 
+static void
+mdb_sql_convert_constant(MdbColumn *col, MdbSargNode *node)
+{
+	/* Do conversion to required target value type.
+	 * Plain integers are UNIX timestamps for backwards compatibility of parser
+	*/
+	if (col->col_type == MDB_DATETIME && node->val_type == MDB_INT) {
+		struct tm *tmp;
+#ifdef HAVE_GMTIME_R
+		struct tm tm;
+		tmp = gmtime_r((time_t*)&node->value.i, &tm);
+#else		// regular gmtime on Windows uses thread-local storage
+		tmp = gmtime((time_t*)&node->value.i);
+#endif
+		mdb_tm_to_date(tmp, &node->value.d);
+		node->val_type = MDB_DOUBLE;
+	}
+}
+
 int mdb_sql_find_sargcol(MdbSargNode *node, gpointer data)
 {
 	MdbTableDef *table = data;
 	MdbColumn *col;
+	MdbSargNode *value;
+	unsigned int i;
 
 	if (!mdb_is_relational_op(node->op)) return 0;
 	if (!node->parent) return 0;
 
 	if ((col = mdb_sql_find_colbyname(table, (char *)node->parent))) {
 		node->col = col;
-		/* Do conversion to required target value type.
-		 * Plain integers are UNIX timestamps for backwards compatibility of parser
-		*/
-		if (col->col_type == MDB_DATETIME && node->val_type == MDB_INT) {
-			struct tm *tmp;
-#ifdef HAVE_GMTIME_R
-			struct tm tm;
-			tmp = gmtime_r((time_t*)&node->value.i, &tm);
-#else		// regular gmtime on Windows uses thread-local storage
-			tmp = gmtime((time_t*)&node->value.i);
-#endif
-			mdb_tm_to_date(tmp, &node->value.d);
-			node->val_type = MDB_DOUBLE;
+		mdb_sql_convert_constant(col, node);
+		for (i=0; node->values && i<node->values->len; i++) {
+			value = g_ptr_array_index(node->values, i);
+			value->col = col;
+			mdb_sql_convert_constant(col, value);
 		}
 	}
 	return 0;
@@ -781,17 +847,14 @@ int found = 0;
 		MdbTableDef *ttable = mdb_create_temp_table(mdb, "#count");
 		char tmpstr[32];
 		gchar row_cnt[32];
-		unsigned char row_buffer[MDB_PGSIZE];
 		MdbField fields[1];
-		int row_size, tmpsiz;
+		int tmpsiz;
 
 		mdb_sql_add_temp_col(sql, ttable, 0, "count", MDB_TEXT, 30, 0);
 		snprintf(tmpstr, sizeof(tmpstr), "%d", table->num_rows);
 		tmpsiz = mdb_ascii2unicode(mdb, tmpstr, 0, row_cnt, sizeof(row_cnt));
 		mdb_fill_temp_field(&fields[0],row_cnt, tmpsiz, 0,0,0,0);
-		row_size = mdb_pack_row(ttable, row_buffer, 1, fields);
-		mdb_add_row_to_pg(ttable,row_buffer, row_size);
-		ttable->num_rows++;
+		mdb_temp_table_add_row(ttable, fields, 1);
 		sql->cur_table = ttable;
 		mdb_free_tabledef(table);
 		return;
@@ -840,6 +903,7 @@ int found = 0;
 	 */
 	table->sarg_tree = sql->sarg_tree;
 	sql->sarg_tree = NULL;
+	mdb_compile_sargs(table);
 
 	sql->cur_table = table;
 	mdb_index_scan_init(mdb, table);
@@ -63,7 +63,7 @@ typedef struct sql_context
 %token <name> IDENT NAME PATH STRING NUMBER OPENING CLOSING
 %token SELECT FROM WHERE CONNECT DISCONNECT TO LIST TABLES AND OR NOT LIMIT COUNT STRPTIME
 %token DESCRIBE TABLE TOP PERCENT
-%token LTEQ GTEQ NEQ LIKE ILIKE IS NUL
+%token LTEQ GTEQ NEQ LIKE ILIKE IS NUL IN BETWEEN
 
 %type <name> database
 %type <name> constant
@@ -81,7 +81,7 @@ typedef struct sql_context
 %left OR
 %left AND
 %right NOT
-%left EQ LTEQ GTEQ NEQ LT GT LIKE ILIKE IS
+%left EQ LTEQ GTEQ NEQ LT GT LIKE ILIKE IS IN BETWEEN
 
 %%
 
@@ -179,6 +179,33 @@ sarg:
 	                        mdb_sql_add_sarg(parser_ctx->mdb, $1, $2, NULL);
 				free($1);
 				}
+	| identifier IN OPENING constant_list CLOSING {
+	                        mdb_sql_add_in(parser_ctx->mdb, $1);
+				free($1);
+				}
+	| identifier NOT IN OPENING constant_list CLOSING {
+	                        mdb_sql_add_in(parser_ctx->mdb, $1);
+	                        mdb_sql_add_not(parser_ctx->mdb);
+				free($1);
+				}
+	| identifier BETWEEN constant AND constant {
+	                        mdb_sql_add_between(parser_ctx->mdb, $1, $3, $5);
+				free($1);
+				free($3);
+				free($5);
+				}
+	| identifier NOT BETWEEN constant AND constant {
+	                        mdb_sql_add_between(parser_ctx->mdb, $1, $4, $6);
+	                        mdb_sql_add_not(parser_ctx->mdb);
+				free($1);
+				free($4);
+				free($6);
+				}
+	;
+
+constant_list:
+	constant	{ mdb_sql_add_in_value(parser_ctx->mdb, $1); free($1); }
+	| constant_list ',' constant	{ mdb_sql_add_in_value(parser_ctx->mdb, $3); free($3); }
 	;
 
 identifier:
@@ -0,0 +1,104 @@
+/* MDB Tools - A library for reading MS Access database file
+ * Copyright (C) 2000 Brian Bruns
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Times the GHashTable and GPtrArray calls libmdb relies on, for comparing
+ * a build against GLib with one using fakeglib.
+ */
+
+#include "mdbtools.h"
+#include <time.h>
+
+static double
+elapsed_ns(clock_t start, unsigned long ops)
+{
+	return (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / ops;
+}
+
+static void
+bench(unsigned long n, int reps)
+{
+	char **keys = g_malloc(n * sizeof(char *));
+	char **misses = g_malloc(n * sizeof(char *));
+	GHashTable *hash;
+	GPtrArray *array;
+	unsigned long i, found = 0;
+	clock_t start;
+	double add_ns = 0, insert_ns = 0, hit_ns = 0, miss_ns = 0;
+	int rep;
+
+	for (i=0; i<n; i++) {
+		keys[i] = g_strdup_printf("Column %lu", i);
+		misses[i] = g_strdup_printf("Missing %lu", i);
+	}
+	for (rep=0; rep<reps; rep++) {
+		start = clock();
+		array = g_ptr_array_new();
+		for (i=0; i<n; i++)
+			g_ptr_array_add(array, keys[i]);
+		g_ptr_array_free(array, TRUE);
+		add_ns += elapsed_ns(start, n);
+
+		start = clock();
+		hash = g_hash_table_new(g_str_hash, g_str_equal);
+		for (i=0; i<n; i++)
+			g_hash_table_insert(hash, keys[i], keys[i]);
+		insert_ns += elapsed_ns(start, n);
+
+		start = clock();
+		for (i=0; i<n; i++)
+			if (g_hash_table_lookup(hash, keys[(i * 7919) % n]))
+				found++;
+		hit_ns += elapsed_ns(start, n);
+
+		start = clock();
+		for (i=0; i<n; i++)
+			if (g_hash_table_lookup(hash, misses[i]))
+				found++;
+		miss_ns += elapsed_ns(start, n);
+		g_hash_table_destroy(hash);
+	}
+	if (found != n * reps)
+		fprintf(stderr, "%lu keys: found %lu of %lu\n", n, found, n * reps);
+
+	printf("%8lu %12.1f %12.1f %12.1f %12.1f\n", n,
+		add_ns / reps, insert_ns / reps, hit_ns / reps, miss_ns / reps);
+
+	for (i=0; i<n; i++) {
+		g_free(keys[i]);
+		g_free(misses[i]);
+	}
+	g_free(keys);
+	g_free(misses);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long max = 100000, n;
+
+	if (argc>1)
+		max = strtoul(argv[1], NULL, 10);
+
+	printf("%8s %12s %12s %12s %12s\n", "keys", "array add", "insert", "lookup", "miss");
+	printf("%8s %12s %12s %12s %12s\n", "", "ns/op", "ns/op", "ns/op", "ns/op");
+	for (n=10; n<=max; n*=10)
+		bench(n, n < 10000 ? 1000 : 10);
+
+	return 0;
+}
@@ -30,9 +30,14 @@ int main(int argc, char **argv) {
     char *table_name = NULL;
     GError *error = NULL;
 	int print_mdbver = 0;
+	int exact = 0;
+	int jobs = 1;
+	long num_rows;
 
 	GOptionContext *opt_context;
 	GOptionEntry entries[] = {
+		{"exact", 'e', 0, G_OPTION_ARG_NONE, &exact, "Count the rows on the table's data pages instead of trusting the row count in the table definition", NULL},
+		{"jobs", 'j', 0, G_OPTION_ARG_INT, &jobs, "Number of threads to count with --exact. Default is 1.", "int"},
 		{"version", 0, 0, G_OPTION_ARG_NONE, &print_mdbver, "Show mdbtools version and exit", NULL},
 		{NULL}
 	};
@@ -57,6 +62,14 @@ int main(int argc, char **argv) {
 		fputs(g_option_context_get_help(opt_context, TRUE, NULL), stderr);
 		return 1;
 	}
+	if (jobs < 1) {
+		fputs("Invalid number of jobs\n", stderr);
+		return 1;
+	}
+	if (!exact && jobs != 1) {
+		fputs("--jobs only goes with --exact\n", stderr);
+		return 1;
+	}
 	table_name = g_locale_to_utf8(argv[2], -1, NULL, NULL, &error);
 	setlocale(LC_CTYPE, locale);
 	if (!table_name) {
@@ -76,7 +89,16 @@ int main(int argc, char **argv) {
 		entry = g_ptr_array_index(mdb->catalog, i);
 		if (entry->object_type == MDB_TABLE && !g_ascii_strcasecmp(entry->object_name, table_name)) {
             table = mdb_read_table(entry);
-            fprintf(stdout, "%d\n", table->num_rows);
+            if (!table)
+                return 1;
+            if (exact) {
+                if ((num_rows = mdb_count_rows(table, jobs)) < 0)
+                    return 1;
+                fprintf(stdout, "%ld\n", num_rows);
+            } else {
+                fprintf(stdout, "%d\n", table->num_rows);
+            }
+            mdb_free_tabledef(table);
             found = 1;
             break;
 		}
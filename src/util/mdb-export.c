@@ -18,47 +18,64 @@
 
 #include "mdbtools.h"
 #include "mdbver.h"
+#include <errno.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 #define EXPORT_BIND_SIZE 200000
+#define EXPORT_OLE_CHUNK_SIZE 65536
 
 #define is_binary_type(x) (x==MDB_OLE || x==MDB_BINARY || x==MDB_REPID)
 
 static char *escapes(char *s);
-static void format_value(FILE *outfile, char *value, size_t length, int quote_text, int col_type, char *escape_char, char *quote_char, int bin_mode, int export_flags, char *backend_name);
+static char *column_value(MdbHandle *mdb, MdbColumn *col, char *bound_value, int bound_len, int bin_mode, size_t *length, MdbLvalCursor **lval, char **to_free);
+static void format_value(MdbOutput *out, char *value, size_t length, MdbLvalCursor *lval, int quote_text, int col_type, char *escape_char, char *quote_char, int bin_mode, int export_flags, char *backend_name);
+
+static int export_table(MdbHandle *mdb, MdbTableDef *table, char *table_name, MdbOutput *out, const guint32 *pages, unsigned int num_pages);
+static int check_manifest(MdbTableDef *table, guint32 **pages, unsigned int *num_pages);
+static int export_all_tables(MdbHandle *mdb, char *output_dir, int jobs);
+
+/* options, shared by all tables and left alone once parsed */
+static char *delimiter = NULL;
+static char *row_delimiter = NULL;
+static char *quote_char = NULL;
+static char *escape_char = NULL;
+static int header_row = 1;
+static int quote_text = 1;
+static int batch_size = 1000;
+static char *insert_dialect = NULL;
+static char *namespace = NULL;
+static char *null_text = NULL;
+static int export_flags = 0;
+static int bin_mode = 0;
+static int changed_rows = 0;
+/* --manifest being built, and the --previous one */
+static MdbManifest *manifest = NULL;
+static MdbManifest *previous = NULL;
 
 int
 main(int argc, char **argv)
 {
-	unsigned int i;
 	MdbHandle *mdb;
 	MdbTableDef *table;
-	MdbColumn *col;
-	char **bound_values;
-	int  *bound_lens;
-	FILE *outfile = stdout;
-	char *delimiter = NULL;
-	char *row_delimiter = NULL;
-	char *quote_char = NULL;
-	char *escape_char = NULL;
-	int header_row = 1;
-	int quote_text = 1;
+	MdbOutput *out;
 	int boolean_words = 0;
-	int batch_size = 1000;
 	int escape_cr_lf = 0;
-	char *insert_dialect = NULL;
 	char *shortdate_fmt = NULL;
 	char *date_fmt = NULL;
-	char *namespace = NULL;
 	char *str_bin_mode = NULL;
-	char *null_text = NULL;
-	int export_flags = 0;
-	int bin_mode = 0;
-	char *value;
-	size_t length;
-	int ret;
 	char *locale = NULL;
 	char *table_name = NULL;
 	int print_mdbver = 0;
+	int all_tables = 0;
+	int jobs = 1;
+	char *output_dir = NULL;
+	char *manifest_path = NULL;
+	char *previous_path = NULL;
+	guint32 *pages;
+	unsigned int num_pages;
+	int ret = 0;
 
 	GOptionEntry entries[] = {
 		{"no-header", 'H', G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &header_row, "Suppress header row.", NULL},
@@ -76,6 +93,12 @@ main(int argc, char **argv)
 		{"null", '0', 0, G_OPTION_ARG_STRING, &null_text, "Use <char> to represent a NULL value", "char"},
 		{"bin", 'b', 0, G_OPTION_ARG_STRING, &str_bin_mode, "Binary export mode", "strip|raw|octal|hex"},
 		{"boolean-words", 'B', 0, G_OPTION_ARG_NONE, &boolean_words, "Use TRUE/FALSE in Boolean fields (default is 0/1)", NULL},
+		{"all-tables", 'A', 0, G_OPTION_ARG_NONE, &all_tables, "Export every user table, each to its own file, instead of <table>", NULL},
+		{"output-dir", 'o', 0, G_OPTION_ARG_STRING, &output_dir, "Directory to write the files to with --all-tables. Default is the current directory.", "dir"},
+		{"jobs", 'j', 0, G_OPTION_ARG_INT, &jobs, "Number of tables to export at once with --all-tables. Default is 1.", "int"},
+		{"manifest", 'M', 0, G_OPTION_ARG_STRING, &manifest_path, "Write the checksums of the data pages of the exported tables to <file>", "file"},
+		{"previous", 'p', 0, G_OPTION_ARG_STRING, &previous_path, "Skip tables whose data pages are unchanged since the manifest <file> was written", "file"},
+		{"changed-rows", 'c', 0, G_OPTION_ARG_NONE, &changed_rows, "With --previous, only export the rows of changed pages, each preceded by its page and row number", NULL},
 		{"version", 0, 0, G_OPTION_ARG_NONE, &print_mdbver, "Show mdbtools version and exit", NULL},
 		{NULL},
 	};
@@ -99,16 +122,30 @@ main(int argc, char **argv)
 		fprintf(stdout,"%s\n", MDB_FULL_VERSION);
 		exit(argc > 1);
 	}
-	if (argc != 3) {
+	if (argc != (all_tables ? 2 : 3)) {
 		fputs("Wrong number of arguments.\n\n", stderr);
 		fputs(g_option_context_get_help(opt_context, TRUE, NULL), stderr);
 		exit(1);
 	}
-	table_name = g_locale_to_utf8(argv[2], -1, NULL, NULL, &error);
-	if (!table_name) {
-		fprintf(stderr, "argument parsing failed: %s\n", error->message);
+	if (!all_tables && (output_dir || jobs != 1)) {
+		fputs("--output-dir and --jobs only go with --all-tables\n", stderr);
+		exit(1);
+	}
+	if (jobs < 1) {
+		fputs("Invalid number of jobs\n", stderr);
 		exit(1);
 	}
+	if (changed_rows && (!previous_path || insert_dialect)) {
+		fputs("--changed-rows needs --previous, and doesn't go with --insert\n", stderr);
+		exit(1);
+	}
+	if (!all_tables) {
+		table_name = g_locale_to_utf8(argv[2], -1, NULL, NULL, &error);
+		if (!table_name) {
+			fprintf(stderr, "argument parsing failed: %s\n", error->message);
+			exit(1);
+		}
+	}
 	setlocale(LC_CTYPE, locale);
 
 	/* Process options */
@@ -161,6 +198,11 @@ main(int argc, char **argv)
 		export_flags |= MDB_EXPORT_ESCAPE_CONTROL_CHARS;
 	}
 
+	if (previous_path && !(previous = mdb_manifest_read(previous_path)))
+		exit(1);
+	if (manifest_path)
+		manifest = mdb_manifest_new();
+
 	/* Open file */
 	if (!(mdb = mdb_open(argv[1], MDB_NOFLAGS))) {
 		/* Don't bother clean up memory before exit */
@@ -185,15 +227,78 @@ main(int argc, char **argv)
 			exit(1);
 		}
 
-	table = mdb_read_table_by_name(mdb, table_name, MDB_TABLE);
-	if (!table) {
-		fprintf(stderr, "Error: Table %s does not exist in this database.\n", table_name);
-		/* Don't bother clean up memory before exit */
-		exit(1);
+	if (all_tables) {
+		ret = export_all_tables(mdb, output_dir ? output_dir : ".", jobs);
+	} else {
+		table = mdb_read_table_by_name(mdb, table_name, MDB_TABLE);
+		if (!table) {
+			fprintf(stderr, "Error: Table %s does not exist in this database.\n", table_name);
+			/* Don't bother clean up memory before exit */
+			exit(1);
+		}
+
+		mdb_read_columns(table);
+		if (!check_manifest(table, &pages, &num_pages)) {
+			out = mdb_output_new(stdout);
+			if (export_table(mdb, table, table_name, out, pages, num_pages))
+				exit(1);
+			if (mdb_output_free(out)) {
+				perror("Error writing output");
+				exit(1);
+			}
+		}
+		g_free(pages);
+		mdb_free_tabledef(table);
 	}
+	if (manifest && !ret && mdb_manifest_write(manifest, manifest_path))
+		ret = 1;
+
+	mdb_close(mdb);
+	mdb_manifest_free(manifest);
+	mdb_manifest_free(previous);
+	g_option_context_free(opt_context);
+
+	// g_free ignores NULL
+	g_free(quote_char);
+	g_free(delimiter);
+	g_free(row_delimiter);
+	g_free(insert_dialect);
+	g_free(date_fmt);
+	g_free(escape_char);
+	g_free(namespace);
+	g_free(str_bin_mode);
+	g_free(table_name);
+	g_free(output_dir);
+	g_free(manifest_path);
+	g_free(previous_path);
+	return ret;
+}
+
+/* mdb_fetch_row(), or just the rows of @pages if given */
+static int fetch_row(MdbTableDef *table, const guint32 *pages, unsigned int num_pages)
+{
+	if (pages)
+		return mdb_fetch_row_in_pages(table, pages, num_pages);
+	return mdb_fetch_row(table);
+}
+
+/*
+ * Writes the rows of @table, its columns read already, to @out.  With
+ * --changed-rows, only the rows of @pages are written, each starting with
+ * its page and row number.
+ */
+static int export_table(MdbHandle *mdb, MdbTableDef *table, char *table_name, MdbOutput *out, const guint32 *pages, unsigned int num_pages)
+{
+	char row_id[32];
+	unsigned int i;
+	MdbColumn *col;
+	char **bound_values;
+	int  *bound_lens;
+	char *value, *to_free;
+	MdbLvalCursor *lval;
+	size_t length;
+	int ret;
 
-	/* read table */
-	mdb_read_columns(table);
 	mdb_rewind_table(table);
 
 	bound_values = g_malloc(table->num_cols * sizeof(char *));
@@ -204,130 +309,143 @@ main(int argc, char **argv)
 		ret = mdb_bind_column(table, i + 1, bound_values[i], &bound_lens[i]);
 		if (ret == -1) {
 			fprintf(stderr, "Failed to bind column %d\n", i + 1);
-			exit(1);
+			return -1;
 		}
 	}
 	if (header_row) {
+		if (pages) {
+			mdb_output_puts(out, "_page");
+			mdb_output_puts(out, delimiter);
+			mdb_output_puts(out, "_row");
+			mdb_output_puts(out, delimiter);
+		}
 		for (i = 0; i < table->num_cols; i++) {
 			col = g_ptr_array_index(table->columns, i);
 			if (i)
-				fputs(delimiter, outfile);
-			fputs(col->name, outfile);
+				mdb_output_puts(out, delimiter);
+			mdb_output_puts(out, col->name);
 		}
-		fputs(row_delimiter, outfile);
+		mdb_output_puts(out, row_delimiter);
 	}
 
 	// TODO refactor this into functions
 	if (mdb->default_backend->capabilities & MDB_SHEXP_BULK_INSERT) {
 		//for efficiency do multi row insert on engines that support this
 		int counter = 0;
-		while (mdb_fetch_row(table)) {
+		while (fetch_row(table, pages, num_pages)) {
 			if (counter % batch_size == 0) {
 				counter = 0; // reset to 0, prevent overflow on extremely large data sets.
 				char *quoted_name;
 				quoted_name = mdb->default_backend->quote_schema_name(namespace, table_name);
 				quoted_name = mdb_normalise_and_replace(mdb, &quoted_name);
-				fprintf(outfile, "INSERT INTO %s (", quoted_name);
+				mdb_output_puts(out, "INSERT INTO ");
+				mdb_output_puts(out, quoted_name);
+				mdb_output_puts(out, " (");
 				free(quoted_name);
 				for (i = 0; i < table->num_cols; i++) {
-					if (i > 0) fputs(", ", outfile);
+					if (i > 0) mdb_output_puts(out, ", ");
 					col = g_ptr_array_index(table->columns, i);
 					quoted_name = mdb->default_backend->quote_schema_name(NULL, col->name);
 					quoted_name = mdb_normalise_and_replace(mdb, &quoted_name);
-					fputs(quoted_name, outfile);
+					mdb_output_puts(out, quoted_name);
 					free(quoted_name);
 				}
-				fputs(") VALUES ", outfile);
+				mdb_output_puts(out, ") VALUES ");
 			} else {
-				fputs(", ", outfile);
+				mdb_output_puts(out, ", ");
 			}
-			fputs("(", outfile);
+			mdb_output_puts(out, "(");
 			for (i = 0; i < table->num_cols; i++) {
 				if (i > 0)
-					fputs(delimiter, outfile);
+					mdb_output_puts(out, delimiter);
 				col = g_ptr_array_index(table->columns, i);
 				if (!bound_lens[i]) {
 					/* Don't quote NULLs */
 					if (insert_dialect)
-						fputs("NULL", outfile);
+						mdb_output_puts(out, "NULL");
 					else
-						fputs(null_text, outfile);
+						mdb_output_puts(out, null_text);
 				} else {
-					if (col->col_type == MDB_OLE) {
-						value = mdb_ole_read_full(mdb, col, &length);
-					} else {
-						value = bound_values[i];
-						length = bound_lens[i];
-					}
-					format_value(outfile, value, length,
+					value = column_value(mdb, col, bound_values[i], bound_lens[i],
+						bin_mode, &length, &lval, &to_free);
+					format_value(out, value, length, lval,
 						     quote_text, col->col_type,
 						     escape_char, quote_char,
 						     bin_mode, export_flags,
 						     mdb->backend_name);
-					if (col->col_type == MDB_OLE)
-						free(value);
+					if (lval)
+						mdb_lval_close(lval);
+					free(to_free);
 				}
 			}
-			fputs(")", outfile);
+			mdb_output_puts(out, ")");
 			if (counter % batch_size == batch_size - 1) {
-				fputs(";", outfile);
-				fputs(row_delimiter, outfile);
+				mdb_output_puts(out, ";");
+				mdb_output_puts(out, row_delimiter);
 			}
 			counter++;
 		}
 		if (counter % batch_size != 0) {
 			//if our last row did not land on closing tag, close the stement here
-			fputs(";", outfile);
-			fputs(row_delimiter, outfile);
+			mdb_output_puts(out, ";");
+			mdb_output_puts(out, row_delimiter);
 		}
 	} else {
-		while (mdb_fetch_row(table)) {
+		while (fetch_row(table, pages, num_pages)) {
+
+			if (pages) {
+				snprintf(row_id, sizeof(row_id), "%u", (unsigned int)table->cur_phys_pg);
+				mdb_output_puts(out, row_id);
+				mdb_output_puts(out, delimiter);
+				snprintf(row_id, sizeof(row_id), "%u", table->cur_row - 1);
+				mdb_output_puts(out, row_id);
+				mdb_output_puts(out, delimiter);
+			}
 
 			if (insert_dialect) {
 				char *quoted_name;
 				quoted_name = mdb->default_backend->quote_schema_name(namespace, table_name);
 				quoted_name = mdb_normalise_and_replace(mdb, &quoted_name);
-				fprintf(outfile, "INSERT INTO %s (", quoted_name);
+				mdb_output_puts(out, "INSERT INTO ");
+				mdb_output_puts(out, quoted_name);
+				mdb_output_puts(out, " (");
 				free(quoted_name);
 				for (i = 0; i < table->num_cols; i++) {
-					if (i > 0) fputs(", ", outfile);
+					if (i > 0) mdb_output_puts(out, ", ");
 					col = g_ptr_array_index(table->columns, i);
 					quoted_name = mdb->default_backend->quote_schema_name(NULL, col->name);
 					quoted_name = mdb_normalise_and_replace(mdb, &quoted_name);
-					fputs(quoted_name, outfile);
+					mdb_output_puts(out, quoted_name);
 					free(quoted_name);
 				}
-				fputs(") VALUES (", outfile);
+				mdb_output_puts(out, ") VALUES (");
 			}
 
 			for (i = 0; i < table->num_cols; i++) {
 				if (i > 0)
-					fputs(delimiter, outfile);
+					mdb_output_puts(out, delimiter);
 				col = g_ptr_array_index(table->columns, i);
 				if (!bound_lens[i]) {
 					/* Don't quote NULLs */
 					if (insert_dialect)
-						fputs("NULL", outfile);
+						mdb_output_puts(out, "NULL");
 					else
-						fputs(null_text, outfile);
+						mdb_output_puts(out, null_text);
 				} else {
-					if (col->col_type == MDB_OLE) {
-						value = mdb_ole_read_full(mdb, col, &length);
-					} else {
-						value = bound_values[i];
-						length = bound_lens[i];
-					}
-					format_value(outfile, value, length,
+					value = column_value(mdb, col, bound_values[i], bound_lens[i],
+						bin_mode, &length, &lval, &to_free);
+					format_value(out, value, length, lval,
 						     quote_text, col->col_type,
 						     escape_char, quote_char,
 						     bin_mode, export_flags,
 						     mdb->backend_name);
-					if (col->col_type == MDB_OLE)
-						free(value);
+					if (lval)
+						mdb_lval_close(lval);
+					free(to_free);
 				}
 			}
-			if (insert_dialect) fputs(");", outfile);
-			fputs(row_delimiter, outfile);
+			if (insert_dialect) mdb_output_puts(out, ");");
+			mdb_output_puts(out, row_delimiter);
 		}
 	}
 
@@ -337,54 +455,311 @@ main(int argc, char **argv)
 	}
 	g_free(bound_values);
 	g_free(bound_lens);
+	return 0;
+}
+
+/*
+ * --all-tables: the tables are queued largest first, and each worker takes
+ * the next one off the queue on its own clone of the handle.  The catalog
+ * and table definitions are shared through the MdbFile, so opening and
+ * freeing tables is done under the lock; only the rows are read in
+ * parallel.
+ */
+typedef struct {
+	char *name;
+	unsigned long num_rows;
+} ExportJob;
+
+static struct {
+	GPtrArray *jobs;
+	unsigned int next;
+	char *output_dir;
+	int failed;
+} queue;
+
+#ifdef HAVE_PTHREAD_H
+/* also taken on the single job path, so it's ready before any job runs */
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void queue_lock(void)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&queue_mutex);
+#endif
+}
+
+static void queue_unlock(void)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&queue_mutex);
+#endif
+}
+
+/*
+ * --manifest and --previous: checksums the data pages of @table, and adds
+ * them to the manifest being built.  Returns 1 if they are the same as in
+ * the previous manifest, in which case the table isn't exported again.
+ * Otherwise, with --changed-rows, *pages is set to the pages whose rows
+ * have to be exported, for the caller to free.
+ */
+static int check_manifest(MdbTableDef *table, guint32 **pages, unsigned int *num_pages)
+{
+	MdbManifestTable *mt, *old = NULL;
+	int unchanged = 0;
+
+	*pages = NULL;
+	*num_pages = 0;
+	if (!manifest && !previous)
+		return 0;
+	mt = mdb_manifest_scan_table(table);
+	if (previous) {
+		old = mdb_manifest_find_table(previous, table->name);
+		unchanged = mdb_manifest_table_equal(old, mt);
+		if (!unchanged && changed_rows)
+			*pages = mdb_manifest_changed_pages(old, mt, num_pages);
+	}
+	if (manifest) {
+		queue_lock();
+		mdb_manifest_add_table(manifest, mt);
+		queue_unlock();
+	} else {
+		mdb_manifest_free_table(mt);
+	}
+	return unchanged;
+}
+
+static int job_cmp(const void *a, const void *b)
+{
+	const ExportJob *ja = *(ExportJob * const *)a;
+	const ExportJob *jb = *(ExportJob * const *)b;
+
+	if (ja->num_rows != jb->num_rows)
+		return ja->num_rows < jb->num_rows ? 1 : -1;
+	return strcmp(ja->name, jb->name);
+}
+
+/* <dir>/<table>.csv, or .sql for INSERT statements */
+static char *job_path(ExportJob *job)
+{
+	char *file_name = g_strdup(job->name);
+	char *path, *p;
+
+	for (p = file_name; *p; p++)
+		if (*p == '/' || *p == '\\')
+			*p = '_';
+	path = g_strdup_printf("%s/%s.%s", queue.output_dir, file_name, insert_dialect ? "sql" : "csv");
+	g_free(file_name);
+	return path;
+}
+
+static int export_job(MdbHandle *mdb, ExportJob *job)
+{
+	MdbTableDef *table;
+	MdbOutput *out;
+	FILE *outfile;
+	char *path;
+	guint32 *pages;
+	unsigned int num_pages;
+	int ret = 0;
+
+	queue_lock();
+	table = mdb_read_table_by_name(mdb, job->name, MDB_TABLE);
+	if (table)
+		mdb_read_columns(table);
+	queue_unlock();
+	if (!table) {
+		fprintf(stderr, "Error: Table %s does not exist in this database.\n", job->name);
+		return -1;
+	}
+
+	if (check_manifest(table, &pages, &num_pages)) {
+		queue_lock();
+		mdb_free_tabledef(table);
+		queue_unlock();
+		return 0;
+	}
+
+	path = job_path(job);
+	if (!(outfile = fopen(path, "w"))) {
+		fprintf(stderr, "Error: Unable to create %s: %s\n", path, strerror(errno));
+		ret = -1;
+	} else {
+		out = mdb_output_new(outfile);
+		ret = export_table(mdb, table, job->name, out, pages, num_pages);
+		if (mdb_output_free(out) || fclose(outfile)) {
+			fprintf(stderr, "Error writing %s: %s\n", path, strerror(errno));
+			ret = -1;
+		}
+	}
+	g_free(path);
+	g_free(pages);
+
+	queue_lock();
 	mdb_free_tabledef(table);
+	queue_unlock();
+	return ret;
+}
 
-	mdb_close(mdb);
-	g_option_context_free(opt_context);
+static void *export_worker(void *arg)
+{
+	MdbHandle *mdb = arg;
+	ExportJob *job;
+
+	while (1) {
+		queue_lock();
+		job = queue.next < queue.jobs->len ? g_ptr_array_index(queue.jobs, queue.next++) : NULL;
+		queue_unlock();
+		if (!job)
+			break;
+		if (export_job(mdb, job)) {
+			queue_lock();
+			queue.failed = 1;
+			queue_unlock();
+		}
+	}
+	return NULL;
+}
 
-	// g_free ignores NULL
-	g_free(quote_char);
-	g_free(delimiter);
-	g_free(row_delimiter);
-	g_free(insert_dialect);
-	g_free(date_fmt);
-	g_free(escape_char);
-	g_free(namespace);
-	g_free(str_bin_mode);
-	g_free(table_name);
-	return 0;
+static int export_all_tables(MdbHandle *mdb, char *output_dir, int jobs)
+{
+	MdbCatalogEntry *entry;
+	MdbTableDef *table;
+	ExportJob *job;
+	unsigned int i;
+
+	if (!mdb_read_catalog(mdb, MDB_TABLE)) {
+		fputs("File does not appear to be an Access database\n", stderr);
+		return 1;
+	}
+
+	queue.jobs = g_ptr_array_new();
+	queue.output_dir = output_dir;
+	for (i = 0; i < mdb->num_catalog; i++) {
+		entry = g_ptr_array_index(mdb->catalog, i);
+		if (!mdb_is_user_table(entry))
+			continue;
+		if (!(table = mdb_read_table(entry)))
+			continue;
+		job = g_malloc0(sizeof(ExportJob));
+		job->name = g_strdup(entry->object_name);
+		job->num_rows = table->num_rows;
+		g_ptr_array_add(queue.jobs, job);
+		mdb_free_tabledef(table);
+	}
+	qsort(queue.jobs->pdata, queue.jobs->len, sizeof(gpointer), job_cmp);
+
+#ifdef HAVE_PTHREAD_H
+	if ((unsigned int)jobs > queue.jobs->len)
+		jobs = queue.jobs->len;
+	if (jobs > 1) {
+		/* this thread is one of the workers */
+		pthread_t *threads = g_malloc((jobs - 1) * sizeof(pthread_t));
+		MdbHandle **handles = g_malloc((jobs - 1) * sizeof(MdbHandle *));
+		int started;
+
+		/* clone from @mdb before any worker starts using it */
+		for (i = 0; i < (unsigned int)jobs - 1; i++)
+			handles[i] = mdb_clone_handle(mdb);
+		for (started = 0; started < jobs - 1; started++) {
+			if (pthread_create(&threads[started], NULL, export_worker, handles[started]))
+				break;
+		}
+		export_worker(mdb);
+		for (i = 0; i < (unsigned int)started; i++)
+			pthread_join(threads[i], NULL);
+		for (i = 0; i < (unsigned int)jobs - 1; i++)
+			mdb_close(handles[i]);
+		g_free(threads);
+		g_free(handles);
+	} else
+#else
+	/* without threads, tables go one by one */
+	if (jobs > 1)
+		fputs("Warning: --jobs is not supported on this platform, exporting one table at a time\n", stderr);
+#endif
+	export_worker(mdb);
+
+	for (i = 0; i < queue.jobs->len; i++) {
+		job = g_ptr_array_index(queue.jobs, i);
+		g_free(job->name);
+		g_free(job);
+	}
+	g_ptr_array_free(queue.jobs, TRUE);
+	return queue.failed;
+}
+
+/*
+ * Returns the value of @col in the current row.  OLE data printed in hex or
+ * octal is streamed through *lval instead, since those don't escape
+ * anything across chunk boundaries.  Values read in full are returned in
+ * *to_free too.
+ */
+static char *column_value(MdbHandle *mdb, MdbColumn *col, char *bound_value, int bound_len, int bin_mode, size_t *length, MdbLvalCursor **lval, char **to_free)
+{
+	*lval = NULL;
+	*to_free = NULL;
+	if (col->col_type == MDB_OLE) {
+		if (bin_mode == MDB_BINEXPORT_STRIP) {
+			*length = 0;
+			return "";
+		}
+		if (bin_mode == MDB_BINEXPORT_OCTAL || bin_mode == MDB_BINEXPORT_HEXADECIMAL) {
+			*lval = mdb_lval_open(mdb, col);
+			*length = mdb_lval_length(*lval);
+			return NULL;
+		}
+		return *to_free = mdb_ole_read_full(mdb, col, length);
+	}
+	/* the bound copy of a memo is cut at the bind size */
+	if (col->col_type == MDB_MEMO && col->bind_truncated)
+		return *to_free = mdb_memo_read_full(mdb, col, length);
+	*length = bound_len;
+	return bound_value;
+}
+
+/* mdb_output_col, reading the value from @lval as it goes if given */
+static void print_value(MdbOutput *out, char *value, size_t length, MdbLvalCursor *lval, int quote_text, int col_type, char *quote_char, char *escape_char, int flags)
+{
+	char buf[EXPORT_OLE_CHUNK_SIZE];
+	size_t len;
+
+	if (!lval) {
+		mdb_output_col(out, value, quote_text, col_type, length, quote_char, escape_char, flags);
+		return;
+	}
+	if (quote_text)
+		mdb_output_puts(out, quote_char);
+	while ((len = mdb_lval_read(lval, buf, sizeof(buf))))
+		mdb_output_col(out, buf, 0, col_type, len, quote_char, escape_char, flags);
+	if (quote_text)
+		mdb_output_puts(out, quote_char);
 }
 
-static void format_value(FILE *outfile, char *value, size_t length, int quote_text, int col_type, char *escape_char, char *quote_char, int bin_mode, int export_flags, char *backend_name)
+static void format_value(MdbOutput *out, char *value, size_t length, MdbLvalCursor *lval, int quote_text, int col_type, char *escape_char, char *quote_char, int bin_mode, int export_flags, char *backend_name)
 {
 	/* Correctly handle insertion of binary blobs into sqlite3 using the notation of X'1234ABCD...') */
 	if (!strcmp(backend_name, "sqlite")
 			&& is_binary_type(col_type)
 			&& bin_mode == MDB_BINEXPORT_HEXADECIMAL) {
-		char *quote_char_binary_sqlite = (char *) g_strdup("'");
-		fputs("X", outfile);
-		mdb_print_col(outfile, value, quote_text, col_type, length, quote_char_binary_sqlite, escape_char, bin_mode | export_flags);
-		g_free (quote_char_binary_sqlite);
+		mdb_output_puts(out, "X");
+		print_value(out, value, length, lval, quote_text, col_type, "'", escape_char, bin_mode | export_flags);
 		/* Correctly handle insertion of binary blobs into MySQL using the notation of 0x1234ABCD...) */
 	} else if (!strcmp(backend_name, "mysql")
 			&& is_binary_type(col_type)
 			&& bin_mode == MDB_BINEXPORT_HEXADECIMAL) {
-		char *quote_char_binary_sqlite = (char *) g_strdup("");
-		fputs("0x", outfile);
-		mdb_print_col(outfile, value, quote_text, col_type, length, quote_char_binary_sqlite, escape_char, bin_mode | export_flags);
-		g_free (quote_char_binary_sqlite);
+		mdb_output_puts(out, "0x");
+		print_value(out, value, length, lval, quote_text, col_type, "", escape_char, bin_mode | export_flags);
 		/* Correctly handle insertion of binary blobs into PostgreSQL using the notation of decode('1234ABCD...', 'hex') */
 	} else if (!strcmp(backend_name, "postgres")
 			&& is_binary_type(col_type)
 			&& bin_mode == MDB_BINEXPORT_HEXADECIMAL) {
-		char *quote_char_binary_postgres = (char *) g_strdup("'");
-		fputs("decode(", outfile);
-		mdb_print_col(outfile, value, quote_text, col_type, length, quote_char_binary_postgres, escape_char, bin_mode | export_flags);
-		fputs(", 'hex')", outfile);
-		g_free (quote_char_binary_postgres);
+		mdb_output_puts(out, "decode(");
+		print_value(out, value, length, lval, quote_text, col_type, "'", escape_char, bin_mode | export_flags);
+		mdb_output_puts(out, ", 'hex')");
 		/* No special treatment for other backends or when hexadecimal notation hasn't been selected with the -b hex command line option */
 	} else {
-		mdb_print_col(outfile, value, quote_text, col_type, length, quote_char, escape_char, bin_mode | export_flags);
+		print_value(out, value, length, lval, quote_text, col_type, quote_char, escape_char, bin_mode | export_flags);
 	}
 }
 
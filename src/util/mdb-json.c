@@ -19,9 +19,9 @@
 #include "mdbtools.h"
 #include "mdbver.h"
 
-#include "base64.h"
-
 #define EXPORT_BIND_SIZE 200000
+/* a multiple of 3, so that each chunk encodes to base64 without padding */
+#define EXPORT_OLE_CHUNK_SIZE (3 * 16384)
 
 #define is_quote_type(x) (x==MDB_TEXT || x==MDB_OLE || x==MDB_MEMO || x==MDB_DATETIME || x==MDB_BINARY || x==MDB_REPID)
 #define is_binary_type(x) (x==MDB_OLE || x==MDB_BINARY || x==MDB_REPID)
@@ -32,72 +32,87 @@ static char *separator_char = ":";
 static char *row_start = "{";
 static char *row_end = "}\n";
 static char *delimiter = ",";
-static size_t quote_len = 1; //strlen(quote_char); /* multibyte */
-static size_t orig_escape_len = 1; //strlen(escape_char);
 static int drop_nonascii = 0;
+/* bytes print_quoted_value() can't copy as they are */
+static unsigned char special[256];
 
-//#define DONT_ESCAPE_ESCAPE
 static void
-print_quoted_value(FILE *outfile, char* value, int bin_len) {
-	fputs(quote_char, outfile);
-	int is_binary = (bin_len != -1);
-	while (1) {
-		if (is_binary) {
-			if (!bin_len--)
-				break;
-		} else /* use \0 sentry */
-			if (!*value)
-				break;
-
-		if (quote_len && !strncmp(value, quote_char, quote_len)) {
-			fprintf(outfile, "%s%s", escape_char, quote_char);
-			value += quote_len;
-#ifndef DONT_ESCAPE_ESCAPE
-		} else if (orig_escape_len && !strncmp(value, escape_char, orig_escape_len)) {
-			fprintf(outfile, "%s%s", escape_char, escape_char);
-			value += orig_escape_len;
-#endif
-		} else if ((unsigned char)*value < 0x20) {
-			if (drop_nonascii) {
-				putc(' ', outfile);
-				++value;
-			} else {
-				// escape control codes / binary data.
-				fprintf(outfile, "\\u00%02x", *(unsigned char*)value++);
-			}
+init_special(void)
+{
+	int c;
+
+	for (c = 0; c < 0x20; c++)
+		special[c] = 1;
+	special[(unsigned char)quote_char[0]] = 1;
+	special[(unsigned char)escape_char[0]] = 1;
+}
+
+static void
+print_quoted_value(MdbOutput *out, const char* value, int bin_len) {
+	static const char hex_digits[] = "0123456789abcdef";
+	const char *end = value + (bin_len != -1 ? (size_t)bin_len : strlen(value));
+	const char *run;
+	char u[6] = { '\\', 'u', '0', '0' };
+
+	mdb_output_puts(out, quote_char);
+	while (value < end) {
+		run = value;
+		while (value < end && !special[(unsigned char)*value])
+			value++;
+		if (value > run)
+			mdb_output_write(out, run, value - run);
+		if (value == end)
+			break;
+
+		if (*value == quote_char[0] || *value == escape_char[0]) {
+			mdb_output_puts(out, escape_char);
+			mdb_output_putc(out, *value++);
+		} else if (drop_nonascii) {
+			mdb_output_putc(out, ' ');
+			++value;
 		} else {
-			putc(*value++, outfile);
+			// escape control codes / binary data.
+			u[4] = hex_digits[(unsigned char)*value >> 4];
+			u[5] = hex_digits[*value++ & 0x0f];
+			mdb_output_write(out, u, sizeof(u));
 		}
 	}
-	fputs(quote_char, outfile);
+	mdb_output_puts(out, quote_char);
 }
 
 static void
-print_binary_value(FILE *outfile, char const * value, int bin_len) {
-	fputs("{\"$binary\": \"", outfile);
-	size_t const base64_buf_len = (bin_len / 3 + 1) * 4 + 1;
-	char * base64_buf = g_malloc(base64_buf_len);
-	if (base64encode(value, bin_len, base64_buf, base64_buf_len) != 0) {
-		fprintf(stderr, "Error: Base64 serialization failed.\n");
-	}
-	fputs(base64_buf, outfile);
-	g_free(base64_buf);
-	fputs("\", \"$type\": \"00\"}", outfile);
+print_binary_value(MdbOutput *out, char const * value, int bin_len) {
+	mdb_output_puts(out, "{\"$binary\": \"");
+	mdb_output_base64(out, value, bin_len);
+	mdb_output_puts(out, "\", \"$type\": \"00\"}");
 }
 
 static void
-print_col(FILE *outfile, char* col_name, gchar *col_val, int col_type, int bin_len) {
-	print_quoted_value(outfile, col_name, -1);
-	fputs(separator_char, outfile);
+print_lval(MdbOutput *out, char* col_name, MdbLvalCursor *lval) {
+	char buf[EXPORT_OLE_CHUNK_SIZE];
+	size_t len;
+
+	print_quoted_value(out, col_name, -1);
+	mdb_output_puts(out, separator_char);
+	mdb_output_puts(out, "{\"$binary\": \"");
+	while ((len = mdb_lval_read(lval, buf, sizeof(buf))))
+		mdb_output_base64(out, buf, len);
+	mdb_output_puts(out, "\", \"$type\": \"00\"}");
+}
+
+static void
+print_col(MdbOutput *out, char* col_name, gchar *col_val, int col_type, int bin_len) {
+	print_quoted_value(out, col_name, -1);
+	mdb_output_puts(out, separator_char);
 	if (is_quote_type(col_type)) {
 		if (is_binary_type(col_type)) {
-			print_binary_value(outfile, col_val, bin_len);
+			print_binary_value(out, col_val, bin_len);
 			bin_len = -1;
 		} else {
-			print_quoted_value(outfile, col_val, bin_len);
+			print_quoted_value(out, col_val, bin_len);
 		}
 	} else
-		fputs(col_val, outfile);
+		mdb_output_puts(out, col_val);
 }
 int
 main(int argc, char **argv)
@@ -108,7 +123,7 @@ main(int argc, char **argv)
 	MdbColumn *col;
 	char **bound_values;
 	int  *bound_lens;
-	FILE *outfile = stdout;
+	MdbOutput *out;
 	char *date_fmt = NULL;
 	char *shortdate_fmt = NULL;
 	char *value;
@@ -117,11 +132,24 @@ main(int argc, char **argv)
 	char *table_name = NULL;
 	char *locale = NULL;
 	int print_mdbver = 0;
+	char *manifest_path = NULL;
+	char *previous_path = NULL;
+	int changed_rows = 0;
+	MdbManifest *manifest = NULL;
+	MdbManifest *previous = NULL;
+	MdbManifestTable *mt;
+	guint32 *pages = NULL;
+	unsigned int num_pages = 0;
+	char row_id[64];
+	int unchanged = 0;
 
 	GOptionEntry entries[] = {
 		{"date-format", 'D', 0, G_OPTION_ARG_STRING, &shortdate_fmt, "Set the date format (see strftime(3) for details)", "format"},
 		{"datetime-format", 'T', 0, G_OPTION_ARG_STRING, &date_fmt, "Set the date/time format (see strftime(3) for details)", "format"},
 		{"no-unprintable", 'U', 0, G_OPTION_ARG_NONE, &drop_nonascii, "Change unprintable characters to spaces (otherwise escaped as \\u00XX)", NULL},
+		{"manifest", 'M', 0, G_OPTION_ARG_STRING, &manifest_path, "Write the checksums of the data pages of the table to <file>", "file"},
+		{"previous", 'p', 0, G_OPTION_ARG_STRING, &previous_path, "Export nothing if the data pages are unchanged since the manifest <file> was written", "file"},
+		{"changed-rows", 'c', 0, G_OPTION_ARG_NONE, &changed_rows, "With --previous, only export the rows of changed pages, keyed by _page and _row", NULL},
 		{"version", 0, 0, G_OPTION_ARG_NONE, &print_mdbver, "Show mdbtools version and exit", NULL},
         {NULL}
     };
@@ -150,6 +178,12 @@ main(int argc, char **argv)
 		fputs(g_option_context_get_help(opt_context, TRUE, NULL), stderr);
 		exit(1);
 	}
+	if (changed_rows && !previous_path) {
+		fputs("--changed-rows needs --previous\n", stderr);
+		exit(1);
+	}
+	if (previous_path && !(previous = mdb_manifest_read(previous_path)))
+		exit(1);
 
 	table_name = g_locale_to_utf8(argv[2], -1, NULL, NULL, &error);
 	if (!table_name) {
@@ -180,6 +214,22 @@ main(int argc, char **argv)
 
 	/* read table */
 	mdb_read_columns(table);
+	if (manifest_path || previous) {
+		mt = mdb_manifest_scan_table(table);
+		if (previous) {
+			MdbManifestTable *old = mdb_manifest_find_table(previous, table->name);
+
+			unchanged = mdb_manifest_table_equal(old, mt);
+			if (changed_rows)
+				pages = mdb_manifest_changed_pages(old, mt, &num_pages);
+		}
+		if (manifest_path) {
+			manifest = mdb_manifest_new();
+			mdb_manifest_add_table(manifest, mt);
+		} else {
+			mdb_manifest_free_table(mt);
+		}
+	}
 	mdb_rewind_table(table);
 
 	bound_values = g_malloc(table->num_cols * sizeof(char *));
@@ -195,40 +245,65 @@ main(int argc, char **argv)
 		}
 	}
 
-	while(mdb_fetch_row(table)) {
-		fputs(row_start, outfile);
+	init_special();
+	out = mdb_output_new(stdout);
+	while(!unchanged && (pages ? mdb_fetch_row_in_pages(table, pages, num_pages) : mdb_fetch_row(table))) {
+		mdb_output_puts(out, row_start);
 		int add_delimiter = 0;
+		if (pages) {
+			snprintf(row_id, sizeof(row_id), "\"_page\"%s%u%s\"_row\"%s%u",
+				separator_char, (unsigned int)table->cur_phys_pg, delimiter,
+				separator_char, table->cur_row - 1);
+			mdb_output_puts(out, row_id);
+			add_delimiter = 1;
+		}
 		for (i=0;i<table->num_cols;i++) {
 			col=g_ptr_array_index(table->columns,i);
 			if (bound_lens[i]) {
 				if (add_delimiter) {
-					fputs(delimiter, outfile);
+					mdb_output_puts(out, delimiter);
 					add_delimiter = 0;
 				}
 
 				if (col->col_type == MDB_OLE) {
-					value = mdb_ole_read_full(mdb, col, &length);
+					MdbLvalCursor *lval = mdb_lval_open(mdb, col);
+					print_lval(out, col->name, lval);
+					mdb_lval_close(lval);
+				} else if (col->col_type == MDB_MEMO && col->bind_truncated) {
+					/* the bound copy is cut at the bind size */
+					value = mdb_memo_read_full(mdb, col, &length);
+					print_col(out, col->name, value, col->col_type, length);
+					free(value);
 				} else {
-					value = bound_values[i];
-					length = bound_lens[i];
+					print_col(out, col->name, bound_values[i], col->col_type, bound_lens[i]);
 				}
-				print_col(outfile, col->name, value, col->col_type, length);
 				add_delimiter = 1;
-				if (col->col_type == MDB_OLE)
-					free(value);
 			}
 		}
-		fputs(row_end, outfile);
+		mdb_output_puts(out, row_end);
 	}
 
+	if (mdb_output_free(out)) {
+		perror("Error writing output");
+		exit(1);
+	}
+
+	if (manifest && mdb_manifest_write(manifest, manifest_path))
+		exit(1);
+
 	/* free the memory used to bind */
 	for (i=0;i<table->num_cols;i++) {
 		g_free(bound_values[i]);
 	}
 	g_free(bound_values);
 	g_free(bound_lens);
+	g_free(pages);
+	mdb_manifest_free(manifest);
+	mdb_manifest_free(previous);
 	mdb_free_tabledef(table);
 	g_free(table_name);
+	g_free(manifest_path);
+	g_free(previous_path);
 
 	mdb_close(mdb);
 	return 0;
@@ -112,12 +112,15 @@ main(int argc, char **argv)
 
 	if (found) {
 		MdbColumn *col = g_ptr_array_index(table->columns, col_num-1);
-		size_t size;
-		void *kkd = mdb_ole_read_full(mdb, col, &size);
-		if (size)
+		size_t size = 0;
+		void *kkd = NULL;
+		/* an empty field has none, one that can't be read is an error */
+		if (!col->cur_value_len)
+			printf("No properties.\n");
+		else if ((kkd = mdb_ole_read_full(mdb, col, &size)) && size)
 			dump_kkd(mdb, kkd, size);
 		else
-			printf("No properties.\n");
+			fprintf(stderr, "Unable to read the properties of %s\n", table_name);
 		free(kkd);
 	}
 
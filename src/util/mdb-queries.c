@@ -36,38 +36,40 @@
 
 #define QUERY_BIND_SIZE 200000
 
+/* one row of MSysQueries */
+typedef struct {
+	int attribute;
+	int flag;
+	char *expression;
+	char *name1;
+	char *name2;
+	char *order;
+	int order_len;
+	unsigned int seq; /* position in MSysQueries, to keep the sort stable */
+} QueryRow;
+
 void mdb_list_queries(MdbHandle *mdb, int line_break, char *delimiter);
 char * mdb_get_query_id(MdbHandle *mdb,char *query);
+static GHashTable *read_query_rows(MdbHandle *mdb, MdbCatalogEntry *sys_queries, const char *only_id);
+static GHashTable *read_query_ids(MdbHandle *mdb);
+static void print_query_sql(GPtrArray *rows);
+static void free_query_rows(GHashTable *queries);
+static void free_query_id(gpointer key, gpointer value, gpointer data);
 
 int main (int argc, char **argv) {
 	unsigned int i;
 	MdbHandle *mdb = NULL;
 	MdbCatalogEntry *entry = NULL, *sys_queries = NULL, *temp = NULL;
-	MdbTableDef *table = NULL;
 	char *delimiter = NULL;
 	int list_only=0;
+	int all_queries=0;
 	int found_match=0;
 	int line_break=0;
 	char *query_id;
 	char *query_name = NULL;
-    size_t bind_size = QUERY_BIND_SIZE;
-	
-	// variables for the msysqueries table
-	char *attribute = malloc(bind_size);
-	char *expression = malloc(bind_size);
-	char *flag = malloc(bind_size);
-	char *name1 = malloc(bind_size);
-	char *name2 = malloc(bind_size);
-	char *objectid = malloc(bind_size);
-	char *order = malloc(bind_size);
-	
-	//variables for the generation of sql
-	char *sql_tables = malloc(bind_size);
-	char *sql_predicate = malloc(bind_size);
-	char *sql_columns = malloc(bind_size);
-	char *sql_where = malloc(bind_size);
-	char *sql_sorting = malloc(bind_size);
-	int flagint;
+	GHashTable *queries, *ids;
+	GPtrArray *rows;
+	size_t bind_size = QUERY_BIND_SIZE;
 	char *locale = NULL;
 	int print_mdbver = 0;
 	
@@ -76,6 +78,7 @@ int main (int argc, char **argv) {
 
 	GOptionEntry entries[] = {
 		{"list", 'L', 0, G_OPTION_ARG_NONE, &list_only, "List queries in the database (default if no query name is passed)", NULL},
+		{"all", 'A', 0, G_OPTION_ARG_NONE, &all_queries, "Print the SQL of every query in the database, each after a comment with its name", NULL},
 		{"newline", '1', 0, G_OPTION_ARG_NONE, &line_break, "Use newline as the delimiter (used in conjunction with listing)", NULL},
 		{"delimiter", 'd', 0, G_OPTION_ARG_STRING, &delimiter, "Specify delimiter to use", "delim"},
 		{"version", 0, 0, G_OPTION_ARG_NONE, &print_mdbver, "Show mdbtools version and exit", NULL},
@@ -99,8 +102,9 @@ int main (int argc, char **argv) {
 	}
 	/* let's turn list_only on if only a database filename was passed */
 	if(argc == 2) {
-		list_only=1;
-	} else if (argc == 3) {
+		if (!all_queries)
+			list_only=1;
+	} else if (argc == 3 && !all_queries) {
 		query_name= g_locale_to_utf8(argv[2], -1, NULL, NULL, &error);
 		if (!query_name) {
 			fprintf(stderr, "argument parsing failed: %s\n", error->message);
@@ -136,7 +140,7 @@ int main (int argc, char **argv) {
 		for (i=0; i < mdb->num_catalog; i++) {
 			temp = g_ptr_array_index(mdb->catalog, i);
 			
-			if(strcmp(temp->object_name,query_name) == 0) {
+			if(query_name && strcmp(temp->object_name,query_name) == 0) {
 				entry = g_ptr_array_index(mdb->catalog,i);
 				found_match=1;
 			} else if(strcmp(temp->object_name,"MSysQueries") == 0) {
@@ -144,90 +148,35 @@ int main (int argc, char **argv) {
 			} 
 		}
 		
-		if(found_match) {
+		if (all_queries) {
+			/* MSysObjects and MSysQueries are read once each, and
+			 * the rows of each query looked up by ObjectId */
+			ids = read_query_ids(mdb);
+			queries = read_query_rows(mdb, sys_queries, NULL);
+			for (i=0; queries && i < mdb->num_catalog; i++) {
+				temp = g_ptr_array_index(mdb->catalog, i);
+				if (temp->object_type != MDB_QUERY)
+					continue;
+				/* a query without rows in MSysQueries is printed
+				 * as it is on its own, with an empty SELECT */
+				query_id = g_hash_table_lookup(ids, temp->object_name);
+				rows = query_id ? g_hash_table_lookup(queries, query_id) : NULL;
+				fprintf(stdout, "-- %s\n", temp->object_name);
+				print_query_sql(rows);
+			}
+			if (queries)
+				free_query_rows(queries);
+			g_hash_table_foreach(ids, free_query_id, NULL);
+			g_hash_table_destroy(ids);
+		} else if(found_match) {
 			/* Let's get the id for the query */
 			query_id = mdb_get_query_id(mdb,entry->object_name);
-			
-			table = mdb_read_table(sys_queries);
-
-			if(table) {
-				mdb_read_columns(table);
-
-				mdb_bind_column_by_name(table, "Attribute", attribute, NULL);
-				mdb_bind_column_by_name(table, "Expression", expression, NULL);
-				mdb_bind_column_by_name(table, "Flag", flag, NULL);
-				mdb_bind_column_by_name(table, "Name1", name1, NULL);
-				mdb_bind_column_by_name(table, "Name2", name2, NULL);
-				mdb_bind_column_by_name(table, "ObjectId", objectid, NULL);
-				mdb_bind_column_by_name(table, "Order", order, NULL);
-
-				mdb_rewind_table(table);
-
-				while (mdb_fetch_row(table)) {
-					if(strcmp(query_id,objectid) == 0) {
-						flagint = atoi(flag);
-						//we have a row for our query
-						switch(atoi(attribute)) {
-							case 3:		// predicate
-								if (flagint & 0x30) {
-									strcpy(sql_predicate, " TOP ");
-									strcat(sql_predicate, name1);
-									if (flagint & 0x20) {
-										strcat(sql_predicate, " PERCENT");
-									}
-								} else if (flagint & 0x8) {
-									strcpy(sql_predicate, " DISTINCTROW");
-								} else if (flagint & 0x2) {
-									strcpy(sql_predicate, " DISTINCT");
-								}
-								break;
-							case 5:		// table name
-								if(strcmp(sql_tables,"") != 0) {
-									strcat(sql_tables,",");
-								}
-								sprintf(sql_tables+strlen(sql_tables),"[%s]",name1);
-								break;
-							case 6:		// column name
-								if(strcmp(sql_columns,"") == 0) {
-									strcpy(sql_columns,expression);
-								} else {
-									strcat(sql_columns,",");
-									strcat(sql_columns,expression);
-								}
-								break;
-							case 7:		// join/relationship where clause
-								//fprintf(stdout,"join tables: %s - %s\n",name1,name2);
-								//fprintf(stdout,"join clause: %s\n",expression);
-								break;
-							case 8:		// where clause
-								strcpy(sql_where,expression);
-								break;
-							case 11:		// sorting
-								if(strcmp(sql_sorting,"") == 0) {
-									strcpy(sql_sorting,"ORDER BY ");
-									strcat(sql_sorting,expression);
-									if(strcmp(name1,"D") == 0) {
-										strcat(sql_sorting," DESCENDING");
-									}
-								}
-								break;
-						}
-					}
-				}
-				
-				/*fprintf(stdout,"sql_tables: %s\n",sql_tables);
-				fprintf(stdout,"sql_columns: %s\n",sql_columns);
-				fprintf(stdout,"sql_where: %s\n",sql_where);
-				fprintf(stdout,"sql_sorting: %s\n",sql_sorting);*/
-				
-				/* print out the sql statement */
-				if(strcmp(sql_where,"") == 0) {
-					fprintf(stdout,"SELECT%s %s FROM %s %s\n",sql_predicate,sql_columns,sql_tables,sql_sorting);
-				} else {
-					fprintf(stdout,"SELECT%s %s FROM %s WHERE %s %s\n",sql_predicate,sql_columns,sql_tables,sql_where,sql_sorting);
-				}
-						
-				mdb_free_tabledef(table);
+
+			queries = read_query_rows(mdb, sys_queries, query_id);
+			if (queries) {
+				rows = g_hash_table_lookup(queries, query_id);
+				print_query_sql(rows);
+				free_query_rows(queries);
 			}
 			free(query_id);
 		} else {
@@ -241,6 +190,232 @@ int main (int argc, char **argv) {
 	return 0;
 }
 
+static gint query_row_cmp(gconstpointer a, gconstpointer b)
+{
+	const QueryRow *ra = *(QueryRow * const *)a;
+	const QueryRow *rb = *(QueryRow * const *)b;
+	int len = ra->order_len < rb->order_len ? ra->order_len : rb->order_len;
+	int ret;
+
+	if (len && (ret = memcmp(ra->order, rb->order, len)))
+		return ret;
+	if (ra->order_len != rb->order_len)
+		return ra->order_len - rb->order_len;
+	return ra->seq < rb->seq ? -1 : ra->seq > rb->seq;
+}
+
+static void sort_query_rows(gpointer key, gpointer value, gpointer data)
+{
+	g_ptr_array_sort(value, query_row_cmp);
+}
+
+/*
+ * Reads MSysQueries into a hash of ObjectId to the rows of that query,
+ * sorted by Order.  With @only_id, the rows of other queries are skipped.
+ */
+static GHashTable *read_query_rows(MdbHandle *mdb, MdbCatalogEntry *sys_queries, const char *only_id)
+{
+	MdbTableDef *table;
+	GHashTable *queries;
+	GPtrArray *rows;
+	QueryRow *row;
+	MdbColumn *col_order = NULL;
+	char *attribute, *expression, *flag, *name1, *name2, *objectid;
+	unsigned int seq = 0;
+	int i;
+
+	if (!sys_queries || !(table = mdb_read_table(sys_queries)))
+		return NULL;
+	mdb_read_columns(table);
+
+	attribute = g_malloc0(mdb->bind_size);
+	expression = g_malloc0(mdb->bind_size);
+	flag = g_malloc0(mdb->bind_size);
+	name1 = g_malloc0(mdb->bind_size);
+	name2 = g_malloc0(mdb->bind_size);
+	objectid = g_malloc0(mdb->bind_size);
+	mdb_bind_column_by_name(table, "Attribute", attribute, NULL);
+	mdb_bind_column_by_name(table, "Expression", expression, NULL);
+	mdb_bind_column_by_name(table, "Flag", flag, NULL);
+	mdb_bind_column_by_name(table, "Name1", name1, NULL);
+	mdb_bind_column_by_name(table, "Name2", name2, NULL);
+	mdb_bind_column_by_name(table, "ObjectId", objectid, NULL);
+	/* Order is binary, so it's taken from the page rather than bound */
+	if ((i = mdb_bind_column_by_name(table, "Order", NULL, NULL)) > 0)
+		col_order = g_ptr_array_index(table->columns, i-1);
+
+	queries = g_hash_table_new(g_str_hash, g_str_equal);
+	mdb_rewind_table(table);
+	while (mdb_fetch_row(table)) {
+		if (only_id && strcmp(only_id, objectid))
+			continue;
+		if (!(rows = g_hash_table_lookup(queries, objectid))) {
+			rows = g_ptr_array_new();
+			g_hash_table_insert(queries, g_strdup(objectid), rows);
+		}
+		row = g_malloc0(sizeof(QueryRow));
+		row->attribute = atoi(attribute);
+		row->flag = atoi(flag);
+		row->expression = g_strdup(expression);
+		row->name1 = g_strdup(name1);
+		row->name2 = g_strdup(name2);
+		if (col_order && col_order->cur_value_len) {
+			row->order = g_memdup2(mdb->pg_buf + col_order->cur_value_start, col_order->cur_value_len);
+			row->order_len = col_order->cur_value_len;
+		}
+		row->seq = seq++;
+		g_ptr_array_add(rows, row);
+	}
+	mdb_free_tabledef(table);
+	g_free(attribute);
+	g_free(expression);
+	g_free(flag);
+	g_free(name1);
+	g_free(name2);
+	g_free(objectid);
+
+	g_hash_table_foreach(queries, sort_query_rows, NULL);
+	return queries;
+}
+
+static void free_query(gpointer key, gpointer value, gpointer data)
+{
+	GPtrArray *rows = value;
+	QueryRow *row;
+	unsigned int i;
+
+	for (i=0; i<rows->len; i++) {
+		row = g_ptr_array_index(rows, i);
+		g_free(row->expression);
+		g_free(row->name1);
+		g_free(row->name2);
+		g_free(row->order);
+		g_free(row);
+	}
+	g_ptr_array_free(rows, TRUE);
+	g_free(key);
+}
+
+static void free_query_rows(GHashTable *queries)
+{
+	g_hash_table_foreach(queries, free_query, NULL);
+	g_hash_table_destroy(queries);
+}
+
+static void free_query_id(gpointer key, gpointer value, gpointer data)
+{
+	g_free(key);
+	g_free(value);
+}
+
+/* Reads MSysObjects into a hash of query name to Id */
+static GHashTable *read_query_ids(MdbHandle *mdb)
+{
+	MdbTableDef *table;
+	GHashTable *ids = g_hash_table_new(g_str_hash, g_str_equal);
+	char *id, *name, *type;
+
+	if (!(table = mdb_read_table_by_name(mdb, "MSysObjects", MDB_TABLE)))
+		return ids;
+	mdb_read_columns(table);
+
+	id = g_malloc0(mdb->bind_size);
+	name = g_malloc0(mdb->bind_size);
+	type = g_malloc0(mdb->bind_size);
+	mdb_bind_column_by_name(table, "Id", id, NULL);
+	mdb_bind_column_by_name(table, "Name", name, NULL);
+	mdb_bind_column_by_name(table, "Type", type, NULL);
+
+	mdb_rewind_table(table);
+	while (mdb_fetch_row(table)) {
+		/* the first row of a name wins, as in mdb_get_query_id() */
+		if ((atoi(type) & 0x7F) == MDB_QUERY && !g_hash_table_lookup(ids, name))
+			g_hash_table_insert(ids, g_strdup(name), g_strdup(id));
+	}
+	mdb_free_tabledef(table);
+	g_free(id);
+	g_free(name);
+	g_free(type);
+	return ids;
+}
+
+/* Prints the SELECT statement made up by @rows, which may be NULL */
+static void print_query_sql(GPtrArray *rows)
+{
+	size_t bind_size = QUERY_BIND_SIZE;
+	char *sql_tables = g_malloc0(bind_size);
+	char *sql_predicate = g_malloc0(bind_size);
+	char *sql_columns = g_malloc0(bind_size);
+	char *sql_where = g_malloc0(bind_size);
+	char *sql_sorting = g_malloc0(bind_size);
+	QueryRow *row;
+	unsigned int i;
+	int flagint;
+
+	for (i=0; rows && i<rows->len; i++) {
+		row = g_ptr_array_index(rows, i);
+		flagint = row->flag;
+		switch(row->attribute) {
+			case 3:		// predicate
+				if (flagint & 0x30) {
+					strcpy(sql_predicate, " TOP ");
+					strcat(sql_predicate, row->name1);
+					if (flagint & 0x20) {
+						strcat(sql_predicate, " PERCENT");
+					}
+				} else if (flagint & 0x8) {
+					strcpy(sql_predicate, " DISTINCTROW");
+				} else if (flagint & 0x2) {
+					strcpy(sql_predicate, " DISTINCT");
+				}
+				break;
+			case 5:		// table name
+				if(strcmp(sql_tables,"") != 0) {
+					strcat(sql_tables,",");
+				}
+				sprintf(sql_tables+strlen(sql_tables),"[%s]",row->name1);
+				break;
+			case 6:		// column name
+				if(strcmp(sql_columns,"") == 0) {
+					strcpy(sql_columns,row->expression);
+				} else {
+					strcat(sql_columns,",");
+					strcat(sql_columns,row->expression);
+				}
+				break;
+			case 7:		// join/relationship where clause
+				//fprintf(stdout,"join tables: %s - %s\n",row->name1,row->name2);
+				//fprintf(stdout,"join clause: %s\n",row->expression);
+				break;
+			case 8:		// where clause
+				strcpy(sql_where,row->expression);
+				break;
+			case 11:		// sorting
+				if(strcmp(sql_sorting,"") == 0) {
+					strcpy(sql_sorting,"ORDER BY ");
+					strcat(sql_sorting,row->expression);
+					if(strcmp(row->name1,"D") == 0) {
+						strcat(sql_sorting," DESCENDING");
+					}
+				}
+				break;
+		}
+	}
+
+	/* print out the sql statement */
+	if(strcmp(sql_where,"") == 0) {
+		fprintf(stdout,"SELECT%s %s FROM %s %s\n",sql_predicate,sql_columns,sql_tables,sql_sorting);
+	} else {
+		fprintf(stdout,"SELECT%s %s FROM %s WHERE %s %s\n",sql_predicate,sql_columns,sql_tables,sql_where,sql_sorting);
+	}
+
+	g_free(sql_tables);
+	g_free(sql_predicate);
+	g_free(sql_columns);
+	g_free(sql_where);
+	g_free(sql_sorting);
+}
+
 /**************************************************** 	
 		mdb_list_queries
 		Description: 	This function prints the list of queries to stdout
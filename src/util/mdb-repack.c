@@ -0,0 +1,153 @@
+/* MDB Tools - A library for reading MS Access database files
+ * Copyright (C) 2000 Brian Bruns
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "mdbtools.h"
+#include "mdbver.h"
+
+/* Copies @src to @dest, which mustn't exist yet */
+static int
+copy_file(const char *src, const char *dest)
+{
+	char buf[65536];
+	ssize_t len;
+	int in, out, ret = 0;
+
+	if ((in = open(src, O_RDONLY)) == -1) {
+		fprintf(stderr, "Can't open %s: %s\n", src, strerror(errno));
+		return -1;
+	}
+	if ((out = open(dest, O_WRONLY | O_CREAT | O_EXCL, 0666)) == -1) {
+		fprintf(stderr, "Can't create %s: %s\n", dest, strerror(errno));
+		close(in);
+		return -1;
+	}
+	while ((len = read(in, buf, sizeof(buf))) > 0) {
+		if (write(out, buf, len) != len) {
+			len = -1;
+			break;
+		}
+	}
+	if (len == -1 || close(out) == -1) {
+		fprintf(stderr, "Can't copy %s to %s: %s\n", src, dest, strerror(errno));
+		unlink(dest);
+		ret = -1;
+	}
+	close(in);
+	return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+	MdbHandle *mdb;
+	MdbCatalogEntry *entry;
+	MdbTableDef *table;
+	MdbCompactStats stats;
+	unsigned int i;
+	int verbose = 0;
+	int print_mdbver = 0;
+	int skipped = 0;
+	int ret = 0;
+	char *locale = NULL;
+	GError *error = NULL;
+	GOptionContext *opt_context;
+	GOptionEntry entries[] = {
+		{"verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose, "Print the rows and pages of each table", NULL},
+		{"version", 0, 0, G_OPTION_ARG_NONE, &print_mdbver, "Show mdbtools version and exit", NULL},
+		{NULL}
+	};
+
+	opt_context = g_option_context_new("<source> <destination> - write a copy of an Access database with its tables repacked");
+	g_option_context_add_main_entries(opt_context, entries, NULL /*i18n*/);
+	locale = setlocale(LC_CTYPE, "");
+	if (!g_option_context_parse (opt_context, &argc, &argv, &error))
+	{
+		fprintf(stderr, "option parsing failed: %s\n", error->message);
+		fputs(g_option_context_get_help(opt_context, TRUE, NULL), stderr);
+		return 1;
+	}
+	setlocale(LC_CTYPE, locale);
+	if (print_mdbver) {
+		if (argc > 1) {
+			fputs(g_option_context_get_help(opt_context, TRUE, NULL), stderr);
+		}
+		fprintf(stdout,"%s\n", MDB_FULL_VERSION);
+		exit(argc > 1);
+	}
+	if (argc != 3) {
+		fputs("Wrong number of arguments.\n\n", stderr);
+		fputs(g_option_context_get_help(opt_context, TRUE, NULL), stderr);
+		return 1;
+	}
+	g_option_context_free(opt_context);
+
+	if (copy_file(argv[1], argv[2]) == -1)
+		return 1;
+	if (!(mdb = mdb_open(argv[2], MDB_WRITABLE))) {
+		unlink(argv[2]);
+		return 1;
+	}
+	if (!mdb_read_catalog(mdb, MDB_TABLE)) {
+		fprintf(stderr, "File does not appear to be an Access database\n");
+		mdb_close(mdb);
+		unlink(argv[2]);
+		return 1;
+	}
+
+	for (i=0; i<mdb->num_catalog && ret == 0; i++) {
+		entry = g_ptr_array_index(mdb->catalog, i);
+		if (!mdb_is_user_table(entry))
+			continue;
+		if (!(table = mdb_read_table(entry))) {
+			skipped++;
+			continue;
+		}
+		mdb_read_columns(table);
+		mdb_read_indices(table);
+		switch (mdb_compact_table(table, &stats)) {
+		case 0:
+			if (verbose)
+				printf("%s: %lu rows, data pages %u -> %u, index pages %u -> %u, %u pages freed\n",
+					table->name, stats.rows,
+					stats.data_pages_before, stats.data_pages_after,
+					stats.index_pages_before, stats.index_pages_after,
+					stats.pages_freed);
+			break;
+		case 1:
+			fprintf(stderr, "Table %s left as it was\n", table->name);
+			skipped++;
+			break;
+		default:
+			fprintf(stderr, "Writing table %s failed\n", table->name);
+			ret = 1;
+		}
+		mdb_free_tabledef(table);
+	}
+	mdb_close(mdb);
+
+	if (ret) {
+		/* the copy is part repacked, part not */
+		unlink(argv[2]);
+	} else if (verbose && skipped) {
+		printf("%d tables left as they were\n", skipped);
+	}
+	return ret;
+}
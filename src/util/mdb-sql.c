@@ -48,8 +48,24 @@ extern void clear_history ();
 #include "mdbsql.h"
 #include "mdbver.h"
 
+#if defined(HAVE_PTHREAD_H) && !defined(_WIN32)
+#define MDB_SQL_SERVER 1
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#endif
+
 void dump_results(FILE *out, MdbSQL *sql, char *delimiter);
-void dump_results_pp(FILE *out, MdbSQL *sql);
+#ifdef MDB_SQL_SERVER
+static void run_remote_query(FILE *out, char *query, char *delimiter);
+static int server_fd = -1;
+static char *server_path = NULL;
+#endif
 
 int headers = 1;
 int footers = 1;
@@ -95,6 +111,12 @@ void
 do_set_cmd(MdbSQL *sql, char *s)
 {
 	char *level1, *level2;
+#ifdef MDB_SQL_SERVER
+	if (server_path) {
+		printf("Set commands are not available with --connect\n");
+		return;
+	}
+#endif
 	level1 = strtok(s, " \t\n");
 	if (!level1) {
 		printf("Usage: set [stats|showplan|noexec] [on|off]\n");
@@ -154,6 +176,12 @@ run_query(FILE *out, MdbSQL *sql, char *mybuf, char *delimiter)
 {
 	MdbTableDef *table;
 
+#ifdef MDB_SQL_SERVER
+	if (server_path) {
+		run_remote_query(out, mybuf, delimiter);
+		return;
+	}
+#endif
 	mdb_sql_run_query(sql, mybuf);
 	if (!mdb_sql_has_error(sql)) {
 		if (showplan) {
@@ -161,16 +189,14 @@ run_query(FILE *out, MdbSQL *sql, char *mybuf, char *delimiter)
 			if (table->sarg_tree) mdb_sql_dump_node(table->sarg_tree, 0);
 			if (sql->cur_table->strategy == MDB_TABLE_SCAN)
 				printf("Table scanning %s\n", table->name);
+			else if (sql->cur_table->strategy == MDB_HASH_SCAN)
+				printf("Hash scanning %s\n", table->name);
 			else 
 				printf("Index scanning %s using %s\n", table->name, table->scan_idx->name);
 		}
 		/* If noexec != on, dump results */
-		if (!noexec) {
-			if (pretty_print)
-				dump_results_pp(out, sql);
-			else
-				dump_results(out, sql, delimiter);
-		}
+		if (!noexec)
+			dump_results(out, sql, delimiter);
 		mdb_sql_reset(sql);
 	}
 }
@@ -207,91 +233,623 @@ void print_rows_retrieved(FILE *out, unsigned long row_count)
 		fprintf(out, "%lu Rows retrieved\n", row_count);
 	fflush(out);
 }
-void
-dump_results(FILE *out, MdbSQL *sql, char *delimiter)
+
+/*
+ * The result printers work from plain arrays of names, display sizes and
+ * values, so that results read back from a server print the same way as
+ * results fetched locally.
+ */
+static void
+print_header(FILE *out, unsigned int num_columns, char **names, int *sizes, char *delimiter)
 {
 	unsigned int j;
-	MdbSQLColumn *sqlcol;
 
+	if (!pretty_print) {
+		if (headers) {
+			for (j=0;j<num_columns;j++) {
+				if (j)
+					fputs(delimiter ? delimiter : "\t", out);
+				fputs(names[j], out);
+			}
+			fprintf(out,"\n");
+			fflush(out);
+		}
+		return;
+	}
 	if (headers) {
-		for (j=0;j<sql->num_columns-1;j++) {
-			sqlcol = g_ptr_array_index(sql->columns,j);
-			fprintf(out, "%s%s", sqlcol->name,
-				delimiter ? delimiter : "\t");
+		for (j=0;j<num_columns;j++) {
+			if (strlen(names[j])>(size_t)sizes[j])
+				sizes[j] = strlen(names[j]);
+			print_break(out, sizes[j], !j);
 		}
-		sqlcol = g_ptr_array_index(sql->columns,sql->num_columns-1);
-		fprintf(out, "%s", sqlcol->name);
+		fprintf(out,"\n");
+		fflush(out);
+		for (j=0;j<num_columns;j++)
+			print_value(out, names[j], sizes[j], !j);
 		fprintf(out,"\n");
 		fflush(out);
 	}
-	while(mdb_sql_fetch_row(sql, sql->cur_table)) {
-  		for (j=0;j<sql->num_columns-1;j++) {
-			sqlcol = g_ptr_array_index(sql->columns,j);
-			fprintf(out, "%s%s", (char*)(g_ptr_array_index(sql->bound_values, j)),
-				delimiter ? delimiter : "\t");
+	for (j=0;j<num_columns;j++)
+		print_break(out, sizes[j], !j);
+	fprintf(out,"\n");
+	fflush(out);
+}
+
+static void
+print_row(FILE *out, unsigned int num_columns, char **values, int *sizes, char *delimiter)
+{
+	unsigned int j;
+
+	for (j=0;j<num_columns;j++) {
+		if (pretty_print)
+			print_value(out, values[j], sizes[j], !j);
+		else {
+			if (j)
+				fputs(delimiter ? delimiter : "\t", out);
+			fputs(values[j], out);
 		}
-		sqlcol = g_ptr_array_index(sql->columns,sql->num_columns-1);
-		fprintf(out, "%s", (char*)(g_ptr_array_index(sql->bound_values, sql->num_columns-1)));
+	}
+	fprintf(out,"\n");
+	fflush(out);
+}
+
+static void
+print_footer(FILE *out, unsigned int num_columns, int *sizes, unsigned long row_count)
+{
+	unsigned int j;
+
+	if (pretty_print) {
+		for (j=0;j<num_columns;j++)
+			print_break(out, sizes[j], !j);
 		fprintf(out,"\n");
 		fflush(out);
 	}
 	if (footers) {
-		print_rows_retrieved(out, sql->row_count);
+		print_rows_retrieved(out, row_count);
 	}
 }
 
-void 
-dump_results_pp(FILE *out, MdbSQL *sql)
+void
+dump_results(FILE *out, MdbSQL *sql, char *delimiter)
 {
+	char **names = g_malloc(sql->num_columns * sizeof(char *));
+	int *sizes = g_malloc(sql->num_columns * sizeof(int));
+	MdbSQLColumn *sqlcol;
 	unsigned int j;
+
+	for (j=0;j<sql->num_columns;j++) {
+		sqlcol = g_ptr_array_index(sql->columns,j);
+		names[j] = sqlcol->name;
+		sizes[j] = sqlcol->disp_size;
+	}
+	print_header(out, sql->num_columns, names, sizes, delimiter);
+	while(mdb_sql_fetch_row(sql, sql->cur_table))
+		print_row(out, sql->num_columns, (char **)sql->bound_values->pdata, sizes, delimiter);
+	print_footer(out, sql->num_columns, sizes, sql->row_count);
+
+	g_free(names);
+	g_free(sizes);
+}
+
+#ifdef MDB_SQL_SERVER
+/*
+ * Server mode.  mdb-sql --listen keeps one database open and answers
+ * queries sent over a Unix domain socket, so that clients don't pay for
+ * opening the file and reading its catalog on every query.  Connections
+ * are handed to a fixed pool of threads; each connection gets its own
+ * MdbSQL on a clone of the server's handle, and the clones share the
+ * file, its catalog and its table definitions.
+ *
+ * Every message is a frame: one type byte, the length of the payload as
+ * 4 bytes big endian, then the payload.  Numbers in a payload are also
+ * 4 bytes big endian.
+ *
+ *  client  'Q'  SQL text of one query
+ *  server  'H'  column count, then for each column its display size,
+ *               the length of its name and the name
+ *          'R'  for each column the length of its value and the value
+ *          'F'  number of rows retrieved; ends the reply
+ *          'E'  error message; ends the reply in place of 'F'
+ *
+ * A client that sends nothing, or reads nothing, for the server's timeout
+ * is dropped, so that it doesn't keep a thread of the pool.  The client
+ * connects again when its next query finds the connection closed.
+ */
+
+#define MDB_SQL_MAX_FRAME (16 * 1024 * 1024)
+
+static struct {
+	MdbHandle *mdb;
+	int *fds;
+	unsigned int num_fds;
+	unsigned int fds_size;
+	int timeout;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} server = { NULL, NULL, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static volatile sig_atomic_t server_stop = 0;
+
+static void
+put_u32(unsigned char *b, guint32 v)
+{
+	b[0] = v >> 24;
+	b[1] = v >> 16;
+	b[2] = v >> 8;
+	b[3] = v;
+}
+
+static guint32
+get_u32(const unsigned char *b)
+{
+	return ((guint32)b[0] << 24) | ((guint32)b[1] << 16) | ((guint32)b[2] << 8) | b[3];
+}
+
+static int
+read_full(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	ssize_t n;
+
+	while (len) {
+		n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int
+write_full(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Returns the payload, NUL terminated, or NULL if the peer went away */
+static char *
+read_frame(int fd, char *type, guint32 *len)
+{
+	unsigned char head[5];
+	char *payload;
+
+	if (read_full(fd, head, sizeof(head)) == -1)
+		return NULL;
+	*type = head[0];
+	*len = get_u32(head + 1);
+	if (*len > MDB_SQL_MAX_FRAME) {
+		fprintf(stderr, "Frame of %lu bytes is too large\n", (unsigned long)*len);
+		return NULL;
+	}
+	payload = g_malloc(*len + 1);
+	if (read_full(fd, payload, *len) == -1) {
+		g_free(payload);
+		return NULL;
+	}
+	payload[*len] = '\0';
+	return payload;
+}
+
+static void
+output_frame(MdbOutput *out, char type, size_t len)
+{
+	unsigned char head[5];
+
+	head[0] = type;
+	put_u32(head + 1, len);
+	mdb_output_write(out, head, sizeof(head));
+}
+
+static void
+output_u32(MdbOutput *out, guint32 v)
+{
+	unsigned char b[4];
+
+	put_u32(b, v);
+	mdb_output_write(out, b, sizeof(b));
+}
+
+static void
+output_error(MdbOutput *out, const char *msg)
+{
+	output_frame(out, 'E', strlen(msg));
+	mdb_output_puts(out, msg);
+}
+
+/* CONNECT and DISCONNECT, which would take a session off the server's database */
+static int
+is_session_command(const char *query)
+{
+	unsigned char c;
+	size_t len;
+
+	while (isspace((unsigned char)*query))
+		query++;
+	if (!g_ascii_strncasecmp(query, "connect", 7))
+		len = 7;
+	else if (!g_ascii_strncasecmp(query, "disconnect", 10))
+		len = 10;
+	else
+		return 0;
+	/* the lexer reads "connections" as a name */
+	c = query[len];
+	return !(isalnum(c) || c == '_' || c == '#' || c == '@' || c >= 0xa0);
+}
+
+static void
+serve_query(MdbOutput *out, MdbSQL *sql, char *query)
+{
 	MdbSQLColumn *sqlcol;
+	unsigned int j;
+	size_t len;
 
-	/* print header */
-	if (headers) {
-		for (j=0;j<sql->num_columns;j++) {
-			sqlcol = g_ptr_array_index(sql->columns,j);
-			if (strlen(sqlcol->name)>(size_t)sqlcol->disp_size)
-				sqlcol->disp_size = strlen(sqlcol->name);
-			print_break(out, sqlcol->disp_size, !j);
-		}
-		fprintf(out,"\n");
-		fflush(out);
-		for (j=0;j<sql->num_columns;j++) {
-			sqlcol = g_ptr_array_index(sql->columns,j);
-			print_value(out, sqlcol->name,sqlcol->disp_size,!j);
-		}
-		fprintf(out,"\n");
-		fflush(out);
+	if (is_session_command(query)) {
+		output_error(out, "Can not connect or disconnect through a server");
+		return;
+	}
+	mdb_sql_run_query(sql, query);
+	if (mdb_sql_has_error(sql)) {
+		output_error(out, mdb_sql_last_error(sql));
+		mdb_sql_reset(sql);
+		return;
 	}
 
+	len = 4;
 	for (j=0;j<sql->num_columns;j++) {
 		sqlcol = g_ptr_array_index(sql->columns,j);
-		print_break(out, sqlcol->disp_size, !j);
+		len += 8 + strlen(sqlcol->name);
+	}
+	output_frame(out, 'H', len);
+	output_u32(out, sql->num_columns);
+	for (j=0;j<sql->num_columns;j++) {
+		sqlcol = g_ptr_array_index(sql->columns,j);
+		output_u32(out, sqlcol->disp_size);
+		output_u32(out, strlen(sqlcol->name));
+		mdb_output_puts(out, sqlcol->name);
 	}
-	fprintf(out,"\n");
-	fflush(out);
 
-	/* print each row */
-	while(mdb_sql_fetch_row(sql, sql->cur_table)) {
-  		for (j=0;j<sql->num_columns;j++) {
-			sqlcol = g_ptr_array_index(sql->columns,j);
-			print_value(out, (char *) g_ptr_array_index(sql->bound_values, j), sqlcol->disp_size,!j);
+	while (mdb_sql_fetch_row(sql, sql->cur_table)) {
+		len = 0;
+		for (j=0;j<sql->num_columns;j++)
+			len += 4 + strlen(g_ptr_array_index(sql->bound_values, j));
+		output_frame(out, 'R', len);
+		for (j=0;j<sql->num_columns;j++) {
+			char *value = g_ptr_array_index(sql->bound_values, j);
+			output_u32(out, strlen(value));
+			mdb_output_puts(out, value);
 		}
-		fprintf(out,"\n");
-		fflush(out);
 	}
 
-	/* footer */
-	for (j=0;j<sql->num_columns;j++) {
-		sqlcol = g_ptr_array_index(sql->columns,j);
-		print_break(out, sqlcol->disp_size, !j);
+	output_frame(out, 'F', 4);
+	output_u32(out, sql->row_count);
+	mdb_sql_reset(sql);
+}
+
+static void
+serve_client(int fd)
+{
+	MdbSQL *sql = mdb_sql_init();
+	FILE *file = fdopen(fd, "w");
+	MdbOutput *out;
+	char *query, type;
+	guint32 len;
+	struct timeval tv;
+
+	sql->mdb = mdb_clone_handle(server.mdb);
+	if (server.timeout > 0) {
+		/* reads and writes that wait longer than this fail */
+		tv.tv_sec = server.timeout;
+		tv.tv_usec = 0;
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
 	}
-	fprintf(out,"\n");
-	fflush(out);
-	if (footers) {
-		print_rows_retrieved(out, sql->row_count);
+	if (!file) {
+		close(fd);
+		mdb_sql_exit(sql);
+		return;
+	}
+	out = mdb_output_new(file);
+	while ((query = read_frame(fd, &type, &len))) {
+		if (type != 'Q')
+			output_error(out, "Expected a query");
+		else
+			serve_query(out, sql, query);
+		g_free(query);
+		if (mdb_output_flush(out) == -1)
+			break;
+	}
+	mdb_output_free(out);
+	fclose(file);
+	mdb_sql_exit(sql);
+}
+
+static int
+next_client(void)
+{
+	int fd;
+
+	pthread_mutex_lock(&server.lock);
+	while (!server.num_fds)
+		pthread_cond_wait(&server.cond, &server.lock);
+	fd = server.fds[0];
+	memmove(server.fds, server.fds + 1, --server.num_fds * sizeof(int));
+	pthread_mutex_unlock(&server.lock);
+	return fd;
+}
+
+static void
+add_client(int fd)
+{
+	pthread_mutex_lock(&server.lock);
+	if (server.num_fds == server.fds_size) {
+		server.fds_size = server.fds_size ? server.fds_size * 2 : 16;
+		server.fds = g_realloc(server.fds, server.fds_size * sizeof(int));
+	}
+	server.fds[server.num_fds++] = fd;
+	pthread_cond_signal(&server.cond);
+	pthread_mutex_unlock(&server.lock);
+}
+
+static void *
+server_worker(void *arg)
+{
+	while (1)
+		serve_client(next_client());
+	return NULL;
+}
+
+static void
+server_signal(int sig)
+{
+	server_stop = 1;
+}
+
+static int
+unix_address(struct sockaddr_un *addr, const char *path)
+{
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		fprintf(stderr, "Socket path %s is too long\n", path);
+		return -1;
+	}
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+static int
+run_server(char *db_name, char *path, int num_threads, int timeout)
+{
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	struct stat st;
+	sigset_t mask, old_mask;
+	pthread_t thread;
+	int fd, client, t;
+
+	if (num_threads < 1) {
+		fprintf(stderr, "Number of threads must be positive\n");
+		return 1;
+	}
+	if (unix_address(&addr, path) == -1)
+		return 1;
+	server.timeout = timeout;
+	if (!(server.mdb = mdb_open(db_name, MDB_NOFLAGS)))
+		return 1;
+	if (!mdb_read_catalog(server.mdb, MDB_ANY)) {
+		fprintf(stderr, "File does not appear to be an Access database\n");
+		mdb_close(server.mdb);
+		return 1;
+	}
+
+	/* replace a socket left behind by an earlier server, but nothing else */
+	if (!lstat(path, &st) && S_ISSOCK(st.st_mode))
+		unlink(path);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 ||
+	    bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+	    listen(fd, 64) == -1) {
+		fprintf(stderr, "Unable to listen on %s: %s\n", path, strerror(errno));
+		if (fd != -1)
+			close(fd);
+		mdb_close(server.mdb);
+		return 1;
+	}
+
+	/* writes to a client that went away should fail, not kill the server */
+	signal(SIGPIPE, SIG_IGN);
+
+	/* only this thread sees SIGINT and SIGTERM, so they interrupt accept() */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+	for (t=0; t<num_threads; t++) {
+		if (pthread_create(&thread, NULL, server_worker, NULL)) {
+			fprintf(stderr, "Can't start thread %d\n", t);
+			break;
+		}
+		pthread_detach(thread);
+	}
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = server_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	while (t && !server_stop) {
+		if ((client = accept(fd, NULL, NULL)) == -1) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			fprintf(stderr, "Unable to accept connections: %s\n", strerror(errno));
+			break;
+		}
+		add_client(client);
+	}
+
+	/* clients still connected are dropped when the process exits */
+	close(fd);
+	unlink(path);
+	return server_stop ? 0 : 1;
+}
+
+static int
+connect_server(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (unix_address(&addr, path) == -1)
+		return -1;
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 ||
+	    connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		fprintf(stderr, "Unable to connect to %s: %s\n", path, strerror(errno));
+		if (fd != -1)
+			close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * Walks the 4 byte lengths and the strings of a payload.  Each string is
+ * NUL terminated in place, over the length that follows it; the
+ * terminator of the last one is the byte read_frame() adds.
+ */
+static int
+take_u32(char **p, char *end, guint32 *v)
+{
+	if (end - *p < 4)
+		return -1;
+	*v = get_u32((unsigned char *)*p);
+	*p += 4;
+	return 0;
+}
+
+static char *
+take_string(char **p, char *end, guint32 len)
+{
+	char *s = *p;
+
+	if ((guint32)(end - s) < len)
+		return NULL;
+	*p += len;
+	return s;
+}
+
+static int
+take_strings(char **p, char *end, guint32 num, char **strings, int *sizes)
+{
+	guint32 i, size, len;
+	char *prev_end = NULL;
+
+	for (i=0; i<num; i++) {
+		if ((sizes && take_u32(p, end, &size) == -1) ||
+		    take_u32(p, end, &len) == -1 ||
+		    !(strings[i] = take_string(p, end, len)))
+			return -1;
+		if (sizes)
+			sizes[i] = size;
+		if (prev_end)
+			*prev_end = '\0';
+		prev_end = *p;
+	}
+	if (*p != end)
+		return -1;
+	if (prev_end)
+		*prev_end = '\0';
+	return 0;
+}
+
+static int
+send_query(char *query)
+{
+	unsigned char head[5];
+
+	head[0] = 'Q';
+	put_u32(head + 1, strlen(query));
+	if (write_full(server_fd, head, sizeof(head)) == -1 ||
+	    write_full(server_fd, query, strlen(query)) == -1)
+		return -1;
+	return 0;
+}
+
+static void
+run_remote_query(FILE *out, char *query, char *delimiter)
+{
+	char **names = NULL, **values = NULL;
+	int *sizes = NULL;
+	char *header = NULL, *payload = NULL, *p, *end, type;
+	guint32 num_columns = 0, len, row_count;
+	int done = 0;
+
+	/* the server drops idle clients: connect again, once, if it did */
+	if (server_fd == -1 || send_query(query) == -1 ||
+	    !(payload = read_frame(server_fd, &type, &len))) {
+		if (server_fd != -1)
+			close(server_fd);
+		if ((server_fd = connect_server(server_path)) == -1)
+			return;
+		if (send_query(query) == -1 || !(payload = read_frame(server_fd, &type, &len))) {
+			fprintf(stderr, "Lost connection to server\n");
+			return;
+		}
 	}
+	while (!done && payload) {
+		p = payload;
+		end = payload + len;
+		if (type == 'E') {
+			fprintf(stderr, "%s\n", payload);
+			done = 1;
+		} else if (type == 'H' && !header) {
+			if (take_u32(&p, end, &num_columns) == -1 || num_columns > len / 8)
+				break;
+			names = g_malloc(num_columns * sizeof(char *));
+			values = g_malloc(num_columns * sizeof(char *));
+			sizes = g_malloc(num_columns * sizeof(int));
+			if (take_strings(&p, end, num_columns, names, sizes) == -1)
+				break;
+			header = payload;
+			payload = NULL;
+			print_header(out, num_columns, names, sizes, delimiter);
+		} else if (type == 'R' && header) {
+			if (take_strings(&p, end, num_columns, values, NULL) == -1)
+				break;
+			print_row(out, num_columns, values, sizes, delimiter);
+		} else if (type == 'F' && header) {
+			if (take_u32(&p, end, &row_count) == -1)
+				break;
+			print_footer(out, num_columns, sizes, row_count);
+			done = 1;
+		} else
+			break;
+		g_free(payload);
+		payload = done ? NULL : read_frame(server_fd, &type, &len);
+	}
+	if (!done) {
+		g_free(payload);
+		fprintf(stderr, "Lost connection to server\n");
+	}
+	g_free(header);
+	g_free(names);
+	g_free(values);
+	g_free(sizes);
 }
+#endif /* MDB_SQL_SERVER */
 
 static char *
 find_sql_terminator(char *s)
@@ -334,6 +892,11 @@ main(int argc, char **argv)
 	int in_from_colon_r = 0;
 	char *locale = NULL;
 	int print_mdbver = 0;
+#ifdef MDB_SQL_SERVER
+	char *listen_path = NULL, *connect_path = NULL;
+	int num_threads = 4;
+	int timeout = 300;
+#endif
 
 	GOptionEntry entries[] = {
 		{ "delim", 'd', 0, G_OPTION_ARG_STRING, &delimiter, "Use this delimiter.", "char"},
@@ -342,6 +905,12 @@ main(int argc, char **argv)
 		{ "no-footer", 'F', G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &footers, "Don't print footer", NULL},
 		{ "input", 'i', 0, G_OPTION_ARG_FILENAME, &filename_in, "Read SQL from specified file", "file"},
 		{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &filename_out, "Write result to specified file", "file"},
+#ifdef MDB_SQL_SERVER
+		{ "listen", 'l', 0, G_OPTION_ARG_FILENAME, &listen_path, "Serve queries on the database from a Unix socket", "socket"},
+		{ "threads", 't', 0, G_OPTION_ARG_INT, &num_threads, "Number of clients served at once with --listen (default 4)", "n"},
+		{ "timeout", 'T', 0, G_OPTION_ARG_INT, &timeout, "Drop --listen clients idle for this many seconds (default 300, 0 for never)", "seconds"},
+		{ "connect", 'c', 0, G_OPTION_ARG_FILENAME, &connect_path, "Send queries to the server on a Unix socket", "socket"},
+#endif
 		{"version", 0, 0, G_OPTION_ARG_NONE, &print_mdbver, "Show mdbtools version and exit", NULL},
 		{ NULL },
 	};
@@ -373,6 +942,29 @@ main(int argc, char **argv)
 		exit(1);
 	}
 
+#ifdef MDB_SQL_SERVER
+	if (listen_path) {
+		if (argc != 2 || connect_path) {
+			fputs("--listen needs a database, and can not be used with --connect.\n\n", stderr);
+			fputs(g_option_context_get_help(opt_context, TRUE, NULL), stderr);
+			exit(1);
+		}
+		exit(run_server(argv[1], listen_path, num_threads, timeout));
+	}
+	if (connect_path) {
+		if (argc == 2) {
+			fputs("A database can not be given with --connect.\n\n", stderr);
+			fputs(g_option_context_get_help(opt_context, TRUE, NULL), stderr);
+			exit(1);
+		}
+		/* a server that dropped us fails the next write, not the process */
+		signal(SIGPIPE, SIG_IGN);
+		server_path = connect_path;
+		if ((server_fd = connect_server(connect_path)) == -1)
+			exit(1);
+	}
+#endif
+
 #ifdef HAVE_READLINE_HISTORY
 	if (home) {
 		histpath = (char *) g_strconcat(home, "/", HISTFILE, NULL);
@@ -433,8 +1025,20 @@ main(int argc, char **argv)
 					in_from_colon_r = 0;
 				} else
 					break;
-			} else if (s[strlen(s)-1]=='\n')
-				s[strlen(s)-1]=0;
+			} else {
+				size_t len = strlen(s), s_sz = bufsz;
+
+				/* long lines take more than one read */
+				while (len && s[len-1]!='\n' && !feof(in)) {
+					s_sz *= 2;
+					s = realloc(s, s_sz);
+					if (!fgets(s + len, (int)(s_sz - len), in))
+						break;
+					len += strlen(s + len);
+				}
+				if (len && s[len-1]=='\n')
+					s[len-1]=0;
+			}
 		} else {
 			snprintf(prompt, sizeof(prompt), "%d => ", line);
 			locale = setlocale(LC_CTYPE, "");
@@ -476,7 +1080,7 @@ main(int argc, char **argv)
 		} else {
 			char *p;
 
-			while (strlen(mybuf) + strlen(s) > bufsz) {
+			while (strlen(mybuf) + strlen(s) + 2 > bufsz) {
 				bufsz *= 2;
 				mybuf = realloc(mybuf, bufsz);
 			}
@@ -499,6 +1103,12 @@ main(int argc, char **argv)
 		}
 	}
 	mdb_sql_exit(sql);
+#ifdef MDB_SQL_SERVER
+	if (server_fd != -1)
+		close(server_fd);
+	g_free(listen_path);
+	g_free(connect_path);
+#endif
 
 	free(mybuf);
 	if (s) free(s);
@@ -0,0 +1,162 @@
+/* MDB Tools - A library for reading MS Access database file
+ * Copyright (C) 2000 Brian Bruns
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Times the decoding of the MONEY and NUMERIC values of a table, as
+ * strings and through the integer accessors, and checks that the two
+ * agree wherever the value fits in 64 bits.
+ */
+
+#include "mdbtools.h"
+#include <inttypes.h>
+#include <time.h>
+
+enum { SCAN_ONLY, AS_STRING, AS_INTEGER };
+
+/* the string of @value divided by ten to the @scale, as money.c prints it */
+static char *
+scaled_to_string(gint64 value, int scale)
+{
+	guint64 mag = value < 0 ? ~(guint64)value + 1 : (guint64)value;
+	char digits[64], *s;
+	int len, i, j = 0;
+
+	/* at least one digit before the point */
+	len = snprintf(digits, sizeof(digits), "%0*" PRIu64, scale + 1, mag);
+	s = g_malloc(len + 3);
+	if (value < 0)
+		s[j++] = '-';
+	for (i=0; i<len; i++) {
+		if (scale && i == len - scale)
+			s[j++] = '.';
+		s[j++] = digits[i];
+	}
+	s[j] = '\0';
+	return s;
+}
+
+static unsigned long
+scan(MdbTableDef *table, int how, unsigned long *values, unsigned long *mismatches)
+{
+	MdbHandle *mdb = table->entry->mdb;
+	unsigned long sum = 0;
+	unsigned int i;
+	gint64 hi;
+	guint64 lo;
+	int scale;
+	char *str, *expect;
+
+	*values = 0;
+	mdb_rewind_table(table);
+	while (mdb_fetch_row(table)) {
+		for (i=0; i<table->num_cols; i++) {
+			MdbColumn *col = g_ptr_array_index(table->columns, i);
+			int start = col->cur_value_start;
+
+			if (!col->cur_value_len)
+				continue;
+			if (col->col_type == MDB_MONEY) {
+				(*values)++;
+				if (how == AS_STRING) {
+					str = mdb_money_to_string(mdb, start);
+					sum += str[0];
+					g_free(str);
+				} else if (how == AS_INTEGER) {
+					sum += mdb_money_to_int64(mdb, start, &scale);
+				}
+				if (how != SCAN_ONLY && mismatches) {
+					str = mdb_money_to_string(mdb, start);
+					expect = scaled_to_string(mdb_money_to_int64(mdb, start, &scale), scale);
+					if (strcmp(str, expect))
+						(*mismatches)++;
+					g_free(str);
+					g_free(expect);
+				}
+			} else if (col->col_type == MDB_NUMERIC) {
+				(*values)++;
+				if (how == AS_STRING) {
+					str = mdb_numeric_to_string(mdb, start, col->col_scale, col->col_prec);
+					sum += str[0];
+					g_free(str);
+				} else if (how == AS_INTEGER) {
+					if (!mdb_numeric_to_int128(mdb, start, col->col_prec, &hi, &lo, &scale))
+						sum += lo;
+				}
+				if (how != SCAN_ONLY && mismatches
+						&& !mdb_numeric_to_int128(mdb, start, col->col_prec, &hi, &lo, &scale)
+						&& hi == ((gint64)lo < 0 ? -1 : 0)) {
+					str = mdb_numeric_to_string(mdb, start, col->col_scale, col->col_prec);
+					expect = scaled_to_string((gint64)lo, scale);
+					/* the string keeps the sign of a negative zero */
+					if (strcmp(str, expect) && strcmp(str + 1, expect))
+						(*mismatches)++;
+					g_free(str);
+					g_free(expect);
+				}
+			}
+		}
+	}
+	return sum;
+}
+
+int
+main(int argc, char **argv)
+{
+	MdbHandle *mdb;
+	MdbTableDef *table;
+	unsigned long values = 0, mismatches = 0, sum = 0;
+	double ms[3];
+	int reps = 10, rep, how;
+	clock_t start;
+
+	if (argc < 3 || argc > 4) {
+		fprintf(stderr, "Usage: %s <file> <table> [<repetitions>]\n", argv[0]);
+		return 1;
+	}
+	if (argc == 4)
+		reps = atoi(argv[3]);
+
+	if (!(mdb = mdb_open(argv[1], MDB_NOFLAGS)))
+		return 1;
+	if (!(table = mdb_read_table_by_name(mdb, argv[2], MDB_TABLE))) {
+		fprintf(stderr, "Can't read table %s\n", argv[2]);
+		mdb_close(mdb);
+		return 1;
+	}
+	mdb_read_columns(table);
+
+	scan(table, AS_INTEGER, &values, &mismatches);
+	for (how=SCAN_ONLY; how<=AS_INTEGER; how++) {
+		start = clock();
+		for (rep=0; rep<reps; rep++)
+			sum += scan(table, how, &values, NULL);
+		ms[how] = (double)(clock() - start) / CLOCKS_PER_SEC * 1000 / reps;
+	}
+	printf("%s: %lu MONEY and NUMERIC values\n", argv[2], values);
+	printf("scan only   %10.3f ms\n", ms[SCAN_ONLY]);
+	printf("as string   %10.3f ms, %.1f ns per value\n", ms[AS_STRING],
+		values ? (ms[AS_STRING] - ms[SCAN_ONLY]) * 1e6 / values : 0.0);
+	printf("as integer  %10.3f ms, %.1f ns per value\n", ms[AS_INTEGER],
+		values ? (ms[AS_INTEGER] - ms[SCAN_ONLY]) * 1e6 / values : 0.0);
+	if (mismatches)
+		fprintf(stderr, "%lu values differ between string and integer (%lu)\n", mismatches, sum);
+
+	mdb_free_tabledef(table);
+	mdb_close(mdb);
+	return mismatches != 0;
+}
@@ -75,37 +75,43 @@ page_name(int page_type)
 void check_row(MdbHandle *mdb, MdbIndex *idx, guint32 pg, int row)
 {
 	MdbField fields[256];
-	unsigned int num_fields, i, j;
+	unsigned int i;
+	int num_fields, j;
 	int row_start;
-	size_t row_size;
+	size_t row_size, len;
 	MdbColumn *col;
 	gchar buf[256], key[256];
 	int elem;
 	MdbTableDef *table = idx->table; 
 	
-	mdb_read_pg(mdb, pg);
-	mdb_find_row(mdb, row, &row_start, &row_size);
+	if (!mdb_read_pg(mdb, pg) || mdb_find_row(mdb, row, &row_start, &row_size)) {
+		fprintf(stderr, "ERROR No row %d on page %lu\n", row, (long unsigned) pg);
+		return;
+	}
 
-	num_fields = mdb_crack_row(table, row_start, row_start + row_size - 1,
-		fields);
+	/* the top bits of the offset are flags */
+	num_fields = mdb_crack_row(table, row_start & 0x1fff, row_size, fields);
 	for (i=0;i<idx->num_keys;i++) {
 		col=g_ptr_array_index(table->columns,idx->key_col_num[i]-1);
-		if (col->col_type==MDB_TEXT) {
-			mdb_index_hash_text(mdb, buf, key);
-		}
 		for (j=0;j<num_fields;j++) {
 			if (fields[j].colnum+1==idx->key_col_num[i]) {
 				elem = j;
 				break;
 			}
 		}
-		if (j==num_fields) {
+		if (j>=num_fields) {
 			fprintf(stderr, "ERROR Lost field #%d\n", idx->key_col_num[i]);
 			continue;
 		}
 		//j = idx->key_col_num[i];
-		strncpy(buf, fields[elem].value, fields[elem].siz);
-		buf[fields[elem].siz]=0;
+		len = fields[elem].siz;
+		if (len > sizeof(buf) - 1)
+			len = sizeof(buf) - 1;
+		strncpy(buf, fields[elem].value, len);
+		buf[len]=0;
+		if (col->col_type==MDB_TEXT) {
+			mdb_index_hash_text(mdb, buf, key);
+		}
 		//fprintf(stdout, "elem %d %d column %d %s %s\n",elem, fields[elem].colnum, idx->key_col_num[i], col->name, buf);
 		if (col->col_type == MDB_TEXT) {
 			// fprintf(stdout, "%s = %s \n", buf, key);
@@ -0,0 +1,172 @@
+/* MDB Tools - A library for reading MS Access database file
+ * Copyright (C) 2000 Brian Bruns
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Reads every user table of a database through each of the page sources,
+ * then every page in an order that jumps about, checking that they give
+ * the same rows and pages, and timing them.  The compressed copy, if
+ * given, is read with the default cache and with a small one.
+ */
+
+#include "mdbtools.h"
+#include <time.h>
+
+static int
+checksum(MdbHandle *mdb, unsigned long *rows, guint32 *sum)
+{
+	MdbCatalogEntry *entry;
+	MdbTableDef *table;
+	char **values;
+	int *lens;
+	unsigned int i, j;
+	int k;
+
+	*rows = 0;
+	*sum = 2166136261U;
+	if (!mdb_read_catalog(mdb, MDB_TABLE))
+		return -1;
+	for (i=0; i<mdb->num_catalog; i++) {
+		entry = g_ptr_array_index(mdb->catalog, i);
+		if (!mdb_is_user_table(entry))
+			continue;
+		if (!(table = mdb_read_table(entry)))
+			return -1;
+		mdb_read_columns(table);
+		mdb_rewind_table(table);
+		values = g_malloc(table->num_cols * sizeof(char *));
+		lens = g_malloc(table->num_cols * sizeof(int));
+		for (j=0; j<table->num_cols; j++) {
+			values[j] = g_malloc0(MDB_BIND_SIZE);
+			mdb_bind_column(table, j+1, values[j], &lens[j]);
+		}
+		while (mdb_fetch_row(table)) {
+			(*rows)++;
+			for (j=0; j<table->num_cols; j++)
+				for (k=0; k<lens[j]; k++)
+					*sum = (*sum ^ (unsigned char)values[j][k]) * 16777619U;
+		}
+		for (j=0; j<table->num_cols; j++)
+			g_free(values[j]);
+		g_free(values);
+		g_free(lens);
+		mdb_free_tabledef(table);
+	}
+	return 0;
+}
+
+/* Reads the @num_pages pages of the file, each once, in a scattered order */
+static int
+page_checksum(MdbHandle *mdb, unsigned long num_pages, guint32 *sum)
+{
+	/* a prime step visits every page, unless it divides num_pages */
+	unsigned long step = num_pages % 7919 ? 7919 : 1, i, pg;
+	guint32 h;
+	unsigned int j;
+
+	*sum = 0;
+	for (i=0; i<num_pages; i++) {
+		pg = (i * step) % num_pages;
+		if (!mdb_read_pg(mdb, pg))
+			return -1;
+		h = 2166136261U;
+		for (j=0; j<mdb->fmt->pg_size; j++)
+			h = (h ^ mdb->pg_buf[j]) * 16777619U;
+		*sum += h * (2 * pg + 1);
+	}
+	return 0;
+}
+
+static int
+run(const char *name, MdbHandle *mdb, long len, unsigned long *rows, guint32 *sum)
+{
+	clock_t start = clock();
+	double rows_s;
+	guint32 pages_sum = 0;
+	int ret;
+
+	if (!mdb) {
+		fprintf(stderr, "%s: couldn't open\n", name);
+		return -1;
+	}
+	ret = checksum(mdb, rows, sum);
+	rows_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+	start = clock();
+	if (ret == 0)
+		ret = page_checksum(mdb, (len + mdb->fmt->pg_size - 1) / mdb->fmt->pg_size, &pages_sum);
+	printf("%-14s %10lu rows  %08x  %8.3f s   pages %08x  %8.3f s\n", name, *rows, *sum, rows_s,
+		pages_sum, (double)(clock() - start) / CLOCKS_PER_SEC);
+	/* the page sum goes in with the rows, so any difference shows */
+	*sum ^= pages_sum;
+	mdb_close(mdb);
+	return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+	FILE *file;
+	MdbPageSource *src;
+	void *buffer;
+	long len;
+	unsigned long rows, first_rows;
+	guint32 sum, first_sum;
+	int i, ret = 0;
+
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "Usage: %s <file> [<file compressed with gzip>]\n", argv[0]);
+		return 1;
+	}
+
+	if (!(file = fopen(argv[1], "r")) || fseek(file, 0, SEEK_END) == -1
+			|| (len = ftell(file)) == -1 || fseek(file, 0, SEEK_SET) == -1) {
+		perror(argv[1]);
+		return 1;
+	}
+	if (run("stdio", mdb_open(argv[1], MDB_NOFLAGS), len, &first_rows, &first_sum))
+		return 1;
+
+	buffer = g_malloc(len);
+	if (fread(buffer, 1, len, file) != (size_t)len) {
+		perror(argv[1]);
+		return 1;
+	}
+	fclose(file);
+	if (run("buffer", mdb_open_buffer(buffer, len, MDB_NOFLAGS), len, &rows, &sum)
+			|| rows != first_rows || sum != first_sum)
+		ret = 1;
+	g_free(buffer);
+
+	for (i=0; argc == 3 && i<2; i++) {
+		if (!(file = fopen(argv[2], "r"))) {
+			perror(argv[2]);
+			ret = 1;
+			break;
+		}
+		/* NULL if mdbtools was built without zlib */
+		if (!(src = mdb_page_source_inflate(file, 0, i ? 1024 * 1024 : 0))) {
+			fclose(file);
+			break;
+		}
+		if (run(i ? "inflate 1 MB" : "inflate", mdb_open_source(src, MDB_NOFLAGS), len, &rows, &sum)
+				|| rows != first_rows || sum != first_sum)
+			ret = 1;
+	}
+	if (ret)
+		fprintf(stderr, "Sources disagree\n");
+	return ret;
+}
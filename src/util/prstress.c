@@ -0,0 +1,206 @@
+/* MDB Tools - A library for reading MS Access database file
+ * Copyright (C) 2000 Brian Bruns
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Scans every user table from several threads at once, each through its
+ * own clone of one handle, and checks each scan against a scan done
+ * beforehand from a single thread.
+ */
+
+#include "mdbtools.h"
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+typedef struct {
+	char *name;
+	unsigned long rows;
+	guint32 sum;
+} Scan;
+
+static GPtrArray *scans;
+static int rounds = 4;
+
+/* row count and FNV-1a hash of every bound value */
+static int
+scan_table(MdbHandle *mdb, const char *name, unsigned long *rows, guint32 *sum)
+{
+	MdbTableDef *table;
+	char **values;
+	int *lens;
+	unsigned int i;
+	int j;
+
+	table = mdb_read_table_by_name(mdb, (gchar *)name, MDB_TABLE);
+	if (!table) {
+		fprintf(stderr, "Can't read table %s\n", name);
+		return -1;
+	}
+	mdb_read_columns(table);
+	mdb_rewind_table(table);
+	values = g_malloc(table->num_cols * sizeof(char *));
+	lens = g_malloc0(table->num_cols * sizeof(int));
+	for (i=0; i<table->num_cols; i++) {
+		values[i] = g_malloc0(MDB_BIND_SIZE);
+		mdb_bind_column(table, i+1, values[i], &lens[i]);
+	}
+	*rows = 0;
+	*sum = 2166136261U;
+	while (mdb_fetch_row(table)) {
+		(*rows)++;
+		for (i=0; i<table->num_cols; i++) {
+			for (j=0; j<lens[i]; j++)
+				*sum = (*sum ^ (unsigned char)values[i][j]) * 16777619U;
+			*sum = (*sum ^ 0xff) * 16777619U;
+		}
+	}
+	for (i=0; i<table->num_cols; i++)
+		g_free(values[i]);
+	g_free(values);
+	g_free(lens);
+	mdb_free_tabledef(table);
+	return 0;
+}
+
+/* each thread starts on a different table, and goes through all of them */
+static int
+check_tables(MdbHandle *mdb, int thread)
+{
+	unsigned int i;
+	unsigned long rows;
+	guint32 sum;
+	int round, errors = 0;
+
+	for (round=0; round<rounds; round++) {
+		for (i=0; i<scans->len; i++) {
+			Scan *scan = g_ptr_array_index(scans, (i + thread) % scans->len);
+
+			if (scan_table(mdb, scan->name, &rows, &sum) == -1)
+				errors++;
+			else if (rows != scan->rows || sum != scan->sum) {
+				fprintf(stderr, "thread %d: table %s read %lu rows (hash %08x), expected %lu (hash %08x)\n",
+					thread, scan->name, rows, sum, scan->rows, scan->sum);
+				errors++;
+			}
+		}
+	}
+	return errors;
+}
+
+#ifdef HAVE_PTHREAD_H
+typedef struct {
+	MdbHandle *mdb;
+	int thread;
+	int errors;
+} Worker;
+
+static void *
+worker_main(void *arg)
+{
+	Worker *w = arg;
+
+	w->errors = check_tables(w->mdb, w->thread);
+	return NULL;
+}
+#endif
+
+int
+main(int argc, char **argv)
+{
+	MdbHandle *mdb;
+	MdbCatalogEntry *entry;
+	Scan *scan;
+	unsigned int i;
+	int num_threads = 4;
+	int errors = 0;
+
+	if (argc<2) {
+		fprintf(stderr,"Usage: %s <file> [<threads> [<rounds>]]\n",argv[0]);
+		exit(1);
+	}
+	if (argc>2)
+		num_threads = atoi(argv[2]);
+	if (argc>3)
+		rounds = atoi(argv[3]);
+	if (num_threads < 1 || rounds < 1) {
+		fprintf(stderr, "Number of threads and rounds must be positive\n");
+		exit(1);
+	}
+
+	if (!(mdb = mdb_open(argv[1], MDB_NOFLAGS)))
+		exit(1);
+	if (!mdb_read_catalog(mdb, MDB_TABLE)) {
+		fprintf(stderr, "File does not appear to be an Access database\n");
+		mdb_close(mdb);
+		exit(1);
+	}
+
+	scans = g_ptr_array_new();
+	for (i=0; i<mdb->num_catalog; i++) {
+		entry = g_ptr_array_index(mdb->catalog, i);
+		if (!mdb_is_user_table(entry))
+			continue;
+		scan = g_malloc0(sizeof(Scan));
+		scan->name = g_strdup(entry->object_name);
+		if (scan_table(mdb, scan->name, &scan->rows, &scan->sum) == -1)
+			errors++;
+		g_ptr_array_add(scans, scan);
+	}
+
+	if (scans->len) {
+#ifdef HAVE_PTHREAD_H
+		Worker *workers = g_malloc0(num_threads * sizeof(Worker));
+		pthread_t *threads = g_malloc(num_threads * sizeof(pthread_t));
+		int started, t;
+
+		for (started=0; started<num_threads; started++) {
+			workers[started].mdb = mdb_clone_handle(mdb);
+			workers[started].thread = started;
+			if (pthread_create(&threads[started], NULL, worker_main, &workers[started])) {
+				fprintf(stderr, "Can't start thread %d\n", started);
+				mdb_close(workers[started].mdb);
+				errors++;
+				break;
+			}
+		}
+		for (t=0; t<started; t++) {
+			pthread_join(threads[t], NULL);
+			errors += workers[t].errors;
+			mdb_close(workers[t].mdb);
+		}
+		g_free(threads);
+		g_free(workers);
+#else
+		fprintf(stderr, "Built without threads, checking from one thread\n");
+		errors += check_tables(mdb, 0);
+#endif
+	}
+
+	printf("%u tables, %d threads, %d rounds: %d errors\n",
+		scans->len, num_threads, rounds, errors);
+
+	for (i=0; i<scans->len; i++) {
+		scan = g_ptr_array_index(scans, i);
+		g_free(scan->name);
+		g_free(scan);
+	}
+	g_ptr_array_free(scans, TRUE);
+	mdb_close(mdb);
+
+	return errors ? 1 : 0;
+}
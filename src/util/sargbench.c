@@ -0,0 +1,116 @@
+/* MDB Tools - A library for reading MS Access database file
+ * Copyright (C) 2000 Brian Bruns
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Times table scans with one comparison on a numeric column, the kind
+ * mdb_filter_page() weeds out rows on.  Run it once as it is and once with
+ * MDBOPTS=no_page_filter to compare the filtered scan with testing every
+ * row; the row counts printed must be the same.
+ */
+
+#include "mdbtools.h"
+#include <time.h>
+
+static const struct {
+	const char *name;
+	int op;
+} ops[] = {
+	{ "=", MDB_EQUAL }, { "<>", MDB_NEQ },
+	{ "<", MDB_LT }, { "<=", MDB_LTEQ },
+	{ ">", MDB_GT }, { ">=", MDB_GTEQ }
+};
+
+int
+main(int argc, char **argv)
+{
+	MdbHandle *mdb;
+	MdbTableDef *table;
+	MdbSargNode node;
+	char **values;
+	unsigned long rows = 0;
+	unsigned int i;
+	int reps = 20, rep;
+	clock_t start;
+
+	if (argc < 6 || argc > 7) {
+		fprintf(stderr, "Usage: %s <file> <table> <column> <op> <value> [<repetitions>]\n", argv[0]);
+		return 1;
+	}
+	if (argc == 7)
+		reps = atoi(argv[6]);
+
+	memset(&node, 0, sizeof(node));
+	node.op = -1;
+	for (i=0; i<sizeof(ops)/sizeof(ops[0]); i++)
+		if (!strcmp(argv[4], ops[i].name))
+			node.op = ops[i].op;
+	if (node.op == -1) {
+		fprintf(stderr, "Unknown operator %s\n", argv[4]);
+		return 1;
+	}
+	node.val_type = MDB_DOUBLE;
+	node.value.d = strtod(argv[5], NULL);
+
+	if (!(mdb = mdb_open(argv[1], MDB_NOFLAGS)))
+		return 1;
+	if (!(table = mdb_read_table_by_name(mdb, argv[2], MDB_TABLE))) {
+		fprintf(stderr, "Can't read table %s\n", argv[2]);
+		mdb_close(mdb);
+		return 1;
+	}
+	mdb_read_columns(table);
+	for (i=0; i<table->num_cols; i++) {
+		MdbColumn *col = g_ptr_array_index(table->columns, i);
+		if (!g_ascii_strcasecmp(col->name, argv[3]))
+			node.col = col;
+	}
+	if (!node.col) {
+		fprintf(stderr, "No column %s in table %s\n", argv[3], argv[2]);
+		mdb_free_tabledef(table);
+		mdb_close(mdb);
+		return 1;
+	}
+
+	/* bind every column, as the tools do, so each match costs what it would */
+	values = g_malloc(table->num_cols * sizeof(char *));
+	for (i=0; i<table->num_cols; i++) {
+		values[i] = g_malloc0(MDB_BIND_SIZE);
+		mdb_bind_column(table, i+1, values[i], NULL);
+	}
+	table->sarg_tree = &node;
+
+	start = clock();
+	for (rep=0; rep<reps; rep++) {
+		rows = 0;
+		mdb_rewind_table(table);
+		while (mdb_fetch_row(table))
+			rows++;
+	}
+	printf("%s %s %s %s: %lu rows, %.3f ms per scan%s\n",
+		argv[2], argv[3], argv[4], argv[5], rows,
+		(double)(clock() - start) / CLOCKS_PER_SEC * 1000 / reps,
+		mdb_get_option(MDB_NO_PAGE_FILTER) ? " (no_page_filter)" : "");
+
+	table->sarg_tree = NULL;
+	for (i=0; i<table->num_cols; i++)
+		g_free(values[i]);
+	g_free(values);
+	mdb_free_tabledef(table);
+	mdb_close(mdb);
+	return 0;
+}
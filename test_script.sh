@@ -77,6 +77,108 @@ testCommand() {
 	esac
 }
 
+# mdb-export --manifest, then --previous and --changed-rows on the same
+# file: nothing is exported for the unchanged table, and once the first
+# page's checksum is changed in the manifest, only rows of the table are
+# exported again.
+testManifest() {
+	testManifest_dir="$(mktemp -d)"
+	printf 'Testing mdb-export --manifest round trip (%s)... ' "$*"
+	if ./src/util/mdb-export --manifest "$testManifest_dir/manifest" "$@" >"$testManifest_dir/full.csv" &&
+		test -s "$testManifest_dir/full.csv" &&
+		./src/util/mdb-export --previous "$testManifest_dir/manifest" "$@" >"$testManifest_dir/unchanged.csv" &&
+		! test -s "$testManifest_dir/unchanged.csv" &&
+		sed '3s/ .*/ 0000000000000000/' "$testManifest_dir/manifest" >"$testManifest_dir/changed" &&
+		./src/util/mdb-export --previous "$testManifest_dir/changed" "$@" >"$testManifest_dir/again.csv" &&
+		cmp -s "$testManifest_dir/full.csv" "$testManifest_dir/again.csv" &&
+		./src/util/mdb-export --previous "$testManifest_dir/changed" --changed-rows --no-header "$@" >"$testManifest_dir/rows.csv" &&
+		test -s "$testManifest_dir/rows.csv" &&
+		cut -d, -f3- "$testManifest_dir/rows.csv" | sort >"$testManifest_dir/rows.sorted" &&
+		sort "$testManifest_dir/full.csv" >"$testManifest_dir/full.sorted" &&
+		test -z "$(comm -23 "$testManifest_dir/rows.sorted" "$testManifest_dir/full.sorted")"; then
+		printf 'passed.\n'
+		testManifest_rc=0
+	else
+		printf 'failed.\n'
+		testManifest_rc=1
+	fi
+	rm -rf "$testManifest_dir"
+	return $testManifest_rc
+}
+
+# Walk the primary key index of every table with prindex: the walk goes
+# from leaf to leaf, and should visit each row of the table exactly once
+testIndexWalk() {
+	testIndexWalk_dir="$(mktemp -d)"
+	printf 'Testing index walks (%s)... ' "$1"
+	testIndexWalk_rc=0
+	if ./src/util/mdb-tables -1 "$1" >"$testIndexWalk_dir/tables"; then
+		while IFS= read -r testIndexWalk_table; do
+			testIndexWalk_index="$(./src/util/prtable "$1" "$testIndexWalk_table" |
+				awk '/^index name / { sub(/^index name +/, ""); name = $0 } /^index is a primary key/ { print name; exit }')"
+			if [ -z "$testIndexWalk_index" ]; then
+				continue
+			fi
+			if ! { ./src/util/prindex "$1" "$testIndexWalk_table" "$testIndexWalk_index" >"$testIndexWalk_dir/walk" &&
+				grep '^row = ' "$testIndexWalk_dir/walk" | sort >"$testIndexWalk_dir/rows" &&
+				test -z "$(uniq -d "$testIndexWalk_dir/rows")" &&
+				test "$(wc -l <"$testIndexWalk_dir/rows")" -eq "$(./src/util/mdb-count "$1" "$testIndexWalk_table")"; }; then
+				testIndexWalk_rc=1
+			fi
+		done <"$testIndexWalk_dir/tables"
+	else
+		testIndexWalk_rc=1
+	fi
+	if [ $testIndexWalk_rc = 0 ]; then
+		printf 'passed.\n'
+	else
+		printf 'failed.\n'
+	fi
+	rm -rf "$testIndexWalk_dir"
+	return $testIndexWalk_rc
+}
+
+# mdb-repack a copy of a database, then check that every table of the copy
+# has the same rows as before
+testRepack() {
+	testRepack_dir="$(mktemp -d)"
+	printf 'Testing mdb-repack (%s)... ' "$1"
+	testRepack_rc=0
+	if ./src/util/mdb-repack "$1" "$testRepack_dir/copy" 2>"$testRepack_dir/stderr" &&
+		./src/util/mdb-tables -1 "$1" >"$testRepack_dir/tables" &&
+		test -s "$testRepack_dir/tables"; then
+		while IFS= read -r testRepack_table; do
+			if ! { ./src/util/mdb-export "$1" "$testRepack_table" >"$testRepack_dir/before.csv" &&
+				./src/util/mdb-export "$testRepack_dir/copy" "$testRepack_table" >"$testRepack_dir/after.csv" &&
+				sort "$testRepack_dir/before.csv" >"$testRepack_dir/before.sorted" &&
+				sort "$testRepack_dir/after.csv" >"$testRepack_dir/after.sorted" &&
+				cmp -s "$testRepack_dir/before.sorted" "$testRepack_dir/after.sorted"; }; then
+				testRepack_rc=1
+			fi
+		done <"$testRepack_dir/tables"
+	else
+		testRepack_rc=1
+	fi
+	if [ $testRepack_rc = 0 ]; then
+		printf 'passed.\n'
+	else
+		printf 'failed.\n'
+	fi
+	rm -rf "$testRepack_dir"
+	return $testRepack_rc
+}
+
+# prsource on a database and on a copy of it compressed with gzip
+testSource() {
+	testSource_gz="$(mktemp)"
+	testSource_rc=0
+	if ! gzip -c "$1" >"$testSource_gz" || ! testCommand prsource "$1" "$testSource_gz"; then
+		testSource_rc=1
+	fi
+	rm -f "$testSource_gz"
+	return $testSource_rc
+}
+
 parseArgs "$@"
 
 rc=0
@@ -122,6 +224,30 @@ fi
 if ! testCommand mdb-queries test/data/ASampleDatabase.accdb qryCostsSummedByOwner; then
 	rc=1
 fi
+if ! testCommand prstress test/data/nwind.mdb 8; then
+	rc=1
+fi
+if ! testManifest test/data/nwind.mdb "Umsätze"; then
+	rc=1
+fi
+if ! testManifest test/data/ASampleDatabase.accdb "Asset Items"; then
+	rc=1
+fi
+if ! testIndexWalk test/data/ASampleDatabase.accdb; then
+	rc=1
+fi
+if ! testRepack test/data/nwind.mdb; then
+	rc=1
+fi
+if ! testRepack test/data/ASampleDatabase.accdb; then
+	rc=1
+fi
+if ! testSource test/data/nwind.mdb; then
+	rc=1
+fi
+if ! testSource test/data/ASampleDatabase.accdb; then
+	rc=1
+fi
 
 if [ $rc = 0 ]; then
 	printf -- '\n%s passed.\n' "$0"
@@ -3,3 +3,61 @@
 # Simple test script; run after performing
 # git clone https://github.com/mdbtools/mdbtestdata.git test
 ./src/util/mdb-sql -i test/sql/nwind.sql test/data/nwind.mdb
+STATUS=$?
+
+# Pairs of queries that should give the same rows
+ROWS=$(mktemp)
+sameRows() {
+	printf '%s\ngo\n' "$1" | ./src/util/mdb-sql -P -F test/data/nwind.mdb | sort > "$ROWS"
+	printf '%s\ngo\n' "$2" | ./src/util/mdb-sql -P -F test/data/nwind.mdb | sort | diff "$ROWS" - || STATUS=1
+}
+# The sarg stack is popped last in, first out: "a or (b and c)" is not
+# "c or (a and b)"
+sameRows "select Artikelname from Artikel where Lagerbestand = 0 or (Lagerbestand > 10 and Lagerbestand < 20)" \
+	"select Artikelname from Artikel where (Lagerbestand > 10 and Lagerbestand < 20) or Lagerbestand = 0"
+# IN and BETWEEN should give the rows of the ORs and ranges they stand for
+sameRows "select Artikelname from Artikel where Lagerbestand in (0, 17, 29)" \
+	"select Artikelname from Artikel where Lagerbestand = 0 or Lagerbestand = 17 or Lagerbestand = 29"
+sameRows "select Artikelname from Artikel where Lagerbestand in (0, 3, 4, 6, 10, 15, 17, 20, 29, 120)" \
+	"select Artikelname from Artikel where Lagerbestand = 0 or Lagerbestand = 3 or Lagerbestand = 4 or Lagerbestand = 6 or Lagerbestand = 10 or Lagerbestand = 15 or Lagerbestand = 17 or Lagerbestand = 20 or Lagerbestand = 29 or Lagerbestand = 120"
+sameRows "select Artikelname from Artikel where Artikelname in ('Chai', 'Chang', 'Tofu')" \
+	"select Artikelname from Artikel where Artikelname = 'Chai' or Artikelname = 'Chang' or Artikelname = 'Tofu'"
+sameRows "select Artikelname from Artikel where Lagerbestand between 10 and 40" \
+	"select Artikelname from Artikel where Lagerbestand >= 10 and Lagerbestand <= 40"
+sameRows "select Artikelname from Artikel where Lagerbestand not between 10 and 40" \
+	"select Artikelname from Artikel where not (Lagerbestand >= 10 and Lagerbestand <= 40)"
+# A line longer than mdb-sql's 4096-byte read buffer is still read as one
+# line; this one would be cut in the middle of a column name
+LONG="select Artikelname from Artikel where Lagerbestand = 0"
+for i in $(seq 300); do
+	LONG="$LONG or Lagerbestand = 32000"
+done
+sameRows "$LONG" "select Artikelname from Artikel where Lagerbestand = 0"
+# LIKE matches the runs between '%'s at their leftmost places instead of
+# backtracking; each of these took seconds with a backtracking matcher
+A=$(printf 'a%.0s' $(seq 200000))
+RUN=$(printf 'a%.0s' $(seq 20000))
+EVERY=$(printf '%%a%.0s' $(seq 20000))
+SECONDS=0
+sameRows "select Artikelname from Artikel where '$A' like '%${RUN}b%'" \
+	"select Artikelname from Artikel where 1 = 0"
+sameRows "select Artikelname from Artikel where '${A}b' like '${EVERY}b'" \
+	"select Artikelname from Artikel"
+[ $SECONDS -lt 3 ] || STATUS=1
+# Each query frees the sarg tree of the one before; the same query run twice
+# in one session should give its rows twice
+TWICE="select Artikelname from Artikel where Lagerbestand = 0 or (Lagerbestand > 10 and Lagerbestand < 20)"
+printf '%s\ngo\n' "$TWICE" | ./src/util/mdb-sql -P -F test/data/nwind.mdb > "$ROWS"
+printf '%s\ngo\n%s\ngo\n' "$TWICE" "$TWICE" | ./src/util/mdb-sql -P -F test/data/nwind.mdb | diff - <(cat "$ROWS" "$ROWS") || STATUS=1
+rm -f "$ROWS"
+
+# The same queries through mdb-sql --listen should give the same output
+SOCKET=$(mktemp -u)
+./src/util/mdb-sql -l "$SOCKET" test/data/nwind.mdb &
+SERVER=$!
+while [ ! -S "$SOCKET" ] && kill -0 $SERVER 2>/dev/null; do sleep 0.1; done
+./src/util/mdb-sql -i test/sql/nwind.sql test/data/nwind.mdb > "$SOCKET.local"
+./src/util/mdb-sql -i test/sql/nwind.sql -c "$SOCKET" | diff "$SOCKET.local" - || STATUS=1
+kill $SERVER
+rm -f "$SOCKET.local"
+exit $STATUS